@@ -15,7 +15,7 @@
 
 SERIAL_DIR := $(QUANTUM_DIR)/serial_link
 SERIAL_PATH := $(QUANTUM_PATH)/serial_link
-SERIAL_SRC := $(wildcard $(SERIAL_PATH)/protocol/*.c)
+SERIAL_SRC := $(filter-out %/reliable_link.c,$(wildcard $(SERIAL_PATH)/protocol/*.c))
 SERIAL_SRC += $(wildcard $(SERIAL_PATH)/system/*.c)
 SERIAL_DEFS += -DSERIAL_LINK_ENABLE
 COMMON_VPATH += $(SERIAL_PATH)
@@ -34,15 +34,21 @@ ifeq ($(strip $(AUDIO_ENABLE)), yes)
     OPT_DEFS += -DAUDIO_ENABLE
     MUSIC_ENABLE := 1
     SRC += $(QUANTUM_DIR)/process_keycode/process_audio.c
-    SRC += $(QUANTUM_DIR)/audio/audio.c
-    SRC += $(QUANTUM_DIR)/audio/voices.c
+    SRC += $(QUANTUM_DIR)/audio/song.c
     SRC += $(QUANTUM_DIR)/audio/luts.c
+    SRC += $(QUANTUM_DIR)/audio/voices.c
+    ifeq ($(PLATFORM),CHIBIOS)
+        SRC += $(QUANTUM_DIR)/audio/audio_arm.c
+    else
+        SRC += $(QUANTUM_DIR)/audio/audio.c
+    endif
 endif
 
 ifeq ($(strip $(MIDI_ENABLE)), yes)
     OPT_DEFS += -DMIDI_ENABLE
     MUSIC_ENABLE := 1
     SRC += $(QUANTUM_DIR)/process_keycode/process_midi.c
+    SRC += $(QUANTUM_DIR)/midi_engine.c
 endif
 
 ifeq ($(MUSIC_ENABLE), 1)
@@ -108,6 +114,33 @@ ifeq ($(strip $(SERIAL_LINK_ENABLE)), yes)
     SRC += $(patsubst $(QUANTUM_PATH)/%,%,$(SERIAL_SRC))
     OPT_DEFS += $(SERIAL_DEFS)
     VAPTH += $(SERIAL_PATH)
+    ifeq ($(strip $(SERIAL_LINK_RELIABLE)), yes)
+        SRC += $(SERIAL_DIR)/protocol/reliable_link.c
+        OPT_DEFS += -DSERIAL_LINK_RELIABLE
+    endif
+endif
+
+ifneq ($(strip $(SPLIT_TRANSPORT)),)
+    OPT_DEFS += -DSPLIT_TRANSPORT_ENABLE
+    SRC += $(QUANTUM_DIR)/split/split_transport.c
+    ifeq ($(strip $(SPLIT_TRANSPORT)), usart)
+        SRC += $(QUANTUM_DIR)/split/split_serial_usart.c
+    else ifeq ($(strip $(SPLIT_TRANSPORT)), soft)
+        OPT_DEFS += -DSPLIT_TRANSPORT_SOFT
+        SRC += $(QUANTUM_DIR)/split/split_serial_soft.c
+    else
+        $(error SPLIT_TRANSPORT="$(SPLIT_TRANSPORT)" is not a valid split transport, use soft or usart)
+    endif
+endif
+
+ifeq ($(strip $(EXPANDER_MATRIX_ENABLE)), yes)
+    OPT_DEFS += -DEXPANDER_MATRIX_ENABLE
+    SRC += $(QUANTUM_DIR)/expander_matrix.c
+endif
+
+ifeq ($(strip $(IS31FL3731_ENABLE)), yes)
+    OPT_DEFS += -DIS31FL3731_ENABLE
+    SRC += $(QUANTUM_DIR)/is31fl3731.c
 endif
 
 ifneq ($(strip $(VARIABLE_TRACE)),)
@@ -133,6 +166,14 @@ ifeq ($(strip $(CIE1931_CURVE)), yes)
     LED_TABLES = yes
 endif
 
+# The backlight PWM is gamma corrected, only the AVR backlight uses the table
+ifeq ($(strip $(BACKLIGHT_ENABLE)), yes)
+    ifneq ($(PLATFORM),CHIBIOS)
+        OPT_DEFS += -DUSE_CIE1931_CURVE_16
+        LED_TABLES = yes
+    endif
+endif
+
 ifeq ($(strip $(LED_BREATHING_TABLE)), yes)
     OPT_DEFS += -DUSE_LED_BREATHING_TABLE
     LED_TABLES = yes
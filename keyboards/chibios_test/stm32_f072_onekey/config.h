@@ -3,5 +3,9 @@
 
 #include "../config.h"
 
+/* Emulate the EEPROM in the last two 2KB pages of the 128KB flash */
+#define EEPROM_FLASH_START 0x0801F000
+#define EEPROM_FLASH_SIZE 0x1000
+#define EEPROM_FLASH_PAGE_SIZE 0x800
 
 #endif /* KEYBOARDS_CHIBIOS_TEST_STM32_F072_ONEKEY_CONFIG_H_ */
@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <avr/io.h>
 #include "wait.h"
 #include "action_layer.h"
@@ -35,6 +36,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "ez.h"
 #include "i2cmaster.h"
+#include "expander_matrix.h"
 #ifdef DEBUG_MATRIX_SCAN_RATE
 #include  "timer.h"
 #endif
@@ -62,13 +64,24 @@ static matrix_row_t matrix[MATRIX_ROWS];
 // already changed in the last DEBOUNCE scans.
 static uint8_t debounce_matrix[MATRIX_ROWS * MATRIX_COLS];
 
-static matrix_row_t read_cols(uint8_t row);
+static matrix_row_t read_cols(void);
 static void init_cols(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
 
 static uint8_t mcp23018_reset_loop;
 
+// Rows 0 to 6 are on the MCP23018, and scanned by the TWI interrupt
+#define MCP23018_ROWS 7
+
+static const expander_matrix_config_t mcp23018_matrix = {
+    .address = I2C_ADDR,
+    .rows = MCP23018_ROWS,
+    .row_register = GPIOA,
+    .col_register = GPIOB,
+    .col_mask = 0b00111111,
+};
+
 #ifdef DEBUG_MATRIX_SCAN_RATE
 uint32_t matrix_timer;
 uint32_t matrix_scan_count;
@@ -108,6 +121,7 @@ void matrix_init(void)
     // initialize row and col
 
     mcp23018_status = init_mcp23018();
+    expander_matrix_init(&mcp23018_matrix);
 
 
     unselect_rows();
@@ -131,7 +145,11 @@ void matrix_init(void)
 }
 
 void matrix_power_up(void) {
+    // init_mcp23018() talks to the expander directly, so a scan that was
+    // running when the keyboard suspended has to be stopped first
+    expander_matrix_abort();
     mcp23018_status = init_mcp23018();
+    expander_matrix_init(&mcp23018_matrix);
 
     unselect_rows();
     init_cols();
@@ -171,6 +189,13 @@ void debounce_report(matrix_row_t change, uint8_t row) {
   }
 }
 
+static void matrix_update_row(uint8_t row, matrix_row_t cols) {
+    matrix_row_t mask = debounce_mask(row);
+    cols = (cols & mask) | (matrix[row] & ~mask);
+    debounce_report(cols ^ matrix[row], row);
+    matrix[row] = cols;
+}
+
 uint8_t matrix_scan(void)
 {
     if (mcp23018_status) { // if there was an error
@@ -202,17 +227,44 @@ uint8_t matrix_scan(void)
     }
 #endif
 
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+    // The left half is read over I2C while the right half is scanned, and
+    // a scan that isn't done yet is picked up by the next matrix scan
+    uint8_t left_cols[MCP23018_ROWS];
+    bool left_scanned = false;
+    if (mcp23018_status) { // if there was an error
+        memset(left_cols, 0, sizeof(left_cols));
+        left_scanned = true;
+    } else {
+        switch (expander_matrix_update(left_cols)) {
+            case EXPANDER_MATRIX_DONE:
+                left_scanned = true;
+                break;
+            case EXPANDER_MATRIX_ERROR:
+                mcp23018_status = 1;
+                memset(left_cols, 0, sizeof(left_cols));
+                left_scanned = true;
+                break;
+            default:
+                break;
+        }
+        if (!mcp23018_status) {
+            expander_matrix_start();
+        }
+    }
+
+    for (uint8_t i = MCP23018_ROWS; i < MATRIX_ROWS; i++) {
         select_row(i);
         wait_us(30);  // without this wait read unstable value.
-        matrix_row_t mask = debounce_mask(i);
-        matrix_row_t cols = (read_cols(i) & mask) | (matrix[i] & ~mask);
-        debounce_report(cols ^ matrix[i], i);
-        matrix[i] = cols;
-
+        matrix_update_row(i, read_cols());
         unselect_rows();
     }
 
+    if (left_scanned) {
+        for (uint8_t i = 0; i < MCP23018_ROWS; i++) {
+            matrix_update_row(i, left_cols[i]);
+        }
+    }
+
     matrix_scan_quantum();
 
     return 1;
@@ -275,32 +327,17 @@ static void  init_cols(void)
     PORTF |=  (1<<7 | 1<<6 | 1<<5 | 1<<4 | 1<<1 | 1<<0);
 }
 
-static matrix_row_t read_cols(uint8_t row)
+static matrix_row_t read_cols(void)
 {
-    if (row < 7) {
-        if (mcp23018_status) { // if there was an error
-            return 0;
-        } else {
-            uint8_t data = 0;
-            mcp23018_status = i2c_start(I2C_ADDR_WRITE);    if (mcp23018_status) goto out;
-            mcp23018_status = i2c_write(GPIOB);             if (mcp23018_status) goto out;
-            mcp23018_status = i2c_start(I2C_ADDR_READ);     if (mcp23018_status) goto out;
-            data = i2c_readNak();
-            data = ~data;
-        out:
-            i2c_stop();
-            return data;
-        }
-    } else {
-        // read from teensy
-        return
-            (PINF&(1<<0) ? 0 : (1<<0)) |
-            (PINF&(1<<1) ? 0 : (1<<1)) |
-            (PINF&(1<<4) ? 0 : (1<<2)) |
-            (PINF&(1<<5) ? 0 : (1<<3)) |
-            (PINF&(1<<6) ? 0 : (1<<4)) |
-            (PINF&(1<<7) ? 0 : (1<<5)) ;
-    }
+    // the mcp23018 rows are read by expander_matrix
+    // read from teensy
+    return
+        (PINF&(1<<0) ? 0 : (1<<0)) |
+        (PINF&(1<<1) ? 0 : (1<<1)) |
+        (PINF&(1<<4) ? 0 : (1<<2)) |
+        (PINF&(1<<5) ? 0 : (1<<3)) |
+        (PINF&(1<<6) ? 0 : (1<<4)) |
+        (PINF&(1<<7) ? 0 : (1<<5)) ;
 }
 
 /* Row pin configuration
@@ -315,19 +352,8 @@ static matrix_row_t read_cols(uint8_t row)
  */
 static void unselect_rows(void)
 {
-    // unselect on mcp23018
-    if (mcp23018_status) { // if there was an error
-        // do nothing
-    } else {
-        // set all rows hi-Z : 1
-        mcp23018_status = i2c_start(I2C_ADDR_WRITE);    if (mcp23018_status) goto out;
-        mcp23018_status = i2c_write(GPIOA);             if (mcp23018_status) goto out;
-        mcp23018_status = i2c_write( 0xFF
-                              & ~(0<<7)
-                          );                            if (mcp23018_status) goto out;
-    out:
-        i2c_stop();
-    }
+    // the mcp23018 rows are unselected by expander_matrix at the end of
+    // each scan
 
     // unselect on teensy
     // Hi-Z(DDR:0, PORT:0) to unselect
@@ -341,21 +367,8 @@ static void unselect_rows(void)
 
 static void select_row(uint8_t row)
 {
-    if (row < 7) {
-        // select on mcp23018
-        if (mcp23018_status) { // if there was an error
-            // do nothing
-        } else {
-            // set active row low  : 0
-            // set other rows hi-Z : 1
-            mcp23018_status = i2c_start(I2C_ADDR_WRITE);        if (mcp23018_status) goto out;
-            mcp23018_status = i2c_write(GPIOA);                 if (mcp23018_status) goto out;
-            mcp23018_status = i2c_write( 0xFF & ~(1<<row)
-                                  & ~(0<<7)
-                              );                                if (mcp23018_status) goto out;
-        out:
-            i2c_stop();
-        }
+    if (row < MCP23018_ROWS) {
+        // selected by expander_matrix
     } else {
         // select on teensy
         // Output low(DDR:1, PORT:0) to select
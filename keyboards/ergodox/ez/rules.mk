@@ -74,3 +74,5 @@ OPT_DEFS += -DBOOTLOADER_SIZE=512
 SLEEP_LED_ENABLE = no
 API_SYSEX_ENABLE ?= no
 RGBLIGHT_ENABLE ?= yes
+# The matrix reads the left half with quantum/expander_matrix.c
+EXPANDER_MATRIX_ENABLE = yes
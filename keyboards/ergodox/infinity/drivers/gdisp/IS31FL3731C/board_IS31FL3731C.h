@@ -18,6 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef _GDISP_LLD_BOARD_H
 #define _GDISP_LLD_BOARD_H
 
+#include "is31fl3731.h"
+
 static const I2CConfig i2ccfg = {
   400000 // clock speed (Hz); 400kHz max for IS31
 };
@@ -63,7 +65,12 @@ static const uint8_t led_mapping[GDISP_SCREEN_HEIGHT][GDISP_SCREEN_WIDTH] = {
 
 
 #define IS31_ADDR_DEFAULT 0x74 // AD connected to GND
-#define IS31_TIMEOUT 5000
+
+static const is31fl3731_config_t is31fl3731_config = {
+    .i2c = &I2CD1,
+    .address = IS31_ADDR_DEFAULT,
+    .led_mask = led_mask,
+};
 
 static GFXINLINE void init_board(GDisplay *g) {
     (void) g;
@@ -84,9 +91,9 @@ static GFXINLINE void post_init_board(GDisplay *g) {
 	(void) g;
 }
 
-static GFXINLINE const uint8_t* get_led_mask(GDisplay* g) {
+static GFXINLINE const is31fl3731_config_t* get_is31fl3731_config(GDisplay* g) {
     (void) g;
-    return led_mask;
+    return &is31fl3731_config;
 }
 
 static GFXINLINE uint8_t get_led_address(GDisplay* g, uint16_t x, uint16_t y)
@@ -105,9 +112,4 @@ static GFXINLINE void set_hardware_shutdown(GDisplay* g, bool shutdown) {
     }
 }
 
-static GFXINLINE void write_data(GDisplay *g, uint8_t* data, uint16_t length) {
-	(void) g;
-	i2cMasterTransmitTimeout(&I2CD1, IS31_ADDR_DEFAULT, data, length, 0, 0, US2ST(IS31_TIMEOUT));
-}
-
 #endif /* _GDISP_LLD_BOARD_H */
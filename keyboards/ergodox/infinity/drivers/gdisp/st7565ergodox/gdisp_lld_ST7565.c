@@ -56,11 +56,22 @@
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#define GDISP_PAGES (GDISP_SCREEN_HEIGHT / 8)
+
+// The columns of a page that changed, from start up to but not including end
+typedef struct{
+    uint8_t start;
+    uint8_t end;
+}DirtyRange;
+
 typedef struct{
     bool_t buffer2;
     uint8_t data_pos;
     uint8_t data[16];
     uint8_t ram[GDISP_SCREEN_HEIGHT * GDISP_SCREEN_WIDTH / 8];
+    // Changed since the last flush, and changed by the last flush
+    DirtyRange dirty[GDISP_PAGES];
+    DirtyRange prev_dirty[GDISP_PAGES];
 }PrivData;
 
 // Some common routines and macros
@@ -86,6 +97,29 @@ static GFXINLINE void flush_cmd(GDisplay* g) {
 #define xyaddr(x, y)		((x) + ((y)>>3)*GDISP_SCREEN_WIDTH)
 #define xybit(y)			(1<<((y)&7))
 
+static GFXINLINE void mark_dirty(GDisplay* g, coord_t x, coord_t y) {
+    DirtyRange* range = &PRIV(g)->dirty[y >> 3];
+    if (range->start >= range->end) {
+        range->start = x;
+        range->end = x + 1;
+    }
+    else if (x < range->start) {
+        range->start = x;
+    }
+    else if (x >= range->end) {
+        range->end = x + 1;
+    }
+}
+
+static GFXINLINE void set_ram_bit(GDisplay* g, coord_t x, coord_t y, bool_t set) {
+    uint8_t* dst = &(RAM(g)[xyaddr(x, y)]);
+    uint8_t value = set ? *dst | xybit(y) : *dst & ~xybit(y);
+    if (value != *dst) {
+        *dst = value;
+        mark_dirty(g, x, y);
+    }
+}
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -102,6 +136,12 @@ LLDSPEC bool_t gdisp_lld_init(GDisplay *g) {
     g->priv = gfxAlloc(sizeof(PrivData));
     PRIV(g)->buffer2 = false;
     PRIV(g)->data_pos = 0;
+    // The contents of both buffers on the display are unknown
+    for (unsigned p = 0; p < GDISP_PAGES; p++) {
+        PRIV(g)->dirty[p].start = 0;
+        PRIV(g)->dirty[p].end = GDISP_SCREEN_WIDTH;
+        PRIV(g)->prev_dirty[p] = PRIV(g)->dirty[p];
+    }
 
     // Initialise the board interface
     init_board(g);
@@ -156,17 +196,50 @@ LLDSPEC void gdisp_lld_flush(GDisplay *g) {
     if (!(g->flags & GDISP_FLG_NEEDFLUSH))
         return;
 
+    g->flags &= ~GDISP_FLG_NEEDFLUSH;
+
+    bool_t changed = FALSE;
+    for (p = 0; p < GDISP_PAGES; p++) {
+        if (PRIV(g)->dirty[p].start < PRIV(g)->dirty[p].end) {
+            changed = TRUE;
+        }
+    }
+    // Everything was drawn with the same pixels that were already there
+    if (!changed)
+        return;
+
     acquire_bus(g);
     enter_cmd_mode(g);
     unsigned dstOffset = (PRIV(g)->buffer2 ? 4 : 0);
-    for (p = 0; p < 4; p++) {
+    for (p = 0; p < GDISP_PAGES; p++) {
+        // The buffer that is written was last written two flushes ago, so
+        // it needs the changes of the last flush as well
+        DirtyRange* dirty = &PRIV(g)->dirty[p];
+        DirtyRange* prev = &PRIV(g)->prev_dirty[p];
+        unsigned start = dirty->start;
+        unsigned end = dirty->end;
+        if (prev->start < prev->end) {
+            if (start >= end) {
+                start = prev->start;
+                end = prev->end;
+            }
+            else {
+                start = prev->start < start ? prev->start : start;
+                end = prev->end > end ? prev->end : end;
+            }
+        }
+        *prev = *dirty;
+        dirty->start = 0;
+        dirty->end = 0;
+        if (start >= end)
+            continue;
         write_cmd(g, ST7565_PAGE | (p + dstOffset));
-        write_cmd(g, ST7565_COLUMN_MSB | 0);
-        write_cmd(g, ST7565_COLUMN_LSB | 0);
+        write_cmd(g, ST7565_COLUMN_MSB | (start >> 4));
+        write_cmd(g, ST7565_COLUMN_LSB | (start & 0xF));
         write_cmd(g, ST7565_RMW);
         flush_cmd(g);
         enter_data_mode(g);
-        write_data(g, RAM(g) + (p*GDISP_SCREEN_WIDTH), GDISP_SCREEN_WIDTH);
+        write_data(g, RAM(g) + (p*GDISP_SCREEN_WIDTH) + start, end - start);
         enter_cmd_mode(g);
     }
     unsigned line = (PRIV(g)->buffer2 ? 32 : 0);
@@ -174,8 +247,6 @@ LLDSPEC void gdisp_lld_flush(GDisplay *g) {
     flush_cmd(g);
     PRIV(g)->buffer2 = !PRIV(g)->buffer2;
     release_bus(g);
-
-    g->flags &= ~GDISP_FLG_NEEDFLUSH;
 }
 #endif
 
@@ -202,10 +273,7 @@ LLDSPEC void gdisp_lld_draw_pixel(GDisplay *g) {
         y = g->p.x;
         break;
     }
-    if (gdispColor2Native(g->p.color) != Black)
-        RAM(g)[xyaddr(x, y)] |= xybit(y);
-    else
-        RAM(g)[xyaddr(x, y)] &= ~xybit(y);
+    set_ram_bit(g, x, y, gdispColor2Native(g->p.color) != Black);
     g->flags |= GDISP_FLG_NEEDFLUSH;
 }
 #endif
@@ -250,13 +318,7 @@ LLDSPEC void gdisp_lld_blit_area(GDisplay *g) {
             uint8_t src = buffer[srcbit / 8];
             uint8_t bit = 7-(srcbit % 8);
             uint8_t bitset = (src >> bit) & 1;
-            uint8_t* dst = &(RAM(g)[xyaddr(dstx, dsty)]);
-            if (bitset) {
-                *dst |= xybit(dsty);
-            }
-            else {
-                *dst &= ~xybit(dsty);
-            }
+            set_ram_bit(g, dstx, dsty, bitset);
 			dstx++;
             srcbit++;
         }
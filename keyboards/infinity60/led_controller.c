@@ -19,6 +19,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * LED controller code
  * IS31FL3731C matrix LED driver from ISSI
  * datasheet: http://www.issi.com/WW/pdf/31FL3731C.pdf
+ *
+ * This doesn't use quantum/is31fl3731.c. That driver switches between
+ * frames 0 and 1 for its double buffering, and only writes PWM values, with
+ * the same LED mask on every frame. The keymaps here keep their own LED
+ * pages in the frames, and switch the LEDs and their blinking on and off
+ * with the control registers.
  */
 
 #include "ch.h"
@@ -12,7 +12,7 @@
 #ifdef USE_I2C
 #  include "i2c.h"
 #else
-#  include "serial.h"
+#  include "split/split_transport.h"
 #endif
 
 volatile bool isLeftHand = true;
@@ -37,7 +37,7 @@ static void keyboard_master_setup(void) {
     matrix_master_OLED_init ();
 #endif
 #else
-    serial_master_init();
+    split_transport_init(true);
 #endif
 }
 
@@ -45,7 +45,7 @@ static void keyboard_slave_setup(void) {
 #ifdef USE_I2C
     i2c_slave_init(SLAVE_I2C_ADDRESS);
 #else
-    serial_slave_init();
+    split_transport_init(false);
 #endif
 }
 
@@ -35,7 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef USE_I2C
 #  include "i2c.h"
 #else // USE_SERIAL
-#  include "serial.h"
+#  include "split/split_transport.h"
 #endif
 
 #ifndef DEBOUNCE
@@ -54,6 +54,10 @@ static const uint8_t col_pins[MATRIX_COLS] = MATRIX_COL_PINS;
 /* matrix state(1:on, 0:off) */
 static matrix_row_t matrix[MATRIX_ROWS];
 static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+#ifndef USE_I2C
+// The debounced local half, merged into the matrix with the slave events
+static matrix_row_t matrix_local[MATRIX_ROWS/2];
+#endif
 
 static matrix_row_t read_cols(void);
 static void init_cols(void);
@@ -141,7 +145,11 @@ uint8_t _matrix_scan(void)
             _delay_ms(1);
         } else {
             for (uint8_t i = 0; i < ROWS_PER_HAND; i++) {
+#ifndef USE_I2C
+                matrix_local[i] = matrix_debouncing[i+offset];
+#else
                 matrix[i+offset] = matrix_debouncing[i+offset];
+#endif
             }
         }
     }
@@ -185,16 +193,7 @@ i2c_error: // the cable is disconnceted, or something else went wrong
 #else // USE_SERIAL
 
 int serial_transaction(void) {
-    int slaveOffset = (isLeftHand) ? (ROWS_PER_HAND) : 0;
-
-    if (serial_update_buffers()) {
-        return 1;
-    }
-
-    for (int i = 0; i < ROWS_PER_HAND; ++i) {
-        matrix[slaveOffset+i] = serial_slave_buffer[i];
-    }
-    return 0;
+    return split_transport_master_scan(matrix, matrix_local, isLeftHand) ? 0 : 1;
 }
 #endif
 
@@ -202,8 +201,6 @@ uint8_t matrix_scan(void)
 {
     int ret = _matrix_scan();
 
-
-
 #ifdef USE_I2C
     if( i2c_transaction() ) {
 #else // USE_SERIAL
@@ -233,17 +230,14 @@ uint8_t matrix_scan(void)
 void matrix_slave_scan(void) {
     _matrix_scan();
 
-    int offset = (isLeftHand) ? 0 : (MATRIX_ROWS / 2);
-
 #ifdef USE_I2C
+    int offset = (isLeftHand) ? 0 : (MATRIX_ROWS / 2);
     for (int i = 0; i < ROWS_PER_HAND; ++i) {
         /* i2c_slave_buffer[i] = matrix[offset+i]; */
         i2c_slave_buffer[i] = matrix[offset+i];
     }
 #else // USE_SERIAL
-    for (int i = 0; i < ROWS_PER_HAND; ++i) {
-        serial_slave_buffer[i] = matrix[offset+i];
-    }
+    split_transport_slave_task(matrix_local);
 #endif
 }
 
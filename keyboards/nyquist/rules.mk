@@ -1,7 +1,6 @@
 SRC += matrix.c \
 	   i2c.c \
-	   split_util.c \
-	   serial.c
+	   split_util.c
 
 # MCU name
 #MCU = at90usb1287
@@ -69,6 +68,8 @@ BLUETOOTH_ENABLE ?= no       # Enable Bluetooth with the Adafruit EZ-Key HID
 RGBLIGHT_ENABLE ?= no       # Enable WS2812 RGB underlight.  Do not enable this with audio at the same time.
 SUBPROJECT_rev1 ?= yes
 USE_I2C ?= yes
+# Serial backend used when USE_SERIAL is defined (soft: PD0, usart: D2/D3)
+SPLIT_TRANSPORT ?= soft
 # Do not enable SLEEP_LED_ENABLE. it uses the same timer as BACKLIGHT_ENABLE
 SLEEP_LED_ENABLE ?= no    # Breathing sleep LED during USB suspend
 
@@ -39,7 +39,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef USE_I2C
 #  include "i2c.h"
 #else // USE_SERIAL
-#  include "serial.h"
+#  include "split/split_transport.h"
 #endif
 
 #ifndef DEBOUNCE
@@ -58,6 +58,10 @@ static const uint8_t col_pins[MATRIX_COLS] = MATRIX_COL_PINS;
 /* matrix state(1:on, 0:off) */
 static matrix_row_t matrix[MATRIX_ROWS];
 static matrix_row_t matrix_debouncing[MATRIX_ROWS];
+#ifndef USE_I2C
+// The debounced local half, merged into the matrix with the slave events
+static matrix_row_t matrix_local[MATRIX_ROWS/2];
+#endif
 
 static matrix_row_t read_cols(void);
 static void init_cols(void);
@@ -145,7 +149,11 @@ uint8_t _matrix_scan(void)
             _delay_ms(1);
         } else {
             for (uint8_t i = 0; i < ROWS_PER_HAND; i++) {
+#ifndef USE_I2C
+                matrix_local[i] = matrix_debouncing[i+offset];
+#else
                 matrix[i+offset] = matrix_debouncing[i+offset];
+#endif
             }
         }
     }
@@ -206,16 +214,7 @@ i2c_error: // the cable is disconnected, or something else went wrong
 #else // USE_SERIAL
 
 int serial_transaction(void) {
-    int slaveOffset = (isLeftHand) ? (ROWS_PER_HAND) : 0;
-
-    if (serial_update_buffers()) {
-        return 1;
-    }
-
-    for (int i = 0; i < ROWS_PER_HAND; ++i) {
-        matrix[slaveOffset+i] = serial_slave_buffer[i];
-    }
-    return 0;
+    return split_transport_master_scan(matrix, matrix_local, isLeftHand) ? 0 : 1;
 }
 #endif
 
@@ -223,8 +222,6 @@ uint8_t matrix_scan(void)
 {
     int ret = _matrix_scan();
 
-
-
 #ifdef USE_I2C
     if( i2c_transaction() ) {
 #else // USE_SERIAL
@@ -254,9 +251,8 @@ uint8_t matrix_scan(void)
 void matrix_slave_scan(void) {
     _matrix_scan();
 
-    int offset = (isLeftHand) ? 0 : ROWS_PER_HAND;
-
 #ifdef USE_I2C
+    int offset = (isLeftHand) ? 0 : ROWS_PER_HAND;
     // SLAVE_BUFFER_SIZE is from i2c.h
     // (MATRIX_ROWS/2*sizeof(matrix_row_t))
     // memcpy((void*)i2c_slave_buffer, (const void*)&matrix[offset], (ROWS_PER_HAND*sizeof(matrix_row_t)));
@@ -276,9 +272,7 @@ void matrix_slave_scan(void) {
     i2c_slave_buffer[5] = (uint8_t)matrix[offset+2];
     */
 #else // USE_SERIAL
-    for (int i = 0; i < ROWS_PER_HAND; ++i) {
-        serial_slave_buffer[i] = matrix[offset+i];
-    }
+    split_transport_slave_task(matrix_local);
 #endif
 }
 
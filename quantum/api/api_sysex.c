@@ -17,6 +17,29 @@
 #include "sysex_tools.h"
 #include "print.h"
 
+// The message is sent as it's encoded, so that it doesn't have to be copied
+// to a buffer first. The bytes are collected into packets of three, the same
+// packets that midi_send_array would send.
+typedef struct {
+    uint8_t data[3];
+    uint8_t count;
+} sysex_packet_t;
+
+static void sysex_packet_send(sysex_packet_t* packet) {
+    for (uint8_t i = packet->count; i < 3; i++) {
+        packet->data[i] = 0;
+    }
+    midi_send_data(&midi_device, packet->count, packet->data[0], packet->data[1], packet->data[2]);
+    packet->count = 0;
+}
+
+static void sysex_packet_add(sysex_packet_t* packet, uint8_t byte) {
+    packet->data[packet->count++] = byte;
+    if (packet->count == 3) {
+        sysex_packet_send(packet);
+    }
+}
+
 void send_bytes_sysex(uint8_t message_type, uint8_t data_type, uint8_t * bytes, uint16_t length) {
     // SEND_STRING("\nTX: ");
     // for (uint8_t i = 0; i < length; i++) {
@@ -28,45 +51,39 @@ void send_bytes_sysex(uint8_t message_type, uint8_t data_type, uint8_t * bytes,
         return;
     }
 
-
-    // The buffer size required is calculated as the following
-    // API_SYSEX_MAX_SIZE is the maximum length
-    // In addition to that we have a two byte message header consisting of the message_type and data_type
-    // This has to be encoded with an additional overhead of one byte for every starting 7 bytes
-    // We just add one extra byte in case it's not divisible by 7
-    // Then we have an unencoded header consisting of 4 bytes
-    // Plus a one byte terminator
-    const unsigned message_header = 2;
-    const unsigned unencoded_message = API_SYSEX_MAX_SIZE + message_header;
-    const unsigned encoding_overhead = unencoded_message / 7 + 1;
-    const unsigned encoded_size = unencoded_message + encoding_overhead;
-    const unsigned unencoded_header = 4;
-    const unsigned terminator = 1;
-    const unsigned buffer_size = encoded_size + unencoded_header + terminator;
-    uint8_t buffer[encoded_size + unencoded_header + terminator];
+    sysex_packet_t packet = {{0, 0, 0}, 0};
     // The unencoded header
-    buffer[0] = 0xF0;
-    buffer[1] = 0x00;
-    buffer[2] = 0x00;
-    buffer[3] = 0x00;
-
-    // We copy the message to the end of the array, this way we can do an inplace encoding, using the same
-    // buffer for both input and output
-    const unsigned message_size = length + message_header;
-    uint8_t* unencoded_start = buffer + buffer_size - message_size;
-    uint8_t* ptr = unencoded_start;
-    *(ptr++) = message_type;
-    *(ptr++) = data_type;
-    memcpy(ptr, bytes, length);
+    sysex_packet_add(&packet, 0xF0);
+    sysex_packet_add(&packet, 0x00);
+    sysex_packet_add(&packet, 0x00);
+    sysex_packet_add(&packet, 0x00);
 
-    unsigned encoded_length = sysex_encode(buffer + unencoded_header, unencoded_start, message_size);
-    unsigned final_size = unencoded_header + encoded_length + terminator;
-    buffer[final_size - 1] = 0xF7;
-    midi_send_array(&midi_device, final_size, buffer);
+    // The message consists of the two byte header of message_type and data_type, and the bytes. It's
+    // encoded 7 bytes at a time, which is the same as encoding all of it at once
+    const uint16_t message_size = length + 2;
+    uint16_t position = 0;
+    while (position < message_size) {
+        uint8_t group[7];
+        uint8_t group_size = 0;
+        for (; group_size < 7 && position < message_size; group_size++, position++) {
+            if (position == 0) {
+                group[group_size] = message_type;
+            } else if (position == 1) {
+                group[group_size] = data_type;
+            } else {
+                group[group_size] = bytes[position - 2];
+            }
+        }
+        uint8_t encoded[8];
+        uint8_t encoded_size = sysex_encode(encoded, group, group_size);
+        for (uint8_t i = 0; i < encoded_size; i++) {
+            sysex_packet_add(&packet, encoded[i]);
+        }
+    }
 
-    // SEND_STRING("\nTD: ");
-    // for (uint8_t i = 0; i < encoded_length + 5; i++) {
-    //     send_byte(buffer[i]);
-    //     SEND_STRING(" ");
-    // }
+    // The terminator
+    sysex_packet_add(&packet, 0xF7);
+    if (packet.count) {
+        sysex_packet_send(&packet);
+    }
 }
@@ -71,46 +71,92 @@
 
 // -----------------------------------------------------------------------------
 
+// The periods of frequency_lut are for a 2 MHz timer, which a 16 MHz clock
+// gives with the prescaler of 8
+#if F_CPU / CPU_PRESCALER == FREQUENCY_LUT_TIMER_FREQUENCY
+    #define TIMER_PERIOD(period) (period)
+#elif F_CPU / CPU_PRESCALER == FREQUENCY_LUT_TIMER_FREQUENCY / 2
+    #define TIMER_PERIOD(period) ((period) >> 1)
+#else
+    #error "The audio only supports an F_CPU of 16 MHz or 8 MHz"
+#endif
+
+#define TIMER_DUTY(period) ((uint16_t)(((uint32_t)TIMER_PERIOD(period) * note_duty) >> 8))
+
+// -----------------------------------------------------------------------------
+
+// The glissando moves 220 semitones a second, 2^16 * 220 * 4 * 128 / 2 MHz
+// pitch steps for each tick of the period
+#define GLISSANDO_STEP 3691
+
+// The vibrato moves (1 + 440 / frequency) times the rate for each period,
+// 2^24 * 440 / 2 MHz
+#define VIBRATO_FREQUENCY_SCALE 3691
+
+// The period while resting, the output is disconnected
+#define REST_PERIOD 0x800
+
+// The length of the notes is measured in timer ticks
+#define NOTE_LENGTH_TICKS(length) ((uint32_t)((length) * 0xFFFF))
+// The same for the compact songs, duration / 4 * tempo / 100 * 0xFFFF, with
+// 0xFFFF / 400 as 41943 / 256
+#define SONG_LENGTH_TICKS(duration, tempo) (((uint32_t)(duration) * (tempo) * 41943) >> 8)
+// The compact songs count their notes in semitones, which are 4 steps of frequency_lut
+#define SEMITONE_PITCH (4 << 7)
+
 
 int voices = 0;
 int voice_place = 0;
-float frequency = 0;
-float frequency_alt = 0;
+uint16_t glide_pitch = PITCH_NONE;
+uint16_t glide_pitch_alt = PITCH_NONE;
+uint16_t current_period = 0;
+uint16_t current_period_alt = 0;
 int volume = 0;
 long position = 0;
 
+// The frequencies are only kept to find the notes that are stopped
 float frequencies[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+uint16_t pitches[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 int volumes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 bool sliding = false;
 
-float place = 0;
+uint32_t place = 0;
 
 uint8_t * sample;
 uint16_t sample_length = 0;
 
 bool     playing_notes = false;
 bool     playing_note = false;
-float    note_frequency = 0;
-float    note_length = 0;
+uint16_t note_pitch = PITCH_NONE;
+uint32_t note_length_ticks = 0;
 uint8_t  note_tempo = TEMPO_DEFAULT;
-float    note_timbre = TIMBRE_DEFAULT;
-uint16_t note_position = 0;
+uint8_t  note_duty = (uint8_t)(TIMBRE_DEFAULT * 256);
+uint32_t note_ticks = 0;
 float (* notes_pointer)[][2];
 uint16_t notes_count;
 bool     notes_repeat;
-float    notes_rest;
+uint32_t notes_rest_ticks;
 bool     note_resting = false;
 
+// The compact song that is playing, NULL while notes_pointer is played
+const uint8_t* song_pointer = NULL;
+song_reader_t song_reader;
+uint8_t song_note;
+
 uint8_t current_note = 0;
 uint8_t rest_counter = 0;
 
 #ifdef VIBRATO_ENABLE
-float vibrato_counter = 0;
+// 8.8 fixed point index of vibrato_lut
+uint16_t vibrato_counter = 0;
 float vibrato_strength = .5;
 float vibrato_rate = 0.125;
+uint16_t vibrato_strength_fp = 128;
+uint16_t vibrato_rate_fp = 32;
 #endif
 
-float polyphony_rate = 0;
+// The timer ticks that each voice plays for, 0 when polyphony is disabled
+uint32_t polyphony_ticks = 0;
 
 static bool audio_initialized = false;
 
@@ -166,6 +212,12 @@ void audio_init()
     #ifdef B5_AUDIO
         TCCR1A = (0 << COM1A1) | (0 << COM1A0) | (1 << WGM11) | (0 << WGM10);
         TCCR1B = (1 << WGM13)  | (1 << WGM12)  | (0 << CS12)  | (1 << CS11) | (0 << CS10);
+        #ifdef C6_AUDIO
+            // The alternate voice is only set by the timer 3 interrupt, with a
+            // period of 0 the timer 1 interrupt would run on every tick and
+            // starve it, since it has a higher priority
+            TIMER_1_PERIOD = TIMER_PERIOD(REST_PERIOD);
+        #endif
     #endif
 
     audio_initialized = true;
@@ -193,13 +245,14 @@ void stop_all_notes()
 
     playing_notes = false;
     playing_note = false;
-    frequency = 0;
-    frequency_alt = 0;
+    glide_pitch = PITCH_NONE;
+    glide_pitch_alt = PITCH_NONE;
     volume = 0;
 
     for (uint8_t i = 0; i < 8; i++)
     {
         frequencies[i] = 0;
+        pitches[i] = 0;
         volumes[i] = 0;
     }
 }
@@ -215,10 +268,13 @@ void stop_note(float freq)
         for (int i = 7; i >= 0; i--) {
             if (frequencies[i] == freq) {
                 frequencies[i] = 0;
+                pitches[i] = 0;
                 volumes[i] = 0;
                 for (int j = i; (j < 7); j++) {
                     frequencies[j] = frequencies[j+1];
                     frequencies[j+1] = 0;
+                    pitches[j] = pitches[j+1];
+                    pitches[j+1] = 0;
                     volumes[j] = volumes[j+1];
                     volumes[j+1] = 0;
                 }
@@ -240,198 +296,215 @@ void stop_note(float freq)
                 DISABLE_AUDIO_COUNTER_1_ISR;
                 DISABLE_AUDIO_COUNTER_1_OUTPUT;
             #endif
-            frequency = 0;
-            frequency_alt = 0;
+            glide_pitch = PITCH_NONE;
+            glide_pitch_alt = PITCH_NONE;
             volume = 0;
             playing_note = false;
         }
     }
 }
 
+// Moves the pitch towards the target by the step of one period
+static uint16_t glide(uint16_t* pitch, uint16_t target, uint16_t period)
+{
+    if (glissando && *pitch != PITCH_NONE) {
+        uint16_t step = ((uint32_t)period * GLISSANDO_STEP) >> 16;
+        if (*pitch + step < target) {
+            *pitch += step;
+            return *pitch;
+        } else if (*pitch > target + step) {
+            *pitch -= step;
+            return *pitch;
+        }
+    }
+    *pitch = target;
+    return target;
+}
+
 #ifdef VIBRATO_ENABLE
 
-float mod(float a, int b)
+static uint16_t clamp_pitch(int32_t pitch)
 {
-    float r = fmod(a, b);
-    return r < 0 ? r + b : r;
+    if (pitch < 0) {
+        return 0;
+    }
+    if (pitch > PITCH_MAX) {
+        return PITCH_MAX;
+    }
+    return pitch;
 }
 
-float vibrato(float average_freq) {
+static uint16_t vibrato(uint16_t pitch, uint16_t period) {
+    int16_t offset = (int8_t)pgm_read_byte(&vibrato_lut[vibrato_counter >> 8]);
     #ifdef VIBRATO_STRENGTH_ENABLE
-        float vibrated_freq = average_freq * pow(vibrato_lut[(int)vibrato_counter], vibrato_strength);
-    #else
-        float vibrated_freq = average_freq * vibrato_lut[(int)vibrato_counter];
+        offset = ((int32_t)offset * vibrato_strength_fp) >> 8;
     #endif
-    vibrato_counter = mod((vibrato_counter + vibrato_rate * (1.0 + 440.0/average_freq)), VIBRATO_LUT_LENGTH);
-    return vibrated_freq;
+    vibrato_counter += vibrato_rate_fp + (((((uint32_t)vibrato_rate_fp * period) >> 12) * VIBRATO_FREQUENCY_SCALE) >> 12);
+    while (vibrato_counter >= (VIBRATO_LUT_LENGTH << 8)) {
+        vibrato_counter -= VIBRATO_LUT_LENGTH << 8;
+    }
+    return clamp_pitch((int32_t)pitch + offset);
 }
 
 #endif
 
+// Song functions, the float math is only done once for each note, and not at
+// all for the compact songs
+
+static void load_note(void)
+{
+    if (song_pointer) {
+        note_pitch = song_note == SONG_REST ? PITCH_NONE : song_note * SEMITONE_PITCH;
+        note_length_ticks = SONG_LENGTH_TICKS(song_reader.duration, song_reader.tempo);
+        return;
+    }
+    float freq = (*notes_pointer)[current_note][0];
+    note_pitch = freq > 0 ? audio_frequency_to_pitch(freq) : PITCH_NONE;
+    note_length_ticks = NOTE_LENGTH_TICKS(((*notes_pointer)[current_note][1] / 4) * (((float)note_tempo) / 100));
+}
+
+// Moves to the next note of the song, returns false at the end of the song
+static bool advance_note(void)
+{
+    if (song_pointer) {
+        if (song_reader_next(&song_reader, &song_note)) {
+            return true;
+        }
+        if (!notes_repeat) {
+            return false;
+        }
+        song_reader_init(&song_reader, song_pointer, note_tempo);
+        return song_reader_next(&song_reader, &song_note);
+    }
+    current_note++;
+    if (current_note >= notes_count) {
+        if (notes_repeat) {
+            current_note = 0;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false at the end of the song
+static bool next_note(void)
+{
+    note_ticks = 0;
+    if (note_resting) {
+        // The note after the rest was already read
+        note_resting = false;
+    } else {
+        if (!advance_note()) {
+            return false;
+        }
+        if (notes_rest_ticks > 0) {
+            note_resting = true;
+            note_pitch = PITCH_NONE;
+            note_length_ticks = notes_rest_ticks;
+            return true;
+        }
+    }
+    envelope_index = 0;
+    load_note();
+    return true;
+}
+
 #ifdef C6_AUDIO
 ISR(TIMER3_COMPA_vect)
 {
-    float freq;
+    uint16_t pitch;
 
     if (playing_note) {
         if (voices > 0) {
 
             #ifdef B5_AUDIO
-            float freq_alt = 0;
                 if (voices > 1) {
-                    if (polyphony_rate == 0) {
-                        if (glissando) {
-                            if (frequency_alt != 0 && frequency_alt < frequencies[voices - 2] && frequency_alt < frequencies[voices - 2] * pow(2, -440/frequencies[voices - 2]/12/2)) {
-                                frequency_alt = frequency_alt * pow(2, 440/frequency_alt/12/2);
-                            } else if (frequency_alt != 0 && frequency_alt > frequencies[voices - 2] && frequency_alt > frequencies[voices - 2] * pow(2, 440/frequencies[voices - 2]/12/2)) {
-                                frequency_alt = frequency_alt * pow(2, -440/frequency_alt/12/2);
-                            } else {
-                                frequency_alt = frequencies[voices - 2];
-                            }
-                        } else {
-                            frequency_alt = frequencies[voices - 2];
-                        }
+                    uint16_t pitch_alt = glide(&glide_pitch_alt, pitches[voices - 2], current_period_alt);
 
-                        #ifdef VIBRATO_ENABLE
-                            if (vibrato_strength > 0) {
-                                freq_alt = vibrato(frequency_alt);
-                            } else {
-                                freq_alt = frequency_alt;
-                            }
-                        #else
-                            freq_alt = frequency_alt;
-                        #endif
-                    }
+                    #ifdef VIBRATO_ENABLE
+                        if (vibrato_strength_fp > 0) {
+                            pitch_alt = vibrato(pitch_alt, current_period_alt);
+                        }
+                    #endif
 
                     if (envelope_index < 65535) {
                         envelope_index++;
                     }
 
-                    freq_alt = voice_envelope(freq_alt);
-
-                    if (freq_alt < 30.517578125) {
-                        freq_alt = 30.52;
-                    }
+                    pitch_alt = voice_envelope(pitch_alt);
 
-                    TIMER_1_PERIOD = (uint16_t)(((float)F_CPU) / (freq_alt * CPU_PRESCALER));
-                    TIMER_1_DUTY_CYCLE = (uint16_t)((((float)F_CPU) / (freq_alt * CPU_PRESCALER)) * note_timbre);
+                    current_period_alt = audio_pitch_period(pitch_alt);
+                    TIMER_1_PERIOD = TIMER_PERIOD(current_period_alt);
+                    TIMER_1_DUTY_CYCLE = TIMER_DUTY(current_period_alt);
                 }
             #endif
 
-            if (polyphony_rate > 0) {
+            if (polyphony_ticks > 0) {
                 if (voices > 1) {
                     voice_place %= voices;
-                    if (place++ > (frequencies[voice_place] / polyphony_rate / CPU_PRESCALER)) {
+                    place += current_period;
+                    if (place > polyphony_ticks) {
                         voice_place = (voice_place + 1) % voices;
-                        place = 0.0;
+                        place = 0;
                     }
                 }
-
-                #ifdef VIBRATO_ENABLE
-                    if (vibrato_strength > 0) {
-                        freq = vibrato(frequencies[voice_place]);
-                    } else {
-                        freq = frequencies[voice_place];
-                    }
-                #else
-                    freq = frequencies[voice_place];
-                #endif
+                pitch = pitches[voice_place];
             } else {
-                if (glissando) {
-                    if (frequency != 0 && frequency < frequencies[voices - 1] && frequency < frequencies[voices - 1] * pow(2, -440/frequencies[voices - 1]/12/2)) {
-                        frequency = frequency * pow(2, 440/frequency/12/2);
-                    } else if (frequency != 0 && frequency > frequencies[voices - 1] && frequency > frequencies[voices - 1] * pow(2, 440/frequencies[voices - 1]/12/2)) {
-                        frequency = frequency * pow(2, -440/frequency/12/2);
-                    } else {
-                        frequency = frequencies[voices - 1];
-                    }
-                } else {
-                    frequency = frequencies[voices - 1];
-                }
-
-                #ifdef VIBRATO_ENABLE
-                    if (vibrato_strength > 0) {
-                        freq = vibrato(frequency);
-                    } else {
-                        freq = frequency;
-                    }
-                #else
-                    freq = frequency;
-                #endif
+                pitch = glide(&glide_pitch, pitches[voices - 1], current_period);
             }
 
+            #ifdef VIBRATO_ENABLE
+                if (vibrato_strength_fp > 0) {
+                    pitch = vibrato(pitch, current_period);
+                }
+            #endif
+
             if (envelope_index < 65535) {
                 envelope_index++;
             }
 
-            freq = voice_envelope(freq);
+            pitch = voice_envelope(pitch);
 
-            if (freq < 30.517578125) {
-                freq = 30.52;
-            }
-
-            TIMER_3_PERIOD = (uint16_t)(((float)F_CPU) / (freq * CPU_PRESCALER));
-            TIMER_3_DUTY_CYCLE = (uint16_t)((((float)F_CPU) / (freq * CPU_PRESCALER)) * note_timbre);
+            current_period = audio_pitch_period(pitch);
+            TIMER_3_PERIOD = TIMER_PERIOD(current_period);
+            TIMER_3_DUTY_CYCLE = TIMER_DUTY(current_period);
         }
     }
 
     if (playing_notes) {
-        if (note_frequency > 0) {
+        if (note_pitch != PITCH_NONE) {
+            pitch = note_pitch;
             #ifdef VIBRATO_ENABLE
-                if (vibrato_strength > 0) {
-                    freq = vibrato(note_frequency);
-                } else {
-                    freq = note_frequency;
+                if (vibrato_strength_fp > 0) {
+                    pitch = vibrato(pitch, current_period);
                 }
-            #else
-                    freq = note_frequency;
             #endif
 
             if (envelope_index < 65535) {
                 envelope_index++;
             }
-            freq = voice_envelope(freq);
+            pitch = voice_envelope(pitch);
 
-            TIMER_3_PERIOD = (uint16_t)(((float)F_CPU) / (freq * CPU_PRESCALER));
-            TIMER_3_DUTY_CYCLE = (uint16_t)((((float)F_CPU) / (freq * CPU_PRESCALER)) * note_timbre);
+            current_period = audio_pitch_period(pitch);
+            TIMER_3_PERIOD = TIMER_PERIOD(current_period);
+            TIMER_3_DUTY_CYCLE = TIMER_DUTY(current_period);
+            ENABLE_AUDIO_COUNTER_3_OUTPUT;
         } else {
-            TIMER_3_PERIOD = 0;
+            current_period = REST_PERIOD;
+            TIMER_3_PERIOD = TIMER_PERIOD(REST_PERIOD);
             TIMER_3_DUTY_CYCLE = 0;
+            DISABLE_AUDIO_COUNTER_3_OUTPUT;
         }
 
-        note_position++;
-        bool end_of_note = false;
-        if (TIMER_3_PERIOD > 0) {
-            end_of_note = (note_position >= (note_length / TIMER_3_PERIOD * 0xFFFF));
-        } else {
-            end_of_note = (note_position >= (note_length * 0x7FF));
-        }
-
-        if (end_of_note) {
-            current_note++;
-            if (current_note >= notes_count) {
-                if (notes_repeat) {
-                    current_note = 0;
-                } else {
-                    DISABLE_AUDIO_COUNTER_3_ISR;
-                    DISABLE_AUDIO_COUNTER_3_OUTPUT;
-                    playing_notes = false;
-                    return;
-                }
-            }
-            if (!note_resting && (notes_rest > 0)) {
-                note_resting = true;
-                note_frequency = 0;
-                note_length = notes_rest;
-                current_note--;
-            } else {
-                note_resting = false;
-                envelope_index = 0;
-                note_frequency = (*notes_pointer)[current_note][0];
-                note_length = ((*notes_pointer)[current_note][1] / 4) * (((float)note_tempo) / 100);
+        note_ticks += current_period;
+        if (note_ticks >= note_length_ticks) {
+            if (!next_note()) {
+                DISABLE_AUDIO_COUNTER_3_ISR;
+                DISABLE_AUDIO_COUNTER_3_OUTPUT;
+                playing_notes = false;
+                return;
             }
-
-            note_position = 0;
         }
     }
 
@@ -446,124 +519,75 @@ ISR(TIMER3_COMPA_vect)
 ISR(TIMER1_COMPA_vect)
 {
     #if defined(B5_AUDIO) && !defined(C6_AUDIO)
-    float freq = 0;
+    uint16_t pitch;
 
     if (playing_note) {
         if (voices > 0) {
-            if (polyphony_rate > 0) {
+            if (polyphony_ticks > 0) {
                 if (voices > 1) {
                     voice_place %= voices;
-                    if (place++ > (frequencies[voice_place] / polyphony_rate / CPU_PRESCALER)) {
+                    place += current_period;
+                    if (place > polyphony_ticks) {
                         voice_place = (voice_place + 1) % voices;
-                        place = 0.0;
+                        place = 0;
                     }
                 }
-
-                #ifdef VIBRATO_ENABLE
-                    if (vibrato_strength > 0) {
-                        freq = vibrato(frequencies[voice_place]);
-                    } else {
-                        freq = frequencies[voice_place];
-                    }
-                #else
-                    freq = frequencies[voice_place];
-                #endif
+                pitch = pitches[voice_place];
             } else {
-                if (glissando) {
-                    if (frequency != 0 && frequency < frequencies[voices - 1] && frequency < frequencies[voices - 1] * pow(2, -440/frequencies[voices - 1]/12/2)) {
-                        frequency = frequency * pow(2, 440/frequency/12/2);
-                    } else if (frequency != 0 && frequency > frequencies[voices - 1] && frequency > frequencies[voices - 1] * pow(2, 440/frequencies[voices - 1]/12/2)) {
-                        frequency = frequency * pow(2, -440/frequency/12/2);
-                    } else {
-                        frequency = frequencies[voices - 1];
-                    }
-                } else {
-                    frequency = frequencies[voices - 1];
-                }
-
-                #ifdef VIBRATO_ENABLE
-                    if (vibrato_strength > 0) {
-                        freq = vibrato(frequency);
-                    } else {
-                        freq = frequency;
-                    }
-                #else
-                    freq = frequency;
-                #endif
+                pitch = glide(&glide_pitch, pitches[voices - 1], current_period);
             }
 
+            #ifdef VIBRATO_ENABLE
+                if (vibrato_strength_fp > 0) {
+                    pitch = vibrato(pitch, current_period);
+                }
+            #endif
+
             if (envelope_index < 65535) {
                 envelope_index++;
             }
 
-            freq = voice_envelope(freq);
-
-            if (freq < 30.517578125) {
-                freq = 30.52;
-            }
+            pitch = voice_envelope(pitch);
 
-            TIMER_1_PERIOD = (uint16_t)(((float)F_CPU) / (freq * CPU_PRESCALER));
-            TIMER_1_DUTY_CYCLE = (uint16_t)((((float)F_CPU) / (freq * CPU_PRESCALER)) * note_timbre);
+            current_period = audio_pitch_period(pitch);
+            TIMER_1_PERIOD = TIMER_PERIOD(current_period);
+            TIMER_1_DUTY_CYCLE = TIMER_DUTY(current_period);
         }
     }
 
     if (playing_notes) {
-        if (note_frequency > 0) {
+        if (note_pitch != PITCH_NONE) {
+            pitch = note_pitch;
             #ifdef VIBRATO_ENABLE
-                if (vibrato_strength > 0) {
-                    freq = vibrato(note_frequency);
-                } else {
-                    freq = note_frequency;
+                if (vibrato_strength_fp > 0) {
+                    pitch = vibrato(pitch, current_period);
                 }
-            #else
-                    freq = note_frequency;
             #endif
 
             if (envelope_index < 65535) {
                 envelope_index++;
             }
-            freq = voice_envelope(freq);
+            pitch = voice_envelope(pitch);
 
-            TIMER_1_PERIOD = (uint16_t)(((float)F_CPU) / (freq * CPU_PRESCALER));
-            TIMER_1_DUTY_CYCLE = (uint16_t)((((float)F_CPU) / (freq * CPU_PRESCALER)) * note_timbre);
+            current_period = audio_pitch_period(pitch);
+            TIMER_1_PERIOD = TIMER_PERIOD(current_period);
+            TIMER_1_DUTY_CYCLE = TIMER_DUTY(current_period);
+            ENABLE_AUDIO_COUNTER_1_OUTPUT;
         } else {
-            TIMER_1_PERIOD = 0;
+            current_period = REST_PERIOD;
+            TIMER_1_PERIOD = TIMER_PERIOD(REST_PERIOD);
             TIMER_1_DUTY_CYCLE = 0;
+            DISABLE_AUDIO_COUNTER_1_OUTPUT;
         }
 
-        note_position++;
-        bool end_of_note = false;
-        if (TIMER_1_PERIOD > 0) {
-            end_of_note = (note_position >= (note_length / TIMER_1_PERIOD * 0xFFFF));
-        } else {
-            end_of_note = (note_position >= (note_length * 0x7FF));
-        }
-
-        if (end_of_note) {
-            current_note++;
-            if (current_note >= notes_count) {
-                if (notes_repeat) {
-                    current_note = 0;
-                } else {
-                    DISABLE_AUDIO_COUNTER_1_ISR;
-                    DISABLE_AUDIO_COUNTER_1_OUTPUT;
-                    playing_notes = false;
-                    return;
-                }
-            }
-            if (!note_resting && (notes_rest > 0)) {
-                note_resting = true;
-                note_frequency = 0;
-                note_length = notes_rest;
-                current_note--;
-            } else {
-                note_resting = false;
-                envelope_index = 0;
-                note_frequency = (*notes_pointer)[current_note][0];
-                note_length = ((*notes_pointer)[current_note][1] / 4) * (((float)note_tempo) / 100);
+        note_ticks += current_period;
+        if (note_ticks >= note_length_ticks) {
+            if (!next_note()) {
+                DISABLE_AUDIO_COUNTER_1_ISR;
+                DISABLE_AUDIO_COUNTER_1_OUTPUT;
+                playing_notes = false;
+                return;
             }
-
-            note_position = 0;
         }
     }
 
@@ -601,6 +625,7 @@ void play_note(float freq, int vol) {
 
         if (freq > 0) {
             frequencies[voices] = freq;
+            pitches[voices] = audio_frequency_to_pitch(freq);
             volumes[voices] = vol;
             voices++;
         }
@@ -624,7 +649,8 @@ void play_note(float freq, int vol) {
 
 }
 
-void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest)
+// Plays the float notes of np, or the compact song s when it's not NULL
+static void start_song(float (*np)[][2], uint16_t n_count, const uint8_t* s, bool n_repeat, float n_rest)
 {
 
     if (!audio_initialized) {
@@ -649,14 +675,24 @@ void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest)
         notes_pointer = np;
         notes_count = n_count;
         notes_repeat = n_repeat;
-        notes_rest = n_rest;
+        notes_rest_ticks = NOTE_LENGTH_TICKS(n_rest);
+        note_resting = false;
 
         place = 0;
         current_note = 0;
 
-        note_frequency = (*notes_pointer)[current_note][0];
-        note_length = ((*notes_pointer)[current_note][1] / 4) * (((float)note_tempo) / 100);
-        note_position = 0;
+        song_pointer = s;
+        if (song_pointer) {
+            song_reader_init(&song_reader, song_pointer, note_tempo);
+            if (!song_reader_next(&song_reader, &song_note)) {
+                // An empty song ends at the first tick
+                song_note = SONG_REST;
+                song_reader.duration = 0;
+            }
+        }
+
+        load_note();
+        note_ticks = 0;
 
 
         #ifdef C6_AUDIO
@@ -673,6 +709,16 @@ void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest)
 
 }
 
+void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest)
+{
+    start_song(np, n_count, NULL, n_repeat, n_rest);
+}
+
+void play_song(const uint8_t* s, bool n_repeat, float n_rest)
+{
+    start_song(NULL, 0, s, n_repeat, n_rest);
+}
+
 bool is_playing_notes(void) {
     return playing_notes;
 }
@@ -705,28 +751,30 @@ void audio_off(void) {
 
 void set_vibrato_rate(float rate) {
     vibrato_rate = rate;
+    vibrato_rate_fp = rate * 256;
 }
 
 void increase_vibrato_rate(float change) {
-    vibrato_rate *= change;
+    set_vibrato_rate(vibrato_rate * change);
 }
 
 void decrease_vibrato_rate(float change) {
-    vibrato_rate /= change;
+    set_vibrato_rate(vibrato_rate / change);
 }
 
 #ifdef VIBRATO_STRENGTH_ENABLE
 
 void set_vibrato_strength(float strength) {
     vibrato_strength = strength;
+    vibrato_strength_fp = strength * 256;
 }
 
 void increase_vibrato_strength(float change) {
-    vibrato_strength *= change;
+    set_vibrato_strength(vibrato_strength * change);
 }
 
 void decrease_vibrato_strength(float change) {
-    vibrato_strength /= change;
+    set_vibrato_strength(vibrato_strength / change);
 }
 
 #endif  /* VIBRATO_STRENGTH_ENABLE */
@@ -735,30 +783,33 @@ void decrease_vibrato_strength(float change) {
 
 // Polyphony functions
 
+// Each voice plays for 1 / (8 * rate) seconds
+#define POLYPHONY_TICKS(rate) ((uint32_t)(FREQUENCY_LUT_TIMER_FREQUENCY / CPU_PRESCALER / (rate)))
+
 void set_polyphony_rate(float rate) {
-    polyphony_rate = rate;
+    polyphony_ticks = rate > 0 ? POLYPHONY_TICKS(rate) : 0;
 }
 
 void enable_polyphony() {
-    polyphony_rate = 5;
+    polyphony_ticks = POLYPHONY_TICKS(5);
 }
 
 void disable_polyphony() {
-    polyphony_rate = 0;
+    polyphony_ticks = 0;
 }
 
 void increase_polyphony_rate(float change) {
-    polyphony_rate *= change;
+    polyphony_ticks = polyphony_ticks / change;
 }
 
 void decrease_polyphony_rate(float change) {
-    polyphony_rate /= change;
+    polyphony_ticks = polyphony_ticks * change;
 }
 
 // Timbre function
 
 void set_timbre(float timbre) {
-    note_timbre = timbre;
+    note_duty = timbre >= 1 ? 0xFF : (uint8_t)(timbre * 256);
 }
 
 // Tempo functions
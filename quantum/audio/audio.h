@@ -18,10 +18,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/io.h>
-#include <util/delay.h>
+#if defined(__AVR__)
+  #include <avr/io.h>
+  #include <util/delay.h>
+#endif
 #include "musical_notes.h"
 #include "song_list.h"
+#include "song.h"
+#include "song_list_compact.h"
 #include "voices.h"
 #include "quantum.h"
 
@@ -87,6 +91,17 @@ void play_note(float freq, int vol);
 void stop_note(float freq);
 void stop_all_notes(void);
 void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest);
+// Plays a compact song of song.h from PROGMEM, without any float math for the notes
+void play_song(const uint8_t* s, bool n_repeat, float n_rest);
+
+// The synthesis is done with integer pitches, in 1/128 steps of
+// frequency_lut, so an octave is 48 * 128 steps, and 0 is B0
+#define PITCH_NONE 0xFFFF
+#define PITCH_MAX ((FREQUENCY_LUT_LENGTH - 1) << 7)
+
+uint16_t audio_frequency_to_pitch(float frequency);
+// The period at FREQUENCY_LUT_TIMER_FREQUENCY
+uint16_t audio_pitch_period(uint16_t pitch);
 
 #define SCALE (int8_t []){ 0 + (12*0), 2 + (12*0), 4 + (12*0), 5 + (12*0), 7 + (12*0), 9 + (12*0), 11 + (12*0), \
                            0 + (12*1), 2 + (12*1), 4 + (12*1), 5 + (12*1), 7 + (12*1), 9 + (12*1), 11 + (12*1), \
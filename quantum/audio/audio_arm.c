@@ -0,0 +1,607 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Audio for ChibiOS boards with a DAC, like the STM32F3 and STM32F0.
+ *
+ * Instead of switching a timer between the notes, all the playing voices are
+ * mixed into a circular sample buffer, that the DAC reads with DMA at a fixed
+ * sample rate, paced by a timer. The DMA calls back each time that half of
+ * the buffer has been played, and that half is filled with the next samples,
+ * so the CPU only runs once per half buffer, and never for single samples.
+ *
+ * The voices of voices.c are applied to each note separately, every
+ * AUDIO_DAC_ENVELOPE_SAMPLES, with the number of periods that the note has
+ * played as the envelope_index, like the AVR timers count it. Only the pitch
+ * and the duty cycle of the envelopes are used. The glissando and the
+ * polyphony of the AVR switch a single timer between the held notes, which
+ * are all played at the same time here, so both are ignored.
+ *
+ * The board has to enable the DAC and GPT drivers in halconf.h, and the DAC
+ * channel and the trigger timer in mcuconf.h.
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "print.h"
+#include "audio.h"
+#include "keymap.h"
+#include "eeconfig.h"
+#include "wave.h"
+#include "luts.h"
+
+#ifndef AUDIO_DAC_SAMPLE_RATE
+#define AUDIO_DAC_SAMPLE_RATE 25000
+#endif
+
+// The samples of the whole buffer, half of it is filled at a time
+#ifndef AUDIO_DAC_BUFFER_SIZE
+#define AUDIO_DAC_BUFFER_SIZE 256
+#endif
+
+// The envelopes of the voices are updated at this interval
+#ifndef AUDIO_DAC_ENVELOPE_SAMPLES
+#define AUDIO_DAC_ENVELOPE_SAMPLES 32
+#endif
+
+#ifndef AUDIO_MAX_VOICES
+#define AUDIO_MAX_VOICES 8
+#endif
+
+// The peak of one voice at full volume, two voices use the whole range of
+// the 12 bit DAC, and more are clipped when their peaks meet
+#ifndef AUDIO_DAC_VOICE_AMPLITUDE
+#define AUDIO_DAC_VOICE_AMPLITUDE 1023
+#endif
+
+#ifndef AUDIO_DAC_DRIVER
+#define AUDIO_DAC_DRIVER DACD1
+#endif
+
+// The timer that triggers the conversions, TIM6 for the DAC_TRG(0) trigger
+#ifndef AUDIO_DAC_TIMER
+#define AUDIO_DAC_TIMER GPTD6
+#endif
+
+#ifndef AUDIO_DAC_TRIGGER
+#define AUDIO_DAC_TRIGGER DAC_TRG(0)
+#endif
+
+#ifndef AUDIO_DAC_PORT
+#define AUDIO_DAC_PORT GPIOA
+#endif
+
+#ifndef AUDIO_DAC_PAD
+#define AUDIO_DAC_PAD 4
+#endif
+
+#define AUDIO_DAC_TIMER_FREQUENCY 1000000
+#define DAC_MID 2048
+#define DAC_MAX 4095
+
+// The notes of the songs are as long as with the 2 MHz timers of the AVR
+#define NOTE_SAMPLES(length) ((uint32_t)((length) * (0xFFFF * (float)AUDIO_DAC_SAMPLE_RATE / 2000000)))
+// The same for the compact songs, duration / 4 * tempo / 100 of the 0xFFFF ticks
+#define SONG_SAMPLES(duration, tempo) ((uint32_t)(((uint64_t)(duration) * (tempo) * 0xFFFF * AUDIO_DAC_SAMPLE_RATE) / (400ULL * 2000000)))
+#define PHASE_INCREMENT(frequency) ((uint32_t)((frequency) * (4294967296.0f / AUDIO_DAC_SAMPLE_RATE)))
+// The compact songs count their notes in semitones, which are 4 steps of frequency_lut
+#define SEMITONE_PITCH (4 << 7)
+
+typedef enum {
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+    WAVE_SINE,
+    NUMBER_OF_WAVES
+} wave_type;
+
+// The wave of each voice of voices.h. The voices that change the duty cycle
+// need the square wave, the others are smoother waves for the DAC.
+static const wave_type voice_waves[number_of_voices] = {
+    [default_voice] = WAVE_SQUARE,
+#ifdef AUDIO_VOICES
+    [something] = WAVE_SQUARE,
+    [drums] = WAVE_SQUARE,
+    [butts_fader] = WAVE_SQUARE,
+    [octave_crunch] = WAVE_TRIANGLE,
+    [duty_osc] = WAVE_SQUARE,
+    [duty_octave_down] = WAVE_SQUARE,
+    [delayed_vibrato] = WAVE_SINE,
+#endif
+};
+
+typedef struct {
+    // Only used to find the note that is stopped
+    float frequency;
+    uint16_t pitch;
+    // The increment of the pitch, without the envelope
+    uint32_t base_increment;
+    // The samples that have been played since the start of the note
+    uint32_t age;
+    uint32_t phase;
+    uint32_t increment;
+    // The square wave is high while the phase is below this
+    uint32_t duty;
+    uint16_t amplitude;
+    // The amplitude, or 0 while the envelope silences the note
+    uint16_t gain;
+} voice_t;
+
+// Changed with the system lock, and read by the DMA callback
+static voice_t voices[AUDIO_MAX_VOICES];
+static uint8_t num_voices = 0;
+
+static bool     playing_notes = false;
+static bool     playing_note = false;
+static uint8_t  note_tempo = TEMPO_DEFAULT;
+static uint32_t note_samples = 0;
+static float (* notes_pointer)[][2];
+static uint16_t notes_count;
+static bool     notes_repeat;
+static uint32_t notes_rest_samples;
+static bool     note_resting = false;
+static uint8_t  current_note = 0;
+// Set when a note or rest with samples was loaded since the song started over
+static bool     notes_progress;
+
+// The compact song that is playing, NULL while notes_pointer is played
+static const uint8_t* song_pointer = NULL;
+static song_reader_t song_reader;
+static uint8_t song_note;
+
+// These are shared with voices.c
+extern voice_type voice;
+uint16_t envelope_index = 0;
+uint8_t note_duty = (uint8_t)(TIMBRE_DEFAULT * 256);
+uint32_t polyphony_ticks = 0;
+bool glissando = false;
+
+static bool audio_initialized = false;
+
+audio_config_t audio_config;
+
+static dacsample_t samples[AUDIO_DAC_BUFFER_SIZE];
+
+// The phase increment of the period at FREQUENCY_LUT_TIMER_FREQUENCY,
+// 2^32 * timer frequency / (period * sample rate)
+static uint32_t pitch_increment(uint16_t pitch)
+{
+    uint16_t period = audio_pitch_period(pitch);
+    return ((uint64_t)FREQUENCY_LUT_TIMER_FREQUENCY << 32) / ((uint64_t)period * AUDIO_DAC_SAMPLE_RATE);
+}
+
+static void start_voice(voice_t* v, float frequency, int volume)
+{
+    v->frequency = frequency;
+    v->pitch = audio_frequency_to_pitch(frequency);
+    v->base_increment = PHASE_INCREMENT(frequency);
+    v->age = 0;
+    v->amplitude = (volume > 0xF ? 0xF : volume) * AUDIO_DAC_VOICE_AMPLITUDE / 0xF;
+}
+
+// Runs the envelope of the voice for each note, the default voice keeps the
+// pitch, so the notes are played at their exact frequency
+static void update_envelopes(void)
+{
+    for (uint8_t j = 0; j < num_voices; j++) {
+        voice_t* v = &voices[j];
+        uint32_t periods = ((uint64_t)v->age * v->base_increment) >> 32;
+        envelope_index = periods > 0xFFFF ? 0xFFFF : periods;
+        uint16_t pitch = voice_envelope(v->pitch);
+        v->increment = pitch == v->pitch ? v->base_increment : pitch_increment(pitch);
+        v->duty = (uint32_t)note_duty << 24;
+        v->gain = note_duty ? v->amplitude : 0;
+    }
+}
+
+static void mix(dacsample_t* buffer, size_t n)
+{
+    wave_type wave = voice_waves[voice];
+    for (size_t i = 0; i < n; i++) {
+        int32_t sample = 0;
+        for (uint8_t j = 0; j < num_voices; j++) {
+            voice_t* v = &voices[j];
+            int16_t value;
+            switch (wave) {
+                case WAVE_TRIANGLE: {
+                    uint8_t t = v->phase >> 24;
+                    value = t < 128 ? (t << 1) - 128 : 383 - (t << 1);
+                    break;
+                }
+                case WAVE_SINE:
+                    value = (int16_t)sinewave[v->phase >> 21] - 128;
+                    break;
+                default:
+                    value = v->phase < v->duty ? 127 : -127;
+                    break;
+            }
+            sample += (value * v->gain) >> 7;
+            v->phase += v->increment;
+        }
+        sample += DAC_MID;
+        if (sample < 0) {
+            sample = 0;
+        } else if (sample > DAC_MAX) {
+            sample = DAC_MAX;
+        }
+        buffer[i] = sample;
+    }
+    for (uint8_t j = 0; j < num_voices; j++) {
+        voices[j].age += n;
+    }
+}
+
+// The compact songs play the periods of frequency_lut, like the AVR timers
+static void start_song_voice(voice_t* v, uint8_t note)
+{
+    v->frequency = 0;
+    v->pitch = note * SEMITONE_PITCH;
+    v->base_increment = pitch_increment(v->pitch);
+    v->age = 0;
+    v->amplitude = AUDIO_DAC_VOICE_AMPLITUDE;
+}
+
+// Runs in the DMA interrupt. The float songs convert the frequency and
+// length of each note with float math, which is slow on the chips without
+// an FPU like the STM32F0, so those should play the compact songs.
+static void load_note(void)
+{
+    if (song_pointer) {
+        if (song_note == SONG_REST) {
+            num_voices = 0;
+        } else {
+            start_song_voice(&voices[0], song_note);
+            num_voices = 1;
+        }
+        note_samples = SONG_SAMPLES(song_reader.duration, song_reader.tempo);
+        notes_progress = notes_progress || note_samples > 0;
+        return;
+    }
+    float freq = (*notes_pointer)[current_note][0];
+    if (freq > 0) {
+        start_voice(&voices[0], freq, 0xF);
+        num_voices = 1;
+    } else {
+        num_voices = 0;
+    }
+    note_samples = NOTE_SAMPLES(((*notes_pointer)[current_note][1] / 4) * (((float)note_tempo) / 100));
+    notes_progress = notes_progress || note_samples > 0;
+}
+
+// A repeating song where all the notes are too short for a sample would
+// start over forever in the same buffer
+static bool start_over(void)
+{
+    if (!notes_repeat || !notes_progress) {
+        return false;
+    }
+    notes_progress = false;
+    return true;
+}
+
+// Moves to the next note of the song, returns false at the end of the song
+static bool advance_note(void)
+{
+    if (song_pointer) {
+        if (song_reader_next(&song_reader, &song_note)) {
+            return true;
+        }
+        if (!start_over()) {
+            return false;
+        }
+        song_reader_init(&song_reader, song_pointer, note_tempo);
+        return song_reader_next(&song_reader, &song_note);
+    }
+    current_note++;
+    if (current_note >= notes_count) {
+        if (start_over()) {
+            current_note = 0;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false at the end of the song
+static bool next_note(void)
+{
+    if (note_resting) {
+        // The note after the rest was already read
+        note_resting = false;
+    } else {
+        if (!advance_note()) {
+            return false;
+        }
+        if (notes_rest_samples > 0) {
+            note_resting = true;
+            num_voices = 0;
+            note_samples = notes_rest_samples;
+            notes_progress = true;
+            return true;
+        }
+    }
+    load_note();
+    return true;
+}
+
+// Called from the DMA interrupt, with the half of the buffer that was played
+static void dac_end_cb(DACDriver* dacp, const dacsample_t* buffer, size_t n)
+{
+    (void)dacp;
+    dacsample_t* out = (dacsample_t*)buffer;
+
+    if (!audio_config.enable) {
+        playing_notes = false;
+        playing_note = false;
+        num_voices = 0;
+    }
+
+    while (n > 0) {
+        size_t count = n > AUDIO_DAC_ENVELOPE_SAMPLES ? AUDIO_DAC_ENVELOPE_SAMPLES : n;
+        if (playing_notes && note_samples == 0 && !next_note()) {
+            playing_notes = false;
+            num_voices = 0;
+        }
+        if (playing_notes) {
+            if (count > note_samples) {
+                count = note_samples;
+            }
+            note_samples -= count;
+        }
+        update_envelopes();
+        mix(out, count);
+        out += count;
+        n -= count;
+    }
+}
+
+static void dac_error_cb(DACDriver* dacp, dacerror_t err)
+{
+    (void)dacp;
+    (void)err;
+}
+
+static const DACConfig dac_config = {
+    .init = DAC_MID,
+    .datamode = DAC_DHRM_12BIT_RIGHT,
+};
+
+static const DACConversionGroup dac_group = {
+    .num_channels = 1U,
+    .end_cb = dac_end_cb,
+    .error_cb = dac_error_cb,
+    .trigger = AUDIO_DAC_TRIGGER,
+};
+
+// MMS = 010, TRGO on the update event
+static const GPTConfig gpt_config = {
+    .frequency = AUDIO_DAC_TIMER_FREQUENCY,
+    .callback = NULL,
+    .cr2 = TIM_CR2_MMS_1,
+    .dier = 0U,
+};
+
+void audio_init()
+{
+    if (audio_initialized) {
+        return;
+    }
+
+    // Check EEPROM
+    if (!eeconfig_is_enabled())
+    {
+        eeconfig_init();
+    }
+    audio_config.raw = eeconfig_read_audio();
+
+    for (size_t i = 0; i < AUDIO_DAC_BUFFER_SIZE; i++) {
+        samples[i] = DAC_MID;
+    }
+
+    palSetPadMode(AUDIO_DAC_PORT, AUDIO_DAC_PAD, PAL_MODE_INPUT_ANALOG);
+    dacStart(&AUDIO_DAC_DRIVER, &dac_config);
+    gptStart(&AUDIO_DAC_TIMER, &gpt_config);
+    dacStartConversion(&AUDIO_DAC_DRIVER, &dac_group, samples, AUDIO_DAC_BUFFER_SIZE);
+    gptStartContinuous(&AUDIO_DAC_TIMER, AUDIO_DAC_TIMER_FREQUENCY / AUDIO_DAC_SAMPLE_RATE);
+
+    audio_initialized = true;
+}
+
+void stop_all_notes()
+{
+    dprintf("audio stop all notes");
+
+    if (!audio_initialized) {
+        audio_init();
+    }
+
+    chSysLock();
+    playing_notes = false;
+    playing_note = false;
+    num_voices = 0;
+    chSysUnlock();
+}
+
+void stop_note(float freq)
+{
+    dprintf("audio stop note freq=%d", (int)freq);
+
+    if (!audio_initialized) {
+        audio_init();
+    }
+
+    chSysLock();
+    if (playing_note) {
+        for (int i = num_voices - 1; i >= 0; i--) {
+            if (voices[i].frequency == freq) {
+                for (int j = i; j < num_voices - 1; j++) {
+                    voices[j] = voices[j + 1];
+                }
+                num_voices--;
+                break;
+            }
+        }
+        if (num_voices == 0) {
+            playing_note = false;
+        }
+    }
+    chSysUnlock();
+}
+
+void play_note(float freq, int vol) {
+
+    dprintf("audio play note freq=%d vol=%d", (int)freq, vol);
+
+    if (!audio_initialized) {
+        audio_init();
+    }
+
+    if (audio_config.enable && freq > 0) {
+        chSysLock();
+        // Cancel notes if notes are playing
+        if (playing_notes) {
+            playing_notes = false;
+            num_voices = 0;
+        }
+        if (num_voices < AUDIO_MAX_VOICES) {
+            voices[num_voices].phase = 0;
+            start_voice(&voices[num_voices], freq, vol);
+            num_voices++;
+            playing_note = true;
+        }
+        chSysUnlock();
+    }
+}
+
+// Plays the float notes of np, or the compact song s when it's not NULL
+static void start_song(float (*np)[][2], uint16_t n_count, const uint8_t* s, bool n_repeat, float n_rest)
+{
+
+    if (!audio_initialized) {
+        audio_init();
+    }
+
+    if (audio_config.enable) {
+        chSysLock();
+        // Cancel note if a note is playing
+        playing_note = false;
+
+        notes_pointer = np;
+        notes_count = n_count;
+        notes_repeat = n_repeat;
+        notes_rest_samples = NOTE_SAMPLES(n_rest);
+
+        current_note = 0;
+        note_resting = false;
+        notes_progress = false;
+
+        song_pointer = s;
+        if (song_pointer) {
+            song_reader_init(&song_reader, song_pointer, note_tempo);
+            if (!song_reader_next(&song_reader, &song_note)) {
+                // An empty song ends at the first buffer
+                song_note = SONG_REST;
+                song_reader.duration = 0;
+            }
+        }
+
+        voices[0].phase = 0;
+        load_note();
+        playing_notes = true;
+        chSysUnlock();
+    }
+
+}
+
+void play_notes(float (*np)[][2], uint16_t n_count, bool n_repeat, float n_rest)
+{
+    start_song(np, n_count, NULL, n_repeat, n_rest);
+}
+
+void play_song(const uint8_t* s, bool n_repeat, float n_rest)
+{
+    start_song(NULL, 0, s, n_repeat, n_rest);
+}
+
+bool is_playing_notes(void) {
+    return playing_notes;
+}
+
+bool is_audio_on(void) {
+    return (audio_config.enable != 0);
+}
+
+void audio_toggle(void) {
+    audio_config.enable ^= 1;
+    eeconfig_update_audio(audio_config.raw);
+    if (audio_config.enable)
+        audio_on_user();
+}
+
+void audio_on(void) {
+    audio_config.enable = 1;
+    eeconfig_update_audio(audio_config.raw);
+    audio_on_user();
+}
+
+void audio_off(void) {
+    audio_config.enable = 0;
+    eeconfig_update_audio(audio_config.raw);
+}
+
+// Polyphony functions, these are not supported, since all the held notes are
+// always mixed, instead of switching between them at the polyphony rate
+
+void set_polyphony_rate(float rate) {
+    (void)rate;
+}
+
+void enable_polyphony() {
+}
+
+void disable_polyphony() {
+}
+
+void increase_polyphony_rate(float change) {
+    (void)change;
+}
+
+void decrease_polyphony_rate(float change) {
+    (void)change;
+}
+
+// Timbre function
+
+void set_timbre(float timbre) {
+    note_duty = timbre >= 1 ? 0xFF : (uint8_t)(timbre * 256);
+}
+
+// Tempo functions
+
+void set_tempo(uint8_t tempo) {
+    note_tempo = tempo;
+}
+
+void decrease_tempo(uint8_t tempo_change) {
+    note_tempo += tempo_change;
+}
+
+void increase_tempo(uint8_t tempo_change) {
+    if (note_tempo - tempo_change < 10) {
+        note_tempo = 10;
+    } else {
+        note_tempo -= tempo_change;
+    }
+}
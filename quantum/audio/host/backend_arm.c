@@ -0,0 +1,117 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Simulates the DAC and the trigger timer of audio_arm.c. The DMA of the
+// DAC plays the circular buffer, and calls the end callback for each half
+// of it, so the output is the buffer half that the callback has just
+// filled, at the rate of the trigger timer.
+
+#include "hal.h"
+#include "render.h"
+#include "audio.h"
+
+// The core clock of the STM32F3, the costs of the callbacks are compared
+// to the cycles between them
+#ifndef RENDER_ARM_CPU_FREQUENCY
+#define RENDER_ARM_CPU_FREQUENCY 72000000
+#endif
+
+#define DAC_MID 2048
+
+DACDriver DACD1;
+GPTDriver GPTD6;
+
+static uint32_t timer_frequency;
+static size_t half;
+static uint64_t current_sample;
+// The samples of the last callback that are not output yet
+static const dacsample_t* pending;
+static size_t num_pending;
+static bool silent = true;
+
+const char* const backend_name = "arm";
+const uint8_t backend_channels = 1;
+
+void palSetPadMode(int port, int pad, int mode) {
+    (void)port;
+    (void)pad;
+    (void)mode;
+}
+
+void dacStart(DACDriver* dacp, const DACConfig* config) {
+    (void)dacp;
+    (void)config;
+}
+
+void dacStartConversion(DACDriver* dacp, const DACConversionGroup* grpp, dacsample_t* samples, size_t depth) {
+    dacp->grp = grpp;
+    dacp->samples = samples;
+    dacp->depth = depth;
+}
+
+void gptStart(GPTDriver* gptp, const GPTConfig* config) {
+    (void)gptp;
+    timer_frequency = config->frequency;
+}
+
+void gptStartContinuous(GPTDriver* gptp, uint32_t interval) {
+    gptp->interval = interval;
+}
+
+void backend_init(void) {
+    audio_init();
+}
+
+uint32_t backend_sample_rate(void) {
+    return timer_frequency / GPTD6.interval;
+}
+
+bool backend_idle(void) {
+    return silent;
+}
+
+static void run_callback(void) {
+    size_t n = DACD1.depth / 2;
+    dacsample_t* buffer = DACD1.samples + half * n;
+    uint32_t interval = (uint64_t)n * RENDER_ARM_CPU_FREQUENCY / backend_sample_rate();
+    uint64_t begin = render_isr_begin();
+    DACD1.grp->end_cb(&DACD1, buffer, n);
+    render_isr_end(begin, interval);
+    half ^= 1;
+
+    silent = true;
+    for (size_t i = 0; i < n; i++) {
+        if (buffer[i] != DAC_MID) {
+            silent = false;
+        }
+    }
+    pending = buffer;
+    num_pending = n;
+}
+
+void backend_run_until(uint64_t sample) {
+    while (current_sample < sample) {
+        if (num_pending == 0) {
+            run_callback();
+        }
+        // The 12 bit samples are scaled to 16 bits
+        int16_t value = ((int16_t)*pending - DAC_MID) << 4;
+        render_output(&value);
+        pending++;
+        num_pending--;
+        current_sample++;
+    }
+}
@@ -0,0 +1,216 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Simulates the timers that audio.c plays the notes with. The timers run in
+// fast PWM mode with the period in ICRn and the duty cycle in OCRnA, and
+// call the interrupt handler at the compare match. The registers are
+// latched at the start of each period, the real OCRnA is double buffered
+// like that, but ICRn is not, so a handler that shortens the period below
+// the counter would wrap around on the keyboard, which is not simulated.
+//
+// The output pin is sampled at RENDER_SAMPLE_RATE by averaging the time
+// that it's high, and filtered like the speaker would, to remove the DC.
+
+#include <avr/io.h>
+#include "render.h"
+#include "audio.h"
+
+#ifndef RENDER_SAMPLE_RATE
+#define RENDER_SAMPLE_RATE 48000
+#endif
+
+// The audio timers run at F_CPU / 8
+#define TIMER_PRESCALER 8
+#define TIMER_FREQUENCY (F_CPU / TIMER_PRESCALER)
+#define SAMPLE_TICK(sample) ((sample) * TIMER_FREQUENCY / RENDER_SAMPLE_RATE)
+// The high level of the pin, before the filter
+#define PIN_HIGH 16383
+// The pole of the DC filter, as a fraction of 256, about 30 Hz
+#define DC_FILTER_SHIFT 8
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3;
+volatile uint8_t DDRB, DDRC, PORTB, PORTC;
+volatile uint16_t ICR1, OCR1A, ICR3, OCR3A;
+
+void TIMER1_COMPA_vect(void);
+void TIMER3_COMPA_vect(void);
+
+typedef struct {
+    volatile uint8_t* control;
+    uint8_t output_bit;
+    volatile uint8_t* mask;
+    uint8_t interrupt_bit;
+    volatile uint16_t* top;
+    volatile uint16_t* compare;
+    void (*isr)(void);
+
+    // The current period, in timer ticks
+    uint64_t period_end;
+    uint64_t high_end;
+    uint64_t isr_tick;
+    bool isr_pending;
+    // An idle period lasts until the next command
+    bool idle;
+    // The intervals between the calls are only measured while running
+    bool has_last_isr;
+    uint64_t last_isr_tick;
+
+    // The ticks that the pin was high in the current sample
+    uint32_t high_ticks;
+    int32_t filter_input;
+    int32_t filter_output;
+} sim_timer_t;
+
+static sim_timer_t timers[] = {
+#ifdef C6_AUDIO
+    {&TCCR3A, COM3A1, &TIMSK3, OCIE3A, &ICR3, &OCR3A, TIMER3_COMPA_vect},
+#endif
+#ifdef B5_AUDIO
+    {&TCCR1A, COM1A1, &TIMSK1, OCIE1A, &ICR1, &OCR1A, TIMER1_COMPA_vect},
+#endif
+};
+
+#define NUM_TIMERS (sizeof(timers) / sizeof(timers[0]))
+
+const char* const backend_name = "avr";
+const uint8_t backend_channels = NUM_TIMERS;
+
+static uint64_t current_tick;
+static uint64_t current_sample;
+
+void backend_init(void) {
+    audio_init();
+}
+
+uint32_t backend_sample_rate(void) {
+    return RENDER_SAMPLE_RATE;
+}
+
+bool backend_idle(void) {
+    for (unsigned i = 0; i < NUM_TIMERS; i++) {
+        if (*timers[i].mask & _BV(timers[i].interrupt_bit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool timer_running(sim_timer_t* timer) {
+    return (*timer->control & _BV(timer->output_bit)) || (*timer->mask & _BV(timer->interrupt_bit));
+}
+
+static void start_period(sim_timer_t* timer, uint64_t end_tick) {
+    timer->idle = !timer_running(timer);
+    if (timer->idle) {
+        timer->has_last_isr = false;
+        timer->high_end = current_tick;
+        timer->period_end = end_tick;
+        timer->isr_pending = false;
+        return;
+    }
+    uint32_t top = (uint32_t)*timer->top + 1;
+    uint32_t compare = *timer->compare;
+    timer->period_end = current_tick + top;
+    timer->high_end = current_tick;
+    if (*timer->control & _BV(timer->output_bit)) {
+        timer->high_end += compare < top ? compare + 1 : top;
+    }
+    timer->isr_pending = (*timer->mask & _BV(timer->interrupt_bit)) && compare < top;
+    timer->isr_tick = current_tick + compare;
+}
+
+static void output_sample(void) {
+    uint32_t ticks = SAMPLE_TICK(current_sample + 1) - SAMPLE_TICK(current_sample);
+    int16_t values[NUM_TIMERS];
+    for (unsigned i = 0; i < NUM_TIMERS; i++) {
+        sim_timer_t* timer = &timers[i];
+        int32_t input = timer->high_ticks * PIN_HIGH / ticks;
+        // The output is kept with 8 fractional bits
+        timer->filter_output += ((input - timer->filter_input) << 8) - (timer->filter_output >> DC_FILTER_SHIFT);
+        timer->filter_input = input;
+        int32_t value = timer->filter_output >> 8;
+        values[i] = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+        timer->high_ticks = 0;
+    }
+    render_output(values);
+    current_sample++;
+}
+
+// Moves the time forward, with the pins at the levels of the current periods
+static void advance(uint64_t tick) {
+    while (current_tick < tick) {
+        uint64_t sample_end = SAMPLE_TICK(current_sample + 1);
+        uint64_t end = tick < sample_end ? tick : sample_end;
+        for (unsigned i = 0; i < NUM_TIMERS; i++) {
+            sim_timer_t* timer = &timers[i];
+            if (timer->high_end > current_tick) {
+                timer->high_ticks += (timer->high_end < end ? timer->high_end : end) - current_tick;
+            }
+        }
+        current_tick = end;
+        if (current_tick == sample_end) {
+            output_sample();
+        }
+    }
+}
+
+void backend_run_until(uint64_t sample) {
+    uint64_t end_tick = SAMPLE_TICK(sample);
+    // The commands disconnect the pins and disable the interrupts at once
+    for (unsigned i = 0; i < NUM_TIMERS; i++) {
+        sim_timer_t* timer = &timers[i];
+        if (!(*timer->control & _BV(timer->output_bit)) && timer->high_end > current_tick) {
+            timer->high_end = current_tick;
+        }
+        if (!(*timer->mask & _BV(timer->interrupt_bit))) {
+            timer->isr_pending = false;
+        }
+        if (timer->idle || !timer_running(timer)) {
+            timer->period_end = current_tick;
+        }
+    }
+    while (current_tick < end_tick) {
+        uint64_t next = end_tick;
+        for (unsigned i = 0; i < NUM_TIMERS; i++) {
+            sim_timer_t* timer = &timers[i];
+            if (timer->period_end <= current_tick) {
+                start_period(timer, end_tick);
+            }
+            if (timer->isr_pending && timer->isr_tick < next) {
+                next = timer->isr_tick;
+            }
+            if (timer->period_end < next) {
+                next = timer->period_end;
+            }
+        }
+        advance(next);
+        for (unsigned i = 0; i < NUM_TIMERS; i++) {
+            sim_timer_t* timer = &timers[i];
+            if (timer->isr_pending && timer->isr_tick == current_tick) {
+                timer->isr_pending = false;
+                uint32_t interval = 0;
+                if (timer->has_last_isr) {
+                    interval = (current_tick - timer->last_isr_tick) * TIMER_PRESCALER;
+                }
+                timer->last_isr_tick = current_tick;
+                timer->has_last_isr = true;
+                uint64_t begin = render_isr_begin();
+                timer->isr();
+                render_isr_end(begin, interval);
+            }
+        }
+    }
+}
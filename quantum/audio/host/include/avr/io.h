@@ -0,0 +1,55 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_HOST_AVR_IO_H
+#define AUDIO_HOST_AVR_IO_H
+
+// The registers of the audio timers, defined by backend_avr.c
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3;
+extern volatile uint8_t DDRB, DDRC, PORTB, PORTC;
+extern volatile uint16_t ICR1, OCR1A, ICR3, OCR3A;
+
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define COM1A0 6
+#define COM1A1 7
+#define OCIE1A 1
+
+#define WGM30 0
+#define WGM31 1
+#define WGM32 3
+#define WGM33 4
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define COM3A0 6
+#define COM3A1 7
+#define OCIE3A 1
+
+#define PORTB5 5
+#define PORTC6 6
+
+#endif
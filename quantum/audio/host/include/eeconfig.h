@@ -0,0 +1,30 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_HOST_EECONFIG_H
+#define AUDIO_HOST_EECONFIG_H
+
+// The audio is always enabled, and the settings are not stored
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline bool eeconfig_is_enabled(void) { return true; }
+static inline void eeconfig_init(void) {}
+static inline uint8_t eeconfig_read_audio(void) { return 0xFF; }
+static inline void eeconfig_update_audio(uint8_t val) { (void)val; }
+
+#endif
@@ -0,0 +1,83 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_HOST_HAL_H
+#define AUDIO_HOST_HAL_H
+
+// The DAC and GPT drivers that audio_arm.c uses, implemented by backend_arm.c
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint16_t dacsample_t;
+typedef int dacerror_t;
+typedef struct DACDriver DACDriver;
+typedef void (*daccallback_t)(DACDriver* dacp, const dacsample_t* buffer, size_t n);
+typedef void (*dacerrorcallback_t)(DACDriver* dacp, dacerror_t err);
+
+typedef enum {
+    DAC_DHRM_12BIT_RIGHT,
+    DAC_DHRM_12BIT_LEFT,
+    DAC_DHRM_8BIT_RIGHT,
+} dacdhrmode_t;
+
+typedef struct {
+    dacsample_t init;
+    dacdhrmode_t datamode;
+} DACConfig;
+
+typedef struct {
+    uint32_t num_channels;
+    daccallback_t end_cb;
+    dacerrorcallback_t error_cb;
+    uint32_t trigger;
+} DACConversionGroup;
+
+struct DACDriver {
+    const DACConversionGroup* grp;
+    dacsample_t* samples;
+    size_t depth;
+};
+
+typedef struct GPTDriver GPTDriver;
+typedef void (*gptcallback_t)(GPTDriver* gptp);
+
+typedef struct {
+    uint32_t frequency;
+    gptcallback_t callback;
+    uint32_t cr2;
+    uint32_t dier;
+} GPTConfig;
+
+struct GPTDriver {
+    uint32_t interval;
+};
+
+extern DACDriver DACD1;
+extern GPTDriver GPTD6;
+
+#define DAC_TRG(n) (n)
+#define TIM_CR2_MMS_1 0x20
+#define GPIOA 0
+#define PAL_MODE_INPUT_ANALOG 0
+
+void palSetPadMode(int port, int pad, int mode);
+void dacStart(DACDriver* dacp, const DACConfig* config);
+void dacStartConversion(DACDriver* dacp, const DACConversionGroup* grpp, dacsample_t* samples, size_t depth);
+void gptStart(GPTDriver* gptp, const GPTConfig* config);
+void gptStartContinuous(GPTDriver* gptp, uint32_t interval);
+
+#endif
@@ -0,0 +1,423 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Renders the audio of the keyboard on the host. The audio commands are
+// read from a script, the output of the simulated hardware is written as a
+// WAV file, and a checksum of it is printed, so that changes of the
+// synthesis can be compared bit by bit. The cost of every interrupt handler
+// call is measured, in nanoseconds or in instructions with the performance
+// counters of Linux.
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "render.h"
+#include "audio.h"
+
+#define DEFAULT_MAX_LENGTH_MS 60000
+// Without an end command, the script ends when the audio is idle, which is
+// checked this often
+#define IDLE_CHECK_MS 10
+#define CALIBRATION_ROUNDS 1000
+
+// Every song of song_list.h is available as a float and a compact song,
+// songs.inc is generated from song_list_compact.h by the Makefile
+#define RENDER_SONG(name) \
+    static float song_##name[][2] = SONG(name); \
+    static const uint8_t compact_##name[] PROGMEM = COMPACT_SONG(name##_COMPACT);
+#include "songs.inc"
+#undef RENDER_SONG
+
+typedef struct {
+    const char* name;
+    float (*notes)[][2];
+    uint16_t count;
+    const uint8_t* compact;
+} song_entry_t;
+
+#define RENDER_SONG(name) {#name, &song_##name, NOTE_ARRAY_SIZE(song_##name), compact_##name},
+static const song_entry_t songs[] = {
+#include "songs.inc"
+};
+#undef RENDER_SONG
+
+#define NUM_SONGS (sizeof(songs) / sizeof(songs[0]))
+
+static FILE* wav;
+static uint64_t num_samples;
+static uint64_t checksum = 0xcbf29ce484222325ULL;
+
+static int perf_fd = -1;
+static uint64_t measure_overhead;
+static uint64_t isr_calls;
+static uint64_t isr_total;
+static uint64_t isr_max;
+static double isr_squares;
+static uint32_t shortest_interval = UINT32_MAX;
+
+static void write_u16(uint16_t value) {
+    fputc(value & 0xFF, wav);
+    fputc(value >> 8, wav);
+}
+
+static void write_u32(uint32_t value) {
+    write_u16(value & 0xFFFF);
+    write_u16(value >> 16);
+}
+
+static void write_wav_header(uint32_t data_size) {
+    uint32_t rate = backend_sample_rate();
+    fwrite("RIFF", 1, 4, wav);
+    write_u32(36 + data_size);
+    fwrite("WAVEfmt ", 1, 8, wav);
+    write_u32(16);
+    write_u16(1);
+    write_u16(backend_channels);
+    write_u32(rate);
+    write_u32(rate * backend_channels * 2);
+    write_u16(backend_channels * 2);
+    write_u16(16);
+    fwrite("data", 1, 4, wav);
+    write_u32(data_size);
+}
+
+// The checksum is the 64 bit FNV-1a hash of the little endian samples
+void render_output(const int16_t* values) {
+    for (uint8_t i = 0; i < backend_channels; i++) {
+        uint16_t value = values[i];
+        checksum = (checksum ^ (value & 0xFF)) * 0x100000001b3ULL;
+        checksum = (checksum ^ (value >> 8)) * 0x100000001b3ULL;
+        if (wav) {
+            write_u16(value);
+        }
+    }
+    num_samples++;
+}
+
+static uint64_t get_cost(void) {
+    if (perf_fd >= 0) {
+        uint64_t count = 0;
+        if (read(perf_fd, &count, sizeof(count)) != sizeof(count)) {
+            perror("perf counter");
+            exit(2);
+        }
+        return count;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t render_isr_begin(void) {
+    return get_cost();
+}
+
+void render_isr_end(uint64_t begin, uint32_t interval_cycles) {
+    uint64_t cost = get_cost() - begin;
+    cost = cost > measure_overhead ? cost - measure_overhead : 0;
+    isr_calls++;
+    isr_total += cost;
+    isr_squares += (double)cost * cost;
+    if (cost > isr_max) {
+        isr_max = cost;
+    }
+    if (interval_cycles && interval_cycles < shortest_interval) {
+        shortest_interval = interval_cycles;
+    }
+}
+
+static bool open_instruction_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    return perf_fd >= 0;
+}
+
+// The cost of the measurement itself is subtracted from every call
+static void calibrate(void) {
+    measure_overhead = UINT64_MAX;
+    for (unsigned i = 0; i < CALIBRATION_ROUNDS; i++) {
+        uint64_t begin = get_cost();
+        uint64_t cost = get_cost() - begin;
+        if (cost < measure_overhead) {
+            measure_overhead = cost;
+        }
+    }
+}
+
+// Defined by process_audio.c on the keyboard
+void audio_on_user(void) {
+}
+
+static uint64_t ms_to_sample(uint64_t ms) {
+    return ms * backend_sample_rate() / 1000;
+}
+
+static const song_entry_t* find_song(const char* name) {
+    for (unsigned i = 0; i < NUM_SONGS; i++) {
+        if (strcmp(songs[i].name, name) == 0) {
+            return &songs[i];
+        }
+    }
+    return NULL;
+}
+
+// The script consists of lines with a time in milliseconds and a command,
+// the times have to be increasing. Empty lines and lines starting with #
+// are ignored.
+//   <ms> note <frequency> [volume]
+//   <ms> stop <frequency>
+//   <ms> stop_all
+//   <ms> song <name> [repeat] [rest]            a float song of song_list.h
+//   <ms> compact_song <name> [repeat] [rest]    the same as a compact song
+//   <ms> voice <number>
+//   <ms> tempo <tempo>
+//   <ms> timbre <timbre>
+//   <ms> polyphony <rate>                       0 disables the polyphony
+//   <ms> vibrato_rate <rate>                    ignored without VIBRATO_ENABLE
+//   <ms> vibrato_strength <strength>            ignored without VIBRATO_STRENGTH_ENABLE
+//   <ms> end
+// Without an end, the script ends when the audio is idle after the last
+// command, or at the maximum length.
+static void run_script(FILE* script, const char* name, uint64_t max_length_ms) {
+    char line[256];
+    unsigned line_number = 0;
+    uint64_t current_ms = 0;
+    while (fgets(line, sizeof(line), script)) {
+        line_number++;
+        char command[32];
+        char args[3][32];
+        uint64_t time;
+        char* start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == 0) {
+            continue;
+        }
+        int fields = sscanf(start, "%" SCNu64 " %31s %31s %31s %31s", &time, command, args[0], args[1], args[2]);
+        if (fields < 2 || time < current_ms) {
+            fprintf(stderr, "%s:%u: invalid line\n", name, line_number);
+            exit(2);
+        }
+        int num_args = fields - 2;
+        current_ms = time;
+        backend_run_until(ms_to_sample(time));
+
+        if (strcmp(command, "end") == 0) {
+            return;
+        }
+        else if (strcmp(command, "stop_all") == 0) {
+            stop_all_notes();
+        }
+        else if (num_args >= 1 && strcmp(command, "note") == 0) {
+            play_note(atof(args[0]), num_args >= 2 ? atoi(args[1]) : 0xF);
+        }
+        else if (num_args == 1 && strcmp(command, "stop") == 0) {
+            stop_note(atof(args[0]));
+        }
+        else if (num_args >= 1 && (strcmp(command, "song") == 0 || strcmp(command, "compact_song") == 0)) {
+            const song_entry_t* song = find_song(args[0]);
+            if (!song) {
+                fprintf(stderr, "%s:%u: unknown song %s\n", name, line_number, args[0]);
+                exit(2);
+            }
+            bool repeat = num_args >= 2 && atoi(args[1]);
+            float rest = num_args >= 3 ? atof(args[2]) : 0;
+            if (command[0] == 's') {
+                play_notes(song->notes, song->count, repeat, rest);
+            }
+            else {
+                play_song(song->compact, repeat, rest);
+            }
+        }
+        else if (num_args == 1 && strcmp(command, "voice") == 0) {
+            set_voice(atoi(args[0]));
+        }
+        else if (num_args == 1 && strcmp(command, "tempo") == 0) {
+            set_tempo(atoi(args[0]));
+        }
+        else if (num_args == 1 && strcmp(command, "timbre") == 0) {
+            set_timbre(atof(args[0]));
+        }
+        else if (num_args == 1 && strcmp(command, "polyphony") == 0) {
+            if (atof(args[0]) > 0) {
+                set_polyphony_rate(atof(args[0]));
+            }
+            else {
+                disable_polyphony();
+            }
+        }
+        // The vibrato commands do nothing when it isn't built, so that the
+        // same scripts can be played by every configuration
+        else if (num_args == 1 && strcmp(command, "vibrato_rate") == 0) {
+#ifdef VIBRATO_ENABLE
+            set_vibrato_rate(atof(args[0]));
+#endif
+        }
+        else if (num_args == 1 && strcmp(command, "vibrato_strength") == 0) {
+#ifdef VIBRATO_STRENGTH_ENABLE
+            set_vibrato_strength(atof(args[0]));
+#endif
+        }
+        else {
+            fprintf(stderr, "%s:%u: unknown command %s\n", name, line_number, command);
+            exit(2);
+        }
+    }
+    while (current_ms < max_length_ms) {
+        current_ms += IDLE_CHECK_MS;
+        backend_run_until(ms_to_sample(current_ms));
+        if (backend_idle()) {
+            break;
+        }
+    }
+}
+
+static void print_report(const char* unit) {
+    double seconds = (double)num_samples / backend_sample_rate();
+    printf("backend %s, %" PRIu32 " Hz, channels %u, %.3f s\n", backend_name, backend_sample_rate(),
+           backend_channels, seconds);
+    if (isr_calls) {
+        double average = (double)isr_total / isr_calls;
+        double deviation = sqrt(isr_squares / isr_calls - average * average);
+        printf("interrupts %" PRIu64 ", %.1f per second\n", isr_calls, isr_calls / seconds);
+        printf("cost avg %.1f, max %" PRIu64 ", jitter (std dev) %.1f %s\n", average, isr_max, deviation, unit);
+        if (shortest_interval != UINT32_MAX) {
+            printf("shortest interval %" PRIu32 " cycles\n", shortest_interval);
+        }
+    }
+    printf("checksum %016" PRIx64 "\n", checksum);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options] [script]\n"
+        "  -o, --output FILE        write the audio to FILE as WAV\n"
+        "  -c, --checksum HEX       the expected checksum of the audio\n"
+        "  -b, --isr-budget COST    maximum average cost of the interrupt handler\n"
+        "  -i, --instructions       measure the costs in instructions instead of ns\n"
+        "  -l, --length MS          maximum length of the audio, 60000 by default\n"
+        "The script is read from stdin if it's not given. The exit code is 1\n"
+        "if the checksum is wrong or the budget was exceeded.\n",
+        name);
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"checksum", required_argument, NULL, 'c'},
+        {"isr-budget", required_argument, NULL, 'b'},
+        {"instructions", no_argument, NULL, 'i'},
+        {"length", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    const char* output = NULL;
+    const char* expected_checksum = NULL;
+    double isr_budget = 0;
+    bool instructions = false;
+    uint64_t max_length_ms = DEFAULT_MAX_LENGTH_MS;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:c:b:il:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            expected_checksum = optarg;
+            break;
+        case 'b':
+            isr_budget = atof(optarg);
+            break;
+        case 'i':
+            instructions = true;
+            break;
+        case 'l':
+            max_length_ms = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    FILE* script = stdin;
+    const char* script_name = "stdin";
+    if (optind < argc) {
+        script_name = argv[optind];
+        script = fopen(script_name, "r");
+        if (!script) {
+            perror(script_name);
+            return 2;
+        }
+    }
+
+    if (instructions && !open_instruction_counter()) {
+        perror("The instruction counter is not available");
+        return 2;
+    }
+    calibrate();
+
+    // The same random numbers for every run, for the drums
+    srand(1);
+    backend_init();
+    if (output) {
+        wav = fopen(output, "wb");
+        if (!wav) {
+            perror(output);
+            return 2;
+        }
+        write_wav_header(0);
+    }
+
+    run_script(script, script_name, max_length_ms);
+    if (script != stdin) {
+        fclose(script);
+    }
+
+    if (wav) {
+        fseek(wav, 0, SEEK_SET);
+        write_wav_header(num_samples * backend_channels * 2);
+        fclose(wav);
+    }
+
+    print_report(instructions ? "instructions" : "ns");
+
+    int ret = 0;
+    char actual_checksum[17];
+    snprintf(actual_checksum, sizeof(actual_checksum), "%016" PRIx64, checksum);
+    if (expected_checksum && strcmp(expected_checksum, actual_checksum) != 0) {
+        printf("The checksum should be %s\n", expected_checksum);
+        ret = 1;
+    }
+    if (isr_budget > 0 && isr_calls && (double)isr_total / isr_calls > isr_budget) {
+        printf("The interrupt handler is over the budget of %.1f\n", isr_budget);
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,43 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUANTUM_AUDIO_HOST_RENDER_H_
+#define QUANTUM_AUDIO_HOST_RENDER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Implemented by the backends, backend_avr.c simulates the timers of
+// audio.c, and backend_arm.c the DAC of audio_arm.c
+extern const char* const backend_name;
+extern const uint8_t backend_channels;
+void backend_init(void);
+// The rate of the output, after backend_init
+uint32_t backend_sample_rate(void);
+// Runs the audio until the output has reached the sample
+void backend_run_until(uint64_t sample);
+// True while no interrupt of the audio is enabled
+bool backend_idle(void);
+
+// Called by the backends, with one value for each channel
+void render_output(const int16_t* values);
+// Measures the cost of the interrupt handlers of the audio, the interval is
+// the time since the previous call in CPU cycles of the keyboard, or 0 for
+// the first call
+uint64_t render_isr_begin(void);
+void render_isr_end(uint64_t begin, uint32_t interval_cycles);
+
+#endif
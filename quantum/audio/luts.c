@@ -14,37 +14,78 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
 #include "luts.h"
+#include "audio.h"
 
-const float vibrato_lut[VIBRATO_LUT_LENGTH] =
+// Pitch offsets, in the units of audio_frequency_to_pitch
+const int8_t vibrato_lut[VIBRATO_LUT_LENGTH] PROGMEM =
 {
-	1.0022336811487,
-	1.0042529943610,
-	1.0058584256028,
-	1.0068905285205,
-	1.0072464122237,
-	1.0068905285205,
-	1.0058584256028,
-	1.0042529943610,
-	1.0022336811487,
-	1.0000000000000,
-	0.9977712970630,
-	0.9957650169978,
-	0.9941756956510,
-	0.9931566259436,
-	0.9928057204913,
-	0.9931566259436,
-	0.9941756956510,
-	0.9957650169978,
-	0.9977712970630,
-	1.0000000000000,
+	20,
+	38,
+	52,
+	61,
+	64,
+	61,
+	52,
+	38,
+	20,
+	0,
+	-20,
+	-38,
+	-52,
+	-61,
+	-64,
+	-61,
+	-52,
+	-38,
+	-20,
+	0,
 };
 
-const uint16_t frequency_lut[FREQUENCY_LUT_LENGTH] =
+// Timer periods at FREQUENCY_LUT_TIMER_FREQUENCY, four steps per semitone,
+// starting from B0
+const uint16_t frequency_lut[FREQUENCY_LUT_LENGTH] PROGMEM =
 {
+	0xFD18,
+	0xF977,
+	0xF5E4,
+	0xF25D,
+	0xEEE4,
+	0xEB77,
+	0xE817,
+	0xE4C3,
+	0xE17B,
+	0xDE40,
+	0xDB10,
+	0xD7EC,
+	0xD4D3,
+	0xD1C6,
+	0xCEC4,
+	0xCBCD,
+	0xC8E1,
+	0xC600,
+	0xC329,
+	0xC05D,
+	0xBD9B,
+	0xBAE3,
+	0xB835,
+	0xB591,
+	0xB2F7,
+	0xB066,
+	0xADDF,
+	0xAB60,
+	0xA8EB,
+	0xA67F,
+	0xA41C,
+	0xA1C2,
+	0x9F70,
+	0x9D27,
+	0x9AE6,
+	0x98AE,
+	0x967D,
+	0x9455,
+	0x9235,
+	0x901C,
 	0x8E0B,
 	0x8C02,
 	0x8A00,
@@ -396,3 +437,44 @@ const uint16_t frequency_lut[FREQUENCY_LUT_LENGTH] =
 	0xEE,
 };
 
+// Pitches and periods
+
+uint16_t audio_frequency_to_pitch(float frequency)
+{
+    float period = FREQUENCY_LUT_TIMER_FREQUENCY / frequency;
+    uint16_t low = 0;
+    uint16_t high = FREQUENCY_LUT_LENGTH - 1;
+
+    if (period >= pgm_read_word(&frequency_lut[low])) {
+        return 0;
+    }
+    uint16_t target = (uint16_t)period;
+    if (target <= pgm_read_word(&frequency_lut[high])) {
+        return PITCH_MAX;
+    }
+
+    // The periods are decreasing, find the step that contains the target
+    while (high - low > 1) {
+        uint16_t middle = (low + high) / 2;
+        if (pgm_read_word(&frequency_lut[middle]) >= target) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    uint16_t low_period = pgm_read_word(&frequency_lut[low]);
+    uint16_t high_period = pgm_read_word(&frequency_lut[high]);
+    return (low << 7) + (((uint32_t)(low_period - target) << 7) / (low_period - high_period));
+}
+
+uint16_t audio_pitch_period(uint16_t pitch)
+{
+    uint16_t index = pitch >> 7;
+    uint8_t fraction = pitch & 0x7F;
+    uint16_t period = pgm_read_word(&frequency_lut[index]);
+    if (fraction) {
+        uint16_t next = pgm_read_word(&frequency_lut[index + 1]);
+        period -= ((uint32_t)(period - next) * fraction) >> 7;
+    }
+    return period;
+}
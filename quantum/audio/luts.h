@@ -14,18 +14,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
+#include <stdint.h>
+#if defined(__AVR__)
+  #include <avr/io.h>
+  #include <avr/interrupt.h>
+  #include <avr/pgmspace.h>
+#else
+  #include "progmem.h"
+#endif
 
 #ifndef LUTS_H
 #define LUTS_H
 
 #define VIBRATO_LUT_LENGTH 20
 
-#define FREQUENCY_LUT_LENGTH 349
+#define FREQUENCY_LUT_LENGTH 389
+// The clock of the timer that the periods of frequency_lut are counted in
+#define FREQUENCY_LUT_TIMER_FREQUENCY 2000000
 
-extern const float vibrato_lut[VIBRATO_LUT_LENGTH];
-extern const uint16_t frequency_lut[FREQUENCY_LUT_LENGTH];
+extern const int8_t vibrato_lut[VIBRATO_LUT_LENGTH] PROGMEM;
+extern const uint16_t frequency_lut[FREQUENCY_LUT_LENGTH] PROGMEM;
 
 #endif /* LUTS_H */
@@ -0,0 +1,58 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "song.h"
+#if defined(__AVR__)
+  #include <avr/pgmspace.h>
+#else
+  #include "progmem.h"
+#endif
+
+#define SONG_OP_LONG_DURATION 0xFD
+#define SONG_OP_TEMPO 0xFE
+
+void song_reader_init(song_reader_t* reader, const uint8_t* song, uint8_t tempo) {
+    reader->song = song;
+    reader->position = 0;
+    reader->duration = SONG_DURATION_DEFAULT;
+    reader->tempo = tempo;
+}
+
+bool song_reader_next(song_reader_t* reader, uint8_t* note) {
+    while (true) {
+        uint8_t code = pgm_read_byte(&reader->song[reader->position++]);
+        switch (code) {
+            case SONG_END:
+                reader->position--;
+                return false;
+            case SONG_OP_LONG_DURATION:
+                reader->duration = pgm_read_byte(&reader->song[reader->position++]);
+                break;
+            case SONG_OP_TEMPO:
+                reader->tempo = pgm_read_byte(&reader->song[reader->position++]);
+                break;
+            default:
+                if (code & 0x80) {
+                    reader->duration = code & 0x7F;
+                } else {
+                    // The unused codes are played as rests
+                    *note = code < SONG_NOTES ? code : SONG_REST;
+                    return true;
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SONG_H
+#define SONG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compact songs are byte arrays in PROGMEM, with one byte for each note
+//
+// 0x00 - 0x61  A note, in semitones above B0, so frequency_lut[note * 4]
+// 0x7F         A rest
+// 0x80 - 0xFC  Sets the duration of the following notes to the low 7 bits
+// 0xFD d       Sets the duration of the following notes to d
+// 0xFE t       Sets the tempo to t, like set_tempo
+// 0xFF         The end of the song
+//
+// The durations are the same as the ones of musical_notes.h, so a quarter
+// note is 16. Like the notes of SONG, each item ends with a comma.
+// song_converter.py converts the songs of song_list.h.
+
+#define SONG_NOTES 98
+#define SONG_REST 0x7F
+#define SONG_MAX_SHORT_DURATION 0x7C
+#define SONG_DURATION_DEFAULT 16
+
+#define SONG_DURATION(duration) (0x80 | (duration))
+#define SONG_LONG_DURATION(duration) 0xFD, (duration)
+#define SONG_TEMPO(tempo) 0xFE, (tempo)
+#define SONG_END 0xFF
+
+#define COMPACT_SONG(notes...) { notes SONG_END }
+
+typedef struct {
+    const uint8_t* song;
+    uint16_t position;
+    uint8_t duration;
+    uint8_t tempo;
+} song_reader_t;
+
+void song_reader_init(song_reader_t* reader, const uint8_t* song, uint8_t tempo);
+// Reads the next note or SONG_REST, and returns false at the end of the song.
+// The duration and tempo of the note are left in the reader.
+bool song_reader_next(song_reader_t* reader, uint8_t* note);
+
+#endif
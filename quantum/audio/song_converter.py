@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+"""Converts the float songs of song_list.h to the compact songs of song.h
+
+The songs are expanded with the C preprocessor, so any header of SONG
+macros can be converted. Each song NAME becomes a NAME_COMPACT macro for
+COMPACT_SONG.
+
+Usage:
+    python song_converter.py [INPUT_PATH [OUTPUT_PATH]]
+
+The default is to convert song_list.h to song_list_compact.h next to
+this script. The preprocessor is taken from the CPP environment variable,
+or is "cc -E".
+"""
+from __future__ import print_function
+
+import math
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+# B0, the first note of frequency_lut
+BASE_FREQUENCY = 55 * 2 ** (-10 / 12.0)
+SONG_NOTES = 98
+SONG_MAX_SHORT_DURATION = 0x7C
+LINE_WIDTH = 100
+
+NOTE_PATTERN = re.compile(r'\{\s*\(([^{}]*)\)\s*,\s*([^{}]*)\}')
+
+
+def song_names(path):
+    names = []
+    with open(path) as f:
+        for line in f:
+            match = re.match(r'\s*#\s*define\s+(\w+)\s*\\?\s*$', line)
+            if match and match.group(1) not in names:
+                names.append(match.group(1))
+    return names
+
+
+def expand_songs(path, names):
+    source = '#include "%s"\n' % os.path.basename(path)
+    for name in names:
+        source += '__song__ "%s" SONG(%s)\n' % (name, name)
+    fd, source_path = tempfile.mkstemp(suffix='.c')
+    with os.fdopen(fd, 'w') as f:
+        f.write(source)
+    try:
+        cpp = shlex.split(os.environ.get('CPP', 'cc -E'))
+        output = subprocess.check_output(cpp + ['-P', '-I', os.path.dirname(os.path.abspath(path)), source_path])
+    finally:
+        os.remove(source_path)
+    songs = []
+    for line in output.decode().splitlines():
+        if line.startswith('__song__'):
+            _, name, notes = line.split(None, 2)
+            songs.append((name.strip('"'), NOTE_PATTERN.findall(notes)))
+    return songs
+
+
+def evaluate(expression):
+    return eval(expression, {'__builtins__': {}})
+
+
+def note_index(frequency):
+    semitones = 12 * math.log(frequency / BASE_FREQUENCY, 2)
+    note = int(round(semitones))
+    if abs(semitones - note) > 0.05 or not 0 <= note < SONG_NOTES:
+        raise ValueError('%.2f Hz is not a note of frequency_lut' % frequency)
+    return note
+
+
+def encode(notes):
+    items = []
+    duration = None
+    for frequency, length in notes:
+        frequency = evaluate(frequency)
+        length = evaluate(length)
+        if length != int(length) or not 0 <= length <= 0xFF:
+            raise ValueError('the duration %s can not be encoded' % length)
+        length = int(length)
+        if length != duration:
+            if length <= SONG_MAX_SHORT_DURATION:
+                items.append('SONG_DURATION(%d)' % length)
+            else:
+                items.append('SONG_LONG_DURATION(%d)' % length)
+            duration = length
+        items.append('SONG_REST' if frequency <= 0 else str(note_index(frequency)))
+    return items
+
+
+def convert(input_path, output_path):
+    lines = [
+        '/* Generated by song_converter.py from %s, do not edit */' % os.path.basename(input_path),
+        '',
+        '#ifndef SONG_LIST_COMPACT_H',
+        '#define SONG_LIST_COMPACT_H',
+        '',
+        '#include "song.h"',
+    ]
+    for name, notes in expand_songs(input_path, song_names(input_path)):
+        if not notes:
+            continue
+        try:
+            items = encode(notes)
+        except ValueError as e:
+            print('%s: %s, skipped' % (name, e), file=sys.stderr)
+            continue
+        lines.append('')
+        lines.append('#define %s_COMPACT \\' % name)
+        line = '   '
+        for item in items:
+            if len(line) + len(item) + 4 > LINE_WIDTH:
+                lines.append(line + ' \\')
+                line = '   '
+            line += ' ' + item + ','
+        lines.append(line)
+    lines += ['', '#endif', '']
+    with open(output_path, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    directory = os.path.dirname(os.path.abspath(__file__))
+    input_path = sys.argv[1] if len(sys.argv) > 1 else os.path.join(directory, 'song_list.h')
+    output_path = sys.argv[2] if len(sys.argv) > 2 else os.path.join(directory, 'song_list_compact.h')
+    convert(input_path, output_path)
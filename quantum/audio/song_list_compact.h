@@ -0,0 +1,93 @@
+/* Generated by song_converter.py from song_list.h, do not edit */
+
+#ifndef SONG_LIST_COMPACT_H
+#define SONG_LIST_COMPACT_H
+
+#include "song.h"
+
+#define COIN_SOUND_COMPACT \
+    SONG_DURATION(8), 58, SONG_DURATION(48), 65,
+
+#define ODE_TO_JOY_COMPACT \
+    SONG_DURATION(16), 41, 41, 42, 44, 44, 42, 41, 39, 37, 37, 39, 41, SONG_DURATION(24), 41, \
+    SONG_DURATION(8), 39, SONG_DURATION(32), 39,
+
+#define ROCK_A_BYE_BABY_COMPACT \
+    SONG_DURATION(24), 48, SONG_DURATION(8), 39, SONG_DURATION(16), 60, SONG_DURATION(32), 58, \
+    SONG_DURATION(16), 56, SONG_DURATION(24), 48, SONG_DURATION(8), 51, SONG_DURATION(16), 56, \
+    SONG_DURATION(32), 55,
+
+#define CLOSE_ENCOUNTERS_5_NOTE_COMPACT \
+    SONG_DURATION(16), 51, 53, 49, 37, 44,
+
+#define DOE_A_DEER_COMPACT \
+    SONG_DURATION(24), 37, SONG_DURATION(8), 39, SONG_DURATION(24), 41, SONG_DURATION(8), 37, \
+    SONG_DURATION(16), 41, 37, 41,
+
+#define IN_LIKE_FLINT_COMPACT \
+    SONG_DURATION(8), 47, 47, SONG_DURATION(24), 48, SONG_DURATION(8), 47, 48, SONG_DURATION(24), \
+    38, SONG_DURATION(8), 48, 38, SONG_DURATION(24), 40, SONG_DURATION(8), 38, 48, \
+    SONG_DURATION(24), 47, SONG_DURATION(8), 47, 47, SONG_DURATION(24), 48,
+
+#define GOODBYE_SOUND_COMPACT \
+    SONG_DURATION(8), 77, 70, SONG_DURATION(12), 65,
+
+#define STARTUP_SOUND_COMPACT \
+    SONG_DURATION(12), 77, SONG_DURATION(8), 74, 65, 70, SONG_DURATION(20), 74,
+
+#define QWERTY_SOUND_COMPACT \
+    SONG_DURATION(8), 69, 70, SONG_DURATION(4), SONG_REST, SONG_DURATION(16), 77,
+
+#define COLEMAK_SOUND_COMPACT \
+    SONG_DURATION(8), 69, 70, SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 77, \
+    SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 81,
+
+#define DVORAK_SOUND_COMPACT \
+    SONG_DURATION(8), 69, 70, SONG_DURATION(4), SONG_REST, SONG_DURATION(8), 77, SONG_DURATION(4), \
+    SONG_REST, SONG_DURATION(8), 79, SONG_DURATION(4), SONG_REST, SONG_DURATION(8), 77,
+
+#define PLOVER_SOUND_COMPACT \
+    SONG_DURATION(8), 69, 70, SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 77, \
+    SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 82,
+
+#define PLOVER_GOODBYE_SOUND_COMPACT \
+    SONG_DURATION(8), 69, 70, SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 82, \
+    SONG_DURATION(4), SONG_REST, SONG_DURATION(12), 77,
+
+#define MUSIC_SCALE_SOUND_COMPACT \
+    SONG_DURATION(8), 58, 60, 62, 63, 65, 67, 69, 70,
+
+#define CAPS_LOCK_ON_SOUND_COMPACT \
+    SONG_DURATION(8), 34, 36,
+
+#define CAPS_LOCK_OFF_SOUND_COMPACT \
+    SONG_DURATION(8), 36, 34,
+
+#define SCROLL_LOCK_ON_SOUND_COMPACT \
+    SONG_DURATION(8), 39, 41,
+
+#define SCROLL_LOCK_OFF_SOUND_COMPACT \
+    SONG_DURATION(8), 41, 39,
+
+#define NUM_LOCK_ON_SOUND_COMPACT \
+    SONG_DURATION(8), 51, 53,
+
+#define NUM_LOCK_OFF_SOUND_COMPACT \
+    SONG_DURATION(8), 53, 51,
+
+#define UNICODE_WINDOWS_COMPACT \
+    SONG_DURATION(8), 60, SONG_DURATION(4), 65,
+
+#define UNICODE_LINUX_COMPACT \
+    SONG_DURATION(8), 65, SONG_DURATION(4), 60,
+
+#define ONE_UP_SOUND_COMPACT \
+    SONG_DURATION(16), 65, 68, 77, 73, 75, 80,
+
+#define SONIC_RING_COMPACT \
+    SONG_DURATION(8), 65, 68, SONG_DURATION(48), 73,
+
+#define ZELDA_PUZZLE_COMPACT \
+    SONG_DURATION(16), 56, 55, 52, 46, 45, 53, 57, SONG_DURATION(48), 61,
+
+#endif
@@ -19,10 +19,28 @@
 
 // these are imported from audio.c
 extern uint16_t envelope_index;
-extern float note_timbre;
-extern float polyphony_rate;
+extern uint8_t note_duty;
+extern uint32_t polyphony_ticks;
 extern bool glissando;
 
+// The pitches of the drum frequencies
+#define PITCH_60HZ   5891
+#define PITCH_80HZ   8440
+#define PITCH_100HZ  10419
+#define PITCH_160HZ  14584
+#define PITCH_320HZ  20728
+#define PITCH_640HZ  26871
+#define PITCH_1KHZ   30825
+#define PITCH_1280HZ 33018
+#define PITCH_2KHZ   36966
+#define PITCH_3KHZ   40563
+#define PITCH_5KHZ   45081
+
+// The duty cycles are in 1/256 of the period
+#define DUTY_12 32
+#define DUTY_25 64
+#define DUTY_50 128
+
 voice_type voice = default_voice;
 
 void set_voice(voice_type v) {
@@ -37,45 +55,65 @@ void voice_deiterate() {
     voice = (voice - 1 + number_of_voices) % number_of_voices;
 }
 
-float voice_envelope(float frequency) {
-    // envelope_index ranges from 0 to 0xFFFF, which is preserved at 880.0 Hz
+#ifdef AUDIO_VOICES
+
+static uint16_t offset_pitch(uint16_t pitch, int16_t offset) {
+    int32_t result = (int32_t)pitch + offset;
+    if (result < 0) {
+        return 0;
+    }
+    if (result > PITCH_MAX) {
+        return PITCH_MAX;
+    }
+    return result;
+}
+
+static uint16_t random_pitch(uint16_t low, uint16_t high) {
+    return (rand() % (high - low)) + low;
+}
+
+#endif
+
+uint16_t voice_envelope(uint16_t pitch) {
+    // envelope_index ranges from 0 to 0xFFFF, which is preserved at 880.0 Hz,
+    // the period is 2 MHz / frequency, so this is index * period * 880 / 2 MHz
     __attribute__ ((unused))
-    uint16_t compensated_index = (uint16_t)((float)envelope_index * (880.0 / frequency));
+    uint16_t compensated_index = ((uint32_t)envelope_index * (((uint32_t)audio_pitch_period(pitch) * 461) >> 9)) >> 11;
 
     switch (voice) {
         case default_voice:
             glissando = false;
-            note_timbre = TIMBRE_50;
-            polyphony_rate = 0;
+            note_duty = DUTY_50;
+            polyphony_ticks = 0;
 	        break;
 
     #ifdef AUDIO_VOICES
 
         case something:
             glissando = false;
-            polyphony_rate = 0;
+            polyphony_ticks = 0;
             switch (compensated_index) {
                 case 0 ... 9:
-                    note_timbre = TIMBRE_12;
+                    note_duty = DUTY_12;
                     break;
 
                 case 10 ... 19:
-                    note_timbre = TIMBRE_25;
+                    note_duty = DUTY_25;
                     break;
 
                 case 20 ... 200:
-                    note_timbre = .125 + .125;
+                    note_duty = DUTY_12 + DUTY_12;
                     break;
 
                 default:
-                    note_timbre = .125;
+                    note_duty = DUTY_12;
                     break;
             }
             break;
 
         case drums:
             glissando = false;
-            polyphony_rate = 0;
+            polyphony_ticks = 0;
                 // switch (compensated_index) {
                 //     case 0 ... 10:
                 //         note_timbre = 0.5;
@@ -89,70 +127,71 @@ float voice_envelope(float frequency) {
                 // }
                 // frequency = (rand() % (int)(frequency * 1.2 - frequency)) + (frequency * 0.8);
 
-            if (frequency < 80.0) {
+            // The fades divide by 10, 15 and 5 with a multiplication
+            if (pitch < PITCH_80HZ) {
 
-            } else if (frequency < 160.0) {
+            } else if (pitch < PITCH_160HZ) {
 
                 // Bass drum: 60 - 100 Hz
-                frequency = (rand() % (int)(40)) + 60;
+                pitch = random_pitch(PITCH_60HZ, PITCH_100HZ);
                 switch (envelope_index) {
                     case 0 ... 10:
-                        note_timbre = 0.5;
+                        note_duty = DUTY_50;
                         break;
                     case 11 ... 20:
-                        note_timbre = 0.5 * (21 - envelope_index) / 10;
+                        note_duty = ((21 - envelope_index) * 205) >> 4;
                         break;
                     default:
-                        note_timbre = 0;
+                        note_duty = 0;
                         break;
                 }
 
-            } else if (frequency < 320.0) {
+            } else if (pitch < PITCH_320HZ) {
 
 
                 // Snare drum: 1 - 2 KHz
-                frequency = (rand() % (int)(1000)) + 1000;
+                pitch = random_pitch(PITCH_1KHZ, PITCH_2KHZ);
                 switch (envelope_index) {
                     case 0 ... 5:
-                        note_timbre = 0.5;
+                        note_duty = DUTY_50;
                         break;
                     case 6 ... 20:
-                        note_timbre = 0.5 * (21 - envelope_index) / 15;
+                        note_duty = ((21 - envelope_index) * 137) >> 4;
                         break;
                     default:
-                        note_timbre = 0;
+                        note_duty = 0;
                         break;
                 }
 
-            } else if (frequency < 640.0) {
+            } else if (pitch < PITCH_640HZ) {
 
                 // Closed Hi-hat: 3 - 5 KHz
-                frequency = (rand() % (int)(2000)) + 3000;
+                pitch = random_pitch(PITCH_3KHZ, PITCH_5KHZ);
                 switch (envelope_index) {
                     case 0 ... 15:
-                        note_timbre = 0.5;
+                        note_duty = DUTY_50;
                         break;
                     case 16 ... 20:
-                        note_timbre = 0.5 * (21 - envelope_index) / 5;
+                        note_duty = ((21 - envelope_index) * 205) >> 3;
                         break;
                     default:
-                        note_timbre = 0;
+                        note_duty = 0;
                         break;
                 }
 
-            } else if (frequency < 1280.0) {
+            } else if (pitch < PITCH_1280HZ) {
 
                 // Open Hi-hat: 3 - 5 KHz
-                frequency = (rand() % (int)(2000)) + 3000;
+                pitch = random_pitch(PITCH_3KHZ, PITCH_5KHZ);
                 switch (envelope_index) {
                     case 0 ... 35:
-                        note_timbre = 0.5;
+                        note_duty = DUTY_50;
                         break;
                     case 36 ... 50:
-                        note_timbre = 0.5 * (51 - envelope_index) / 15;
+                        note_duty = ((51 - envelope_index) * 137) >> 4;
                         break;
                     default:
-                        note_timbre = 0;
+                        note_duty = 0;
                         break;
                 }
 
@@ -160,24 +199,26 @@ float voice_envelope(float frequency) {
             break;
         case butts_fader:
             glissando = true;
-            polyphony_rate = 0;
+            polyphony_ticks = 0;
             switch (compensated_index) {
                 case 0 ... 9:
-                    frequency = frequency / 4;
-                    note_timbre = TIMBRE_12;
+                    // two octaves down
+                    pitch = offset_pitch(pitch, -96 * 128);
+                    note_duty = DUTY_12;
 	                break;
 
                 case 10 ... 19:
-                    frequency = frequency / 2;
-                    note_timbre = TIMBRE_12;
+                    pitch = offset_pitch(pitch, -48 * 128);
+                    note_duty = DUTY_12;
 	                break;
 
                 case 20 ... 200:
-                    note_timbre = .125 - pow(((float)compensated_index - 20) / (200 - 20), 2)*.125;
+                    // (index - 20)^2 / 180^2 of DUTY_12
+                    note_duty = DUTY_12 - (((uint16_t)(compensated_index - 20) * (compensated_index - 20)) >> 10);
 	                break;
 
                 default:
-                    note_timbre = 0;
+                    note_duty = 0;
                 	break;
             }
     	    break;
@@ -208,39 +249,36 @@ float voice_envelope(float frequency) {
         case duty_osc:
             // This slows the loop down a substantial amount, so higher notes may freeze
             glissando = true;
-            polyphony_rate = 0;
+            polyphony_ticks = 0;
             switch (compensated_index) {
                 default:
                     #define OCS_SPEED 10
-                    #define OCS_AMP   .25
-                    // sine wave is slow
-                    // note_timbre = (sin((float)compensated_index/10000*OCS_SPEED) * OCS_AMP / 2) + .5;
-                    // triangle wave is a bit faster
-                    note_timbre = (float)abs((compensated_index*OCS_SPEED % 3000) - 1500) * ( OCS_AMP / 1500 ) + (1 - OCS_AMP) / 2;
+                    // triangle wave between 96 / 256 and 160 / 256, 1500 * 11 / 256 is 64
+                    note_duty = ((abs((int16_t)((uint16_t)(compensated_index * OCS_SPEED) % 3000) - 1500) * 11) >> 8) + 96;
                 	break;
             }
 	        break;
 
         case duty_octave_down:
             glissando = true;
-            polyphony_rate = 0;
-            note_timbre = (envelope_index % 2) * .125 + .375 * 2;
+            polyphony_ticks = 0;
+            note_duty = (envelope_index % 2) * DUTY_12 + DUTY_25 * 3;
             if ((envelope_index % 4) == 0)
-                note_timbre = 0.5;
+                note_duty = DUTY_50;
             if ((envelope_index % 8) == 0)
-                note_timbre = 0;
+                note_duty = 0;
             break;
         case delayed_vibrato:
             glissando = true;
-            polyphony_rate = 0;
-            note_timbre = TIMBRE_50;
+            polyphony_ticks = 0;
+            note_duty = DUTY_50;
             #define VOICE_VIBRATO_DELAY 150
             #define VOICE_VIBRATO_SPEED 50
             switch (compensated_index) {
                 case 0 ... VOICE_VIBRATO_DELAY:
                     break;
                 default:
-                    frequency = frequency * vibrato_lut[(int)fmod((((float)compensated_index - (VOICE_VIBRATO_DELAY + 1))/1000*VOICE_VIBRATO_SPEED), VIBRATO_LUT_LENGTH)];
+                    pitch = offset_pitch(pitch, (int8_t)pgm_read_byte(&vibrato_lut[((compensated_index - (VOICE_VIBRATO_DELAY + 1)) / (1000 / VOICE_VIBRATO_SPEED)) % VIBRATO_LUT_LENGTH]));
                     break;
             }
             break;
@@ -292,5 +330,5 @@ float voice_envelope(float frequency) {
    			break;
     }
 
-    return frequency;
+    return pitch;
 }
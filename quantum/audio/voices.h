@@ -15,14 +15,16 @@
  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/io.h>
-#include <util/delay.h>
+#if defined(__AVR__)
+  #include <avr/io.h>
+  #include <util/delay.h>
+#endif
 #include "luts.h"
 
 #ifndef VOICES_H
 #define VOICES_H
 
-float voice_envelope(float frequency);
+uint16_t voice_envelope(uint16_t pitch);
 
 typedef enum {
     default_voice,
@@ -0,0 +1,201 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "expander_matrix.h"
+#include "timer.h"
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+typedef enum {
+    PHASE_SELECT_START,
+    PHASE_SELECT_ADDRESS,
+    PHASE_SELECT_REGISTER,
+    PHASE_SELECT_DATA,
+    PHASE_READ_START,
+    PHASE_READ_ADDRESS,
+    PHASE_READ_REGISTER,
+    PHASE_READ_RESTART,
+    PHASE_READ_SLA,
+    PHASE_READ_DATA,
+} scan_phase_t;
+
+#define TWI_START (_BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+#define TWI_CONTINUE (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define TWI_STOP (_BV(TWINT) | _BV(TWSTO) | _BV(TWEN))
+// A stop condition takes a few microseconds even on a 100kHz bus, this is
+// a few times that
+#define STOP_LOOP_TIMEOUT (F_CPU / 100000)
+
+static expander_matrix_config_t config;
+static volatile expander_matrix_status_t status = EXPANDER_MATRIX_IDLE;
+static uint8_t phase;
+static uint8_t row;
+static uint8_t scan_cols[EXPANDER_MATRIX_MAX_ROWS];
+static uint16_t scan_start;
+
+void expander_matrix_init(const expander_matrix_config_t* _config) {
+    config = *_config;
+    if (config.rows > EXPANDER_MATRIX_MAX_ROWS) {
+        config.rows = EXPANDER_MATRIX_MAX_ROWS;
+    }
+    status = EXPANDER_MATRIX_IDLE;
+}
+
+static void reset_twi(void) {
+    TWCR = 0;
+    TWCR = _BV(TWEN);
+}
+
+bool expander_matrix_start(void) {
+    if (status == EXPANDER_MATRIX_BUSY) {
+        return false;
+    }
+    // The stop condition of the last transfer might still be going on
+    uint16_t lim = 0;
+    while ((TWCR & _BV(TWSTO)) && lim < STOP_LOOP_TIMEOUT) {
+        lim++;
+    }
+    if (TWCR & _BV(TWSTO)) {
+        // Something holds the bus, the scan runs into the timeout if it
+        // still does after the reset
+        reset_twi();
+    }
+    row = 0;
+    phase = PHASE_SELECT_START;
+    scan_start = timer_read();
+    status = EXPANDER_MATRIX_BUSY;
+    TWCR = TWI_START;
+    return true;
+}
+
+expander_matrix_status_t expander_matrix_update(uint8_t* cols) {
+    expander_matrix_status_t current = status;
+    if (current == EXPANDER_MATRIX_BUSY) {
+        if (timer_elapsed(scan_start) <= EXPANDER_MATRIX_TIMEOUT) {
+            return current;
+        }
+        // The scan might finish right now, so check again with the
+        // interrupts off before resetting the TWI under it
+        uint8_t sreg = SREG;
+        cli();
+        current = status;
+        if (current == EXPANDER_MATRIX_BUSY) {
+            // The bus is stuck
+            reset_twi();
+            status = EXPANDER_MATRIX_IDLE;
+            SREG = sreg;
+            return EXPANDER_MATRIX_ERROR;
+        }
+        SREG = sreg;
+    }
+    if (current == EXPANDER_MATRIX_DONE) {
+        memcpy(cols, scan_cols, config.rows);
+    }
+    status = EXPANDER_MATRIX_IDLE;
+    return current;
+}
+
+void expander_matrix_abort(void) {
+    uint8_t sreg = SREG;
+    cli();
+    if (status == EXPANDER_MATRIX_BUSY) {
+        // Release the bus, the expander drops a transfer without a stop
+        // when it sees the next start
+        reset_twi();
+    }
+    status = EXPANDER_MATRIX_IDLE;
+    SREG = sreg;
+}
+
+static inline void finish(expander_matrix_status_t result) {
+    TWCR = TWI_STOP;
+    status = result;
+}
+
+ISR(TWI_vect) {
+    uint8_t twi_status = TW_STATUS;
+    switch (phase) {
+    case PHASE_SELECT_START:
+    case PHASE_READ_START:
+    case PHASE_READ_RESTART:
+        if (twi_status != TW_START && twi_status != TW_REP_START) {
+            break;
+        }
+        TWDR = phase == PHASE_READ_RESTART ? (config.address << 1) | TW_READ : (config.address << 1) | TW_WRITE;
+        TWCR = TWI_CONTINUE;
+        phase++;
+        return;
+    case PHASE_SELECT_ADDRESS:
+    case PHASE_READ_ADDRESS:
+        if (twi_status != TW_MT_SLA_ACK) {
+            break;
+        }
+        TWDR = phase == PHASE_SELECT_ADDRESS ? config.row_register : config.col_register;
+        TWCR = TWI_CONTINUE;
+        phase++;
+        return;
+    case PHASE_SELECT_REGISTER:
+        if (twi_status != TW_MT_DATA_ACK) {
+            break;
+        }
+        // Select the row, or unselect all of them after the last one
+        TWDR = row < config.rows ? 0xFF & ~(1 << row) : 0xFF;
+        TWCR = TWI_CONTINUE;
+        phase++;
+        return;
+    case PHASE_SELECT_DATA:
+        if (twi_status != TW_MT_DATA_ACK) {
+            break;
+        }
+        if (row == config.rows) {
+            finish(EXPANDER_MATRIX_DONE);
+            return;
+        }
+        // The address and register bytes of the read are the settle time
+        TWCR = TWI_START;
+        phase = PHASE_READ_START;
+        return;
+    case PHASE_READ_REGISTER:
+        if (twi_status != TW_MT_DATA_ACK) {
+            break;
+        }
+        TWCR = TWI_START;
+        phase++;
+        return;
+    case PHASE_READ_SLA:
+        if (twi_status != TW_MR_SLA_ACK) {
+            break;
+        }
+        // Only one byte, so it's not acknowledged
+        TWCR = TWI_CONTINUE;
+        phase++;
+        return;
+    case PHASE_READ_DATA:
+        if (twi_status != TW_MR_DATA_NACK) {
+            break;
+        }
+        scan_cols[row] = ~TWDR & config.col_mask;
+        row++;
+        // Select the next row in the same transaction
+        TWCR = TWI_START;
+        phase = PHASE_SELECT_START;
+        return;
+    }
+    // Not acknowledged, or the arbitration was lost
+    finish(EXPANDER_MATRIX_ERROR);
+}
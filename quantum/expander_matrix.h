@@ -0,0 +1,75 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXPANDER_MATRIX_H
+#define EXPANDER_MATRIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Scans the rows of a keyboard half that sits behind an MCP23017/MCP23018
+ * style I2C GPIO expander, with one port driving the rows and the other
+ * port reading the columns.
+ *
+ * The whole scan is a single I2C transaction run by the TWI interrupt. For
+ * each row the row port is written and the column port read back, chained
+ * with repeated starts, and the address and register bytes of the read give
+ * the row time to settle, so nothing busy waits. The main loop starts a
+ * scan, scans its own rows while the transfer runs, and picks up the columns
+ * once it's done.
+ *
+ * The TWI has to be initialized already, for example by i2c_init(), and
+ * nothing else may use it while a scan is running.
+ */
+
+#ifndef EXPANDER_MATRIX_MAX_ROWS
+#define EXPANDER_MATRIX_MAX_ROWS 8
+#endif
+
+// Milliseconds before a scan that doesn't finish is given up
+#ifndef EXPANDER_MATRIX_TIMEOUT
+#define EXPANDER_MATRIX_TIMEOUT 5
+#endif
+
+typedef struct {
+    // 7-bit I2C address
+    uint8_t address;
+    uint8_t rows;
+    // GPIO register of the port driving the rows, row n is bit n, active low
+    uint8_t row_register;
+    // GPIO register of the port the columns are read from
+    uint8_t col_register;
+    // Bits of the column port that are connected to columns
+    uint8_t col_mask;
+} expander_matrix_config_t;
+
+typedef enum {
+    EXPANDER_MATRIX_IDLE,
+    EXPANDER_MATRIX_BUSY,
+    EXPANDER_MATRIX_DONE,
+    EXPANDER_MATRIX_ERROR,
+} expander_matrix_status_t;
+
+void expander_matrix_init(const expander_matrix_config_t* config);
+// Starts a new scan, unless the previous one is still running
+bool expander_matrix_start(void);
+// Returns DONE or ERROR once when a scan finishes. The columns of each row
+// are only written when it's DONE, with a set bit for a pressed key.
+expander_matrix_status_t expander_matrix_update(uint8_t* cols);
+// Stops a running scan, before something else uses the TWI
+void expander_matrix_abort(void);
+
+#endif
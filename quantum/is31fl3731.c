@@ -0,0 +1,203 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "is31fl3731.h"
+#include <string.h>
+
+#define IS31_COMMANDREGISTER 0xFD
+#define IS31_FUNCTIONREG 0x0B    // helpfully called 'page nine'
+#define IS31_FUNCTIONREG_SIZE 0x0D
+#define IS31_NUM_FRAMES 8
+
+#define IS31_REG_PICTDISP 0x01 // D2:D0 frame select for picture mode
+#define IS31_REG_SHUTDOWN 0x0A
+#define IS31_REG_SHUTDOWN_OFF 0x0
+#define IS31_REG_SHUTDOWN_ON 0x1
+
+#define IS31_LED_CONTROL_REG 0x00
+#define IS31_BLINK_REG 0x12
+#define IS31_PWM_REG 0x24
+
+#define NO_PAGE 0xFF
+
+static const is31fl3731_config_t* config;
+
+// Written by the user
+static uint8_t shadow[IS31FL3731_PWM_SIZE];
+// The snapshot of the last flush, protected by the system lock
+static uint8_t pending[IS31FL3731_PWM_SIZE];
+static bool pending_shutdown;
+// The contents of the two banks that are used, only used by the thread
+static uint8_t banks[2][IS31FL3731_PWM_SIZE];
+static uint8_t displayed_bank;
+static uint8_t selected_page = NO_PAGE;
+static bool shutdown;
+// The register address followed by the data of a burst
+static uint8_t tx_buffer[IS31FL3731_PWM_SIZE + 1];
+
+static binary_semaphore_t flush_semaphore;
+
+static void write_data(const uint8_t* data, size_t length) {
+    i2cMasterTransmitTimeout(config->i2c, config->address, data, length, NULL, 0, US2ST(IS31FL3731_TIMEOUT));
+}
+
+static void select_page(uint8_t page) {
+    if (page != selected_page) {
+        uint8_t tx[2] = {IS31_COMMANDREGISTER, page};
+        write_data(tx, 2);
+        selected_page = page;
+    }
+}
+
+static void write_register(uint8_t page, uint8_t reg, uint8_t data) {
+    uint8_t tx[2] = {reg, data};
+    select_page(page);
+    write_data(tx, 2);
+}
+
+static void write_burst(uint8_t page, uint8_t reg, const uint8_t* data, uint8_t length) {
+    select_page(page);
+    tx_buffer[0] = reg;
+    memcpy(&tx_buffer[1], data, length);
+    write_data(tx_buffer, length + 1);
+}
+
+// Writes the frame to the hidden bank, and displays it
+static void write_frame(void) {
+    uint8_t bank = displayed_bank ^ 1;
+    uint8_t* contents = banks[bank];
+    uint8_t dirty[IS31FL3731_PWM_SIZE / 8] = {0};
+    bool changed = false;
+
+    // The hidden bank was last written two flushes ago, so it can be
+    // missing the changes of the last flush as well
+    chSysLock();
+    for (uint8_t i = 0; i < IS31FL3731_PWM_SIZE; i++) {
+        if (contents[i] != pending[i]) {
+            contents[i] = pending[i];
+            dirty[i / 8] |= 1 << (i % 8);
+            changed = true;
+        }
+    }
+    chSysUnlock();
+
+    if (!changed) {
+        return;
+    }
+
+    uint8_t start = 0;
+    while (start < IS31FL3731_PWM_SIZE) {
+        if (!(dirty[start / 8] & (1 << (start % 8)))) {
+            start++;
+            continue;
+        }
+        // Extend the burst over the small gaps
+        uint8_t end = start + 1;
+        uint8_t gap = 0;
+        for (uint8_t i = end; i < IS31FL3731_PWM_SIZE && gap <= IS31FL3731_MAX_GAP; i++) {
+            if (dirty[i / 8] & (1 << (i % 8))) {
+                end = i + 1;
+                gap = 0;
+            }
+            else {
+                gap++;
+            }
+        }
+        write_burst(bank, IS31_PWM_REG + start, &contents[start], end - start);
+        start = end;
+    }
+
+    write_register(IS31_FUNCTIONREG, IS31_REG_PICTDISP, bank);
+    displayed_bank = bank;
+}
+
+static THD_WORKING_AREA(is31fl3731ThreadStack, 256);
+static THD_FUNCTION(is31fl3731Thread, arg) {
+    (void)arg;
+    chRegSetThreadName("is31fl3731");
+    while (true) {
+        chBSemWait(&flush_semaphore);
+
+        chSysLock();
+        bool new_shutdown = pending_shutdown;
+        chSysUnlock();
+
+        if (new_shutdown != shutdown && new_shutdown) {
+            write_register(IS31_FUNCTIONREG, IS31_REG_SHUTDOWN, IS31_REG_SHUTDOWN_OFF);
+        }
+        write_frame();
+        if (new_shutdown != shutdown && !new_shutdown) {
+            write_register(IS31_FUNCTIONREG, IS31_REG_SHUTDOWN, IS31_REG_SHUTDOWN_ON);
+        }
+        shutdown = new_shutdown;
+    }
+}
+
+void is31fl3731_init(const is31fl3731_config_t* c) {
+    config = c;
+    selected_page = NO_PAGE;
+
+    // software shutdown, and zero all the function registers
+    memset(tx_buffer, 0, sizeof(tx_buffer));
+    write_burst(IS31_FUNCTIONREG, 0, tx_buffer, IS31_FUNCTIONREG_SIZE);
+    chThdSleepMilliseconds(10);
+
+    // enable the LEDs of the mask on all the frames, and zero their blink
+    // and PWM registers
+    for (uint8_t i = 0; i < IS31_NUM_FRAMES; i++) {
+        write_burst(i, IS31_LED_CONTROL_REG, config->led_mask, IS31FL3731_LED_MASK_SIZE);
+        write_burst(i, IS31_BLINK_REG, tx_buffer, IS31FL3731_LED_MASK_SIZE);
+        write_burst(i, IS31_PWM_REG, tx_buffer, IS31FL3731_PWM_SIZE);
+        chThdSleepMilliseconds(1);
+    }
+    memset(shadow, 0, sizeof(shadow));
+    memset(pending, 0, sizeof(pending));
+    memset(banks, 0, sizeof(banks));
+    displayed_bank = 0;
+    write_register(IS31_FUNCTIONREG, IS31_REG_PICTDISP, displayed_bank);
+
+    // The chip is left in the software shutdown, until it's turned on
+    shutdown = true;
+    pending_shutdown = true;
+
+    chBSemObjectInit(&flush_semaphore, true);
+    chThdCreateStatic(is31fl3731ThreadStack, sizeof(is31fl3731ThreadStack),
+            IS31FL3731_THREAD_PRIORITY, is31fl3731Thread, NULL);
+}
+
+void is31fl3731_set_pwm(uint8_t led, uint8_t value) {
+    if (led < IS31FL3731_PWM_SIZE) {
+        shadow[led] = value;
+    }
+}
+
+uint8_t is31fl3731_get_pwm(uint8_t led) {
+    return led < IS31FL3731_PWM_SIZE ? shadow[led] : 0;
+}
+
+void is31fl3731_flush(void) {
+    chSysLock();
+    memcpy(pending, shadow, sizeof(pending));
+    chSysUnlock();
+    chBSemSignal(&flush_semaphore);
+}
+
+void is31fl3731_set_shutdown(bool s) {
+    chSysLock();
+    pending_shutdown = s;
+    chSysUnlock();
+    chBSemSignal(&flush_semaphore);
+}
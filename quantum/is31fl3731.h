@@ -0,0 +1,75 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IS31FL3731_H
+#define IS31FL3731_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ch.h"
+#include "hal.h"
+
+/* Driver for the IS31FL3731 LED matrix controller, for ChibiOS.
+ *
+ * The PWM values are written to a shadow frame, and nothing is sent until
+ * is31fl3731_flush is called. The flush only takes a snapshot of the frame,
+ * the I2C transfers are done by a thread of the driver, so the caller never
+ * waits for the bus. The thread writes the frame to the bank of the chip
+ * that isn't displayed, and then switches to it, so a frame is never seen
+ * half written. Only the registers that differ from what the bank already
+ * contains are written, in auto-increment bursts.
+ *
+ * The driver thread is the only user of the I2C bus after the init.
+ */
+
+#define IS31FL3731_PWM_SIZE 144
+#define IS31FL3731_LED_MASK_SIZE 18
+
+// Microseconds before an I2C transfer is given up
+#ifndef IS31FL3731_TIMEOUT
+#define IS31FL3731_TIMEOUT 5000
+#endif
+
+#ifndef IS31FL3731_THREAD_PRIORITY
+#define IS31FL3731_THREAD_PRIORITY (NORMALPRIO - 1)
+#endif
+
+// Unchanged registers between two changed ones that are sent anyway, since
+// a new burst costs more than a few extra bytes
+#ifndef IS31FL3731_MAX_GAP
+#define IS31FL3731_MAX_GAP 3
+#endif
+
+typedef struct {
+    // The I2C driver has to be started already
+    I2CDriver* i2c;
+    // 7-bit I2C address
+    uint8_t address;
+    // Enabled LEDs, in the format of the LED control registers
+    const uint8_t* led_mask;
+} is31fl3731_config_t;
+
+// Initializes the chip and starts the driver thread, this waits for the
+// transfers, unlike the rest of the functions
+void is31fl3731_init(const is31fl3731_config_t* config);
+// The led is the index of the PWM register, 16 per row of the matrix
+void is31fl3731_set_pwm(uint8_t led, uint8_t value);
+uint8_t is31fl3731_get_pwm(uint8_t led);
+// Sends the changes of the shadow frame to the chip
+void is31fl3731_flush(void);
+void is31fl3731_set_shutdown(bool shutdown);
+
+#endif
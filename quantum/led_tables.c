@@ -49,6 +49,22 @@ const uint8_t CIE1931_CURVE[] PROGMEM = {
     };
 #endif
 
+#ifdef USE_CIE1931_CURVE_16
+// The same curve with 16 bit output, for 16 bit PWM timers. The lightness of
+// the entry i is i * 4 / 256, so the lightness 255 can be interpolated too.
+const uint16_t CIE1931_CURVE_16[] PROGMEM = {
+    0, 113, 227, 340, 454, 567, 686, 821,
+    972, 1141, 1328, 1535, 1762, 2010, 2281, 2575,
+    2894, 3237, 3607, 4004, 4429, 4883, 5367, 5882,
+    6429, 7009, 7623, 8272, 8956, 9677, 10436, 11234,
+    12071, 12948, 13868, 14830, 15835, 16885, 17980, 19121,
+    20310, 21547, 22833, 24170, 25558, 26997, 28490, 30037,
+    31639, 33297, 35012, 36785, 38616, 40507, 42460, 44473,
+    46550, 48690, 50895, 53166, 55503, 57907, 60380, 62922,
+    65535,
+    };
+#endif
+
 #ifdef USE_LED_BREATHING_TABLE
 const uint8_t LED_BREATHING_TABLE[] PROGMEM = {
   0, 0, 0, 0, 1, 1, 1, 2, 2, 3, 4, 5, 5, 6, 7, 9,
@@ -23,6 +23,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern const uint8_t CIE1931_CURVE[] PROGMEM;
 #endif
 
+#ifdef USE_CIE1931_CURVE_16
+// 65 entries, for interpolating a lightness of 0-256 in steps of 4
+extern const uint16_t CIE1931_CURVE_16[] PROGMEM;
+#endif
+
 #ifdef USE_LED_BREATHING_TABLE
 extern const uint8_t LED_BREATHING_TABLE[] PROGMEM;
 #endif
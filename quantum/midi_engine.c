@@ -0,0 +1,429 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "process_midi.h"
+
+#if defined(MIDI_ENABLE) && defined(MIDI_ENGINE)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "midi_engine.h"
+
+#ifndef MIDI_ADVANCED
+#error "MIDI_ENGINE needs MIDI_ADVANCED"
+#endif
+
+#if !defined(__AVR_ATmega32U4__) && !defined(__AVR_ATmega16U4__)
+#error "MIDI_ENGINE needs timer 4 of the ATmega32U4 or ATmega16U4"
+#endif
+
+// The timer runs at F_CPU / 16, and overflows at TICK_TOP every 100 us
+#define TICK_TOP (F_CPU / 16 / 10000 - 1)
+// A pulse is 600000 / 24 / tempo ticks long. The phase is advanced by the
+// tempo every tick, so that the pulses are exact on average.
+#define PULSE_PHASE (600000UL / MIDI_ENGINE_PPQN)
+
+// Keeps the interrupt of the clock from running while the state is changed,
+// so that the state and the queue of midi_engine_send only have one writer
+#define ENGINE_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+
+// The step lengths in pulses, from a 32nd note to a quarter note
+static const uint8_t step_lengths[] = {3, 4, 6, 8, 12, 16, 24};
+#define STEP_LENGTH_DEFAULT 2
+#define NUM_STEP_LENGTHS (sizeof(step_lengths) / sizeof(step_lengths[0]))
+
+static bool clock_running;
+static bool clock_external;
+static uint16_t clock_tempo;
+static uint16_t clock_phase;
+static uint8_t step_length;
+static uint8_t step_pulse;
+
+typedef struct {
+    uint8_t note;
+    uint8_t velocity;
+} engine_note_t;
+
+static bool arp_enabled;
+static midi_arp_mode_t arp_mode;
+// The held notes, sorted from the lowest
+static engine_note_t arp_notes[MIDI_ARP_MAX_NOTES];
+static uint8_t arp_count;
+static int8_t arp_position;
+static int8_t arp_direction;
+static uint8_t arp_random;
+static uint8_t arp_playing;
+static uint8_t arp_channel;
+
+static bool sequencer_playing;
+static bool sequencer_recording;
+static engine_note_t sequencer_steps[MIDI_SEQUENCER_STEPS];
+static uint8_t sequencer_length;
+static uint8_t sequencer_position;
+static uint8_t sequencer_playing_note;
+static uint8_t sequencer_channel;
+
+static void timer_start(void) {
+    clock_phase = PULSE_PHASE - 1;
+    TC4H = 0;
+    TCNT4 = 0;
+    TIFR4 = _BV(TOV4);
+    // Clock Select (CS4n) = 0b0101 = Clock / 16
+    TCCR4B = _BV(CS42) | _BV(CS40);
+}
+
+static void timer_stop(void) {
+    TCCR4B = 0;
+}
+
+static void send_note_on(uint8_t channel, uint8_t note, uint8_t velocity) {
+    midi_engine_send(3, MIDI_NOTEON | channel, note, velocity);
+}
+
+static void send_note_off(uint8_t channel, uint8_t note) {
+    midi_engine_send(3, MIDI_NOTEOFF | channel, note, 0);
+}
+
+static void arp_release(void) {
+    if (arp_playing != MIDI_INVALID_NOTE) {
+        send_note_off(arp_channel, arp_playing);
+        arp_playing = MIDI_INVALID_NOTE;
+    }
+}
+
+static void arp_step(void) {
+    arp_release();
+    if (!arp_enabled || arp_count == 0) {
+        arp_position = -1;
+        return;
+    }
+
+    switch (arp_mode) {
+        case MIDI_ARP_UP:
+            arp_position = arp_position + 1 < arp_count ? arp_position + 1 : 0;
+            break;
+        case MIDI_ARP_DOWN:
+            arp_position = arp_position > 0 && arp_position <= arp_count ? arp_position - 1 : arp_count - 1;
+            break;
+        case MIDI_ARP_UP_DOWN:
+            if (arp_position < 0 || arp_count == 1) {
+                arp_position = 0;
+                arp_direction = 1;
+                break;
+            }
+            if (arp_position + arp_direction >= arp_count || arp_position + arp_direction < 0) {
+                arp_direction = -arp_direction;
+            }
+            arp_position += arp_direction;
+            if (arp_position >= arp_count) {
+                arp_position = arp_count - 1;
+            }
+            break;
+        default:
+            // Xorshift, which is cheap enough for the interrupt
+            arp_random ^= arp_random << 3;
+            arp_random ^= arp_random >> 5;
+            arp_random ^= arp_random << 4;
+            arp_position = arp_random % arp_count;
+            break;
+    }
+
+    engine_note_t* note = &arp_notes[arp_position];
+    arp_channel = midi_config.channel;
+    arp_playing = note->note;
+    send_note_on(arp_channel, note->note, note->velocity);
+}
+
+static void sequencer_release(void) {
+    if (sequencer_playing_note != MIDI_INVALID_NOTE) {
+        send_note_off(sequencer_channel, sequencer_playing_note);
+        sequencer_playing_note = MIDI_INVALID_NOTE;
+    }
+}
+
+static void sequencer_step(void) {
+    sequencer_release();
+    if (!sequencer_playing || sequencer_length == 0) {
+        return;
+    }
+    if (sequencer_position >= sequencer_length) {
+        sequencer_position = 0;
+    }
+    engine_note_t* step = &sequencer_steps[sequencer_position++];
+    if (step->note != MIDI_INVALID_NOTE) {
+        sequencer_channel = midi_config.channel;
+        sequencer_playing_note = step->note;
+        send_note_on(sequencer_channel, step->note, step->velocity);
+    }
+}
+
+static void engine_reset(void) {
+    step_pulse = 0;
+    arp_position = -1;
+    sequencer_position = 0;
+}
+
+static void engine_stop(void) {
+    clock_running = false;
+    arp_release();
+    sequencer_release();
+}
+
+// Called for every clock pulse, the notes start at the first pulse of a step
+// and end halfway through it
+static void engine_pulse(void) {
+    if (!clock_running) {
+        return;
+    }
+    uint8_t length = step_lengths[step_length];
+    if (step_pulse == 0) {
+        arp_step();
+        sequencer_step();
+    } else if (step_pulse == length / 2) {
+        arp_release();
+        sequencer_release();
+    }
+    if (++step_pulse >= length) {
+        step_pulse = 0;
+    }
+}
+
+ISR(TIMER4_OVF_vect) {
+    clock_phase += clock_tempo;
+    if (clock_phase >= PULSE_PHASE) {
+        clock_phase -= PULSE_PHASE;
+        midi_engine_send(1, MIDI_CLOCK, 0, 0);
+        engine_pulse();
+    }
+}
+
+void midi_engine_init(void) {
+    clock_running = false;
+    clock_external = false;
+    clock_tempo = MIDI_ENGINE_TEMPO;
+    step_length = STEP_LENGTH_DEFAULT;
+
+    arp_enabled = false;
+    arp_mode = MIDI_ARP_UP;
+    arp_count = 0;
+    arp_direction = 1;
+    arp_random = 1;
+    arp_playing = MIDI_INVALID_NOTE;
+
+    sequencer_playing = false;
+    sequencer_recording = false;
+    sequencer_length = 0;
+    sequencer_playing_note = MIDI_INVALID_NOTE;
+
+    engine_reset();
+
+    // Timer 4 counts up to OCR4C and overflows, in normal mode
+    TCCR4A = 0;
+    TCCR4B = 0;
+    TCCR4C = 0;
+    TCCR4D = 0;
+    TC4H = 0;
+    OCR4C = TICK_TOP;
+    TIMSK4 = _BV(TOIE4);
+}
+
+void midi_clock_toggle(void) {
+    if (clock_external) {
+        return;
+    }
+    ENGINE_ATOMIC {
+        if (clock_running) {
+            timer_stop();
+            engine_stop();
+            midi_engine_send(1, MIDI_STOP, 0, 0);
+        } else {
+            engine_reset();
+            midi_engine_send(1, MIDI_START, 0, 0);
+            clock_running = true;
+            timer_start();
+        }
+    }
+    dprintf("midi clock %d\n", clock_running);
+}
+
+void midi_clock_toggle_external(void) {
+    ENGINE_ATOMIC {
+        timer_stop();
+        if (clock_running && !clock_external) {
+            midi_engine_send(1, MIDI_STOP, 0, 0);
+        }
+        engine_stop();
+        clock_external = !clock_external;
+    }
+    dprintf("midi clock external %d\n", clock_external);
+}
+
+void midi_clock_set_tempo(uint16_t tempo) {
+    if (tempo < MIDI_ENGINE_TEMPO_MIN) {
+        tempo = MIDI_ENGINE_TEMPO_MIN;
+    } else if (tempo > MIDI_ENGINE_TEMPO_MAX) {
+        tempo = MIDI_ENGINE_TEMPO_MAX;
+    }
+    ENGINE_ATOMIC {
+        clock_tempo = tempo;
+    }
+    dprintf("midi tempo %d\n", tempo);
+}
+
+uint16_t midi_clock_get_tempo(void) {
+    return clock_tempo;
+}
+
+void midi_engine_step_length(int8_t direction) {
+    ENGINE_ATOMIC {
+        if (direction < 0 && step_length > 0) {
+            step_length--;
+        } else if (direction > 0 && step_length < NUM_STEP_LENGTHS - 1) {
+            step_length++;
+        }
+        if (step_pulse >= step_lengths[step_length]) {
+            step_pulse = 0;
+        }
+    }
+    dprintf("midi step length %d\n", step_lengths[step_length]);
+}
+
+// The timer is stopped while the external clock is used, so this is the
+// only writer
+void midi_engine_realtime_callback(MidiDevice * device, uint8_t byte) {
+    if (!clock_external) {
+        return;
+    }
+    switch (byte) {
+        case MIDI_CLOCK:
+            engine_pulse();
+            break;
+        case MIDI_START:
+            engine_reset();
+            clock_running = true;
+            break;
+        case MIDI_CONTINUE:
+            clock_running = true;
+            break;
+        case MIDI_STOP:
+            engine_stop();
+            break;
+    }
+}
+
+void midi_arp_toggle(void) {
+    ENGINE_ATOMIC {
+        arp_enabled = !arp_enabled;
+        if (!arp_enabled) {
+            arp_release();
+            arp_count = 0;
+        }
+    }
+    dprintf("midi arpeggiator %d\n", arp_enabled);
+}
+
+void midi_arp_next_mode(void) {
+    ENGINE_ATOMIC {
+        arp_mode = (arp_mode + 1) % MIDI_ARP_MODES;
+        arp_direction = 1;
+    }
+    dprintf("midi arpeggiator mode %d\n", arp_mode);
+}
+
+bool midi_arp_note_on(uint8_t note, uint8_t velocity) {
+    if (!arp_enabled || arp_count == MIDI_ARP_MAX_NOTES) {
+        return false;
+    }
+    ENGINE_ATOMIC {
+        uint8_t i = arp_count;
+        while (i > 0 && arp_notes[i - 1].note > note) {
+            arp_notes[i] = arp_notes[i - 1];
+            i--;
+        }
+        arp_notes[i].note = note;
+        arp_notes[i].velocity = velocity;
+        arp_count++;
+        // Keeps playing from the same note
+        if (arp_position >= (int8_t)i) {
+            arp_position++;
+        }
+    }
+    return true;
+}
+
+bool midi_arp_note_off(uint8_t note) {
+    bool found = false;
+    ENGINE_ATOMIC {
+        for (uint8_t i = 0; i < arp_count; i++) {
+            if (found) {
+                arp_notes[i - 1] = arp_notes[i];
+            } else if (arp_notes[i].note == note) {
+                found = true;
+                if (arp_position > (int8_t)i) {
+                    arp_position--;
+                }
+            }
+        }
+        if (found) {
+            arp_count--;
+        }
+    }
+    return found;
+}
+
+void midi_sequencer_toggle(void) {
+    ENGINE_ATOMIC {
+        sequencer_playing = !sequencer_playing;
+        sequencer_position = 0;
+        if (!sequencer_playing) {
+            sequencer_release();
+        }
+    }
+    dprintf("midi sequencer %d\n", sequencer_playing);
+}
+
+void midi_sequencer_toggle_record(void) {
+    sequencer_recording = !sequencer_recording;
+    if (sequencer_recording) {
+        midi_sequencer_clear();
+    }
+    dprintf("midi sequencer recording %d\n", sequencer_recording);
+}
+
+void midi_sequencer_record(uint8_t note, uint8_t velocity) {
+    if (!sequencer_recording) {
+        return;
+    }
+    ENGINE_ATOMIC {
+        engine_note_t* step = &sequencer_steps[sequencer_length++];
+        step->note = note;
+        step->velocity = velocity;
+    }
+    if (sequencer_length == MIDI_SEQUENCER_STEPS) {
+        sequencer_recording = false;
+    }
+    dprintf("midi sequencer step %d note %d\n", sequencer_length, note);
+}
+
+void midi_sequencer_clear(void) {
+    ENGINE_ATOMIC {
+        sequencer_length = 0;
+        sequencer_position = 0;
+    }
+}
+
+#endif // defined(MIDI_ENABLE) && defined(MIDI_ENGINE)
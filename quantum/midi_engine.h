@@ -0,0 +1,90 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MIDI_ENGINE_H
+#define MIDI_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "midi.h"
+
+// A MIDI clock with an arpeggiator and a step sequencer, enabled with
+// MIDI_ENGINE together with MIDI_ADVANCED.
+//
+// The internal clock runs from timer 4, which interrupts every 100 us, so
+// the clock pulses, 24 for each beat, and the notes are sent with at most
+// 0.1 ms of jitter, however busy the main loop is. With the external clock
+// the engine follows the clock, start, continue and stop messages that the
+// host sends. The arpeggiator and the sequencer only play while the clock
+// is running.
+
+#ifndef MIDI_ENGINE_TEMPO
+#define MIDI_ENGINE_TEMPO 120
+#endif
+#define MIDI_ENGINE_TEMPO_MIN 20
+#define MIDI_ENGINE_TEMPO_MAX 300
+#define MIDI_ENGINE_PPQN 24
+
+#ifndef MIDI_ARP_MAX_NOTES
+#define MIDI_ARP_MAX_NOTES 8
+#endif
+
+#ifndef MIDI_SEQUENCER_STEPS
+#define MIDI_SEQUENCER_STEPS 16
+#endif
+
+typedef enum {
+    MIDI_ARP_UP,
+    MIDI_ARP_DOWN,
+    MIDI_ARP_UP_DOWN,
+    MIDI_ARP_RANDOM,
+    MIDI_ARP_MODES
+} midi_arp_mode_t;
+
+void midi_engine_init(void);
+
+// Starts or stops the internal clock
+void midi_clock_toggle(void);
+// Switches between the internal and the external clock
+void midi_clock_toggle_external(void);
+void midi_clock_set_tempo(uint16_t tempo);
+uint16_t midi_clock_get_tempo(void);
+// Changes the length of the steps of the arpeggiator and the sequencer, from
+// a 32nd note to a quarter note, including the triplets
+void midi_engine_step_length(int8_t direction);
+// Follows the realtime messages from the host when the external clock is used
+void midi_engine_realtime_callback(MidiDevice * device, uint8_t byte);
+
+void midi_arp_toggle(void);
+void midi_arp_next_mode(void);
+// Returns false when the note wasn't taken by the arpeggiator, and has to be
+// sent directly
+bool midi_arp_note_on(uint8_t note, uint8_t velocity);
+bool midi_arp_note_off(uint8_t note);
+
+void midi_sequencer_toggle(void);
+// Starts recording from the first step, or stops recording
+void midi_sequencer_toggle_record(void);
+// Records the note as the next step when recording, MIDI_INVALID_NOTE is a rest
+void midi_sequencer_record(uint8_t note, uint8_t velocity);
+void midi_sequencer_clear(void);
+
+// Implemented by the protocol. Queues a message from the interrupt of the
+// clock, or from the main loop with the interrupt disabled, and sends it
+// with the next USB frame.
+void midi_engine_send(uint8_t count, uint8_t byte0, uint8_t byte1, uint8_t byte2);
+
+#endif
@@ -40,6 +40,9 @@ void process_midi_all_notes_off(void)
 #ifdef MIDI_ADVANCED
 
 #include "timer.h"
+#ifdef MIDI_ENGINE
+#include "midi_engine.h"
+#endif
 
 static uint8_t tone_status[MIDI_TONE_COUNT];
 
@@ -68,6 +71,10 @@ void midi_init(void)
     midi_modulation = 0;
     midi_modulation_step = 0;
     midi_modulation_timer = 0;
+
+#ifdef MIDI_ENGINE
+    midi_engine_init();
+#endif
 }
 
 void midi_task(void)
@@ -109,13 +116,24 @@ bool process_midi(uint16_t keycode, keyrecord_t *record)
             uint8_t velocity = compute_velocity(midi_config.velocity);
             if (record->event.pressed) {
                 uint8_t note = midi_compute_note(keycode);
-                midi_send_noteon(&midi_device, channel, note, velocity);
-                dprintf("midi noteon channel:%d note:%d velocity:%d\n", channel, note, velocity);
+                bool send = true;
+#ifdef MIDI_ENGINE
+                midi_sequencer_record(note, velocity);
+                send = !midi_arp_note_on(note, velocity);
+#endif
+                if (send) {
+                    midi_send_noteon(&midi_device, channel, note, velocity);
+                    dprintf("midi noteon channel:%d note:%d velocity:%d\n", channel, note, velocity);
+                }
                 tone_status[tone] = note;
             }
             else {
                 uint8_t note = tone_status[tone];
-                if (note != MIDI_INVALID_NOTE)
+                bool send = note != MIDI_INVALID_NOTE;
+#ifdef MIDI_ENGINE
+                send = send && !midi_arp_note_off(note);
+#endif
+                if (send)
                 {
                     midi_send_noteoff(&midi_device, channel, note, velocity);
                     dprintf("midi noteoff channel:%d note:%d velocity:%d\n", channel, note, velocity);
@@ -243,6 +261,56 @@ bool process_midi(uint16_t keycode, keyrecord_t *record)
                 dprintf("midi modulation interval %d\n", midi_config.modulation_interval);
             }
             return false;
+#ifdef MIDI_ENGINE
+        case MI_CLK:
+            if (record->event.pressed)
+                midi_clock_toggle();
+            return false;
+        case MI_CLKX:
+            if (record->event.pressed)
+                midi_clock_toggle_external();
+            return false;
+        case MI_TEMPD:
+            if (record->event.pressed)
+                midi_clock_set_tempo(midi_clock_get_tempo() - 1);
+            return false;
+        case MI_TEMPU:
+            if (record->event.pressed)
+                midi_clock_set_tempo(midi_clock_get_tempo() + 1);
+            return false;
+        case MI_STEPD:
+            if (record->event.pressed)
+                midi_engine_step_length(-1);
+            return false;
+        case MI_STEPU:
+            if (record->event.pressed)
+                midi_engine_step_length(1);
+            return false;
+        case MI_ARP:
+            if (record->event.pressed)
+                midi_arp_toggle();
+            return false;
+        case MI_ARPM:
+            if (record->event.pressed)
+                midi_arp_next_mode();
+            return false;
+        case MI_SEQ:
+            if (record->event.pressed)
+                midi_sequencer_toggle();
+            return false;
+        case MI_SEQR:
+            if (record->event.pressed)
+                midi_sequencer_toggle_record();
+            return false;
+        case MI_SEQRS:
+            if (record->event.pressed)
+                midi_sequencer_record(MIDI_INVALID_NOTE, 0);
+            return false;
+        case MI_SEQC:
+            if (record->event.pressed)
+                midi_sequencer_clear();
+            return false;
+#endif
     };
 
     return true;
@@ -15,14 +15,14 @@
  */
 #include "process_unicode.h"
 #include "action_util.h"
-#include "eeprom.h"
+#include "eeconfig.h"
 
 static uint8_t first_flag = 0;
 
 bool process_unicode(uint16_t keycode, keyrecord_t *record) {
   if (keycode > QK_UNICODE && record->event.pressed) {
     if (first_flag == 0) {
-      set_unicode_input_mode(eeprom_read_byte(EECONFIG_UNICODEMODE));
+      set_unicode_input_mode(eeconfig_read_unicode_mode());
       first_flag = 1;
     }
     uint16_t unicode = keycode & 0x7FFF;
@@ -15,7 +15,7 @@
  */
 
 #include "process_unicode_common.h"
-#include "eeprom.h"
+#include "eeconfig.h"
 
 static uint8_t input_mode;
 uint8_t mods;
@@ -23,7 +23,7 @@ uint8_t mods;
 void set_unicode_input_mode(uint8_t os_target)
 {
   input_mode = os_target;
-  eeprom_update_byte(EECONFIG_UNICODEMODE, os_target);
+  eeconfig_update_unicode_mode(os_target);
 }
 
 uint8_t get_unicode_input_mode(void) {
@@ -118,6 +118,7 @@ void reset_keyboard(void) {
   music_all_notes_off();
   shutdown_user();
 #endif
+  eeconfig_flush();
   wait_ms(250);
 #ifdef CATERINA_BOOTLOADER
   *(uint16_t *)0x0800 = 0x7777; // these two are a-star-specific
@@ -721,34 +722,173 @@ void matrix_scan_quantum() {
     matrix_scan_combo();
   #endif
 
-  #if defined(BACKLIGHT_ENABLE) && defined(BACKLIGHT_PIN)
-    backlight_task();
-  #endif
-
   matrix_scan_kb();
 }
 
 #if defined(BACKLIGHT_ENABLE) && defined(BACKLIGHT_PIN)
 
+#include <util/atomic.h>
+#include "led_tables.h"
+
 static const uint8_t backlight_pin = BACKLIGHT_PIN;
 
-#if BACKLIGHT_PIN == B7
-#  define COM1x1 COM1C1
-#  define OCR1x  OCR1C
-#elif BACKLIGHT_PIN == B6
-#  define COM1x1 COM1B1
-#  define OCR1x  OCR1B
-#elif BACKLIGHT_PIN == B5
-#  define COM1x1 COM1A1
-#  define OCR1x  OCR1A
+// Pins that are connected to an output channel of a 16-bit timer are driven
+// by the timer directly. Any other pin is driven by the timer 1 interrupts,
+// which turn it on at the overflow and off at the compare match. Either way
+// the brightness doesn't depend on the main loop.
+#ifndef NO_BACKLIGHT_CLOCK
+#  if BACKLIGHT_PIN == B7
+#    define BACKLIGHT_TIMER 1
+#    define COMxx1 COM1C1
+#    define OCRxx  OCR1C
+#  elif BACKLIGHT_PIN == B6
+#    define BACKLIGHT_TIMER 1
+#    define COMxx1 COM1B1
+#    define OCRxx  OCR1B
+#  elif BACKLIGHT_PIN == B5
+#    define BACKLIGHT_TIMER 1
+#    define COMxx1 COM1A1
+#    define OCRxx  OCR1A
+#  elif BACKLIGHT_PIN == C6
+#    define BACKLIGHT_TIMER 3
+#    define COMxx1 COM3A1
+#    define OCRxx  OCR3A
+#  elif BACKLIGHT_PIN == C5 && (defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__))
+#    define BACKLIGHT_TIMER 3
+#    define COMxx1 COM3B1
+#    define OCRxx  OCR3B
+#  elif BACKLIGHT_PIN == C4 && (defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__))
+#    define BACKLIGHT_TIMER 3
+#    define COMxx1 COM3C1
+#    define OCRxx  OCR3C
+#  else
+#    define NO_BACKLIGHT_CLOCK
+#  endif
+#endif
+
+#ifdef NO_BACKLIGHT_CLOCK
+#  define BACKLIGHT_TIMER 1
+#endif
+
+#if BACKLIGHT_TIMER == 1
+#  if defined(B5_AUDIO) || defined(B6_AUDIO) || defined(B7_AUDIO)
+#    error "The backlight and the audio can't both use timer 1"
+#  endif
+#  if defined(SPLIT_TRANSPORT_SOFT) && !defined(USE_I2C) && !defined(SPLIT_SOFT_SERIAL_TIMER3)
+#    error "The backlight and the soft split serial can't both use timer 1, define SPLIT_SOFT_SERIAL_TIMER3"
+#  endif
+#  define TCCRxA TCCR1A
+#  define TCCRxB TCCR1B
+#  define TIMSKx TIMSK1
+#  define TIFRx  TIFR1
+#  define TCNTx  TCNT1
+#  define ICRx   ICR1
+#  define OCRxA  OCR1A
+#  define OCIExA OCIE1A
+#  define OCFxA  OCF1A
+#  define TOIEx  TOIE1
+#  define WGMx1  WGM11
+#  define WGMx2  WGM12
+#  define WGMx3  WGM13
+#  define CSx0   CS10
+#  define TIMERx_OVF_vect   TIMER1_OVF_vect
+#  define TIMERx_COMPA_vect TIMER1_COMPA_vect
 #else
-#  define NO_BACKLIGHT_CLOCK
+#  if defined(C4_AUDIO) || defined(C5_AUDIO) || defined(C6_AUDIO)
+#    error "The backlight and the audio can't both use timer 3"
+#  endif
+#  if defined(SPLIT_TRANSPORT_SOFT) && !defined(USE_I2C) && defined(SPLIT_SOFT_SERIAL_TIMER3)
+#    error "The backlight and the soft split serial can't both use timer 3"
+#  endif
+#  define TCCRxA TCCR3A
+#  define TCCRxB TCCR3B
+#  define TIMSKx TIMSK3
+#  define ICRx   ICR3
+#  define TOIEx  TOIE3
+#  define WGMx1  WGM31
+#  define WGMx2  WGM32
+#  define WGMx3  WGM33
+#  define CSx0   CS30
+#  define TIMERx_OVF_vect   TIMER3_OVF_vect
 #endif
 
 #ifndef BACKLIGHT_ON_STATE
 #define BACKLIGHT_ON_STATE 0
 #endif
 
+static inline void backlight_pin_on(void) {
+  #if BACKLIGHT_ON_STATE == 0
+    // PORTx &= ~n
+    _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
+  #else
+    // PORTx |= n
+    _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
+  #endif
+}
+
+static inline void backlight_pin_off(void) {
+  #if BACKLIGHT_ON_STATE == 0
+    // PORTx |= n
+    _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
+  #else
+    // PORTx &= ~n
+    _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
+  #endif
+}
+
+#ifdef BACKLIGHT_BREATHING
+static volatile bool breathing;
+#endif
+
+// Returns the PWM duty cycle for a lightness of 0-255, interpolated from the
+// CIE 1931 curve, so that the steps look even
+static uint16_t cie_lightness(uint8_t lightness) {
+  uint16_t x = lightness + (lightness >> 7);
+  uint8_t index = x >> 2;
+  uint8_t fraction = x & 3;
+  uint16_t value = pgm_read_word(&CIE1931_CURVE_16[index]);
+  if (fraction) {
+    uint16_t next = pgm_read_word(&CIE1931_CURVE_16[index + 1]);
+    value += ((next - value) * fraction) >> 2;
+  }
+  return value;
+}
+
+// Has to be called with the interrupts disabled, or from the timer interrupt
+static void set_pwm(uint16_t value) {
+  #ifndef NO_BACKLIGHT_CLOCK
+    if (value == 0) {
+      // Turn off PWM control on backlight pin, revert to output low.
+      TCCRxA &= ~(_BV(COMxx1));
+      OCRxx = 0x0;
+    }
+    else {
+      // Turn on PWM control of backlight pin
+      TCCRxA |= _BV(COMxx1);
+      OCRxx = value;
+    }
+  #else
+    // The compare register is only updated at the overflow, so changing it
+    // doesn't cause glitches
+    OCRxA = value;
+    if (value == 0) {
+      TIMSKx &= ~_BV(OCIExA);
+      #ifdef BACKLIGHT_BREATHING
+        if (!breathing)
+      #endif
+        TIMSKx &= ~_BV(TOIEx);
+      backlight_pin_off();
+    }
+    else if (value == 0xFFFF) {
+      TIMSKx &= ~_BV(OCIExA);
+      TIMSKx |= _BV(TOIEx);
+    }
+    else {
+      TIMSKx |= _BV(OCIExA) | _BV(TOIEx);
+    }
+  #endif
+}
+
 __attribute__ ((weak))
 void backlight_init_ports(void)
 {
@@ -756,31 +896,32 @@ void backlight_init_ports(void)
   // Setup backlight pin as output and output to on state.
   // DDRx |= n
   _SFR_IO8((backlight_pin >> 4) + 1) |= _BV(backlight_pin & 0xF);
-  #if BACKLIGHT_ON_STATE == 0
-    // PORTx &= ~n
-    _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
+  #ifndef NO_BACKLIGHT_CLOCK
+    backlight_pin_on();
   #else
-    // PORTx |= n
-    _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
+    backlight_pin_off();
   #endif
 
-  #ifndef NO_BACKLIGHT_CLOCK
-    // Use full 16-bit resolution.
-    ICR1 = 0xFFFF;
+  // Use full 16-bit resolution.
+  ICRx = 0xFFFF;
 
-    // I could write a wall of text here to explain... but TL;DW
-    // Go read the ATmega32u4 datasheet.
-    // And this: http://blog.saikoled.com/post/43165849837/secret-konami-cheat-code-to-high-resolution-pwm-on
+  // I could write a wall of text here to explain... but TL;DW
+  // Go read the ATmega32u4 datasheet.
+  // And this: http://blog.saikoled.com/post/43165849837/secret-konami-cheat-code-to-high-resolution-pwm-on
 
-    // Pin PB7 = OCR1C (Timer 1, Channel C)
-    // Compare Output Mode = Clear on compare match, Channel C = COM1C1=1 COM1C0=0
-    // (i.e. start high, go low when counter matches.)
-    // WGM Mode 14 (Fast PWM) = WGM13=1 WGM12=1 WGM11=1 WGM10=0
-    // Clock Select = clk/1 (no prescaling) = CS12=0 CS11=0 CS10=1
+  // Pin PB7 = OCR1C (Timer 1, Channel C)
+  // Compare Output Mode = Clear on compare match, Channel C = COM1C1=1 COM1C0=0
+  // (i.e. start high, go low when counter matches.)
+  // WGM Mode 14 (Fast PWM) = WGM13=1 WGM12=1 WGM11=1 WGM10=0
+  // Clock Select = clk/1 (no prescaling) = CS12=0 CS11=0 CS10=1
+  // The software PWM uses the same mode, but without an output channel
 
-    TCCR1A = _BV(COM1x1) | _BV(WGM11); // = 0b00001010;
-    TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10); // = 0b00011001;
+  #ifndef NO_BACKLIGHT_CLOCK
+    TCCRxA = _BV(COMxx1) | _BV(WGMx1); // = 0b00001010;
+  #else
+    TCCRxA = _BV(WGMx1);
   #endif
+  TCCRxB = _BV(WGMx3) | _BV(WGMx2) | _BV(CSx0); // = 0b00011001;
 
   backlight_init();
   #ifdef BACKLIGHT_BREATHING
@@ -791,74 +932,29 @@ void backlight_init_ports(void)
 __attribute__ ((weak))
 void backlight_set(uint8_t level)
 {
-  // Prevent backlight blink on lowest level
-  // #if BACKLIGHT_ON_STATE == 0
-  //   // PORTx &= ~n
-  //   _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
-  // #else
-  //   // PORTx |= n
-  //   _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
-  // #endif
-
-  if ( level == 0 ) {
-    #ifndef NO_BACKLIGHT_CLOCK
-      // Turn off PWM control on backlight pin, revert to output low.
-      TCCR1A &= ~(_BV(COM1x1));
-      OCR1x = 0x0;
-    #else
-      // #if BACKLIGHT_ON_STATE == 0
-      //   // PORTx |= n
-      //   _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
-      // #else
-      //   // PORTx &= ~n
-      //   _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
-      // #endif
-    #endif
-  } 
-  #ifndef NO_BACKLIGHT_CLOCK
-    else if ( level == BACKLIGHT_LEVELS ) {
-      // Turn on PWM control of backlight pin
-      TCCR1A |= _BV(COM1x1);
-      // Set the brightness
-      OCR1x = 0xFFFF;
-    } 
-    else {
-      // Turn on PWM control of backlight pin
-      TCCR1A |= _BV(COM1x1);
-      // Set the brightness
-      OCR1x = 0xFFFF >> ((BACKLIGHT_LEVELS - level) * ((BACKLIGHT_LEVELS + 1) / 2));
-    }
-  #endif
+  uint16_t value = 0;
+  if (level >= BACKLIGHT_LEVELS) {
+    value = 0xFFFF;
+  }
+  else if (level > 0) {
+    value = cie_lightness((uint16_t)level * 255 / BACKLIGHT_LEVELS);
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    set_pwm(value);
+  }
 
   #ifdef BACKLIGHT_BREATHING
     breathing_intensity_default();
   #endif
 }
 
-uint8_t backlight_tick = 0;
-
-void backlight_task(void) {
-  #ifdef NO_BACKLIGHT_CLOCK
-  if ((0xFFFF >> ((BACKLIGHT_LEVELS - backlight_config.level) * ((BACKLIGHT_LEVELS + 1) / 2))) & (1 << backlight_tick)) { 
-    #if BACKLIGHT_ON_STATE == 0
-      // PORTx &= ~n
-      _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
-    #else
-      // PORTx |= n
-      _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
-    #endif
-  } else {
-    #if BACKLIGHT_ON_STATE == 0
-      // PORTx |= n
-      _SFR_IO8((backlight_pin >> 4) + 2) |= _BV(backlight_pin & 0xF);
-    #else
-      // PORTx &= ~n
-      _SFR_IO8((backlight_pin >> 4) + 2) &= ~_BV(backlight_pin & 0xF);
-    #endif
-  }
-  backlight_tick = (backlight_tick + 1) % 16;
-  #endif
+#ifdef NO_BACKLIGHT_CLOCK
+ISR(TIMERx_COMPA_vect)
+{
+    backlight_pin_off();
 }
+#endif
 
 #ifdef BACKLIGHT_BREATHING
 
@@ -871,6 +967,26 @@ static uint8_t breath_speed;
 static uint16_t breathing_index;
 static uint8_t breathing_halt;
 
+// The breathing is advanced by the overflow interrupt of the backlight
+// timer, so it runs at the same speed whatever the main loop is doing
+static void breathing_interrupt_enable(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        breathing = true;
+        TIMSKx |= _BV(TOIEx);
+    }
+}
+
+static void breathing_interrupt_disable(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        breathing = false;
+      #ifndef NO_BACKLIGHT_CLOCK
+        TIMSKx &= ~_BV(TOIEx);
+      #endif
+    }
+}
+
 void breathing_enable(void)
 {
     if (get_backlight_level() == 0)
@@ -885,8 +1001,7 @@ void breathing_enable(void)
 
     breathing_halt = BREATHING_NO_HALT;
 
-    // Enable breathing interrupt
-    TIMSK1 |= _BV(OCIE1A);
+    breathing_interrupt_enable();
 }
 
 void breathing_pulse(void)
@@ -903,14 +1018,12 @@ void breathing_pulse(void)
 
     breathing_halt = BREATHING_HALT_ON;
 
-    // Enable breathing interrupt
-    TIMSK1 |= _BV(OCIE1A);
+    breathing_interrupt_enable();
 }
 
 void breathing_disable(void)
 {
-    // Disable breathing interrupt
-    TIMSK1 &= ~_BV(OCIE1A);
+    breathing_interrupt_disable();
     backlight_set(get_backlight_level());
 }
 
@@ -943,27 +1056,30 @@ void breathing_toggle(void)
         }
 
         breathing_halt = BREATHING_NO_HALT;
+        breathing_interrupt_enable();
     }
-
-    // Toggle breathing interrupt
-    TIMSK1 ^= _BV(OCIE1A);
-
-    // Restore backlight level
-    if (!is_breathing())
+    else
     {
-        backlight_set(get_backlight_level());
+        // Restore backlight level
+        breathing_disable();
     }
 }
 
 bool is_breathing(void)
 {
-    return (TIMSK1 && _BV(OCIE1A));
+    return breathing;
 }
 
+// The maximum lightness of the breathing is the lightness of the current
+// backlight level, or of the lowest level when the backlight is off
 void breathing_intensity_default(void)
 {
-    //breath_intensity = (uint8_t)((uint16_t)100 * (uint16_t)get_backlight_level() / (uint16_t)BACKLIGHT_LEVELS);
-    breath_intensity = ((BACKLIGHT_LEVELS - get_backlight_level()) * ((BACKLIGHT_LEVELS + 1) / 2));
+    uint8_t level = get_backlight_level();
+    if (level == 0)
+    {
+        level = 1;
+    }
+    breath_intensity = (uint16_t)level * 255 / BACKLIGHT_LEVELS;
 }
 
 void breathing_intensity_set(uint8_t value)
@@ -978,26 +1094,11 @@ void breathing_speed_default(void)
 
 void breathing_speed_set(uint8_t value)
 {
-    bool is_breathing_now = is_breathing();
-    uint8_t old_breath_speed = breath_speed;
-
-    if (is_breathing_now)
-    {
-        // Disable breathing interrupt
-        TIMSK1 &= ~_BV(OCIE1A);
-    }
-
-    breath_speed = value;
-
-    if (is_breathing_now)
-    {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
         // Adjust index to account for new speed
-        breathing_index = (( (uint8_t)( (breathing_index) >> old_breath_speed ) ) & 0x3F) << breath_speed;
-
-        // Enable breathing interrupt
-        TIMSK1 |= _BV(OCIE1A);
+        breathing_index = (( (uint8_t)( (breathing_index) >> breath_speed ) ) & 0x3F) << value;
+        breath_speed = value;
     }
-
 }
 
 void breathing_speed_inc(uint8_t value)
@@ -1031,39 +1132,59 @@ void breathing_defaults(void)
     breathing_halt = BREATHING_NO_HALT;
 }
 
-/* Breathing Sleep LED brighness(PWM On period) table
+/* Breathing Sleep LED lightness table
  * (64[steps] * 4[duration]) / 64[PWM periods/s] = 4 second breath cycle
  *
- * http://www.wolframalpha.com/input/?i=%28sin%28+x%2F64*pi%29**8+*+255%2C+x%3D0+to+63
- * (0..63).each {|x| p ((sin(x/64.0*PI)**8)*255).to_i }
+ * The PWM duty cycles of sin(x/64*pi)**8 * 255 converted to CIE 1931
+ * lightness, so that it looks the same as before the gamma correction at
+ * the maximum intensity, and scales evenly at the lower ones
  */
 static const uint8_t breathing_table[64] PROGMEM = {
-  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   2,   4,   6,  10,
- 15,  23,  32,  44,  58,  74,  93, 113, 135, 157, 179, 199, 218, 233, 245, 252,
-255, 252, 245, 233, 218, 199, 179, 157, 135, 113,  93,  74,  58,  44,  32,  23,
- 15,  10,   6,   4,   2,   1,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   9,  18,  33,  44,  60,
+ 74,  92, 107, 124, 140, 155, 171, 185, 198, 211, 222, 232, 240, 246, 251, 254,
+255, 254, 251, 246, 240, 232, 222, 211, 198, 185, 171, 155, 140, 124, 107,  92,
+ 74,  60,  44,  33,  18,   9,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
 };
 
-ISR(TIMER1_COMPA_vect)
-{
-    // OCR1x = (pgm_read_byte(&breathing_table[ ( (uint8_t)( (breathing_index++) >> breath_speed ) ) & 0x3F ] )) * breath_intensity;
+#endif // breathing
 
+// Called once per PWM period, about 244 times a second
+#if defined(NO_BACKLIGHT_CLOCK) || defined(BACKLIGHT_BREATHING)
+ISR(TIMERx_OVF_vect)
+{
+  #ifdef NO_BACKLIGHT_CLOCK
+    // The value that was written during the last period, and is used for
+    // this one. Writing it below only takes effect at the next overflow.
+    uint16_t compare = OCRxA;
+  #endif
+  #ifdef BACKLIGHT_BREATHING
+    if (breathing)
+    {
+        uint8_t local_index = ( (uint8_t)( (breathing_index++) >> breath_speed ) ) & 0x3F;
 
-    uint8_t local_index = ( (uint8_t)( (breathing_index++) >> breath_speed ) ) & 0x3F;
+        if (((breathing_halt == BREATHING_HALT_ON) && (local_index == 0x20)) || ((breathing_halt == BREATHING_HALT_OFF) && (local_index == 0x3F)))
+        {
+            breathing = false;
+          #ifndef NO_BACKLIGHT_CLOCK
+            TIMSKx &= ~_BV(TOIEx);
+          #endif
+        }
 
-    if (((breathing_halt == BREATHING_HALT_ON) && (local_index == 0x20)) || ((breathing_halt == BREATHING_HALT_OFF) && (local_index == 0x3F)))
+        uint8_t lightness = ((uint16_t)pgm_read_byte(&breathing_table[local_index]) * (breath_intensity + 1)) >> 8;
+        set_pwm(cie_lightness(lightness));
+    }
+  #endif
+  #ifdef NO_BACKLIGHT_CLOCK
+    // The compare interrupt has the higher priority, so if this one was
+    // delayed past a short duty cycle, it has already turned the pin off.
+    // The pin is only turned on if the compare match is still to come.
+    if (compare != 0 && (TCNTx < compare || (TIFRx & _BV(OCFxA))))
     {
-        // Disable breathing interrupt
-        TIMSK1 &= ~_BV(OCIE1A);
+        backlight_pin_on();
     }
-
-    OCR1x = (uint16_t)(((uint16_t)pgm_read_byte(&breathing_table[local_index]) * 257)) >> breath_intensity;
-
+  #endif
 }
-
-
-
-#endif // breathing
+#endif
 
 #else // backlight
 
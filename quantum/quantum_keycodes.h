@@ -357,6 +357,21 @@ enum quantum_keycodes {
     MI_MODSU, // increase modulation speed
 #endif // MIDI_ADVANCED
 
+#if !MIDI_ENABLE_STRICT || (defined(MIDI_ENABLE) && defined(MIDI_ENGINE))
+    MI_CLK,   // start or stop the clock
+    MI_CLKX,  // switch between the internal and the external clock
+    MI_TEMPD, // decrease the tempo
+    MI_TEMPU, // increase the tempo
+    MI_STEPD, // shorter steps
+    MI_STEPU, // longer steps
+    MI_ARP,   // arpeggiator on or off
+    MI_ARPM,  // next arpeggiator mode
+    MI_SEQ,   // play or stop the sequencer
+    MI_SEQR,  // record the sequence
+    MI_SEQRS, // record a rest
+    MI_SEQC,  // clear the sequence
+#endif // MIDI_ENGINE
+
     // Backlight functionality
     BL_0,
     BL_1,
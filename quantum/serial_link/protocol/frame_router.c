@@ -26,22 +26,33 @@ SOFTWARE.
 #include "serial_link/protocol/transport.h"
 #include "serial_link/protocol/frame_validator.h"
 
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#define deliver_frame reliable_recv_frame
+#else
+#define deliver_frame transport_recv_frame
+#endif
+
 static bool is_master;
 
 void router_set_master(bool master) {
    is_master = master;
 }
 
+bool router_is_master(void) {
+    return is_master;
+}
+
 void route_incoming_frame(uint8_t link, uint8_t* data, uint16_t size){
     if (is_master) {
         if (link == DOWN_LINK) {
-            transport_recv_frame(data[size-1], data, size - 1);
+            deliver_frame(data[size-1], data, size - 1);
         }
     }
     else {
         if (link == UP_LINK) {
             if (data[size-1] & 1) {
-                transport_recv_frame(0, data, size - 1);
+                deliver_frame(0, data, size - 1);
             }
             data[size-1] >>= 1;
             validator_send_frame(DOWN_LINK, data, size);
@@ -27,6 +27,10 @@ SOFTWARE.
 #include "serial_link/protocol/byte_stuffer.h"
 #include <string.h>
 
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#endif
+
 const uint32_t poly8_lookup[256] =
 {
  0, 0x77073096, 0xEE0E612C, 0x990951BA,
@@ -111,6 +115,11 @@ void validator_recv_frame(uint8_t link, uint8_t* data, uint16_t size) {
         if (frame_crc == expected_crc) {
             route_incoming_frame(link, data, size-4);
         }
+#ifdef SERIAL_LINK_RELIABLE
+        else {
+            reliable_link_crc_error(link);
+        }
+#endif
     }
 }
 
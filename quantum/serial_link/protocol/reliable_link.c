@@ -0,0 +1,313 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "serial_link/protocol/reliable_link.h"
+#include "serial_link/protocol/frame_router.h"
+#include "serial_link/protocol/transport.h"
+#include <string.h>
+
+// Every frame gets a sequence number and a type byte appended
+#define RELIABLE_TRAILER_SIZE 2
+// The router and the validator needs 5 more bytes
+#define RELIABLE_FRAME_EXTRA (RELIABLE_TRAILER_SIZE + 5)
+
+#define BROADCAST_DESTINATION 0xFF
+
+typedef enum {
+    FRAME_UNRELIABLE,
+    FRAME_DATA,
+    // Data frame that tells the receiver to restart from its sequence number
+    FRAME_SYNC,
+    FRAME_ACK,
+    FRAME_NAK,
+} reliable_frame_type;
+
+typedef struct {
+    uint32_t sent_time;
+    uint16_t size;
+    bool retransmitted;
+    uint8_t data[SERIAL_LINK_RELIABLE_MAX_PAYLOAD + RELIABLE_FRAME_EXTRA];
+} reliable_slot_t;
+
+typedef struct {
+    // 0 for the master, 1 and up for the slaves
+    uint8_t address;
+    uint8_t send_base;
+    uint8_t next_send_seq;
+    uint8_t expected_recv_seq;
+    uint8_t timeouts_in_row;
+    bool needs_sync;
+    bool nak_sent;
+    reliable_slot_t slots[SERIAL_LINK_RELIABLE_WINDOW];
+    reliable_link_stats_t stats;
+} reliable_node_t;
+
+static reliable_node_t nodes[NUM_SLAVES];
+
+void init_reliable_link(void) {
+    unsigned int i;
+    memset(nodes, 0, sizeof(nodes));
+    for (i=0;i<NUM_SLAVES;i++) {
+        nodes[i].needs_sync = true;
+    }
+}
+
+static reliable_node_t* get_node(uint8_t address) {
+    uint8_t index = address == 0 ? 0 : address - 1;
+    if (index >= NUM_SLAVES) {
+        return NULL;
+    }
+    reliable_node_t* node = &nodes[index];
+    node->address = address;
+    return node;
+}
+
+static uint8_t router_destination(uint8_t address) {
+    // The router addresses the slaves with a bitmask
+    return address == 0 ? 0 : 1 << (address - 1);
+}
+
+static uint8_t num_outstanding(reliable_node_t* node) {
+    return node->next_send_seq - node->send_base;
+}
+
+static void send_control(uint8_t address, reliable_frame_type type, uint8_t seq) {
+    uint8_t frame[RELIABLE_FRAME_EXTRA];
+    frame[0] = seq;
+    frame[1] = type;
+    router_send_frame(router_destination(address), frame, RELIABLE_TRAILER_SIZE);
+}
+
+static void send_slot(reliable_node_t* node, uint8_t seq) {
+    reliable_slot_t* slot = &node->slots[seq % SERIAL_LINK_RELIABLE_WINDOW];
+    bool sync = node->needs_sync && seq == node->send_base;
+    slot->data[slot->size] = seq;
+    slot->data[slot->size + 1] = sync ? FRAME_SYNC : FRAME_DATA;
+    slot->sent_time = serial_link_get_time();
+    router_send_frame(router_destination(node->address), slot->data,
+        slot->size + RELIABLE_TRAILER_SIZE);
+}
+
+static void retransmit_window(reliable_node_t* node) {
+    uint8_t seq;
+    for (seq=node->send_base;seq!=node->next_send_seq;seq++) {
+        node->slots[seq % SERIAL_LINK_RELIABLE_WINDOW].retransmitted = true;
+        node->stats.retransmits++;
+        send_slot(node, seq);
+    }
+}
+
+static void update_rtt(reliable_node_t* node, uint32_t rtt) {
+    if (rtt > 0xFFFF) {
+        rtt = 0xFFFF;
+    }
+    if (node->stats.rtt == 0) {
+        node->stats.rtt = rtt;
+    }
+    else {
+        // Exponential moving average with a weight of 1/8, like TCP
+        int32_t delta = (int32_t)rtt - node->stats.rtt;
+        node->stats.rtt += delta / 8;
+    }
+    if (rtt > node->stats.max_rtt) {
+        node->stats.max_rtt = rtt;
+    }
+}
+
+static bool process_ack(reliable_node_t* node, uint8_t ack) {
+    uint8_t num_acked = ack - node->send_base;
+    if (num_acked > num_outstanding(node)) {
+        return false;
+    }
+    uint32_t time = serial_link_get_time();
+    while (node->send_base != ack) {
+        reliable_slot_t* slot = &node->slots[node->send_base % SERIAL_LINK_RELIABLE_WINDOW];
+        // Retransmitted frames give ambiguous samples (Karn's algorithm)
+        if (!slot->retransmitted) {
+            update_rtt(node, time - slot->sent_time);
+        }
+        node->send_base++;
+    }
+    if (num_acked > 0) {
+        node->needs_sync = false;
+        node->timeouts_in_row = 0;
+    }
+    return true;
+}
+
+static void reset_sender(reliable_node_t* node) {
+    node->send_base = node->next_send_seq;
+    node->needs_sync = true;
+    node->timeouts_in_row = 0;
+    node->stats.resets++;
+}
+
+bool reliable_link_can_send(uint8_t destination) {
+    if (destination == BROADCAST_DESTINATION) {
+        return true;
+    }
+    reliable_node_t* node = get_node(destination);
+    if (!node) {
+        return true;
+    }
+    return num_outstanding(node) < SERIAL_LINK_RELIABLE_WINDOW;
+}
+
+void reliable_send_frame(uint8_t destination, uint8_t* data, uint16_t size) {
+    reliable_node_t* node = NULL;
+    if (destination != BROADCAST_DESTINATION) {
+        node = get_node(destination);
+    }
+    if (!node || size > SERIAL_LINK_RELIABLE_MAX_PAYLOAD) {
+        data[size] = 0;
+        data[size + 1] = FRAME_UNRELIABLE;
+        uint8_t router_dest = node ? router_destination(destination) : destination;
+        router_send_frame(router_dest, data, size + RELIABLE_TRAILER_SIZE);
+        return;
+    }
+    if (num_outstanding(node) >= SERIAL_LINK_RELIABLE_WINDOW) {
+        // The transport should have checked reliable_link_can_send first
+        return;
+    }
+    uint8_t seq = node->next_send_seq++;
+    reliable_slot_t* slot = &node->slots[seq % SERIAL_LINK_RELIABLE_WINDOW];
+    memcpy(slot->data, data, size);
+    slot->size = size;
+    slot->retransmitted = false;
+    send_slot(node, seq);
+}
+
+static void recv_data(reliable_node_t* node, uint8_t from, uint8_t seq, uint8_t* data, uint16_t size) {
+    if (seq == node->expected_recv_seq) {
+        node->expected_recv_seq++;
+        node->nak_sent = false;
+        transport_recv_frame(from, data, size);
+        send_control(from, FRAME_ACK, node->expected_recv_seq);
+    }
+    else if ((uint8_t)(seq - node->expected_recv_seq) < 128) {
+        // There's a gap, so ask for a retransmit, but only once
+        // since all the following frames will be out of order too
+        if (!node->nak_sent) {
+            node->nak_sent = true;
+            node->stats.naks_sent++;
+            send_control(from, FRAME_NAK, node->expected_recv_seq);
+        }
+    }
+    else {
+        // A duplicate, probably because the ack was lost
+        send_control(from, FRAME_ACK, node->expected_recv_seq);
+    }
+}
+
+void reliable_recv_frame(uint8_t from, uint8_t* data, uint16_t size) {
+    if (size < RELIABLE_TRAILER_SIZE) {
+        return;
+    }
+    size -= RELIABLE_TRAILER_SIZE;
+    uint8_t seq = data[size];
+    uint8_t type = data[size + 1];
+    if (type == FRAME_UNRELIABLE) {
+        transport_recv_frame(from, data, size);
+        return;
+    }
+    reliable_node_t* node = get_node(from);
+    if (!node) {
+        return;
+    }
+    switch (type) {
+    case FRAME_SYNC:
+        node->expected_recv_seq = seq;
+        recv_data(node, from, seq, data, size);
+        break;
+    case FRAME_DATA:
+        recv_data(node, from, seq, data, size);
+        break;
+    case FRAME_ACK:
+        process_ack(node, seq);
+        break;
+    case FRAME_NAK:
+        if (process_ack(node, seq)) {
+            retransmit_window(node);
+        }
+        else if (num_outstanding(node) > 0) {
+            // The receiver has restarted and lost track of the sequence
+            node->needs_sync = true;
+            retransmit_window(node);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void reliable_link_crc_error(uint8_t link) {
+    // The address of a corrupted frame can't be trusted, so the error is
+    // counted for the neighbour that sent it, which is the first slave on the
+    // down link of the master, and the master on the up link of a slave. The
+    // frames that a slave forwards from the slaves below it aren't for any of
+    // its nodes, their loss shows up as timeouts at the sender.
+    if (router_is_master() ? link == DOWN_LINK : link == UP_LINK) {
+        nodes[0].stats.crc_errors++;
+    }
+}
+
+void update_reliable_link(void) {
+    uint32_t time = serial_link_get_time();
+    unsigned int i;
+    for (i=0;i<NUM_SLAVES;i++) {
+        reliable_node_t* node = &nodes[i];
+        if (num_outstanding(node) == 0) {
+            continue;
+        }
+        reliable_slot_t* slot = &node->slots[node->send_base % SERIAL_LINK_RELIABLE_WINDOW];
+        if (time - slot->sent_time >= SERIAL_LINK_RETRANSMIT_TIMEOUT) {
+            node->stats.timeouts++;
+            if (++node->timeouts_in_row > SERIAL_LINK_MAX_RETRANSMITS) {
+                reset_sender(node);
+            }
+            else {
+                retransmit_window(node);
+            }
+        }
+    }
+}
+
+bool reliable_link_has_pending_frames(void) {
+    unsigned int i;
+    for (i=0;i<NUM_SLAVES;i++) {
+        if (num_outstanding(&nodes[i]) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void reliable_link_get_stats(uint8_t node, reliable_link_stats_t* stats) {
+    if (node < NUM_SLAVES) {
+        *stats = nodes[node].stats;
+    }
+    else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SERIAL_LINK_RELIABLE_LINK_H
+#define SERIAL_LINK_RELIABLE_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The reliable link sits between the transport and the frame router.
+// Frames to a single node get a sequence number and are stored until the
+// other side acknowledges them. Lost frames are detected either through a
+// NAK, when the receiver sees a gap in the sequence, or by a timeout, and
+// everything from the first unacknowledged frame is retransmitted (Go-Back-N).
+// Broadcasts are not acknowledged, and are sent without sequence numbers.
+
+// The number of unacknowledged frames that can be in flight to each node
+#ifndef SERIAL_LINK_RELIABLE_WINDOW
+#define SERIAL_LINK_RELIABLE_WINDOW 4
+#endif
+
+// The slots are indexed by the wrapping 8-bit sequence number
+#if (SERIAL_LINK_RELIABLE_WINDOW & (SERIAL_LINK_RELIABLE_WINDOW - 1)) != 0 || SERIAL_LINK_RELIABLE_WINDOW > 128
+#error "SERIAL_LINK_RELIABLE_WINDOW has to be a power of two, no larger than 128"
+#endif
+
+// Bigger frames than this can't be stored for retransmission,
+// so they are sent unreliably
+#ifndef SERIAL_LINK_RELIABLE_MAX_PAYLOAD
+#define SERIAL_LINK_RELIABLE_MAX_PAYLOAD 64
+#endif
+
+// In the same unit as serial_link_get_time, microseconds on ChibiOS
+#ifndef SERIAL_LINK_RETRANSMIT_TIMEOUT
+#define SERIAL_LINK_RETRANSMIT_TIMEOUT 5000
+#endif
+
+// After this many timeouts in a row the outstanding frames are dropped
+// and the link is resynchronized
+#ifndef SERIAL_LINK_MAX_RETRANSMITS
+#define SERIAL_LINK_MAX_RETRANSMITS 8
+#endif
+
+typedef struct {
+    // Frames that failed the CRC check on the link to the node
+    uint16_t crc_errors;
+    uint16_t retransmits;
+    uint16_t timeouts;
+    uint16_t naks_sent;
+    uint16_t resets;
+    // Smoothed and maximum round trip time
+    uint16_t rtt;
+    uint16_t max_rtt;
+} reliable_link_stats_t;
+
+void init_reliable_link(void);
+bool reliable_link_can_send(uint8_t destination);
+// The buffer pointed to by the data needs 7 additional bytes
+void reliable_send_frame(uint8_t destination, uint8_t* data, uint16_t size);
+void reliable_recv_frame(uint8_t from, uint8_t* data, uint16_t size);
+void reliable_link_crc_error(uint8_t link);
+void update_reliable_link(void);
+bool reliable_link_has_pending_frames(void);
+// The node is the slave index on the master, and always 0 on the slaves
+void reliable_link_get_stats(uint8_t node, reliable_link_stats_t* stats);
+
+// Implemented by the system
+uint32_t serial_link_get_time(void);
+
+#endif
@@ -27,6 +27,15 @@ SOFTWARE.
 #include "serial_link/protocol/triple_buffered_object.h"
 #include <string.h>
 
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#define transport_can_send(destination) reliable_link_can_send(destination)
+#define transport_send_frame reliable_send_frame
+#else
+#define transport_can_send(destination) true
+#define transport_send_frame router_send_frame
+#endif
+
 #define MAX_REMOTE_OBJECTS 16
 static remote_object_t* remote_objects[MAX_REMOTE_OBJECTS];
 static uint32_t num_remote_objects = 0;
@@ -102,24 +111,30 @@ void update_transport(void) {
     for(i=0;i<num_remote_objects;i++) {
         remote_object_t* obj = remote_objects[i];
         if (obj->object_type == MASTER_TO_ALL_SLAVES || obj->object_type == SLAVE_TO_MASTER) {
+            uint8_t dest = obj->object_type == MASTER_TO_ALL_SLAVES ? 0xFF : 0;
+            // Leave the object in the buffer until it can be sent
+            if (!transport_can_send(dest)) {
+                continue;
+            }
             triple_buffer_object_t* tb = (triple_buffer_object_t*)obj->buffer;
             uint8_t* ptr = (uint8_t*)triple_buffer_read_internal(obj->object_size + LOCAL_OBJECT_EXTRA, tb);
             if (ptr) {
                 ptr[obj->object_size] = i;
-                uint8_t dest = obj->object_type == MASTER_TO_ALL_SLAVES ? 0xFF : 0;
-                router_send_frame(dest, ptr, obj->object_size + 1);
+                transport_send_frame(dest, ptr, obj->object_size + 1);
             }
         }
         else {
             uint8_t* start = obj->buffer;
             unsigned int j;
             for (j=0;j<NUM_SLAVES;j++) {
-                triple_buffer_object_t* tb = (triple_buffer_object_t*)start;
-                uint8_t* ptr = (uint8_t*)triple_buffer_read_internal(obj->object_size + LOCAL_OBJECT_EXTRA, tb);
-                if (ptr) {
-                    ptr[obj->object_size] = i;
-                    uint8_t dest = j + 1;
-                    router_send_frame(dest, ptr, obj->object_size + 1);
+                uint8_t dest = j + 1;
+                if (transport_can_send(dest)) {
+                    triple_buffer_object_t* tb = (triple_buffer_object_t*)start;
+                    uint8_t* ptr = (uint8_t*)triple_buffer_read_internal(obj->object_size + LOCAL_OBJECT_EXTRA, tb);
+                    if (ptr) {
+                        ptr[obj->object_size] = i;
+                        transport_send_frame(dest, ptr, obj->object_size + 1);
+                    }
                 }
                 start += LOCAL_OBJECT_SIZE(obj->object_size);
             }
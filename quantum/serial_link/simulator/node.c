@@ -0,0 +1,121 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "node.h"
+#include "serial_link/protocol/byte_stuffer.h"
+#include "serial_link/protocol/frame_router.h"
+#include "serial_link/protocol/transport.h"
+#include "serial_link/protocol/physical.h"
+#include <string.h>
+
+// The serial_link.h versions are plain C99 inline functions,
+// which need an external definition somewhere
+extern inline void serial_link_lock(void);
+extern inline void serial_link_unlock(void);
+
+static sim_host_t host;
+
+SLAVE_TO_MASTER_OBJECT(sim_matrix, sim_matrix_object_t);
+MASTER_TO_ALL_SLAVES_OBJECT(sim_broadcast, sim_broadcast_object_t);
+
+static remote_object_t* remote_objects[] = {
+    REMOTE_OBJECT(sim_matrix),
+    REMOTE_OBJECT(sim_broadcast),
+};
+
+void send_data(uint8_t link, const uint8_t* data, uint16_t size) {
+    host.send_data(host.context, link, data, size);
+}
+
+void signal_data_written(void) {
+    host.data_written(host.context);
+}
+
+#ifdef SERIAL_LINK_RELIABLE
+uint32_t serial_link_get_time(void) {
+    return host.get_time(host.context);
+}
+#endif
+
+static void node_init(bool master, const sim_host_t* _host) {
+    host = *_host;
+    reinitialize_serial_link_transport();
+    add_remote_objects(remote_objects, sizeof(remote_objects) / sizeof(remote_object_t*));
+    init_byte_stuffer();
+#ifdef SERIAL_LINK_RELIABLE
+    init_reliable_link();
+#endif
+    router_set_master(master);
+}
+
+static void node_update(void) {
+#ifdef SERIAL_LINK_RELIABLE
+    update_reliable_link();
+#endif
+    update_transport();
+}
+
+static void node_write_matrix(uint32_t timestamp, uint32_t counter) {
+    sim_matrix_object_t* m = begin_write_sim_matrix();
+    m->timestamp = timestamp;
+    m->counter = counter;
+    memset(m->rows, counter & 0xFF, sizeof(m->rows));
+    end_write_sim_matrix();
+}
+
+static bool node_read_matrix(uint8_t slave, sim_matrix_object_t* matrix) {
+    sim_matrix_object_t* m = read_sim_matrix(slave);
+    if (m) {
+        *matrix = *m;
+    }
+    return m != NULL;
+}
+
+static void node_write_broadcast(uint32_t timestamp, uint32_t counter) {
+    sim_broadcast_object_t* b = begin_write_sim_broadcast();
+    b->timestamp = timestamp;
+    b->counter = counter;
+    end_write_sim_broadcast();
+}
+
+static bool node_read_broadcast(sim_broadcast_object_t* broadcast) {
+    sim_broadcast_object_t* b = read_sim_broadcast();
+    if (b) {
+        *broadcast = *b;
+    }
+    return b != NULL;
+}
+
+const sim_node_t sim_node = {
+    .init = node_init,
+    .recv_byte = byte_stuffer_recv_byte,
+    .update = node_update,
+    .write_matrix = node_write_matrix,
+    .read_matrix = node_read_matrix,
+    .write_broadcast = node_write_broadcast,
+    .read_broadcast = node_read_broadcast,
+#ifdef SERIAL_LINK_RELIABLE
+    .get_stats = reliable_link_get_stats,
+#endif
+};
@@ -0,0 +1,74 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SERIAL_LINK_SIMULATOR_NODE_H
+#define SERIAL_LINK_SIMULATOR_NODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#endif
+
+// The protocol layers keep their state in static variables, so every
+// simulated node is a separate copy of the node library, loaded into its
+// own namespace with dlmopen. The node can't see the symbols of the
+// simulator, so it calls back through these function pointers.
+typedef struct {
+    void (*send_data)(void* context, uint8_t link, const uint8_t* data, uint16_t size);
+    uint32_t (*get_time)(void* context);
+    void (*data_written)(void* context);
+    void* context;
+} sim_host_t;
+
+#define SIM_MATRIX_ROWS 8
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t counter;
+    uint8_t rows[SIM_MATRIX_ROWS];
+} sim_matrix_object_t;
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t counter;
+} sim_broadcast_object_t;
+
+typedef struct {
+    void (*init)(bool master, const sim_host_t* host);
+    void (*recv_byte)(uint8_t link, uint8_t data);
+    void (*update)(void);
+    void (*write_matrix)(uint32_t timestamp, uint32_t counter);
+    bool (*read_matrix)(uint8_t slave, sim_matrix_object_t* matrix);
+    void (*write_broadcast)(uint32_t timestamp, uint32_t counter);
+    bool (*read_broadcast)(sim_broadcast_object_t* broadcast);
+#ifdef SERIAL_LINK_RELIABLE
+    void (*get_stats)(uint8_t node, reliable_link_stats_t* stats);
+#endif
+} sim_node_t;
+
+// The only symbol the simulator looks up in each copy of the library
+#define SIM_NODE_SYMBOL "sim_node"
+
+#endif
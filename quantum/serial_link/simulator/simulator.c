@@ -0,0 +1,499 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Simulates a chain of a master and up to NUM_SLAVES slaves, each running
+// the full serial link stack, connected through virtual UARTs. The UARTs
+// model the baud rate, a fixed latency, bit errors and dropped bytes. The
+// simulation is event driven and deterministic for a given seed.
+
+#define _GNU_SOURCE
+#include "node.h"
+#include "serial_link/protocol/byte_stuffer.h"
+#include "serial_link/protocol/frame_router.h"
+#include "serial_link/protocol/transport.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#ifndef SIM_NODE_LIBRARY
+#define SIM_NODE_LIBRARY "serial_link_node.so"
+#endif
+
+#define NUM_NODES (NUM_SLAVES + 1)
+#define UART_QUEUE_SIZE 4096
+// 10 microsecond buckets up to 100 ms
+#define LATENCY_BUCKET_NS 10000
+#define NUM_LATENCY_BUCKETS 10000
+
+typedef struct {
+    uint32_t baud;
+    uint32_t latency_us;
+    double bit_error_rate;
+    double drop_rate;
+    uint32_t interval_us;
+    uint32_t duration_ms;
+    uint32_t seed;
+    int min_slaves;
+    int max_slaves;
+    const char* library;
+} sim_config_t;
+
+typedef struct {
+    uint64_t time;
+    uint8_t data;
+} uart_byte_t;
+
+typedef struct node node_t;
+
+typedef struct {
+    uart_byte_t queue[UART_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t count;
+    uint64_t busy_until;
+    uint64_t busy_time;
+    node_t* to_node;
+    uint8_t to_link;
+    uint32_t bytes;
+    uint32_t bit_errors;
+    uint32_t dropped;
+    uint32_t overflows;
+} uart_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t buckets[NUM_LATENCY_BUCKETS];
+} latency_t;
+
+struct node {
+    const sim_node_t* node;
+    uint8_t index;
+    bool update_pending;
+    uint64_t next_tick;
+    uint32_t counter;
+    uart_t* links[NUM_LINKS];
+};
+
+static sim_config_t config = {
+    .baud = 115200,
+    .latency_us = 0,
+    .bit_error_rate = 0.0,
+    .drop_rate = 0.0,
+    .interval_us = 1000,
+    .duration_ms = 1000,
+    .seed = 1,
+    .min_slaves = 1,
+    .max_slaves = NUM_SLAVES,
+    .library = SIM_NODE_LIBRARY,
+};
+
+static uint64_t now;
+static uint32_t random_state;
+static node_t nodes[NUM_NODES];
+static uart_t down_uarts[NUM_SLAVES];
+static uart_t up_uarts[NUM_SLAVES];
+static latency_t up_latency;
+static latency_t down_latency;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static bool random_event(double probability) {
+    return probability > 0.0 && next_random() < probability * 4294967296.0;
+}
+
+static void record_latency(latency_t* latency, uint64_t value) {
+    latency->count++;
+    latency->sum += value;
+    if (value > latency->max) {
+        latency->max = value;
+    }
+    uint64_t bucket = value / LATENCY_BUCKET_NS;
+    if (bucket >= NUM_LATENCY_BUCKETS) {
+        bucket = NUM_LATENCY_BUCKETS - 1;
+    }
+    latency->buckets[bucket]++;
+}
+
+static double latency_percentile(latency_t* latency, double percentile) {
+    uint64_t target = latency->count * percentile;
+    uint64_t total = 0;
+    unsigned int i;
+    for (i=0;i<NUM_LATENCY_BUCKETS;i++) {
+        total += latency->buckets[i];
+        if (total > target) {
+            break;
+        }
+    }
+    uint64_t value = (uint64_t)(i + 1) * LATENCY_BUCKET_NS;
+    return (value < latency->max ? value : latency->max) / 1000.0;
+}
+
+static void uart_send(uart_t* uart, const uint8_t* data, uint16_t size) {
+    // 8N1, so ten bits for every byte
+    uint64_t byte_time = 10000000000ull / config.baud;
+    uint16_t i;
+    for (i=0;i<size;i++) {
+        uint64_t start = uart->busy_until > now ? uart->busy_until : now;
+        uart->busy_until = start + byte_time;
+        uart->busy_time += byte_time;
+        uart->bytes++;
+        if (random_event(config.drop_rate)) {
+            uart->dropped++;
+            continue;
+        }
+        uint8_t byte = data[i];
+        int bit;
+        for (bit=0;bit<8;bit++) {
+            if (random_event(config.bit_error_rate)) {
+                byte ^= 1 << bit;
+                uart->bit_errors++;
+            }
+        }
+        if (uart->count == UART_QUEUE_SIZE) {
+            uart->overflows++;
+            continue;
+        }
+        uart_byte_t* entry = &uart->queue[(uart->head + uart->count) % UART_QUEUE_SIZE];
+        entry->time = uart->busy_until + config.latency_us * 1000ull;
+        entry->data = byte;
+        uart->count++;
+    }
+}
+
+static void host_send_data(void* context, uint8_t link, const uint8_t* data, uint16_t size) {
+    node_t* node = (node_t*)context;
+    if (node->links[link]) {
+        uart_send(node->links[link], data, size);
+    }
+}
+
+static uint32_t host_get_time(void* context) {
+    (void)context;
+    return now / 1000;
+}
+
+static void host_data_written(void* context) {
+    node_t* node = (node_t*)context;
+    node->update_pending = true;
+}
+
+static void load_nodes(void) {
+    int i;
+    for (i=0;i<NUM_NODES;i++) {
+        void* handle = dlmopen(LM_ID_NEWLM, config.library, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            fprintf(stderr, "Failed to load %s: %s\n", config.library, dlerror());
+            exit(1);
+        }
+        nodes[i].node = (const sim_node_t*)dlsym(handle, SIM_NODE_SYMBOL);
+        if (!nodes[i].node) {
+            fprintf(stderr, "%s\n", dlerror());
+            exit(1);
+        }
+        nodes[i].index = i;
+    }
+}
+
+static void setup_chain(int num_slaves) {
+    int i;
+    memset(down_uarts, 0, sizeof(down_uarts));
+    memset(up_uarts, 0, sizeof(up_uarts));
+    memset(&up_latency, 0, sizeof(up_latency));
+    memset(&down_latency, 0, sizeof(down_latency));
+    now = 0;
+    random_state = config.seed ? config.seed : 1;
+    for (i=0;i<=num_slaves;i++) {
+        node_t* node = &nodes[i];
+        node->links[UP_LINK] = i > 0 ? &up_uarts[i - 1] : NULL;
+        node->links[DOWN_LINK] = i < num_slaves ? &down_uarts[i] : NULL;
+        if (i > 0) {
+            up_uarts[i - 1].to_node = &nodes[i - 1];
+            up_uarts[i - 1].to_link = DOWN_LINK;
+        }
+        if (i < num_slaves) {
+            down_uarts[i].to_node = &nodes[i + 1];
+            down_uarts[i].to_link = UP_LINK;
+        }
+        // Spread out the scans, so that the nodes don't run in lockstep
+        node->next_tick = (uint64_t)config.interval_us * 1000 * i / (num_slaves + 1);
+        node->counter = 0;
+        node->update_pending = false;
+        sim_host_t host = {
+            .send_data = host_send_data,
+            .get_time = host_get_time,
+            .data_written = host_data_written,
+            .context = node,
+        };
+        node->node->init(i == 0, &host);
+    }
+}
+
+// The serial thread blocks while the UART transmit buffer is full, so it
+// doesn't update the transport until the links have sent everything
+static uint64_t tx_busy_until(node_t* node) {
+    uint64_t busy_until = 0;
+    int i;
+    for (i=0;i<NUM_LINKS;i++) {
+        if (node->links[i] && node->links[i]->busy_until > busy_until) {
+            busy_until = node->links[i]->busy_until;
+        }
+    }
+    return busy_until;
+}
+
+static void process_node(node_t* node, int num_slaves) {
+    node->update_pending = false;
+    node->node->update();
+    uint32_t time = now / 1000;
+    if (node->index == 0) {
+        int i;
+        for (i=0;i<num_slaves;i++) {
+            sim_matrix_object_t matrix;
+            if (node->node->read_matrix(i, &matrix)) {
+                record_latency(&up_latency, (uint64_t)(uint32_t)(time - matrix.timestamp) * 1000);
+            }
+        }
+    }
+    else {
+        sim_broadcast_object_t broadcast;
+        if (node->node->read_broadcast(&broadcast)) {
+            record_latency(&down_latency, (uint64_t)(uint32_t)(time - broadcast.timestamp) * 1000);
+        }
+    }
+}
+
+static void run_chain(int num_slaves) {
+    uint64_t end = config.duration_ms * 1000000ull;
+    int num_uarts = num_slaves;
+    setup_chain(num_slaves);
+    while (now < end) {
+        uint64_t next = UINT64_MAX;
+        uart_t* next_uart = NULL;
+        node_t* next_node = NULL;
+        int i;
+        for (i=0;i<num_uarts;i++) {
+            uart_t* uarts[2] = {&down_uarts[i], &up_uarts[i]};
+            int j;
+            for (j=0;j<2;j++) {
+                if (uarts[j]->count > 0 && uarts[j]->queue[uarts[j]->head].time < next) {
+                    next = uarts[j]->queue[uarts[j]->head].time;
+                    next_uart = uarts[j];
+                }
+            }
+        }
+        for (i=0;i<=num_slaves;i++) {
+            if (nodes[i].next_tick < next) {
+                next = nodes[i].next_tick;
+                next_uart = NULL;
+                next_node = &nodes[i];
+            }
+            if (nodes[i].update_pending && tx_busy_until(&nodes[i]) < next) {
+                next = tx_busy_until(&nodes[i]);
+                next_uart = NULL;
+                next_node = NULL;
+            }
+        }
+        now = next;
+        if (next_uart) {
+            uart_byte_t* entry = &next_uart->queue[next_uart->head];
+            next_uart->head = (next_uart->head + 1) % UART_QUEUE_SIZE;
+            next_uart->count--;
+            next_uart->to_node->node->recv_byte(next_uart->to_link, entry->data);
+            next_uart->to_node->update_pending = true;
+        }
+        else if (next_node) {
+            // A scan, the slaves send their matrix and the master broadcasts
+            uint32_t time = now / 1000;
+            if (next_node->index == 0) {
+                next_node->node->write_broadcast(time, next_node->counter++);
+            }
+            else {
+                next_node->node->write_matrix(time, next_node->counter++);
+            }
+            next_node->update_pending = true;
+            next_node->next_tick += config.interval_us * 1000ull;
+        }
+        // Updating can send more data and signal new writes, so keep going
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            for (i=0;i<=num_slaves;i++) {
+                if (nodes[i].update_pending && tx_busy_until(&nodes[i]) <= now) {
+                    process_node(&nodes[i], num_slaves);
+                    pending = true;
+                }
+            }
+        }
+    }
+}
+
+static void print_results(int num_slaves) {
+    uint64_t duration = config.duration_ms * 1000000ull;
+    uint64_t max_busy = 0;
+    uint32_t bit_errors = 0;
+    uint32_t dropped = 0;
+    uint32_t overflows = 0;
+    int i;
+    for (i=0;i<num_slaves;i++) {
+        uart_t* uarts[2] = {&down_uarts[i], &up_uarts[i]};
+        int j;
+        for (j=0;j<2;j++) {
+            uint64_t busy = uarts[j]->busy_time;
+            // Don't count the bytes still waiting to be sent at the end
+            if (uarts[j]->busy_until > duration) {
+                busy -= uarts[j]->busy_until - duration;
+            }
+            if (busy > max_busy) {
+                max_busy = busy;
+            }
+            bit_errors += uarts[j]->bit_errors;
+            dropped += uarts[j]->dropped;
+            overflows += uarts[j]->overflows;
+        }
+    }
+    double up_mean = up_latency.count ? up_latency.sum / 1000.0 / up_latency.count : 0.0;
+    double down_mean = down_latency.count ? down_latency.sum / 1000.0 / down_latency.count : 0.0;
+    double throughput = up_latency.count * 1000.0 / config.duration_ms;
+    printf("%6d %10.1f %10.1f %10.1f %10.1f %10.1f %10.0f %10.0f %6.1f%% %8u %8u %8u",
+        num_slaves,
+        up_mean, latency_percentile(&up_latency, 0.99), up_latency.max / 1000.0,
+        down_mean, down_latency.max / 1000.0,
+        throughput, throughput * sizeof(sim_matrix_object_t),
+        100.0 * max_busy / duration,
+        bit_errors, dropped, overflows);
+#ifdef SERIAL_LINK_RELIABLE
+    reliable_link_stats_t total = {0};
+    for (i=0;i<=num_slaves;i++) {
+        // The master has a separate link state for every slave,
+        // the slaves only talk to the master
+        int num_peers = i == 0 ? num_slaves : 1;
+        int j;
+        for (j=0;j<num_peers;j++) {
+            reliable_link_stats_t stats;
+            nodes[i].node->get_stats(j, &stats);
+            total.retransmits += stats.retransmits;
+            total.resets += stats.resets;
+            if (stats.max_rtt > total.max_rtt) {
+                total.max_rtt = stats.max_rtt;
+            }
+            if (j == 0) {
+                total.crc_errors += stats.crc_errors;
+            }
+        }
+    }
+    printf(" %8u %8u %8u %8u", total.crc_errors, total.retransmits, total.resets, total.max_rtt);
+#endif
+    printf("\n");
+}
+
+static void usage(const char* name) {
+    printf("Usage: %s [options]\n"
+           "  -b, --baud N          baud rate of every link (%u)\n"
+           "  -l, --latency US      extra latency of every byte (%u)\n"
+           "  -e, --ber P           bit error rate (%g)\n"
+           "  -d, --drop P          byte drop rate (%g)\n"
+           "  -i, --interval US     scan interval, the objects are written every scan (%u)\n"
+           "  -t, --duration MS     simulated time for each chain (%u)\n"
+           "  -s, --slaves N[-M]    number of slaves, or a range (%d-%d)\n"
+           "  -r, --seed N          random seed (%u)\n"
+           "  -L, --library PATH    the node library (%s)\n",
+           name, config.baud, config.latency_us, config.bit_error_rate, config.drop_rate,
+           config.interval_us, config.duration_ms, config.min_slaves, config.max_slaves,
+           config.seed, config.library);
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"baud", required_argument, NULL, 'b'},
+        {"latency", required_argument, NULL, 'l'},
+        {"ber", required_argument, NULL, 'e'},
+        {"drop", required_argument, NULL, 'd'},
+        {"interval", required_argument, NULL, 'i'},
+        {"duration", required_argument, NULL, 't'},
+        {"slaves", required_argument, NULL, 's'},
+        {"seed", required_argument, NULL, 'r'},
+        {"library", required_argument, NULL, 'L'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "b:l:e:d:i:t:s:r:L:h", options, NULL)) != -1) {
+        switch (c) {
+        case 'b': config.baud = strtoul(optarg, NULL, 0); break;
+        case 'l': config.latency_us = strtoul(optarg, NULL, 0); break;
+        case 'e': config.bit_error_rate = strtod(optarg, NULL); break;
+        case 'd': config.drop_rate = strtod(optarg, NULL); break;
+        case 'i': config.interval_us = strtoul(optarg, NULL, 0); break;
+        case 't': config.duration_ms = strtoul(optarg, NULL, 0); break;
+        case 's':
+            if (sscanf(optarg, "%d-%d", &config.min_slaves, &config.max_slaves) == 1) {
+                config.max_slaves = config.min_slaves;
+            }
+            break;
+        case 'r': config.seed = strtoul(optarg, NULL, 0); break;
+        case 'L': config.library = optarg; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (config.min_slaves < 1 || config.max_slaves > NUM_SLAVES || config.min_slaves > config.max_slaves ||
+        config.baud == 0 || config.interval_us == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    load_nodes();
+    printf("baud %u, latency %u us, ber %g, drop %g, interval %u us, %u ms per chain%s\n",
+        config.baud, config.latency_us, config.bit_error_rate, config.drop_rate,
+        config.interval_us, config.duration_ms,
+#ifdef SERIAL_LINK_RELIABLE
+        ", reliable"
+#else
+        ""
+#endif
+        );
+    printf("%6s %10s %10s %10s %10s %10s %10s %10s %7s %8s %8s %8s",
+        "slaves", "up mean", "up p99", "up max", "down mean", "down max",
+        "objects/s", "bytes/s", "busy", "biterr", "dropped", "overflow");
+#ifdef SERIAL_LINK_RELIABLE
+    printf(" %8s %8s %8s %8s", "crcerr", "retrans", "resets", "max rtt");
+#endif
+    printf("\n");
+    int num_slaves;
+    for (num_slaves=config.min_slaves;num_slaves<=config.max_slaves;num_slaves++) {
+        run_chain(num_slaves);
+        print_results(num_slaves);
+    }
+    return 0;
+}
@@ -28,6 +28,9 @@ SOFTWARE.
 #include "serial_link/protocol/byte_stuffer.h"
 #include "serial_link/protocol/transport.h"
 #include "serial_link/protocol/frame_router.h"
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#endif
 #include "matrix.h"
 #include <stdbool.h>
 #include "print.h"
@@ -137,7 +140,14 @@ static THD_FUNCTION(serialThread, arg) {
         eventflags_t flags1 = 0;
         eventflags_t flags2 = 0;
         if (need_wait) {
-            eventmask_t mask = chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(1000));
+            systime_t timeout = MS2ST(1000);
+#ifdef SERIAL_LINK_RELIABLE
+            // Wake up in time to retransmit unacknowledged frames
+            if (reliable_link_has_pending_frames()) {
+                timeout = US2ST(SERIAL_LINK_RETRANSMIT_TIMEOUT);
+            }
+#endif
+            eventmask_t mask = chEvtWaitAnyTimeout(ALL_EVENTS, timeout);
             if (mask & EVENT_MASK(1)) {
                 flags1 = chEvtGetAndClearFlags(&sd1_listener);
                 print_error("DOWNLINK", flags1, &SD1);
@@ -155,6 +165,9 @@ static THD_FUNCTION(serialThread, arg) {
         need_wait = true;
         need_wait &= read_from_serial(&SD2, UP_LINK) == 0;
         need_wait &= read_from_serial(&SD1, DOWN_LINK) == 0;
+#ifdef SERIAL_LINK_RELIABLE
+        update_reliable_link();
+#endif
         update_transport();
     }
 }
@@ -168,6 +181,30 @@ void send_data(uint8_t link, const uint8_t* data, uint16_t size) {
     }
 }
 
+#ifdef SERIAL_LINK_RELIABLE
+// A free running microsecond counter, that wraps at 32 bits like the
+// timeouts expect, instead of jumping when the system time wraps. It's
+// advanced by the ticks since the last call, so it has to be called at least
+// once per wrap of the system time, the serial link thread wakes up at least
+// once a second to do that. It's called from both threads, so the update is
+// done with the system locked.
+static systime_t time_base = 0;
+static uint32_t time_us = 0;
+static uint32_t time_remainder = 0;
+
+uint32_t serial_link_get_time(void) {
+    syssts_t sts = chSysGetStatusAndLockX();
+    systime_t now = chVTGetSystemTimeX();
+    uint64_t elapsed = (uint64_t)(systime_t)(now - time_base) * 1000000 + time_remainder;
+    time_base = now;
+    time_us += elapsed / CH_CFG_ST_FREQUENCY;
+    time_remainder = elapsed % CH_CFG_ST_FREQUENCY;
+    uint32_t time = time_us;
+    chSysRestoreStatusX(sts);
+    return time;
+}
+#endif
+
 static systime_t last_update = 0;
 
 typedef struct {
@@ -178,10 +215,19 @@ static matrix_object_t last_matrix = {};
 
 SLAVE_TO_MASTER_OBJECT(keyboard_matrix, matrix_object_t);
 MASTER_TO_ALL_SLAVES_OBJECT(serial_link_connected, bool);
+#ifdef SERIAL_LINK_RELIABLE
+SLAVE_TO_MASTER_OBJECT(link_stats, reliable_link_stats_t);
+
+static systime_t last_stats_update = 0;
+static reliable_link_stats_t remote_link_stats[NUM_SLAVES];
+#endif
 
 static remote_object_t* remote_objects[] = {
     REMOTE_OBJECT(serial_link_connected),
     REMOTE_OBJECT(keyboard_matrix),
+#ifdef SERIAL_LINK_RELIABLE
+    REMOTE_OBJECT(link_stats),
+#endif
 };
 
 void init_serial_link(void) {
@@ -189,6 +235,9 @@ void init_serial_link(void) {
     init_serial_link_hal();
     add_remote_objects(remote_objects, sizeof(remote_objects)/sizeof(remote_object_t*));
     init_byte_stuffer();
+#ifdef SERIAL_LINK_RELIABLE
+    init_reliable_link();
+#endif
     sdStart(&SD1, &config);
     sdStart(&SD2, &config);
     chEvtObjectInit(&new_data_event);
@@ -228,8 +277,35 @@ void serial_link_update(void) {
     if (m) {
         matrix_set_remote(m->rows, 0);
     }
+
+#ifdef SERIAL_LINK_RELIABLE
+    // The slaves report the quality of their link to the master once a second
+    if (current_time - last_stats_update > MS2ST(1000)) {
+        last_stats_update = current_time;
+        reliable_link_get_stats(0, begin_write_link_stats());
+        end_write_link_stats();
+    }
+    for (uint8_t i=0;i<NUM_SLAVES;i++) {
+        reliable_link_stats_t* stats = read_link_stats(i);
+        if (stats) {
+            remote_link_stats[i] = *stats;
+        }
+    }
+#endif
 }
 
+#ifdef SERIAL_LINK_RELIABLE
+void serial_link_get_local_stats(uint8_t slave, reliable_link_stats_t* stats) {
+    reliable_link_get_stats(slave, stats);
+}
+
+void serial_link_get_remote_stats(uint8_t slave, reliable_link_stats_t* stats) {
+    if (slave < NUM_SLAVES) {
+        *stats = remote_link_stats[slave];
+    }
+}
+#endif
+
 void signal_data_written(void) {
     chEvtBroadcast(&new_data_event);
 }
@@ -27,6 +27,9 @@ SOFTWARE.
 
 #include "host_driver.h"
 #include <stdbool.h>
+#ifdef SERIAL_LINK_RELIABLE
+#include "serial_link/protocol/reliable_link.h"
+#endif
 
 void init_serial_link(void);
 void init_serial_link_hal(void);
@@ -35,6 +38,13 @@ bool is_serial_link_master(void);
 host_driver_t* get_serial_link_driver(void);
 void serial_link_update(void);
 
+#ifdef SERIAL_LINK_RELIABLE
+// The statistics of the master's end of the link to a slave
+void serial_link_get_local_stats(uint8_t slave, reliable_link_stats_t* stats);
+// The statistics the slave has reported about its end of the link
+void serial_link_get_remote_stats(uint8_t slave, reliable_link_stats_t* stats);
+#endif
+
 #if defined(PROTOCOL_CHIBIOS)
 #include "ch.h"
 
@@ -0,0 +1,253 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Fred Sundvik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <vector>
+extern "C" {
+#include "serial_link/protocol/reliable_link.h"
+#include "serial_link/protocol/frame_router.h"
+}
+
+using testing::_;
+using testing::ElementsAreArray;
+using testing::Args;
+
+class ReliableLink : public testing::Test {
+public:
+    ReliableLink() :
+        time(0),
+        master(true)
+    {
+        Instance = this;
+        init_reliable_link();
+    }
+
+    ~ReliableLink() {
+        Instance = nullptr;
+    }
+
+    MOCK_METHOD3(transport_recv_frame, void (uint8_t from, uint8_t* data, uint16_t size));
+    MOCK_METHOD1(router_send_frame, void (uint8_t destination));
+
+    void router_send_frame(uint8_t destination, uint8_t* data, uint16_t size) {
+        router_send_frame(destination);
+        sent_frames.emplace_back(data, data + size);
+    }
+
+    void send(uint8_t destination, uint8_t value) {
+        uint8_t data[1 + 7] = {value};
+        reliable_send_frame(destination, data, 1);
+    }
+
+    void receive(uint8_t from, std::vector<uint8_t> frame) {
+        reliable_recv_frame(from, frame.data(), frame.size());
+    }
+
+    uint32_t time;
+    bool master;
+    std::vector<std::vector<uint8_t>> sent_frames;
+
+    static ReliableLink* Instance;
+};
+
+ReliableLink* ReliableLink::Instance = nullptr;
+
+extern "C" {
+    void transport_recv_frame(uint8_t from, uint8_t* data, uint16_t size) {
+        ReliableLink::Instance->transport_recv_frame(from, data, size);
+    }
+
+    void router_send_frame(uint8_t destination, uint8_t* data, uint16_t size) {
+        ReliableLink::Instance->router_send_frame(destination, data, size);
+    }
+
+    uint32_t serial_link_get_time(void) {
+        return ReliableLink::Instance->time;
+    }
+
+    bool router_is_master(void) {
+        return ReliableLink::Instance->master;
+    }
+}
+
+// The trailer is the sequence number followed by the frame type
+static const uint8_t UNRELIABLE = 0;
+static const uint8_t DATA = 1;
+static const uint8_t SYNC = 2;
+static const uint8_t ACK = 3;
+static const uint8_t NAK = 4;
+
+TEST_F(ReliableLink, first_frame_to_master_is_a_sync) {
+    EXPECT_CALL(*this, router_send_frame(0));
+    send(0, 0x55);
+    std::vector<uint8_t> expected = {0x55, 0, SYNC};
+    EXPECT_EQ(sent_frames[0], expected);
+}
+
+TEST_F(ReliableLink, frames_to_slaves_use_the_router_bitmask) {
+    EXPECT_CALL(*this, router_send_frame(1 << 2));
+    send(3, 0x55);
+}
+
+TEST_F(ReliableLink, broadcast_is_sent_unreliably) {
+    EXPECT_CALL(*this, router_send_frame(0xFF));
+    send(0xFF, 0x55);
+    std::vector<uint8_t> expected = {0x55, 0, UNRELIABLE};
+    EXPECT_EQ(sent_frames[0], expected);
+    EXPECT_FALSE(reliable_link_has_pending_frames());
+}
+
+TEST_F(ReliableLink, receives_in_order_frame_and_acks) {
+    std::vector<uint8_t> payload = {0x12};
+    EXPECT_CALL(*this, transport_recv_frame(2, _, _))
+        .With(Args<1, 2>(ElementsAreArray(payload)));
+    EXPECT_CALL(*this, router_send_frame(1 << 1));
+    receive(2, {0x12, 0, SYNC});
+    std::vector<uint8_t> expected = {1, ACK};
+    EXPECT_EQ(sent_frames[0], expected);
+}
+
+TEST_F(ReliableLink, unreliable_frame_is_delivered_without_ack) {
+    EXPECT_CALL(*this, transport_recv_frame(0, _, 1));
+    EXPECT_CALL(*this, router_send_frame(_)).Times(0);
+    receive(0, {0x12, 0, UNRELIABLE});
+}
+
+TEST_F(ReliableLink, duplicate_frame_is_acked_but_not_delivered) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(2);
+    EXPECT_CALL(*this, transport_recv_frame(0, _, _)).Times(1);
+    receive(0, {0x12, 0, DATA});
+    receive(0, {0x12, 0, DATA});
+    std::vector<uint8_t> expected = {1, ACK};
+    EXPECT_EQ(sent_frames[1], expected);
+}
+
+TEST_F(ReliableLink, gap_in_sequence_sends_a_single_nak) {
+    EXPECT_CALL(*this, transport_recv_frame(_, _, _)).Times(0);
+    EXPECT_CALL(*this, router_send_frame(0)).Times(1);
+    receive(0, {0x12, 1, DATA});
+    receive(0, {0x13, 2, DATA});
+    std::vector<uint8_t> expected = {0, NAK};
+    EXPECT_EQ(sent_frames[0], expected);
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.naks_sent, 1);
+}
+
+TEST_F(ReliableLink, retransmits_after_timeout) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(2);
+    send(0, 0x55);
+    time = SERIAL_LINK_RETRANSMIT_TIMEOUT - 1;
+    update_reliable_link();
+    time = SERIAL_LINK_RETRANSMIT_TIMEOUT;
+    update_reliable_link();
+    EXPECT_EQ(sent_frames[0], sent_frames[1]);
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.timeouts, 1);
+    EXPECT_EQ(stats.retransmits, 1);
+}
+
+TEST_F(ReliableLink, ack_stops_retransmission_and_measures_rtt) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(1);
+    send(0, 0x55);
+    time = 300;
+    receive(0, {1, ACK});
+    EXPECT_FALSE(reliable_link_has_pending_frames());
+    time = 2 * SERIAL_LINK_RETRANSMIT_TIMEOUT;
+    update_reliable_link();
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.rtt, 300);
+    EXPECT_EQ(stats.max_rtt, 300);
+}
+
+TEST_F(ReliableLink, frames_after_the_first_ack_are_data) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(2);
+    send(0, 0x55);
+    receive(0, {1, ACK});
+    send(0, 0x56);
+    std::vector<uint8_t> expected = {0x56, 1, DATA};
+    EXPECT_EQ(sent_frames[1], expected);
+}
+
+TEST_F(ReliableLink, full_window_blocks_sending) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(SERIAL_LINK_RELIABLE_WINDOW);
+    for (int i=0;i<SERIAL_LINK_RELIABLE_WINDOW;i++) {
+        EXPECT_TRUE(reliable_link_can_send(0));
+        send(0, i);
+    }
+    EXPECT_FALSE(reliable_link_can_send(0));
+    EXPECT_TRUE(reliable_link_can_send(0xFF));
+    receive(0, {2, ACK});
+    EXPECT_TRUE(reliable_link_can_send(0));
+}
+
+TEST_F(ReliableLink, nak_retransmits_from_the_requested_frame) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(3 + 2);
+    send(0, 0x10);
+    send(0, 0x11);
+    send(0, 0x12);
+    receive(0, {1, NAK});
+    std::vector<uint8_t> expected1 = {0x11, 1, DATA};
+    std::vector<uint8_t> expected2 = {0x12, 2, DATA};
+    EXPECT_EQ(sent_frames[3], expected1);
+    EXPECT_EQ(sent_frames[4], expected2);
+}
+
+TEST_F(ReliableLink, resynchronizes_after_too_many_timeouts) {
+    EXPECT_CALL(*this, router_send_frame(0)).Times(1 + SERIAL_LINK_MAX_RETRANSMITS + 1);
+    send(0, 0x10);
+    for (int i=1;i<=SERIAL_LINK_MAX_RETRANSMITS + 1;i++) {
+        time = i * SERIAL_LINK_RETRANSMIT_TIMEOUT;
+        update_reliable_link();
+    }
+    EXPECT_FALSE(reliable_link_has_pending_frames());
+    send(0, 0x11);
+    std::vector<uint8_t> expected = {0x11, 1, SYNC};
+    EXPECT_EQ(sent_frames.back(), expected);
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.resets, 1);
+}
+
+TEST_F(ReliableLink, counts_crc_errors_for_the_first_slave_on_the_master) {
+    reliable_link_crc_error(DOWN_LINK);
+    reliable_link_crc_error(DOWN_LINK);
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.crc_errors, 2);
+    reliable_link_get_stats(3, &stats);
+    EXPECT_EQ(stats.crc_errors, 0);
+}
+
+TEST_F(ReliableLink, counts_crc_errors_from_the_master_on_a_slave) {
+    master = false;
+    reliable_link_crc_error(UP_LINK);
+    reliable_link_crc_error(DOWN_LINK);
+    reliable_link_stats_t stats;
+    reliable_link_get_stats(0, &stats);
+    EXPECT_EQ(stats.crc_errors, 1);
+}
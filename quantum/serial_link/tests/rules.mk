@@ -20,3 +20,7 @@ serial_link_transport_SRC := \
 	$(SERIAL_PATH)/tests/transport_tests.cpp \
 	$(SERIAL_PATH)/protocol/transport.c \
 	$(SERIAL_PATH)/protocol/triple_buffered_object.c 
+
+serial_link_reliable_link_SRC := \
+	$(SERIAL_PATH)/tests/reliable_link_tests.cpp \
+	$(SERIAL_PATH)/protocol/reliable_link.c
@@ -0,0 +1,40 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPLIT_SERIAL_H
+#define SPLIT_SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The physical layer of the split transport. It's a half-duplex link,
+ * where each frame starts with a break, so that the receiver can find the
+ * start of the frame. Either side can start sending when the line is idle.
+ * The transmit and receive are asynchronous, and complete by calling
+ * split_transport_tx_complete and split_transport_rx_complete from the
+ * interrupt.
+ */
+
+void split_serial_init(bool master);
+// Returns false without sending anything while a frame from the other
+// side is being received, or a frame is being sent
+bool split_serial_transmit(const uint8_t* data, uint8_t size);
+void split_serial_receive(uint8_t* data, uint8_t size);
+// Stops any transfer in progress and releases the line
+void split_serial_abort(void);
+
+#endif
@@ -0,0 +1,323 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Interrupt driven software serial on a single pin, for boards that
+ * connect the halves with one wire to an external interrupt pin.
+ * The falling edge of the start bit triggers the external interrupt,
+ * and a timer in CTC mode then samples or drives one bit per compare
+ * match. The bytes are sent like on a UART, LSB first with one start
+ * and one stop bit, so nothing busy waits and the main loop keeps running.
+ */
+
+// The keymaps of the boards that can also use I2C between the halves
+// define USE_I2C, and don't need the serial transport
+#ifndef USE_I2C
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "split_serial.h"
+#include "split_transport.h"
+
+#ifndef SERIAL_PIN_DDR
+#define SERIAL_PIN_DDR DDRD
+#define SERIAL_PIN_PORT PORTD
+#define SERIAL_PIN_INPUT PIND
+#define SERIAL_PIN_MASK _BV(PD0)
+#define SERIAL_PIN_INTERRUPT INT0_vect
+#define SERIAL_PIN_INT_MASK _BV(INT0)
+#define SERIAL_PIN_INT_FLAG _BV(INTF0)
+#define SERIAL_PIN_ISC0 _BV(ISC00)
+#define SERIAL_PIN_ISC1 _BV(ISC01)
+#endif
+
+#ifndef SPLIT_SOFT_SERIAL_BAUD
+#define SPLIT_SOFT_SERIAL_BAUD 50000
+#endif
+
+// Timer 1 by default, define SPLIT_SOFT_SERIAL_TIMER3 if it's used for
+// the backlight or audio
+#ifdef SPLIT_SOFT_SERIAL_TIMER3
+#define SOFT_SERIAL_TCCRA TCCR3A
+#define SOFT_SERIAL_TCCRB TCCR3B
+#define SOFT_SERIAL_TCNT TCNT3
+#define SOFT_SERIAL_OCR OCR3A
+#define SOFT_SERIAL_TIMSK TIMSK3
+#define SOFT_SERIAL_TIFR TIFR3
+#define SOFT_SERIAL_OCIE _BV(OCIE3A)
+#define SOFT_SERIAL_OCF _BV(OCF3A)
+#define SOFT_SERIAL_CTC _BV(WGM32)
+#define SOFT_SERIAL_CLOCK _BV(CS30)
+#define SOFT_SERIAL_TIMER_vect TIMER3_COMPA_vect
+#else
+#define SOFT_SERIAL_TCCRA TCCR1A
+#define SOFT_SERIAL_TCCRB TCCR1B
+#define SOFT_SERIAL_TCNT TCNT1
+#define SOFT_SERIAL_OCR OCR1A
+#define SOFT_SERIAL_TIMSK TIMSK1
+#define SOFT_SERIAL_TIFR TIFR1
+#define SOFT_SERIAL_OCIE _BV(OCIE1A)
+#define SOFT_SERIAL_OCF _BV(OCF1A)
+#define SOFT_SERIAL_CTC _BV(WGM12)
+#define SOFT_SERIAL_CLOCK _BV(CS10)
+#define SOFT_SERIAL_TIMER_vect TIMER1_COMPA_vect
+#endif
+
+// The audio takes over the whole timer of its pin, the backlight
+// checks its own timer against this one in quantum.c
+#ifdef AUDIO_ENABLE
+    #if !defined(SPLIT_SOFT_SERIAL_TIMER3) && defined(B5_AUDIO)
+        #error "The soft split serial and the audio can't both use timer 1, define SPLIT_SOFT_SERIAL_TIMER3"
+    #endif
+    #if defined(SPLIT_SOFT_SERIAL_TIMER3) && defined(C6_AUDIO)
+        #error "The soft split serial and the audio can't both use timer 3"
+    #endif
+#endif
+
+#define BIT_TICKS (F_CPU / SPLIT_SOFT_SERIAL_BAUD)
+// The line is left idle for a while before transmitting, so that the other
+// side has time to release it after its stop bit
+#define TURNAROUND_BITS 2
+// Long enough for the receiver to see a framing error
+#define BREAK_BITS 12
+#define MARK_BITS 2
+
+typedef enum {
+    SOFT_SERIAL_IDLE,
+    SOFT_SERIAL_TURNAROUND,
+    SOFT_SERIAL_BREAK,
+    SOFT_SERIAL_MARK,
+    SOFT_SERIAL_TRANSMIT,
+    SOFT_SERIAL_RECEIVE,
+} soft_serial_state_t;
+
+static volatile uint8_t state = SOFT_SERIAL_IDLE;
+static const uint8_t* tx_data;
+static uint8_t* rx_data;
+static uint8_t size;
+static uint8_t position;
+// Set from the break until the end of the received frame
+static bool in_frame;
+static uint8_t bit;
+static uint8_t counter;
+static uint8_t shift;
+
+// The line is only driven low, and the pull-ups make the ones, so the
+// halves can't short it by driving it at the same time
+static inline void line_release(void) {
+    SERIAL_PIN_DDR &= ~SERIAL_PIN_MASK;
+    SERIAL_PIN_PORT |= SERIAL_PIN_MASK;
+}
+
+static inline void line_low(void) {
+    SERIAL_PIN_PORT &= ~SERIAL_PIN_MASK;
+    SERIAL_PIN_DDR |= SERIAL_PIN_MASK;
+}
+
+static inline bool line_read(void) {
+    return SERIAL_PIN_INPUT & SERIAL_PIN_MASK;
+}
+
+static inline void timer_start(uint16_t first_tick) {
+    SOFT_SERIAL_TCNT = BIT_TICKS - first_tick;
+    SOFT_SERIAL_TIFR = SOFT_SERIAL_OCF;
+    SOFT_SERIAL_TIMSK |= SOFT_SERIAL_OCIE;
+}
+
+static inline void timer_stop(void) {
+    SOFT_SERIAL_TIMSK &= ~SOFT_SERIAL_OCIE;
+}
+
+static inline void wait_for_start_bit(void) {
+    // The flag is set by every falling edge, even with the interrupt disabled
+    EIFR = SERIAL_PIN_INT_FLAG;
+    EIMSK |= SERIAL_PIN_INT_MASK;
+}
+
+void split_serial_init(bool master) {
+    (void)master;
+    line_release();
+    // Falling edge
+    EICRA = (EICRA & ~SERIAL_PIN_ISC0) | SERIAL_PIN_ISC1;
+    EIMSK &= ~SERIAL_PIN_INT_MASK;
+    SOFT_SERIAL_TCCRA = 0;
+    SOFT_SERIAL_TCCRB = SOFT_SERIAL_CTC | SOFT_SERIAL_CLOCK;
+    SOFT_SERIAL_OCR = BIT_TICKS - 1;
+    timer_stop();
+}
+
+bool split_serial_transmit(const uint8_t* data, uint8_t _size) {
+    uint8_t sreg = SREG;
+    cli();
+    bool receiving = state == SOFT_SERIAL_RECEIVE &&
+        (in_frame || (SOFT_SERIAL_TIMSK & SOFT_SERIAL_OCIE));
+    if (receiving || (state != SOFT_SERIAL_IDLE && state != SOFT_SERIAL_RECEIVE)) {
+        SREG = sreg;
+        return false;
+    }
+    EIMSK &= ~SERIAL_PIN_INT_MASK;
+    tx_data = data;
+    size = _size;
+    position = 0;
+    counter = TURNAROUND_BITS;
+    state = SOFT_SERIAL_TURNAROUND;
+    timer_start(BIT_TICKS);
+    SREG = sreg;
+    return true;
+}
+
+void split_serial_receive(uint8_t* data, uint8_t _size) {
+    uint8_t sreg = SREG;
+    cli();
+    rx_data = data;
+    size = _size;
+    position = 0;
+    in_frame = false;
+    state = SOFT_SERIAL_RECEIVE;
+    line_release();
+    wait_for_start_bit();
+    SREG = sreg;
+}
+
+void split_serial_abort(void) {
+    uint8_t sreg = SREG;
+    cli();
+    timer_stop();
+    EIMSK &= ~SERIAL_PIN_INT_MASK;
+    line_release();
+    in_frame = false;
+    state = SOFT_SERIAL_IDLE;
+    SREG = sreg;
+}
+
+ISR(SERIAL_PIN_INTERRUPT) {
+    EIMSK &= ~SERIAL_PIN_INT_MASK;
+    bit = 0;
+    // Sample in the middle of the bits
+    timer_start(BIT_TICKS / 2);
+}
+
+static void transmit_tick(void) {
+    if (bit == 0) {
+        shift = tx_data[position];
+        line_low();
+    }
+    else if (bit <= 8) {
+        if (shift & 1) {
+            line_release();
+        }
+        else {
+            line_low();
+        }
+        shift >>= 1;
+    }
+    else if (bit == 9) {
+        line_release();
+    }
+    else {
+        // The stop bit is done
+        if (++position < size) {
+            bit = 0;
+            shift = tx_data[position];
+            line_low();
+        }
+        else {
+            timer_stop();
+            line_release();
+            state = SOFT_SERIAL_IDLE;
+            split_transport_tx_complete();
+            return;
+        }
+    }
+    bit++;
+}
+
+static void receive_tick(void) {
+    bool value = line_read();
+    if (bit == 0) {
+        if (value) {
+            // A glitch, not a start bit
+            timer_stop();
+            wait_for_start_bit();
+            return;
+        }
+    }
+    else if (bit <= 8) {
+        shift >>= 1;
+        if (value) {
+            shift |= 0x80;
+        }
+    }
+    else {
+        timer_stop();
+        if (!value) {
+            // Framing error, which means a break and the start of a new frame
+            position = 0;
+            in_frame = true;
+        }
+        else if (in_frame) {
+            // Anything before the first break is the tail of a frame
+            // that started before the receive was set up
+            rx_data[position++] = shift;
+            if (position == size) {
+                in_frame = false;
+                state = SOFT_SERIAL_IDLE;
+                split_transport_rx_complete();
+                return;
+            }
+        }
+        wait_for_start_bit();
+        return;
+    }
+    bit++;
+}
+
+ISR(SOFT_SERIAL_TIMER_vect) {
+    switch (state) {
+    case SOFT_SERIAL_TURNAROUND:
+        if (--counter == 0) {
+            line_low();
+            counter = BREAK_BITS;
+            state = SOFT_SERIAL_BREAK;
+        }
+        break;
+    case SOFT_SERIAL_BREAK:
+        if (--counter == 0) {
+            line_release();
+            counter = MARK_BITS;
+            state = SOFT_SERIAL_MARK;
+        }
+        break;
+    case SOFT_SERIAL_MARK:
+        if (--counter == 0) {
+            bit = 0;
+            state = SOFT_SERIAL_TRANSMIT;
+            transmit_tick();
+        }
+        break;
+    case SOFT_SERIAL_TRANSMIT:
+        transmit_tick();
+        break;
+    case SOFT_SERIAL_RECEIVE:
+        receive_tick();
+        break;
+    default:
+        timer_stop();
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,164 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Half-duplex serial on USART1 of the ATmega32U4. RXD1 (D2) and TXD1 (D3)
+ * are tied to the same wire, TXD1 through a series resistor. The
+ * transmitter is only enabled while sending, and the receiver only while
+ * receiving, so each side ignores its own echo.
+ * The break that starts a frame is a zero sent at half the baud rate,
+ * which the receiver sees as a framing error.
+ */
+
+// The keymaps of the boards that can also use I2C between the halves
+// define USE_I2C, and don't need the serial transport
+#ifndef USE_I2C
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "split_serial.h"
+#include "split_transport.h"
+
+#ifndef SPLIT_USART_BAUD
+#define SPLIT_USART_BAUD 250000
+#endif
+
+// Double speed mode
+#define UBRR_VALUE(baud) ((F_CPU + 4UL * (baud)) / (8UL * (baud)) - 1)
+
+typedef enum {
+    USART_IDLE,
+    USART_BREAK,
+    USART_TRANSMIT,
+    USART_RECEIVE,
+} usart_state_t;
+
+static volatile uint8_t state = USART_IDLE;
+static const uint8_t* tx_data;
+static uint8_t* rx_data;
+static uint8_t size;
+static uint8_t position;
+// Set from the break until the end of the received frame
+static bool in_frame;
+
+static inline void release_tx_pin(void) {
+    // When the transmitter is disabled the pin is a normal input again
+    UCSR1B &= ~(_BV(TXEN1) | _BV(TXCIE1) | _BV(UDRIE1));
+    DDRD &= ~_BV(PD3);
+    PORTD |= _BV(PD3);
+}
+
+void split_serial_init(bool master) {
+    (void)master;
+    UCSR1B = 0;
+    UCSR1A = _BV(U2X1);
+    // 8N1
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UBRR1 = UBRR_VALUE(SPLIT_USART_BAUD);
+    // Pull-up on RXD1 keeps the line idle when nobody drives it
+    DDRD &= ~(_BV(PD2) | _BV(PD3));
+    PORTD |= _BV(PD2) | _BV(PD3);
+}
+
+bool split_serial_transmit(const uint8_t* data, uint8_t _size) {
+    uint8_t sreg = SREG;
+    cli();
+    if ((state == USART_RECEIVE && in_frame) || state == USART_BREAK || state == USART_TRANSMIT) {
+        SREG = sreg;
+        return false;
+    }
+    UCSR1B &= ~(_BV(RXEN1) | _BV(RXCIE1));
+    tx_data = data;
+    size = _size;
+    position = 0;
+    state = USART_BREAK;
+    UBRR1 = UBRR_VALUE(SPLIT_USART_BAUD / 2);
+    UCSR1A |= _BV(TXC1);
+    UCSR1B |= _BV(TXEN1) | _BV(TXCIE1);
+    UDR1 = 0;
+    SREG = sreg;
+    return true;
+}
+
+void split_serial_receive(uint8_t* data, uint8_t _size) {
+    uint8_t sreg = SREG;
+    cli();
+    rx_data = data;
+    size = _size;
+    position = 0;
+    in_frame = false;
+    state = USART_RECEIVE;
+    UCSR1B |= _BV(RXEN1) | _BV(RXCIE1);
+    SREG = sreg;
+}
+
+void split_serial_abort(void) {
+    uint8_t sreg = SREG;
+    cli();
+    release_tx_pin();
+    UCSR1B &= ~(_BV(RXEN1) | _BV(RXCIE1));
+    UBRR1 = UBRR_VALUE(SPLIT_USART_BAUD);
+    in_frame = false;
+    state = USART_IDLE;
+    SREG = sreg;
+}
+
+ISR(USART1_UDRE_vect) {
+    UDR1 = tx_data[position++];
+    if (position == size) {
+        UCSR1B &= ~_BV(UDRIE1);
+    }
+}
+
+ISR(USART1_TX_vect) {
+    if (state == USART_BREAK) {
+        UBRR1 = UBRR_VALUE(SPLIT_USART_BAUD);
+        state = USART_TRANSMIT;
+        UCSR1B |= _BV(UDRIE1);
+    }
+    else if (state == USART_TRANSMIT && position == size) {
+        release_tx_pin();
+        state = USART_IDLE;
+        split_transport_tx_complete();
+    }
+}
+
+ISR(USART1_RX_vect) {
+    uint8_t status = UCSR1A;
+    uint8_t data = UDR1;
+    if (state != USART_RECEIVE) {
+        return;
+    }
+    if (status & _BV(FE1)) {
+        // A break, the frame starts again
+        position = 0;
+        in_frame = true;
+        return;
+    }
+    if (!in_frame) {
+        // The tail of a frame that started before the receive was set up
+        return;
+    }
+    rx_data[position++] = data;
+    if (position == size) {
+        UCSR1B &= ~(_BV(RXEN1) | _BV(RXCIE1));
+        in_frame = false;
+        state = USART_IDLE;
+        split_transport_rx_complete();
+    }
+}
+
+#endif
@@ -0,0 +1,553 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// The keymaps of the boards that can also use I2C between the halves
+// define USE_I2C, and don't need the serial transport
+#ifndef USE_I2C
+
+#include "split_transport.h"
+#include "split_serial.h"
+#include "timer.h"
+#include "host.h"
+#include "led.h"
+#include "action_layer.h"
+#include <string.h>
+#ifdef RGBLIGHT_ENABLE
+#include "rgblight.h"
+#endif
+#ifdef BACKLIGHT_ENABLE
+#include "backlight.h"
+#endif
+
+#if defined(__AVR__)
+#include <util/atomic.h>
+#define SPLIT_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#define SPLIT_ATOMIC
+#endif
+
+#if SPLIT_ROWS_PER_HAND > 8 || MATRIX_COLS > 16
+#error "The split transport supports up to 8 rows per hand and 16 columns"
+#endif
+#if SPLIT_EVENT_QUEUE > 128 || (SPLIT_EVENT_QUEUE & (SPLIT_EVENT_QUEUE - 1))
+#error "SPLIT_EVENT_QUEUE must be a power of two, up to 128"
+#endif
+
+// An event is the row and column of the key, with the top bit set when
+// it's pressed, and how many milliseconds ago it happened
+#define EVENT_PRESSED 0x80
+#define EVENT_KEY(row, col) ((row) << 4 | (col))
+#define EVENT_ROW(key) (((key) >> 4) & 0x07)
+#define EVENT_COL(key) ((key) & 0x0F)
+#define EVENT_QUEUE_MASK (SPLIT_EVENT_QUEUE - 1)
+
+#define TIME_BEFORE_OR_SAME(a, b) ((int16_t)((a) - (b)) <= 0)
+
+// The other side answers this frame
+#define MASTER_FLAG_REPLY 0x01
+// The master lost the slave keys, and wants all pressed keys again
+#define MASTER_FLAG_RESYNC 0x02
+// The frame answers the master, rather than pushing new events
+#define SLAVE_FLAG_REPLY 0x01
+
+typedef struct {
+    uint8_t flags;
+    // Sequence number of the last event batch received
+    uint8_t ack;
+    split_master_state_t state;
+    uint8_t crc;
+} __attribute__((packed)) master_frame_t;
+
+typedef struct {
+    uint8_t key;
+    uint8_t age;
+} __attribute__((packed)) frame_event_t;
+
+typedef struct {
+    uint8_t flags;
+    // Zero when there are no events
+    uint8_t seq;
+    uint8_t count;
+    frame_event_t events[SPLIT_EVENT_BATCH];
+    uint8_t crc;
+} __attribute__((packed)) slave_frame_t;
+
+typedef struct {
+    uint8_t key;
+    uint16_t time;
+} queued_event_t;
+
+typedef enum {
+    LINK_LISTEN,
+    // The master sent its state, and waits for the answer
+    LINK_REQUEST,
+    // Sending a frame that isn't answered
+    LINK_TRANSMIT,
+} link_status_t;
+
+static bool is_master;
+static volatile uint8_t link_status;
+
+static master_frame_t master_frame;
+static slave_frame_t slave_frame;
+
+// Written by the interrupt on the master and read by the main loop on the
+// master, or written by the main loop on the slave and read when sending
+static queued_event_t event_queue[SPLIT_EVENT_QUEUE];
+static volatile uint8_t event_head;
+static volatile uint8_t event_tail;
+
+// Master only
+static volatile bool connected;
+static volatile bool resync;
+static volatile uint16_t last_seen;
+static volatile uint8_t last_seq;
+static uint16_t request_time;
+// Used by the interrupt for the acknowledgements
+static split_master_state_t next_master_state;
+static split_master_state_t sent_master_state;
+static split_master_state_t acked_master_state;
+static bool local_pending;
+static uint16_t local_time;
+static uint8_t settle;
+
+// Slave only
+static slave_frame_t empty_slave_frame;
+static matrix_row_t reported_rows[SPLIT_ROWS_PER_HAND];
+static volatile bool batch_in_flight;
+static volatile bool batch_acked;
+static volatile bool resync_requested;
+static uint16_t batch_time;
+static uint8_t batch_seq;
+// The master still has the last sequence number from before a reboot, so
+// the batches wait for its acknowledgement number to continue from there
+static volatile bool batch_seq_synced;
+// Received by the interrupt and applied by the main loop
+static split_master_state_t received_master_state;
+static volatile bool master_state_received;
+
+static uint8_t crc8(const uint8_t* data, uint8_t size) {
+    // CRC-8 with the polynomial 0x07
+    uint8_t crc = 0;
+    while (size--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+#define FRAME_CRC(frame) crc8((const uint8_t*)(frame), sizeof(*(frame)) - 1)
+
+static inline uint8_t event_queue_count(void) {
+    return (event_tail - event_head) & 0xFF;
+}
+
+static inline uint8_t event_queue_space(void) {
+    return SPLIT_EVENT_QUEUE - event_queue_count();
+}
+
+static inline void event_queue_push(uint8_t key, uint16_t time) {
+    queued_event_t* event = &event_queue[event_tail & EVENT_QUEUE_MASK];
+    event->key = key;
+    event->time = time;
+    event_tail++;
+}
+
+static void get_master_state(split_master_state_t* state) {
+#ifndef NO_ACTION_LAYER
+    state->layer_state = layer_state;
+#else
+    state->layer_state = 0;
+#endif
+    state->host_leds = host_keyboard_leds();
+#ifdef RGBLIGHT_ENABLE
+    state->rgblight = rgblight_config.raw;
+#endif
+#ifdef BACKLIGHT_ENABLE
+    state->backlight = get_backlight_level();
+#endif
+}
+
+void split_transport_init(bool master) {
+    is_master = master;
+    link_status = LINK_LISTEN;
+    event_head = 0;
+    event_tail = 0;
+    connected = false;
+    resync = true;
+    last_seq = 0;
+    local_pending = false;
+    settle = 0;
+    batch_in_flight = false;
+    batch_acked = false;
+    resync_requested = false;
+    batch_seq = 0;
+    batch_seq_synced = false;
+    master_state_received = false;
+    memset(reported_rows, 0, sizeof(reported_rows));
+    memset(&acked_master_state, 0, sizeof(acked_master_state));
+    memset(&empty_slave_frame, 0, sizeof(empty_slave_frame));
+    empty_slave_frame.flags = SLAVE_FLAG_REPLY;
+    empty_slave_frame.crc = FRAME_CRC(&empty_slave_frame);
+    // Look for the slave right away
+    request_time = timer_read() - SPLIT_TRANSPORT_KEEPALIVE;
+    split_serial_init(master);
+    if (is_master) {
+        split_serial_receive((uint8_t*)&slave_frame, sizeof(slave_frame));
+    }
+    else {
+        split_serial_receive((uint8_t*)&master_frame, sizeof(master_frame));
+    }
+}
+
+void split_transport_task(void) {
+    split_master_state_t state;
+    get_master_state(&state);
+
+    SPLIT_ATOMIC {
+        next_master_state = state;
+        if (connected && timer_elapsed(last_seen) > SPLIT_TRANSPORT_DISCONNECT) {
+            // The slave keys are cleared by the matrix, so they have to be
+            // sent again when the slave comes back
+            connected = false;
+            resync = true;
+            event_head = event_tail;
+        }
+        if (link_status == LINK_REQUEST && timer_elapsed(request_time) > SPLIT_TRANSPORT_TIMEOUT) {
+            // The slave didn't answer, or the answer was lost
+            split_serial_abort();
+            split_serial_receive((uint8_t*)&slave_frame, sizeof(slave_frame));
+            link_status = LINK_LISTEN;
+        }
+        if (link_status == LINK_LISTEN) {
+            bool send;
+            if (connected) {
+                send = memcmp(&state, &acked_master_state, sizeof(state)) != 0 ||
+                    timer_elapsed(last_seen) >= SPLIT_TRANSPORT_KEEPALIVE;
+            }
+            else {
+                send = timer_elapsed(request_time) >= SPLIT_TRANSPORT_KEEPALIVE;
+            }
+            // Don't send the state again before the last try timed out
+            send = send && timer_elapsed(request_time) > SPLIT_TRANSPORT_TIMEOUT;
+            if (send) {
+                master_frame.flags = MASTER_FLAG_REPLY | (resync ? MASTER_FLAG_RESYNC : 0);
+                master_frame.ack = last_seq;
+                master_frame.state = state;
+                master_frame.crc = FRAME_CRC(&master_frame);
+                sent_master_state = state;
+                request_time = timer_read();
+                if (split_serial_transmit((uint8_t*)&master_frame, sizeof(master_frame))) {
+                    link_status = LINK_REQUEST;
+                }
+            }
+        }
+    }
+}
+
+bool split_transport_connected(void) {
+    return connected;
+}
+
+static void master_receive_events(uint16_t now) {
+    if (slave_frame.count == 0 || slave_frame.seq == last_seq) {
+        // Nothing new, or the acknowledgement was lost and this is sent again
+        return;
+    }
+    if (slave_frame.count > SPLIT_EVENT_BATCH || event_queue_space() < slave_frame.count) {
+        // Not acknowledged, so the slave sends it again later
+        return;
+    }
+    for (uint8_t i = 0; i < slave_frame.count; i++) {
+        event_queue_push(slave_frame.events[i].key, now - slave_frame.events[i].age);
+    }
+    last_seq = slave_frame.seq;
+}
+
+bool split_transport_merge(matrix_row_t* matrix, const matrix_row_t* local_rows,
+    uint8_t local_offset, uint8_t remote_offset) {
+    bool local_changed = false;
+    for (uint8_t i = 0; i < SPLIT_ROWS_PER_HAND; i++) {
+        if (matrix[local_offset + i] != local_rows[i]) {
+            local_changed = true;
+        }
+    }
+    if (!local_changed) {
+        local_pending = false;
+    }
+    else if (!local_pending) {
+        local_pending = true;
+        local_time = timer_read();
+    }
+
+    // Wait until the keyboard task has handled all the keys of the last change
+    if (settle) {
+        settle--;
+        return false;
+    }
+
+    uint8_t changes = 0;
+    if (event_queue_count() && (!local_pending ||
+            TIME_BEFORE_OR_SAME(event_queue[event_head & EVENT_QUEUE_MASK].time, local_time))) {
+        uint8_t key = event_queue[event_head & EVENT_QUEUE_MASK].key;
+        event_head++;
+        matrix_row_t* row = &matrix[remote_offset + EVENT_ROW(key)];
+        matrix_row_t bit = (matrix_row_t)1 << EVENT_COL(key);
+        matrix_row_t value = key & EVENT_PRESSED ? *row | bit : *row & ~bit;
+        if (value != *row) {
+            *row = value;
+            changes = 1;
+        }
+    }
+    else if (local_pending) {
+        for (uint8_t i = 0; i < SPLIT_ROWS_PER_HAND; i++) {
+            matrix_row_t diff = matrix[local_offset + i] ^ local_rows[i];
+            while (diff) {
+                diff &= diff - 1;
+                changes++;
+            }
+            matrix[local_offset + i] = local_rows[i];
+        }
+        local_pending = false;
+    }
+    if (changes > 1) {
+        settle = changes - 1;
+    }
+    return changes != 0;
+}
+
+bool split_transport_master_scan(matrix_row_t* matrix, const matrix_row_t* local_rows,
+    bool left_hand) {
+    uint8_t local_offset = left_hand ? 0 : SPLIT_ROWS_PER_HAND;
+    uint8_t remote_offset = left_hand ? SPLIT_ROWS_PER_HAND : 0;
+    split_transport_task();
+    split_transport_merge(matrix, local_rows, local_offset, remote_offset);
+    return split_transport_connected();
+}
+
+__attribute__((weak))
+void split_transport_apply_master_state(const split_master_state_t* state) {
+    static uint8_t host_leds;
+#ifndef NO_ACTION_LAYER
+    layer_state = state->layer_state;
+#endif
+    if (state->host_leds != host_leds) {
+        host_leds = state->host_leds;
+        led_set(host_leds);
+    }
+#ifdef RGBLIGHT_ENABLE
+    if (state->rgblight != rgblight_config.raw) {
+        rgblight_update_dword(state->rgblight);
+    }
+#endif
+#ifdef BACKLIGHT_ENABLE
+    if (state->backlight != get_backlight_level()) {
+        backlight_level(state->backlight);
+    }
+#endif
+}
+
+static void slave_queue_changes(const matrix_row_t* rows) {
+    uint16_t now = timer_read();
+    for (uint8_t row = 0; row < SPLIT_ROWS_PER_HAND; row++) {
+        matrix_row_t diff = rows[row] ^ reported_rows[row];
+        if (!diff) {
+            continue;
+        }
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            matrix_row_t bit = (matrix_row_t)1 << col;
+            if (!(diff & bit)) {
+                continue;
+            }
+            if (!event_queue_space()) {
+                // Left unreported, so it's queued by a later scan
+                return;
+            }
+            event_queue_push(EVENT_KEY(row, col) | (rows[row] & bit ? EVENT_PRESSED : 0), now);
+            reported_rows[row] ^= bit;
+        }
+    }
+}
+
+static void slave_fill_batch(uint8_t flags) {
+    uint16_t now = timer_read();
+    for (uint8_t i = 0; i < slave_frame.count; i++) {
+        const queued_event_t* event = &event_queue[(event_head + i) & EVENT_QUEUE_MASK];
+        uint16_t age = now - event->time;
+        slave_frame.events[i].key = event->key;
+        slave_frame.events[i].age = age > 0xFF ? 0xFF : age;
+    }
+    slave_frame.flags = flags;
+    slave_frame.crc = FRAME_CRC(&slave_frame);
+}
+
+static void slave_send_events(void) {
+    SPLIT_ATOMIC {
+        if (batch_acked) {
+            batch_acked = false;
+            batch_in_flight = false;
+            event_head += slave_frame.count;
+        }
+        if (link_status != LINK_LISTEN) {
+            // Still answering the master, which can't be interrupted
+        }
+        else if (!batch_in_flight && batch_seq_synced) {
+            uint8_t count = event_queue_count();
+            if (count) {
+                if (++batch_seq == 0) {
+                    batch_seq = 1;
+                }
+                slave_frame.seq = batch_seq;
+                slave_frame.count = count < SPLIT_EVENT_BATCH ? count : SPLIT_EVENT_BATCH;
+                slave_fill_batch(0);
+                batch_in_flight = true;
+                batch_time = timer_read();
+                if (split_serial_transmit((uint8_t*)&slave_frame, sizeof(slave_frame))) {
+                    link_status = LINK_TRANSMIT;
+                }
+            }
+        }
+        else if (timer_elapsed(batch_time) > 2 * SPLIT_TRANSPORT_TIMEOUT) {
+            // Not acknowledged, send it again. Waiting longer than the
+            // master does keeps both from colliding again after a collision
+            slave_fill_batch(0);
+            batch_time = timer_read();
+            if (split_serial_transmit((uint8_t*)&slave_frame, sizeof(slave_frame))) {
+                link_status = LINK_TRANSMIT;
+            }
+            else {
+                // A frame that was cut short keeps the line busy, start over
+                split_serial_receive((uint8_t*)&master_frame, sizeof(master_frame));
+            }
+        }
+    }
+}
+
+void split_transport_slave_task(const matrix_row_t* rows) {
+    if (resync_requested) {
+        // The presses are sent again, the master ignores the ones it has
+        resync_requested = false;
+        memset(reported_rows, 0, sizeof(reported_rows));
+    }
+    slave_queue_changes(rows);
+    slave_send_events();
+
+    split_master_state_t state;
+    bool received = false;
+    SPLIT_ATOMIC {
+        if (master_state_received) {
+            master_state_received = false;
+            state = received_master_state;
+            received = true;
+        }
+    }
+    if (received) {
+        split_transport_apply_master_state(&state);
+    }
+}
+
+void split_transport_tx_complete(void) {
+    if (is_master) {
+        split_serial_receive((uint8_t*)&slave_frame, sizeof(slave_frame));
+        if (link_status == LINK_TRANSMIT) {
+            link_status = LINK_LISTEN;
+        }
+    }
+    else {
+        split_serial_receive((uint8_t*)&master_frame, sizeof(master_frame));
+        link_status = LINK_LISTEN;
+    }
+}
+
+static void master_rx_complete(void) {
+    if (slave_frame.crc != FRAME_CRC(&slave_frame)) {
+        // An answer is sent again after a timeout
+        split_serial_receive((uint8_t*)&slave_frame, sizeof(slave_frame));
+        return;
+    }
+    uint16_t now = timer_read();
+    connected = true;
+    last_seen = now;
+    if (link_status == LINK_REQUEST && (slave_frame.flags & SLAVE_FLAG_REPLY)) {
+        acked_master_state = sent_master_state;
+        resync = false;
+    }
+    uint8_t seq = last_seq;
+    master_receive_events(now);
+    if (slave_frame.count && (last_seq != seq || slave_frame.seq == last_seq)) {
+        // Acknowledge the events, with the latest state
+        master_frame.flags = 0;
+        master_frame.ack = last_seq;
+        master_frame.state = next_master_state;
+        master_frame.crc = FRAME_CRC(&master_frame);
+        if (split_serial_transmit((uint8_t*)&master_frame, sizeof(master_frame))) {
+            link_status = LINK_TRANSMIT;
+            return;
+        }
+    }
+    split_serial_receive((uint8_t*)&slave_frame, sizeof(slave_frame));
+    link_status = LINK_LISTEN;
+}
+
+static void slave_rx_complete(void) {
+    if (master_frame.crc != FRAME_CRC(&master_frame)) {
+        split_serial_receive((uint8_t*)&master_frame, sizeof(master_frame));
+        return;
+    }
+    received_master_state = master_frame.state;
+    master_state_received = true;
+    if (master_frame.flags & MASTER_FLAG_RESYNC) {
+        resync_requested = true;
+    }
+    if (batch_in_flight && master_frame.ack == slave_frame.seq) {
+        batch_acked = true;
+    }
+    else if (!batch_in_flight) {
+        // The next batch gets a different number than the last one the
+        // master has, even when this side has restarted in between
+        batch_seq = master_frame.ack;
+        batch_seq_synced = true;
+    }
+    if (master_frame.flags & MASTER_FLAG_REPLY) {
+        // The main loop can't be changing the batch here, since it does
+        // that with the interrupts disabled
+        const slave_frame_t* frame = &empty_slave_frame;
+        if (batch_in_flight && !batch_acked) {
+            slave_fill_batch(SLAVE_FLAG_REPLY);
+            frame = &slave_frame;
+        }
+        if (split_serial_transmit((const uint8_t*)frame, sizeof(*frame))) {
+            link_status = LINK_TRANSMIT;
+            return;
+        }
+    }
+    split_serial_receive((uint8_t*)&master_frame, sizeof(master_frame));
+    link_status = LINK_LISTEN;
+}
+
+void split_transport_rx_complete(void) {
+    if (is_master) {
+        master_rx_complete();
+    }
+    else {
+        slave_rx_complete();
+    }
+}
+
+#endif
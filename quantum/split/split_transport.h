@@ -0,0 +1,106 @@
+/* Copyright 2017 Jack Humbert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPLIT_TRANSPORT_H
+#define SPLIT_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+
+/* Shared transport between the two halves of a split keyboard.
+ *
+ * The slave scans and debounces its own half, and pushes only the keys
+ * that changed, as events that remember how long ago they happened. The
+ * master acknowledges each batch of events, and merges them into its
+ * matrix in the order they happened relative to its own keys. The master
+ * sends its state (layers, host LEDs, RGB and backlight) when it changes,
+ * so an idle keyboard only exchanges a keepalive now and then.
+ * Everything runs from interrupts, nothing waits for the other half.
+ */
+
+#ifndef SPLIT_ROWS_PER_HAND
+#define SPLIT_ROWS_PER_HAND (MATRIX_ROWS / 2)
+#endif
+
+// Milliseconds before a frame that wasn't answered is sent again
+#ifndef SPLIT_TRANSPORT_TIMEOUT
+#define SPLIT_TRANSPORT_TIMEOUT 10
+#endif
+
+// Milliseconds of silence before the master checks that the slave is there
+#ifndef SPLIT_TRANSPORT_KEEPALIVE
+#define SPLIT_TRANSPORT_KEEPALIVE 500
+#endif
+
+// Milliseconds of silence before the slave is considered disconnected
+#ifndef SPLIT_TRANSPORT_DISCONNECT
+#define SPLIT_TRANSPORT_DISCONNECT (3 * SPLIT_TRANSPORT_KEEPALIVE)
+#endif
+
+// Events sent in one frame
+#ifndef SPLIT_EVENT_BATCH
+#define SPLIT_EVENT_BATCH 4
+#endif
+
+// Events waiting to be sent on the slave, or to be merged on the master,
+// must be a power of two
+#ifndef SPLIT_EVENT_QUEUE
+#define SPLIT_EVENT_QUEUE 16
+#endif
+
+typedef struct {
+    uint32_t layer_state;
+    uint8_t host_leds;
+#ifdef RGBLIGHT_ENABLE
+    uint32_t rgblight;
+#endif
+#ifdef BACKLIGHT_ENABLE
+    uint8_t backlight;
+#endif
+} __attribute__((packed)) split_master_state_t;
+
+void split_transport_init(bool master);
+
+// Master
+// Sends the master state when it changes, and checks the connection
+void split_transport_task(void);
+bool split_transport_connected(void);
+// Applies one change to the matrix, either the new rows of the local half,
+// or the next event from the slave, whichever happened first. The keyboard
+// task handles one key per scan, so this keeps the order of the keys across
+// both halves. Returns true when the matrix changed.
+bool split_transport_merge(matrix_row_t* matrix, const matrix_row_t* local_rows,
+    uint8_t local_offset, uint8_t remote_offset);
+// The whole master side of a matrix scan for the usual layout, with the left
+// half in the first rows. Returns false when the slave is disconnected.
+bool split_transport_master_scan(matrix_row_t* matrix, const matrix_row_t* local_rows,
+    bool left_hand);
+
+// Slave
+// Queues the keys that changed since the last call and sends them, then
+// applies the state received from the master
+void split_transport_slave_task(const matrix_row_t* rows);
+// Called by split_transport_slave_task, the default applies the layer state,
+// LEDs, RGB light and backlight when they change
+void split_transport_apply_master_state(const split_master_state_t* state);
+
+// Called by the physical layer, from interrupt context
+void split_transport_tx_complete(void);
+void split_transport_rx_complete(void);
+
+#endif
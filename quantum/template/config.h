@@ -179,6 +179,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 //#define MIDI_ADVANCED
 
+/* enable the MIDI engine, needs MIDI_ADVANCED and timer 4 of the ATmega32U4:
+   - MIDI clock, internal or synced to the host
+   - Arpeggiator
+   - Step sequencer
+*/
+//#define MIDI_ENGINE
+
 /* override number of MIDI tone keycodes (each octave adds 12 keycodes and allocates 12 bytes) */
 //#define MIDI_TONE_KEYCODE_OCTAVES 1
 
@@ -0,0 +1,127 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "animation_scheduler.h"
+
+enum {
+    SCHEDULE_NONE,
+    SCHEDULE_WAITING,
+    SCHEDULE_DUE,
+};
+
+static keyframe_animation_t* waiting_animations = NULL;
+static keyframe_animation_t* due_animations = NULL;
+
+// Compares the times so that the system ticks can wrap around
+static bool is_before(systemticks_t a, systemticks_t b) {
+    return (systemticks_t)(a - b) > (systemticks_t)-1 / 2;
+}
+
+static bool is_scheduled_before(keyframe_animation_t* a, keyframe_animation_t* b) {
+    if (a->deadline != b->deadline) {
+        return is_before(a->deadline, b->deadline);
+    }
+    return a->layer < b->layer;
+}
+
+static void unlink(keyframe_animation_t** list, keyframe_animation_t* animation) {
+    while (*list) {
+        if (*list == animation) {
+            *list = animation->next_scheduled;
+            animation->next_scheduled = NULL;
+            return;
+        }
+        list = &(*list)->next_scheduled;
+    }
+}
+
+static void insert(keyframe_animation_t** list, keyframe_animation_t* animation) {
+    // Insert after the animations with the same deadline and layer, so that
+    // the ones that are started first also stay first
+    while (*list && !is_scheduled_before(animation, *list)) {
+        list = &(*list)->next_scheduled;
+    }
+    animation->next_scheduled = *list;
+    *list = animation;
+}
+
+void animation_scheduler_add(keyframe_animation_t* animation, systemticks_t deadline) {
+    if (animation->schedule_state == SCHEDULE_DUE) {
+        unlink(&due_animations, animation);
+    }
+    else if (animation->schedule_state == SCHEDULE_WAITING) {
+        unlink(&waiting_animations, animation);
+    }
+    animation->deadline = deadline;
+    animation->schedule_state = SCHEDULE_WAITING;
+    insert(&waiting_animations, animation);
+}
+
+void animation_scheduler_remove(keyframe_animation_t* animation) {
+    if (animation->schedule_state == SCHEDULE_DUE) {
+        unlink(&due_animations, animation);
+    }
+    else if (animation->schedule_state == SCHEDULE_WAITING) {
+        unlink(&waiting_animations, animation);
+    }
+    animation->schedule_state = SCHEDULE_NONE;
+}
+
+keyframe_animation_t* animation_scheduler_remove_first(void) {
+    keyframe_animation_t* animation = due_animations ? due_animations : waiting_animations;
+    if (animation) {
+        animation_scheduler_remove(animation);
+    }
+    return animation;
+}
+
+bool animation_scheduler_is_empty(void) {
+    return waiting_animations == NULL && due_animations == NULL;
+}
+
+void animation_scheduler_take_due(systemticks_t now) {
+    // The due list keeps the deadline and layer order
+    keyframe_animation_t** tail = &due_animations;
+    while (*tail) {
+        tail = &(*tail)->next_scheduled;
+    }
+    while (waiting_animations && !is_before(now, waiting_animations->deadline)) {
+        keyframe_animation_t* animation = waiting_animations;
+        waiting_animations = animation->next_scheduled;
+        animation->next_scheduled = NULL;
+        animation->schedule_state = SCHEDULE_DUE;
+        *tail = animation;
+        tail = &animation->next_scheduled;
+    }
+}
+
+keyframe_animation_t* animation_scheduler_get_due(void) {
+    return due_animations;
+}
+
+void animation_scheduler_reschedule(keyframe_animation_t* animation, systemticks_t deadline) {
+    if (animation->schedule_state == SCHEDULE_DUE) {
+        animation_scheduler_add(animation, deadline);
+    }
+}
+
+bool animation_scheduler_get_next_deadline(systemticks_t* deadline) {
+    if (waiting_animations) {
+        *deadline = waiting_animations->deadline;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUANTUM_VISUALIZER_ANIMATION_SCHEDULER_H_
+#define QUANTUM_VISUALIZER_ANIMATION_SCHEDULER_H_
+
+#include "visualizer.h"
+
+// Keeps the running animations ordered by the time they need to be updated
+// next. The list is stored in the animations themselves, so there's no limit
+// to how many animations that can run at the same time.
+// Animations that are due at the same time are ordered by their layer, so
+// that the higher layers are drawn on top of the lower ones.
+
+// Adds the animation, or moves it if it's already waiting
+void animation_scheduler_add(keyframe_animation_t* animation, systemticks_t deadline);
+// Removes the animation, it doesn't matter if it's waiting or due
+void animation_scheduler_remove(keyframe_animation_t* animation);
+// Removes the first waiting or due animation and returns it, or NULL if
+// there are none left
+keyframe_animation_t* animation_scheduler_remove_first(void);
+bool animation_scheduler_is_empty(void);
+
+// Moves all the animations whose deadline has passed to the due list
+void animation_scheduler_take_due(systemticks_t now);
+// Returns the first due animation, or NULL if there are none. The animation
+// stays due until it's rescheduled or removed.
+keyframe_animation_t* animation_scheduler_get_due(void);
+// Moves a due animation back to the waiting animations, if it has been
+// started again or removed in the meantime nothing is done
+void animation_scheduler_reschedule(keyframe_animation_t* animation, systemticks_t deadline);
+
+// Returns false if there are no waiting animations
+bool animation_scheduler_get_next_deadline(systemticks_t* deadline);
+
+#endif /* QUANTUM_VISUALIZER_ANIMATION_SCHEDULER_H_ */
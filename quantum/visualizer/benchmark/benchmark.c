@@ -0,0 +1,234 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host side benchmark and accuracy check of the fixed point visualizer math,
+// compared to the floating point code it replaced
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "visualizer_math.h"
+#include "lcd_backlight.h"
+
+// The size of the LED display of the Ergodox Infinity
+#define NUM_ROWS 9
+#define NUM_COLS 16
+
+static uint16_t hal_r, hal_g, hal_b;
+
+void lcd_backlight_hal_init(void) {
+}
+
+void lcd_backlight_hal_color(uint16_t r, uint16_t g, uint16_t b) {
+    hal_r = r;
+    hal_g = g;
+    hal_b = b;
+}
+
+static uint8_t reference_gradient_color(float t, float index, float num) {
+    const float two_pi = M_PI * 2.0f;
+    float normalized_index = (1.0f - index / (num - 1.0f)) * two_pi;
+    float x = t * two_pi + normalized_index;
+    float v = 0.5 * (cosf(x) + 1.0f);
+    return (uint8_t)(255.0f * v);
+}
+
+static void reference_hsi_to_rgb(float h, float s, float i, uint16_t* r_out, uint16_t* g_out, uint16_t* b_out) {
+    unsigned int r, g, b;
+    h = fmodf(h, 360.0f);
+    h = 3.14159f * h / 180.0f;
+    s = s > 0.0f ? (s < 1.0f ? s : 1.0f) : 0.0f;
+    i = i > 0.0f ? (i < 1.0f ? i : 1.0f) : 0.0f;
+
+    if(h < 2.09439f) {
+        r = 65535.0f * i/3.0f *(1.0f + s * cos(h) / cosf(1.047196667f - h));
+        g = 65535.0f * i/3.0f *(1.0f + s *(1.0f - cosf(h) / cos(1.047196667f - h)));
+        b = 65535.0f * i/3.0f *(1.0f - s);
+    } else if(h < 4.188787) {
+        h = h - 2.09439;
+        g = 65535.0f * i/3.0f *(1.0f + s * cosf(h) / cosf(1.047196667f - h));
+        b = 65535.0f * i/3.0f *(1.0f + s * (1.0f - cosf(h) / cosf(1.047196667f - h)));
+        r = 65535.0f * i/3.0f *(1.0f - s);
+    } else {
+        h = h - 4.188787;
+        b = 65535.0f*i/3.0f * (1.0f + s * cosf(h) / cosf(1.047196667f - h));
+        r = 65535.0f*i/3.0f * (1.0f + s * (1.0f - cosf(h) / cosf(1.047196667f - h)));
+        g = 65535.0f*i/3.0f * (1.0f - s);
+    }
+    *r_out = r > 65535 ? 65535 : r;
+    *g_out = g > 65535 ? 65535 : g;
+    *b_out = b > 65535 ? 65535 : b;
+}
+
+static void reference_backlight_color(uint8_t hue, uint8_t saturation, uint8_t intensity) {
+    float hue_f = 360.0f * (float)hue / 255.0f;
+    float saturation_f = (float)saturation / 255.0f;
+    float intensity_f = (float)intensity / 255.0f;
+    reference_hsi_to_rgb(hue_f, saturation_f, intensity_f, &hal_r, &hal_g, &hal_b);
+}
+
+// Draws a full LED display frame of gradients, like led_keyframe_left_to_right_gradient
+// followed by led_keyframe_top_to_bottom_gradient
+static unsigned reference_gradient_frame(float t) {
+    unsigned sum = 0;
+    for (int i = 0; i < NUM_COLS; i++) {
+        sum += reference_gradient_color(t, i, NUM_COLS) * NUM_ROWS;
+    }
+    for (int i = 0; i < NUM_ROWS; i++) {
+        sum += reference_gradient_color(t, i, NUM_ROWS) * NUM_COLS;
+    }
+    return sum;
+}
+
+static unsigned fixed_gradient_frame(uint16_t phase) {
+    uint8_t cols[NUM_COLS];
+    uint8_t rows[NUM_ROWS];
+    unsigned sum = 0;
+    fixed_cos_gradient(cols, NUM_COLS, phase);
+    for (int i = 0; i < NUM_COLS; i++) {
+        sum += cols[i] * NUM_ROWS;
+    }
+    fixed_cos_gradient(rows, NUM_ROWS, phase);
+    for (int i = 0; i < NUM_ROWS; i++) {
+        sum += rows[i] * NUM_COLS;
+    }
+    return sum;
+}
+
+static cos_gradient_table_t col_gradient;
+static cos_gradient_table_t row_gradient;
+
+static unsigned table_gradient_frame(uint16_t phase) {
+    uint8_t cols[NUM_COLS];
+    uint8_t rows[NUM_ROWS];
+    unsigned sum = 0;
+    cos_gradient_table_get(&col_gradient, cols, phase);
+    for (int i = 0; i < NUM_COLS; i++) {
+        sum += cols[i] * NUM_ROWS;
+    }
+    cos_gradient_table_get(&row_gradient, rows, phase);
+    for (int i = 0; i < NUM_ROWS; i++) {
+        sum += rows[i] * NUM_COLS;
+    }
+    return sum;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void check_gradient(void) {
+    int max_error = 0;
+    int max_table_error = 0;
+    const int counts[] = {NUM_ROWS, NUM_COLS};
+    for (int c = 0; c < 2; c++) {
+        uint8_t values[NUM_COLS];
+        uint8_t table_values[NUM_COLS];
+        cos_gradient_table_t table;
+        cos_gradient_table_init(&table, counts[c]);
+        for (int t = 0; t < 65536; t += 16) {
+            fixed_cos_gradient(values, counts[c], t);
+            cos_gradient_table_get(&table, table_values, t);
+            for (int i = 0; i < counts[c]; i++) {
+                int reference = reference_gradient_color(t / 65536.0f, i, counts[c]);
+                int error = abs(values[i] - reference);
+                if (error > max_error) {
+                    max_error = error;
+                }
+                error = abs(table_values[i] - reference);
+                if (error > max_table_error) {
+                    max_table_error = error;
+                }
+            }
+        }
+    }
+    printf("gradient: max error %d/255, table %d/255\n", max_error, max_table_error);
+}
+
+static void check_hsi(void) {
+    int max_error = 0;
+    for (int h = 0; h < 256; h++) {
+        for (int s = 0; s < 256; s++) {
+            for (int i = 0; i < 256; i += 5) {
+                reference_backlight_color(h, s, i);
+                uint16_t r = hal_r, g = hal_g, b = hal_b;
+                lcd_backlight_color(h, s, i);
+                int error = abs(r - hal_r);
+                error = abs(g - hal_g) > error ? abs(g - hal_g) : error;
+                error = abs(b - hal_b) > error ? abs(b - hal_b) : error;
+                if (error > max_error) {
+                    max_error = error;
+                }
+            }
+        }
+    }
+    printf("hsi_to_rgb: max error %d/65535\n", max_error);
+}
+
+static void benchmark_gradient(int iterations) {
+    volatile unsigned sink = 0;
+    double start = now();
+    for (int n = 0; n < iterations; n++) {
+        sink += reference_gradient_frame((n & 1023) / 1024.0f);
+    }
+    double reference = (now() - start) / iterations;
+    start = now();
+    for (int n = 0; n < iterations; n++) {
+        sink += fixed_gradient_frame((n & 1023) << 6);
+    }
+    double fixed = (now() - start) / iterations;
+    cos_gradient_table_init(&col_gradient, NUM_COLS);
+    cos_gradient_table_init(&row_gradient, NUM_ROWS);
+    start = now();
+    for (int n = 0; n < iterations; n++) {
+        sink += table_gradient_frame((n & 1023) << 6);
+    }
+    double table = (now() - start) / iterations;
+    printf("gradient frame: float %.0f ns, fixed %.0f ns, %.1fx, table %.0f ns, %.1fx\n",
+            reference * 1e9, fixed * 1e9, reference / fixed, table * 1e9, reference / table);
+}
+
+static void benchmark_hsi(int iterations) {
+    volatile unsigned sink = 0;
+    double start = now();
+    for (int n = 0; n < iterations; n++) {
+        reference_backlight_color(n, n >> 8, 255);
+        sink += hal_r;
+    }
+    double reference = (now() - start) / iterations;
+    start = now();
+    for (int n = 0; n < iterations; n++) {
+        lcd_backlight_color(n, n >> 8, 255);
+        sink += hal_r;
+    }
+    double fixed = (now() - start) / iterations;
+    printf("hsi_to_rgb: float %.0f ns, fixed %.0f ns, %.1fx\n",
+            reference * 1e9, fixed * 1e9, reference / fixed);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    lcd_backlight_brightness(255);
+    check_gradient();
+    check_hsi();
+    benchmark_gradient(iterations);
+    benchmark_hsi(iterations);
+    return 0;
+}
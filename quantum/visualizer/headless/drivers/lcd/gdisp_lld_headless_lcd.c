@@ -0,0 +1,129 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gfx.h"
+
+#if GFX_USE_GDISP
+
+#define GDISP_DRIVER_VMT			HEADLESS_LCD_VMT
+#include "gdisp_lld_config.h"
+#include "src/gdisp/gdisp_driver.h"
+
+#include <string.h>
+#include "headless.h"
+
+// An in-memory version of the monochrome ST7565 LCD
+
+#ifndef GDISP_SCREEN_HEIGHT
+	#define GDISP_SCREEN_HEIGHT		32
+#endif
+#ifndef GDISP_SCREEN_WIDTH
+	#define GDISP_SCREEN_WIDTH		128
+#endif
+
+#define GDISP_FLG_NEEDFLUSH			(GDISP_FLG_DRIVER<<0)
+
+#define RAM_SIZE (GDISP_SCREEN_WIDTH * GDISP_SCREEN_HEIGHT / 8)
+
+#define xyaddr(x, y)		((x) + ((y)>>3)*GDISP_SCREEN_WIDTH)
+#define xybit(y)			(1<<((y)&7))
+
+static uint8_t ram[RAM_SIZE];
+static uint8_t frame[RAM_SIZE];
+
+headless_display_t headless_lcd = {
+    .name = "lcd",
+    .width = GDISP_SCREEN_WIDTH,
+    .height = GDISP_SCREEN_HEIGHT,
+    .packed = true,
+    .frame = frame,
+    .frame_size = RAM_SIZE,
+};
+
+static void set_ram_bit(coord_t x, coord_t y, bool_t set) {
+    if (set)
+        ram[xyaddr(x, y)] |= xybit(y);
+    else
+        ram[xyaddr(x, y)] &= ~xybit(y);
+}
+
+LLDSPEC bool_t gdisp_lld_init(GDisplay *g) {
+    memset(ram, 0, sizeof(ram));
+    memset(frame, 0, sizeof(frame));
+
+	g->g.Width = GDISP_SCREEN_WIDTH;
+	g->g.Height = GDISP_SCREEN_HEIGHT;
+	g->g.Orientation = GDISP_ROTATE_0;
+	g->g.Powermode = powerOn;
+	g->g.Backlight = 100;
+	g->g.Contrast = 0;
+	return TRUE;
+}
+
+#if GDISP_HARDWARE_FLUSH
+LLDSPEC void gdisp_lld_flush(GDisplay *g) {
+    if (!(g->flags & GDISP_FLG_NEEDFLUSH))
+        return;
+    g->flags &= ~GDISP_FLG_NEEDFLUSH;
+    headless_display_flush(&headless_lcd, ram);
+}
+#endif
+
+#if GDISP_HARDWARE_DRAWPIXEL
+LLDSPEC void gdisp_lld_draw_pixel(GDisplay *g) {
+    set_ram_bit(g->p.x, g->p.y, gdispColor2Native(g->p.color) != Black);
+    g->flags |= GDISP_FLG_NEEDFLUSH;
+}
+#endif
+
+#if GDISP_HARDWARE_PIXELREAD
+LLDSPEC color_t gdisp_lld_get_pixel_color(GDisplay *g) {
+    return (ram[xyaddr(g->p.x, g->p.y)] & xybit(g->p.y)) ? White : Black;
+}
+#endif
+
+#if GDISP_HARDWARE_BITFILLS
+// The source is one bit per pixel, the same as the ST7565 driver expects
+LLDSPEC void gdisp_lld_blit_area(GDisplay *g) {
+    uint8_t* buffer = (uint8_t*)g->p.ptr;
+    for (int i = 0; i < g->p.cy; i++) {
+        unsigned srcbit = (g->p.y1 + i) * g->p.x2 + g->p.x1;
+        for (int j = 0; j < g->p.cx; j++, srcbit++) {
+            uint8_t bitset = (buffer[srcbit / 8] >> (7 - (srcbit % 8))) & 1;
+            set_ram_bit(g->p.x + j, g->p.y + i, bitset);
+        }
+    }
+    g->flags |= GDISP_FLG_NEEDFLUSH;
+}
+#endif
+
+#if GDISP_NEED_CONTROL && GDISP_HARDWARE_CONTROL
+LLDSPEC void gdisp_lld_control(GDisplay *g) {
+    switch(g->p.x) {
+    case GDISP_CONTROL_POWER:
+        g->g.Powermode = (powermode_t)g->p.ptr;
+        return;
+    // Only the native orientation is supported
+    case GDISP_CONTROL_ORIENTATION:
+        return;
+    case GDISP_CONTROL_BACKLIGHT:
+        g->g.Backlight = (unsigned)g->p.ptr;
+        return;
+    }
+}
+#endif // GDISP_NEED_CONTROL
+
+#endif // GFX_USE_GDISP
@@ -0,0 +1,134 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gfx.h"
+
+#if GFX_USE_GDISP
+
+#define GDISP_DRIVER_VMT			HEADLESS_LED_VMT
+#include "gdisp_lld_config.h"
+#include "src/gdisp/gdisp_driver.h"
+
+#include <string.h>
+#include "headless.h"
+
+// An in-memory version of the IS31FL3731C LED matrix. The frame contains the
+// brightness before the gamma correction, so that the dumped frames look
+// like the animations were designed.
+
+#ifndef GDISP_SCREEN_HEIGHT
+	#define GDISP_SCREEN_HEIGHT		9
+#endif
+#ifndef GDISP_SCREEN_WIDTH
+	#define GDISP_SCREEN_WIDTH		16
+#endif
+
+#define GDISP_FLG_NEEDFLUSH			(GDISP_FLG_DRIVER<<0)
+
+#define FRAME_SIZE (GDISP_SCREEN_WIDTH * GDISP_SCREEN_HEIGHT)
+
+static uint8_t frame_buffer[FRAME_SIZE];
+static uint8_t frame[FRAME_SIZE];
+
+headless_display_t headless_led = {
+    .name = "led",
+    .width = GDISP_SCREEN_WIDTH,
+    .height = GDISP_SCREEN_HEIGHT,
+    .packed = false,
+    .frame = frame,
+    .frame_size = FRAME_SIZE,
+};
+
+LLDSPEC bool_t gdisp_lld_init(GDisplay *g) {
+    memset(frame_buffer, 0, sizeof(frame_buffer));
+    memset(frame, 0, sizeof(frame));
+
+	g->g.Width = GDISP_SCREEN_WIDTH;
+	g->g.Height = GDISP_SCREEN_HEIGHT;
+	g->g.Orientation = GDISP_ROTATE_0;
+	g->g.Powermode = powerOff;
+	g->g.Backlight = 0;
+	g->g.Contrast = 0;
+	return TRUE;
+}
+
+#if GDISP_HARDWARE_FLUSH
+LLDSPEC void gdisp_lld_flush(GDisplay *g) {
+    if (!(g->flags & GDISP_FLG_NEEDFLUSH))
+        return;
+    g->flags &= ~GDISP_FLG_NEEDFLUSH;
+
+    uint8_t values[FRAME_SIZE];
+    unsigned backlight = g->g.Powermode == powerOn ? g->g.Backlight : 0;
+    for (int i = 0; i < FRAME_SIZE; i++) {
+        values[i] = (uint16_t)frame_buffer[i] * backlight / 100;
+    }
+    headless_display_flush(&headless_led, values);
+}
+#endif
+
+// Like the real driver, a rotation of 180 degrees mirrors the display, to
+// show the same animation on both halves of the keyboard
+static GFXINLINE coord_t get_x(GDisplay *g) {
+    return g->g.Orientation == GDISP_ROTATE_180 ? GDISP_SCREEN_WIDTH-1 - g->p.x : g->p.x;
+}
+
+#if GDISP_HARDWARE_DRAWPIXEL
+LLDSPEC void gdisp_lld_draw_pixel(GDisplay *g) {
+    frame_buffer[g->p.y * GDISP_SCREEN_WIDTH + get_x(g)] = gdispColor2Native(g->p.color);
+    g->flags |= GDISP_FLG_NEEDFLUSH;
+}
+#endif
+
+#if GDISP_HARDWARE_PIXELREAD
+LLDSPEC color_t gdisp_lld_get_pixel_color(GDisplay *g) {
+    return gdispNative2Color(frame_buffer[g->p.y * GDISP_SCREEN_WIDTH + get_x(g)]);
+}
+#endif
+
+#if GDISP_NEED_CONTROL && GDISP_HARDWARE_CONTROL
+LLDSPEC void gdisp_lld_control(GDisplay *g) {
+    switch(g->p.x) {
+    case GDISP_CONTROL_POWER:
+        if (g->g.Powermode == (powermode_t)g->p.ptr)
+            return;
+        g->g.Powermode = (powermode_t)g->p.ptr;
+        g->flags |= GDISP_FLG_NEEDFLUSH;
+        return;
+
+    case GDISP_CONTROL_ORIENTATION:
+        switch((orientation_t)g->p.ptr) {
+        case GDISP_ROTATE_0:
+        case GDISP_ROTATE_180:
+            g->g.Orientation = (orientation_t)g->p.ptr;
+            break;
+        default:
+            break;
+        }
+        return;
+
+    case GDISP_CONTROL_BACKLIGHT:
+        if (g->g.Backlight == (unsigned)g->p.ptr)
+            return;
+        unsigned val = (unsigned)g->p.ptr;
+        g->g.Backlight = val > 100 ? 100 : val;
+        g->flags |= GDISP_FLG_NEEDFLUSH;
+        return;
+    }
+}
+#endif // GDISP_NEED_CONTROL
+
+#endif // GFX_USE_GDISP
@@ -0,0 +1,421 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the visualizer of a keyboard on the host, without a thread and with
+// a simulated clock. The status changes are read from a script, the frames
+// are written as PPM images, and the time spent in each keyframe function
+// and the bytes of each flush are measured and compared to the budgets.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "visualizer.h"
+#include "headless.h"
+#include "action_util.h"
+#ifdef LCD_BACKLIGHT_ENABLE
+#include "lcd_backlight.h"
+#endif
+#ifdef BACKLIGHT_ENABLE
+#include "backlight.h"
+#endif
+#include "serial_link/system/serial_link.h"
+
+// The serial link is not used, but the triple buffer needs the external
+// definitions of these inline functions
+extern void serial_link_lock(void);
+extern void serial_link_unlock(void);
+
+#define MAX_KEYFRAME_FUNCTIONS 64
+// More updates than this without the time advancing means that an animation
+// never sleeps
+#define MAX_UPDATES_PER_TICK 1000
+
+typedef struct {
+    frame_func func;
+    uint32_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t overruns;
+} keyframe_stats_t;
+
+static keyframe_stats_t keyframe_stats[MAX_KEYFRAME_FUNCTIONS];
+static unsigned num_keyframe_stats;
+
+static systemticks_t current_time;
+static const char* output_dir;
+static uint64_t frame_budget_ns;
+static unsigned flush_budget;
+static unsigned flush_overruns;
+static bool serial_link_master = true;
+
+static uint32_t current_layer = 1;
+static uint32_t current_default_layer = 1;
+static uint8_t current_mods;
+static uint32_t current_leds;
+
+// The visualizer and uGFX are linked with --wrap=gfxSystemTicks, so that
+// they all see the simulated time instead of the real one
+systemticks_t __wrap_gfxSystemTicks(void) {
+    return current_time;
+}
+
+static uint64_t get_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static keyframe_stats_t* get_keyframe_stats(frame_func func) {
+    for (unsigned i = 0; i < num_keyframe_stats; i++) {
+        if (keyframe_stats[i].func == func) {
+            return &keyframe_stats[i];
+        }
+    }
+    if (num_keyframe_stats == MAX_KEYFRAME_FUNCTIONS) {
+        fprintf(stderr, "Too many keyframe functions\n");
+        exit(2);
+    }
+    keyframe_stats_t* stats = &keyframe_stats[num_keyframe_stats++];
+    stats->func = func;
+    return stats;
+}
+
+// Only the functions that are exported have a name, -rdynamic is needed for that
+static void print_function_name(frame_func func) {
+    Dl_info info;
+    if (dladdr((void*)func, &info) && info.dli_sname) {
+        printf("%-40s", info.dli_sname);
+    }
+    else {
+        printf("%-40p", (void*)func);
+    }
+}
+
+bool visualizer_headless_run_frame(frame_func func, keyframe_animation_t* animation, visualizer_state_t* state) {
+    uint64_t start = get_ns();
+    bool ret = (*func)(animation, state);
+    uint64_t time = get_ns() - start;
+
+    keyframe_stats_t* stats = get_keyframe_stats(func);
+    stats->calls++;
+    stats->total_ns += time;
+    if (time > stats->max_ns) {
+        stats->max_ns = time;
+    }
+    if (frame_budget_ns && time > frame_budget_ns) {
+        stats->overruns++;
+    }
+    return ret;
+}
+
+void headless_display_flush(headless_display_t* display, const uint8_t* frame) {
+    uint16_t changed = 0;
+    for (uint16_t i = 0; i < display->frame_size; i++) {
+        if (display->frame[i] != frame[i]) {
+            changed++;
+        }
+    }
+    if (changed == 0) {
+        return;
+    }
+    memcpy(display->frame, frame, display->frame_size);
+    display->flushes++;
+    display->changed_bytes += changed;
+    if (changed > display->max_changed_bytes) {
+        display->max_changed_bytes = changed;
+    }
+    display->updated = true;
+    if (flush_budget && changed > flush_budget) {
+        flush_overruns++;
+        printf("%8u ms: %s flush of %u bytes is over the budget\n",
+               (unsigned)current_time, display->name, changed);
+    }
+}
+
+uint8_t headless_display_get_pixel(headless_display_t* display, uint16_t x, uint16_t y) {
+    if (display->packed) {
+        return (display->frame[x + (y / 8) * display->width] & (1 << (y % 8))) ? 255 : 0;
+    }
+    return display->frame[y * display->width + x];
+}
+
+static uint16_t lcd_color[3] = {65535, 65535, 65535};
+
+static void write_frame(headless_display_t* display, const uint16_t* color) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/%s_%08u.ppm", output_dir, display->name, (unsigned)current_time);
+    FILE* f = fopen(filename, "wb");
+    if (!f) {
+        perror(filename);
+        exit(2);
+    }
+    fprintf(f, "P6\n%u %u\n255\n", display->width, display->height);
+    for (uint16_t y = 0; y < display->height; y++) {
+        for (uint16_t x = 0; x < display->width; x++) {
+            uint8_t pixel = headless_display_get_pixel(display, x, y);
+            for (int c = 0; c < 3; c++) {
+                fputc((uint32_t)pixel * color[c] / 65535, f);
+            }
+        }
+    }
+    fclose(f);
+}
+
+// Called by the visualizer after the displays have been flushed
+void draw_emulator(void) {
+    static const uint16_t white[3] = {65535, 65535, 65535};
+    if (headless_lcd.updated) {
+        headless_lcd.updated = false;
+        if (output_dir) {
+            // The white pixels of the LCD show the backlight color
+            write_frame(&headless_lcd, lcd_color);
+        }
+    }
+    if (headless_led.updated) {
+        headless_led.updated = false;
+        if (output_dir) {
+            write_frame(&headless_led, white);
+        }
+    }
+}
+
+void lcd_backlight_hal_init(void) {
+}
+
+void lcd_backlight_hal_color(uint16_t r, uint16_t g, uint16_t b) {
+    lcd_color[0] = r;
+    lcd_color[1] = g;
+    lcd_color[2] = b;
+    headless_lcd.updated = true;
+}
+
+bool is_serial_link_master(void) {
+    return serial_link_master;
+}
+
+uint8_t get_mods(void) {
+    return current_mods;
+}
+
+uint8_t get_oneshot_mods(void) {
+    return 0;
+}
+
+bool has_oneshot_mods_timed_out(void) {
+    return true;
+}
+
+// Runs the visualizer until the given time, the steps are always run at the
+// exact time the visualizer asked for
+static systemticks_t next_step;
+static bool idle;
+
+static void run_until(systemticks_t time) {
+    unsigned updates = 0;
+    while (!idle && (int32_t)(time - next_step) >= 0) {
+        if (current_time != next_step) {
+            current_time = next_step;
+            updates = 0;
+        }
+        else if (++updates > MAX_UPDATES_PER_TICK) {
+            fprintf(stderr, "%u ms: The visualizer doesn't sleep\n", (unsigned)current_time);
+            exit(2);
+        }
+        systemticks_t sleep_time = visualizer_headless_step();
+        if (sleep_time == TIME_INFINITE) {
+            idle = true;
+        }
+        else {
+            next_step = current_time + sleep_time;
+        }
+    }
+    current_time = time;
+}
+
+static void wake_up(void) {
+    idle = false;
+    next_step = current_time;
+}
+
+// The script consists of lines with a time in milliseconds and a command,
+// the times have to be increasing. Empty lines and lines starting with #
+// are ignored.
+//   <ms> layer <mask>
+//   <ms> default_layer <mask>
+//   <ms> mods <mask>
+//   <ms> leds <mask>
+//   <ms> backlight <level>
+//   <ms> suspend
+//   <ms> resume
+//   <ms> end
+// Without an end, the script ends ten seconds after the last command.
+static void run_script(FILE* script, const char* name) {
+    char line[256];
+    unsigned line_number = 0;
+    while (fgets(line, sizeof(line), script)) {
+        line_number++;
+        char command[32];
+        unsigned time;
+        long value = 0;
+        char* start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == 0) {
+            continue;
+        }
+        int fields = sscanf(start, "%u %31s %li", &time, command, &value);
+        if (fields < 2 || (int32_t)(time - current_time) < 0) {
+            fprintf(stderr, "%s:%u: invalid line\n", name, line_number);
+            exit(2);
+        }
+        run_until(time);
+        if (strcmp(command, "end") == 0) {
+            return;
+        }
+        else if (strcmp(command, "suspend") == 0) {
+            visualizer_suspend();
+        }
+        else if (strcmp(command, "resume") == 0) {
+            visualizer_resume();
+        }
+#ifdef BACKLIGHT_ENABLE
+        else if (fields == 3 && strcmp(command, "backlight") == 0) {
+            backlight_set(value);
+        }
+#endif
+        else if (fields == 3) {
+            if (strcmp(command, "layer") == 0) {
+                current_layer = value;
+            }
+            else if (strcmp(command, "default_layer") == 0) {
+                current_default_layer = value;
+            }
+            else if (strcmp(command, "mods") == 0) {
+                current_mods = value;
+            }
+            else if (strcmp(command, "leds") == 0) {
+                current_leds = value;
+            }
+            else {
+                fprintf(stderr, "%s:%u: unknown command %s\n", name, line_number, command);
+                exit(2);
+            }
+            visualizer_update(current_default_layer, current_layer, current_mods, current_leds);
+        }
+        else {
+            fprintf(stderr, "%s:%u: unknown command %s\n", name, line_number, command);
+            exit(2);
+        }
+        wake_up();
+    }
+    run_until(current_time + 10000);
+}
+
+static void print_report(void) {
+    printf("\n%-40s %8s %10s %10s %8s\n", "keyframe", "calls", "avg us", "max us", "over");
+    for (unsigned i = 0; i < num_keyframe_stats; i++) {
+        keyframe_stats_t* stats = &keyframe_stats[i];
+        print_function_name(stats->func);
+        printf(" %8u %10.1f %10.1f %8u\n", stats->calls,
+               stats->total_ns / 1000.0 / stats->calls, stats->max_ns / 1000.0,
+               stats->overruns);
+    }
+    printf("\n%-40s %8s %10s %10s\n", "display", "flushes", "avg bytes", "max bytes");
+    headless_display_t* displays[] = {&headless_lcd, &headless_led};
+    for (unsigned i = 0; i < sizeof(displays) / sizeof(displays[0]); i++) {
+        headless_display_t* d = displays[i];
+        printf("%-40s %8u %10.1f %10u\n", d->name, d->flushes,
+               d->flushes ? (double)d->changed_bytes / d->flushes : 0.0,
+               d->max_changed_bytes);
+    }
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [options] [script]\n"
+        "  -o, --output DIR         write the changed frames to DIR as PPM images\n"
+        "  -f, --frame-budget US    maximum time of a keyframe function call\n"
+        "  -b, --flush-budget BYTES maximum changed bytes of a flush\n"
+        "  -s, --slave              run the visualizer as the slave half\n"
+        "The script is read from stdin if it's not given. The exit code is 1\n"
+        "if any of the budgets were exceeded.\n",
+        name);
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"frame-budget", required_argument, NULL, 'f'},
+        {"flush-budget", required_argument, NULL, 'b'},
+        {"slave", no_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:f:b:sh", options, NULL)) != -1) {
+        switch (opt) {
+        case 'o':
+            output_dir = optarg;
+            break;
+        case 'f':
+            frame_budget_ns = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        case 'b':
+            flush_budget = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            serial_link_master = false;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    FILE* script = stdin;
+    const char* script_name = "stdin";
+    if (optind < argc) {
+        script_name = argv[optind];
+        script = fopen(script_name, "r");
+        if (!script) {
+            perror(script_name);
+            return 2;
+        }
+    }
+
+    visualizer_init();
+    visualizer_update(current_default_layer, current_layer, current_mods, current_leds);
+    wake_up();
+    run_script(script, script_name);
+    if (script != stdin) {
+        fclose(script);
+    }
+
+    print_report();
+
+    unsigned frame_overruns = 0;
+    for (unsigned i = 0; i < num_keyframe_stats; i++) {
+        frame_overruns += keyframe_stats[i].overruns;
+    }
+    if (frame_overruns || flush_overruns) {
+        printf("\n%u keyframe calls and %u flushes were over the budget\n", frame_overruns, flush_overruns);
+        return 1;
+    }
+    return 0;
+}
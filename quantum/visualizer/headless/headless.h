@@ -0,0 +1,52 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUANTUM_VISUALIZER_HEADLESS_HEADLESS_H_
+#define QUANTUM_VISUALIZER_HEADLESS_HEADLESS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The in-memory displays of the headless build. The drivers keep the
+// contents of the last flush in the same layout as the real controllers, so
+// that the number of changed bytes is what a real flush would have to send.
+typedef struct {
+    const char* name;
+    uint16_t width;
+    uint16_t height;
+    // One bit per pixel in pages of 8 rows, like the ST7565, otherwise
+    // one byte per pixel
+    bool packed;
+    uint8_t* frame;
+    uint16_t frame_size;
+
+    // Statistics, the flushes that didn't change anything are not counted
+    uint32_t flushes;
+    uint32_t changed_bytes;
+    uint16_t max_changed_bytes;
+    // Set by a flush that changed something, cleared by the harness
+    bool updated;
+} headless_display_t;
+
+extern headless_display_t headless_lcd;
+extern headless_display_t headless_led;
+
+// Called by the drivers with the new contents of the display
+void headless_display_flush(headless_display_t* display, const uint8_t* frame);
+// Returns the pixel as it was last flushed, 0 is black and 255 white
+uint8_t headless_display_get_pixel(headless_display_t* display, uint16_t x, uint16_t y);
+
+#endif /* QUANTUM_VISUALIZER_HEADLESS_HEADLESS_H_ */
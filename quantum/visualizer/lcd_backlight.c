@@ -23,7 +23,7 @@ SOFTWARE.
 */
 
 #include "lcd_backlight.h"
-#include <math.h>
+#include "visualizer_math.h"
 
 static uint8_t current_hue = 0;
 static uint8_t current_saturation = 0;
@@ -38,41 +38,43 @@ void lcd_backlight_init(void) {
 // This code is based on Brian Neltner's blogpost and example code
 // "Why every LED light should be using HSI colorspace".
 // http://blog.saikoled.com/post/43693602826/why-every-led-light-should-be-using-hsi
-static void hsi_to_rgb(float h, float s, float i, uint16_t* r_out, uint16_t* g_out, uint16_t* b_out) {
-    unsigned int r, g, b;
-    h = fmodf(h, 360.0f); // cycle h around to 0-360 degrees
-    h = 3.14159f * h / 180.0f; // Convert to radians.
-    s = s > 0.0f ? (s < 1.0f ? s : 1.0f) : 0.0f; // clamp s and i to interval [0,1]
-    i = i > 0.0f ? (i < 1.0f ? i : 1.0f) : 0.0f;
+// It's done in fixed point, h is an angle, s is from 0 to 255 and i from 0 to
+// 255 * 255
+static void hsi_to_rgb(uint16_t h, uint8_t s, uint16_t i, uint16_t* r_out, uint16_t* g_out, uint16_t* b_out) {
+    uint16_t* c1;
+    uint16_t* c2;
+    uint16_t* c3;
 
-    // Math! Thanks in part to Kyle Miller.
-    if(h < 2.09439f) {
-        r = 65535.0f * i/3.0f *(1.0f + s * cos(h) / cosf(1.047196667f - h));
-        g = 65535.0f * i/3.0f *(1.0f + s *(1.0f - cosf(h) / cos(1.047196667f - h)));
-        b = 65535.0f * i/3.0f *(1.0f - s);
-    } else if(h < 4.188787) {
-        h = h - 2.09439;
-        g = 65535.0f * i/3.0f *(1.0f + s * cosf(h) / cosf(1.047196667f - h));
-        b = 65535.0f * i/3.0f *(1.0f + s * (1.0f - cosf(h) / cosf(1.047196667f - h)));
-        r = 65535.0f * i/3.0f *(1.0f - s);
+    // The three 120 degree sectors use the same formula with the colors rotated
+    if (h < ANGLE_DEGREES(120)) {
+        c1 = r_out; c2 = g_out; c3 = b_out;
+    } else if (h < ANGLE_DEGREES(240)) {
+        h -= ANGLE_DEGREES(120);
+        c1 = g_out; c2 = b_out; c3 = r_out;
     } else {
-        h = h - 4.188787;
-        b = 65535.0f*i/3.0f * (1.0f + s * cosf(h) / cosf(1.047196667f - h));
-        r = 65535.0f*i/3.0f * (1.0f + s * (1.0f - cosf(h) / cosf(1.047196667f - h)));
-        g = 65535.0f*i/3.0f * (1.0f - s);
+        h -= ANGLE_DEGREES(240);
+        c1 = b_out; c2 = r_out; c3 = g_out;
     }
-    *r_out = r > 65535 ? 65535 : r;
-    *g_out = g > 65535 ? 65535 : g;
-    *b_out = b > 65535 ? 65535 : b;
+
+    // Math! Thanks in part to Kyle Miller.
+    // i / 3, scaled so that the full intensity gives 65535
+    uint32_t base = (uint32_t)i * 65535 / (3 * 255 * 255);
+    // cos(h) / cos(60 - h) in 2.14, it's between -1 and 2, and the divisor is
+    // never smaller than 0.5
+    int32_t ratio = ((int32_t)fixed_cos(h) << 14) / fixed_cos(ANGLE_DEGREES(60) - h);
+    uint32_t v1 = (base * (uint32_t)(16384 + s * ratio / 255)) >> 14;
+    uint32_t v2 = (base * (uint32_t)(16384 + s * (16384 - ratio) / 255)) >> 14;
+    uint32_t v3 = (base * (uint32_t)(16384 - s * 16384 / 255)) >> 14;
+    *c1 = v1 > 65535 ? 65535 : v1;
+    *c2 = v2 > 65535 ? 65535 : v2;
+    *c3 = v3 > 65535 ? 65535 : v3;
 }
 
 void lcd_backlight_color(uint8_t hue, uint8_t saturation, uint8_t intensity) {
     uint16_t r, g, b;
-    float hue_f = 360.0f * (float)hue / 255.0f;
-    float saturation_f = (float)saturation / 255.0f;
-    float intensity_f = (float)intensity / 255.0f;
-    intensity_f *= (float)current_brightness / 255.0f;
-    hsi_to_rgb(hue_f, saturation_f, intensity_f, &r, &g, &b);
+    // A hue of 255 is a full turn, which wraps around to zero
+    uint16_t h = (uint32_t)hue * 65536 / 255;
+    hsi_to_rgb(h, saturation, (uint16_t)intensity * current_brightness, &r, &g, &b);
 	current_hue = hue;
 	current_saturation = saturation;
 	current_intensity = intensity;
@@ -19,11 +19,21 @@
 #include "action_util.h"
 #include "led.h"
 #include "resources/resources.h"
+#include "lcd_text.h"
+
+static void draw_layer_text(coord_t x, coord_t y, visualizer_state_t* state) {
+    if (state->layer_bitmap) {
+        lcd_text_draw_bitmap(GDISP, x, y, state->layer_bitmap);
+    }
+    else {
+        lcd_text_draw_string(GDISP, x, y, state->layer_text, state->font_dejavusansbold12);
+    }
+}
 
 bool lcd_keyframe_display_layer_text(keyframe_animation_t* animation, visualizer_state_t* state) {
     (void)animation;
     gdispClear(White);
-    gdispDrawString(0, 10, state->layer_text, state->font_dejavusansbold12, Black);
+    draw_layer_text(0, 10, state);
     return false;
 }
 
@@ -57,11 +67,11 @@ bool lcd_keyframe_display_layer_bitmap(keyframe_animation_t* animation, visualiz
     const char* layer_help = "1=On D=Default B=Both";
     char layer_buffer[16 + 4]; // 3 spaces and one null terminator
     gdispClear(White);
-    gdispDrawString(0, 0, layer_help, state->font_fixed5x8, Black);
+    lcd_text_draw_string(GDISP, 0, 0, layer_help, state->font_fixed5x8);
     format_layer_bitmap_string(state->status.default_layer, state->status.layer, layer_buffer);
-    gdispDrawString(0, 10, layer_buffer, state->font_fixed5x8, Black);
+    lcd_text_draw_string(GDISP, 0, 10, layer_buffer, state->font_fixed5x8);
     format_layer_bitmap_string(state->status.default_layer >> 16, state->status.layer >> 16, layer_buffer);
-    gdispDrawString(0, 20, layer_buffer, state->font_fixed5x8, Black);
+    lcd_text_draw_string(GDISP, 0, 20, layer_buffer, state->font_fixed5x8);
     return false;
 }
 
@@ -95,10 +105,10 @@ bool lcd_keyframe_display_mods_bitmap(keyframe_animation_t* animation, visualize
     char status_buffer[12];
 
     gdispClear(White);
-    gdispDrawString(0, 0, title, state->font_fixed5x8, Black);
-    gdispDrawString(0, 10, mods_header, state->font_fixed5x8, Black);
+    lcd_text_draw_string(GDISP, 0, 0, title, state->font_fixed5x8);
+    lcd_text_draw_string(GDISP, 0, 10, mods_header, state->font_fixed5x8);
     format_mods_bitmap_string(state->status.mods, status_buffer);
-    gdispDrawString(0, 20, status_buffer, state->font_fixed5x8, Black);
+    lcd_text_draw_string(GDISP, 0, 20, status_buffer, state->font_fixed5x8);
 
     return false;
 }
@@ -137,7 +147,7 @@ bool lcd_keyframe_display_led_states(keyframe_animation_t* animation, visualizer
     char output[LED_STATE_STRING_SIZE];
     get_led_state_string(output, state);
     gdispClear(White);
-    gdispDrawString(0, 10, output, state->font_dejavusansbold12, Black);
+    lcd_text_draw_string(GDISP, 0, 10, output, state->font_dejavusansbold12);
     return false;
 }
 
@@ -148,10 +158,10 @@ bool lcd_keyframe_display_layer_and_led_states(keyframe_animation_t* animation,
     if (state->status.leds) {
         char output[LED_STATE_STRING_SIZE];
         get_led_state_string(output, state);
-        gdispDrawString(0, 1, output, state->font_dejavusansbold12, Black);
+        lcd_text_draw_string(GDISP, 0, 1, output, state->font_dejavusansbold12);
         y = 17;
     }
-    gdispDrawString(0, y, state->layer_text, state->font_dejavusansbold12, Black);
+    draw_layer_text(0, y, state);
     return false;
 }
 
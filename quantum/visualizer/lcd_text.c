@@ -0,0 +1,144 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lcd_text.h"
+#include <string.h>
+
+// Each cached glyph is up to 16x16 pixels, with two bytes for each row
+#define GLYPH_WIDTH 16
+#define GLYPH_ROW_SIZE (GLYPH_WIDTH / 8)
+#define TEXT_ROW_SIZE (LCD_TEXT_MAX_WIDTH / 8)
+
+typedef struct {
+    font_t font;
+    uint16_t character;
+    uint16_t last_used;
+    // How far the pen moves after the glyph
+    uint8_t advance;
+    // The glyph is rendered this many pixels to the right in the cell, so
+    // that the parts to the left of the pen are not lost
+    uint8_t offset;
+    uint8_t bits[LCD_TEXT_MAX_HEIGHT * GLYPH_ROW_SIZE];
+} glyph_t;
+
+static glyph_t glyph_cache[LCD_GLYPH_CACHE_SIZE];
+static uint16_t use_counter = 0;
+
+static void render_pixels(int16_t x, int16_t y, uint8_t count, uint8_t alpha, void* state) {
+    glyph_t* glyph = (glyph_t*)state;
+    // There's no anti-aliasing on the LCD
+    if (alpha < 0x80 || y < 0 || y >= LCD_TEXT_MAX_HEIGHT) {
+        return;
+    }
+    for (; count; count--, x++) {
+        if (x >= 0 && x < GLYPH_WIDTH) {
+            glyph->bits[y * GLYPH_ROW_SIZE + x / 8] |= 0x80 >> (x % 8);
+        }
+    }
+}
+
+// Free cells are the oldest
+static uint16_t get_age(glyph_t* glyph) {
+    return glyph->font ? (uint16_t)(use_counter - glyph->last_used) : 0xFFFF;
+}
+
+static glyph_t* get_glyph(font_t font, uint16_t character) {
+    glyph_t* oldest = &glyph_cache[0];
+    use_counter++;
+    for (int i = 0; i < LCD_GLYPH_CACHE_SIZE; i++) {
+        glyph_t* glyph = &glyph_cache[i];
+        if (glyph->font == font && glyph->character == character) {
+            glyph->last_used = use_counter;
+            return glyph;
+        }
+        if (get_age(glyph) > get_age(oldest)) {
+            oldest = glyph;
+        }
+    }
+    // Not found, so replace the least recently used glyph
+    glyph_t* glyph = oldest;
+    memset(glyph, 0, sizeof(glyph_t));
+    glyph->font = font;
+    glyph->character = character;
+    glyph->last_used = use_counter;
+    glyph->offset = font->baseline_x < GLYPH_WIDTH / 2 ? font->baseline_x : 0;
+    glyph->advance = mf_character_width(font, character);
+    mf_render_character(font, glyph->offset, 0, character, render_pixels, glyph);
+    return glyph;
+}
+
+static void draw_glyph(glyph_t* glyph, int16_t x, uint8_t height, uint8_t* buffer) {
+    for (uint8_t y = 0; y < height; y++) {
+        uint8_t* row = buffer + y * TEXT_ROW_SIZE;
+        for (uint8_t i = 0; i < GLYPH_ROW_SIZE; i++) {
+            uint8_t bits = glyph->bits[y * GLYPH_ROW_SIZE + i];
+            int16_t pos = x + i * 8;
+            if (bits == 0 || pos <= -8 || pos >= LCD_TEXT_MAX_WIDTH) {
+                continue;
+            }
+            // The byte is usually split over two bytes of the buffer
+            uint8_t shift = pos & 7;
+            int16_t index = pos >> 3;
+            // The text is black, which is a cleared bit
+            if (index >= 0) {
+                row[index] &= ~(bits >> shift);
+            }
+            if (shift && index + 1 < TEXT_ROW_SIZE) {
+                row[index + 1] &= ~(uint8_t)(bits << (8 - shift));
+            }
+        }
+    }
+}
+
+uint8_t lcd_text_render(font_t font, const char* str, uint8_t* buffer) {
+    uint8_t height = font->height < LCD_TEXT_MAX_HEIGHT ? font->height : LCD_TEXT_MAX_HEIGHT;
+    memset(buffer, 0xFF, LCD_TEXT_MAX_HEIGHT * TEXT_ROW_SIZE);
+    // The same layout as gdispDrawString
+    int16_t x = font->baseline_x;
+#if GDISP_NEED_TEXT_KERNING
+    uint16_t prev = 0;
+#endif
+    for (; *str; str++) {
+        uint16_t character = (uint8_t)*str;
+#if GDISP_NEED_TEXT_KERNING
+        if (prev) {
+            x += mf_compute_kerning(font, prev, character);
+        }
+        prev = character;
+#endif
+        glyph_t* glyph = get_glyph(font, character);
+        draw_glyph(glyph, x - glyph->offset, height, buffer);
+        x += glyph->advance;
+    }
+    return x < 0 ? 0 : (x > LCD_TEXT_MAX_WIDTH ? LCD_TEXT_MAX_WIDTH : x);
+}
+
+#ifndef LCD_TEXT_RENDER_ONLY
+static uint8_t text_buffer[LCD_TEXT_MAX_HEIGHT * TEXT_ROW_SIZE];
+
+void lcd_text_draw_string(GDisplay* g, coord_t x, coord_t y, const char* str, font_t font) {
+    uint8_t width = lcd_text_render(font, str, text_buffer);
+    if (width == 0) {
+        return;
+    }
+    uint8_t height = font->height < LCD_TEXT_MAX_HEIGHT ? font->height : LCD_TEXT_MAX_HEIGHT;
+    gdispGBlitArea(g, x, y, width, height, 0, 0, LCD_TEXT_MAX_WIDTH, (pixel_t*)text_buffer);
+}
+
+void lcd_text_draw_bitmap(GDisplay* g, coord_t x, coord_t y, const lcd_text_bitmap_t* bitmap) {
+    gdispGBlitArea(g, x, y, bitmap->width, bitmap->height, 0, 0, bitmap->width, (pixel_t*)bitmap->data);
+}
+#endif
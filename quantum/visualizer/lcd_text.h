@@ -0,0 +1,57 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUANTUM_VISUALIZER_LCD_TEXT_H_
+#define QUANTUM_VISUALIZER_LCD_TEXT_H_
+
+#include <stdint.h>
+#include "gfx.h"
+
+// Fast text drawing for the LCD. The glyphs are rendered only once into a
+// cache, and a whole string is drawn with a single blit, instead of being
+// rasterized pixel by pixel by uGFX every time. The background of the text
+// is cleared, so the strings shouldn't overlap each other.
+// Like the logo, the bitmaps are packed with one bit per pixel, left to
+// right and top to bottom, which is what the LCD driver expects. The text is
+// black on white, and a set bit is white.
+
+// The maximum size of the rendered strings, wider strings are clipped
+#define LCD_TEXT_MAX_WIDTH 128
+#define LCD_TEXT_MAX_HEIGHT 16
+
+// The number of glyphs in the cache, each takes about 40 bytes of RAM
+#ifndef LCD_GLYPH_CACHE_SIZE
+#define LCD_GLYPH_CACHE_SIZE 32
+#endif
+
+// A string that has been rendered at build time, see resources/text_converter
+typedef struct {
+    uint8_t width;
+    uint8_t height;
+    const uint8_t* data;
+} lcd_text_bitmap_t;
+
+// Renders the string into a buffer of LCD_TEXT_MAX_HEIGHT rows, that are
+// LCD_TEXT_MAX_WIDTH pixels wide, and returns the width of the string
+uint8_t lcd_text_render(font_t font, const char* str, uint8_t* buffer);
+
+#ifndef LCD_TEXT_RENDER_ONLY
+// Draws the string with the top left corner at x, y
+void lcd_text_draw_string(GDisplay* g, coord_t x, coord_t y, const char* str, font_t font);
+void lcd_text_draw_bitmap(GDisplay* g, coord_t x, coord_t y, const lcd_text_bitmap_t* bitmap);
+#endif
+
+#endif /* QUANTUM_VISUALIZER_LCD_TEXT_H_ */
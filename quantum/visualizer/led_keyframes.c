@@ -22,20 +22,15 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 #include "gfx.h"
-#include "math.h"
 #include "led_keyframes.h"
+#include "visualizer_keyframes.h"
 
-static uint8_t fade_led_color(keyframe_animation_t* animation, int from, int to) {
-    int frame_length = animation->frame_lengths[animation->current_frame];
-    int current_pos = frame_length - animation->time_left_in_frame;
-    int delta = to - from;
-    int luma = (delta * current_pos) / frame_length;
-    luma += from;
-    return luma;
+static q8_8_t get_fade_position(keyframe_animation_t* animation) {
+    return keyframe_get_progress(animation) >> 8;
 }
 
 static void keyframe_fade_all_leds_from_to(keyframe_animation_t* animation, uint8_t from, uint8_t to) {
-    uint8_t luma = fade_led_color(animation, from, to);
+    uint8_t luma = q8_8_lerp(from, to, get_fade_position(animation));
     color_t color = LUMA2COLOR(luma);
     gdispGClear(LED_DISPLAY, color);
 }
@@ -47,13 +42,10 @@ static void keyframe_fade_all_leds_from_to(keyframe_animation_t* animation, uint
 static uint8_t crossfade_start_frame[NUM_ROWS][NUM_COLS];
 static uint8_t crossfade_end_frame[NUM_ROWS][NUM_COLS];
 
-static uint8_t compute_gradient_color(float t, float index, float num) {
-    const float two_pi = M_PI * 2.0f;
-    float normalized_index = (1.0f - index / (num - 1.0f)) * two_pi;
-    float x = t * two_pi + normalized_index;
-    float v = 0.5 * (cosf(x) + 1.0f);
-    return (uint8_t)(255.0f * v);
-}
+// Filled on the first use, the animations only look them up
+static cos_gradient_table_t col_gradient;
+static cos_gradient_table_t row_gradient;
+
 
 bool led_keyframe_fade_in_all(keyframe_animation_t* animation, visualizer_state_t* state) {
     (void)state;
@@ -69,24 +61,27 @@ bool led_keyframe_fade_out_all(keyframe_animation_t* animation, visualizer_state
 
 bool led_keyframe_left_to_right_gradient(keyframe_animation_t* animation, visualizer_state_t* state) {
     (void)state;
-    float frame_length = animation->frame_lengths[animation->current_frame];
-    float current_pos = frame_length - animation->time_left_in_frame;
-    float t = current_pos / frame_length;
+    uint8_t gradient[NUM_COLS];
+    if (col_gradient.count != NUM_COLS) {
+        cos_gradient_table_init(&col_gradient, NUM_COLS);
+    }
+    // The progress of the frame is the phase, as a fraction of a full turn
+    cos_gradient_table_get(&col_gradient, gradient, (uint16_t)keyframe_get_progress(animation));
     for (int i=0; i< NUM_COLS; i++) {
-        uint8_t color = compute_gradient_color(t, i, NUM_COLS);
-        gdispGDrawLine(LED_DISPLAY, i, 0, i, NUM_ROWS - 1, LUMA2COLOR(color));
+        gdispGDrawLine(LED_DISPLAY, i, 0, i, NUM_ROWS - 1, LUMA2COLOR(gradient[i]));
     }
     return true;
 }
 
 bool led_keyframe_top_to_bottom_gradient(keyframe_animation_t* animation, visualizer_state_t* state) {
     (void)state;
-    float frame_length = animation->frame_lengths[animation->current_frame];
-    float current_pos = frame_length - animation->time_left_in_frame;
-    float t = current_pos / frame_length;
+    uint8_t gradient[NUM_ROWS];
+    if (row_gradient.count != NUM_ROWS) {
+        cos_gradient_table_init(&row_gradient, NUM_ROWS);
+    }
+    cos_gradient_table_get(&row_gradient, gradient, (uint16_t)keyframe_get_progress(animation));
     for (int i=0; i< NUM_ROWS; i++) {
-        uint8_t color = compute_gradient_color(t, i, NUM_ROWS);
-        gdispGDrawLine(LED_DISPLAY, 0, i, NUM_COLS - 1, i, LUMA2COLOR(color));
+        gdispGDrawLine(LED_DISPLAY, 0, i, NUM_COLS - 1, i, LUMA2COLOR(gradient[i]));
     }
     return true;
 }
@@ -105,9 +100,10 @@ bool led_keyframe_crossfade(keyframe_animation_t* animation, visualizer_state_t*
         run_next_keyframe(animation, state);
         copy_current_led_state(&crossfade_end_frame[0][0]);
     }
+    q8_8_t t = get_fade_position(animation);
     for (int i=0;i<NUM_ROWS;i++) {
         for (int j=0;j<NUM_COLS;j++) {
-            color_t color  = LUMA2COLOR(fade_led_color(animation, crossfade_start_frame[i][j], crossfade_end_frame[i][j]));
+            color_t color  = LUMA2COLOR(q8_8_lerp(crossfade_start_frame[i][j], crossfade_end_frame[i][j], t));
             gdispGDrawPixel(LED_DISPLAY, j, i, color);
         }
     }
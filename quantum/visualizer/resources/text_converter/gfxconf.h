@@ -0,0 +1,31 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The uGFX configuration of the text converter, only the fonts are used
+
+#ifndef _GFXCONF_H
+#define _GFXCONF_H
+
+#define GFX_USE_OS_LINUX                             TRUE
+
+#define GFX_USE_GDISP                                TRUE
+#define GDISP_NEED_TEXT                              TRUE
+    #define GDISP_NEED_TEXT_KERNING                  TRUE
+    // Add the fonts that the keyboard uses here
+    #define GDISP_INCLUDE_FONT_DEJAVUSANSBOLD12      TRUE
+    #define GDISP_INCLUDE_FONT_FIXED_5X8             TRUE
+
+#endif /* _GFXCONF_H */
@@ -0,0 +1,86 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Renders strings with the uGFX fonts at build time, so that they can be
+// drawn with a single blit, like the logo in resources/lcd_logo.c.
+// The output is a C file with a lcd_text_bitmap_t for each string, which
+// can for example be used as the layer_bitmap of the visualizer state.
+//
+// Usage: text_converter FONT NAME=TEXT [NAME=TEXT...] > layer_names.c
+// For example: text_converter DejaVuSansBold12 layer_qwerty=QWERTY layer_symbols=Symbols
+
+#include <stdio.h>
+#include <string.h>
+#include "lcd_text.h"
+
+static uint8_t buffer[LCD_TEXT_MAX_HEIGHT * LCD_TEXT_MAX_WIDTH / 8];
+
+static void print_bitmap(const char* name, uint8_t width, uint8_t height) {
+    // The rows of the rendered buffer are packed together, without padding
+    printf("static const uint8_t %s_data[] = {", name);
+    unsigned bits = width * height;
+    for (unsigned byte = 0; byte < (bits + 7) / 8; byte++) {
+        uint8_t value = 0;
+        for (unsigned bit = 0; bit < 8; bit++) {
+            unsigned pos = byte * 8 + bit;
+            if (pos >= bits) {
+                break;
+            }
+            unsigned x = pos % width;
+            unsigned y = pos / width;
+            if (buffer[y * LCD_TEXT_MAX_WIDTH / 8 + x / 8] & (0x80 >> (x % 8))) {
+                value |= 0x80 >> bit;
+            }
+        }
+        printf("%s0x%02x,", byte % 16 ? " " : "\n    ", value);
+    }
+    printf("\n};\n");
+    printf("const lcd_text_bitmap_t %s = {%u, %u, %s_data};\n\n", name, width, height, name);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s FONT NAME=TEXT [NAME=TEXT...]\n", argv[0]);
+        return 1;
+    }
+    font_t font = mf_find_font(argv[1]);
+    if (!font) {
+        fprintf(stderr, "The font %s is not included, check gfxconf.h\n", argv[1]);
+        return 1;
+    }
+    uint8_t height = font->height < LCD_TEXT_MAX_HEIGHT ? font->height : LCD_TEXT_MAX_HEIGHT;
+    for (int i = 2; i < argc; i++) {
+        if (!strchr(argv[i], '=')) {
+            fprintf(stderr, "%s is not in the form NAME=TEXT\n", argv[i]);
+            return 1;
+        }
+    }
+
+    printf("// Generated with quantum/visualizer/resources/text_converter using the font %s\n", argv[1]);
+    printf("#include \"lcd_text.h\"\n\n");
+    for (int i = 2; i < argc; i++) {
+        char* text = strchr(argv[i], '=');
+        *text++ = 0;
+        uint8_t width = lcd_text_render(font, text, buffer);
+        if (width == 0) {
+            fprintf(stderr, "%s is empty\n", argv[i]);
+            return 1;
+        }
+        printf("// %s\n", text);
+        print_bitmap(argv[i], width, height);
+    }
+    return 0;
+}
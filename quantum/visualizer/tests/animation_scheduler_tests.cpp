@@ -0,0 +1,177 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtest/gtest.h"
+extern "C" {
+#include "animation_scheduler.h"
+}
+
+static systemticks_t fake_ticks = 0;
+
+extern "C" systemticks_t gfxSystemTicks(void) {
+    return fake_ticks;
+}
+
+class AnimationScheduler : public testing::Test {
+public:
+    AnimationScheduler() {
+        fake_ticks = 0;
+        for (int i = 0; i < 10; i++) {
+            animations[i] = keyframe_animation_t();
+        }
+    }
+    ~AnimationScheduler() {
+        while (animation_scheduler_remove_first()) {
+        }
+    }
+    // Removes the due animation and checks that it's the expected one
+    void expect_due(keyframe_animation_t* expected) {
+        keyframe_animation_t* animation = animation_scheduler_get_due();
+        EXPECT_EQ(animation, expected);
+        if (animation) {
+            animation_scheduler_remove(animation);
+        }
+    }
+    keyframe_animation_t animations[10];
+};
+
+TEST_F(AnimationScheduler, is_empty_from_the_start) {
+    EXPECT_TRUE(animation_scheduler_is_empty());
+    animation_scheduler_take_due(gfxSystemTicks());
+    EXPECT_EQ(animation_scheduler_get_due(), nullptr);
+    systemticks_t deadline;
+    EXPECT_FALSE(animation_scheduler_get_next_deadline(&deadline));
+}
+
+TEST_F(AnimationScheduler, orders_by_deadline) {
+    animation_scheduler_add(&animations[0], 30);
+    animation_scheduler_add(&animations[1], 10);
+    animation_scheduler_add(&animations[2], 20);
+    fake_ticks = 100;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[1]);
+    expect_due(&animations[2]);
+    expect_due(&animations[0]);
+    expect_due(nullptr);
+    EXPECT_TRUE(animation_scheduler_is_empty());
+}
+
+TEST_F(AnimationScheduler, only_takes_the_animations_that_are_due) {
+    animation_scheduler_add(&animations[0], 10);
+    animation_scheduler_add(&animations[1], 50);
+    fake_ticks = 10;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[0]);
+    expect_due(nullptr);
+    systemticks_t deadline;
+    EXPECT_TRUE(animation_scheduler_get_next_deadline(&deadline));
+    EXPECT_EQ(deadline, 50);
+}
+
+TEST_F(AnimationScheduler, orders_by_layer_at_the_same_deadline) {
+    animations[0].layer = 2;
+    animations[1].layer = 0;
+    animations[2].layer = 1;
+    animations[3].layer = 1;
+    for (int i = 0; i < 4; i++) {
+        animation_scheduler_add(&animations[i], 10);
+    }
+    fake_ticks = 10;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[1]);
+    expect_due(&animations[2]);
+    expect_due(&animations[3]);
+    expect_due(&animations[0]);
+}
+
+TEST_F(AnimationScheduler, runs_more_than_four_animations) {
+    for (int i = 0; i < 10; i++) {
+        animation_scheduler_add(&animations[i], i);
+    }
+    fake_ticks = 10;
+    animation_scheduler_take_due(gfxSystemTicks());
+    for (int i = 0; i < 10; i++) {
+        expect_due(&animations[i]);
+    }
+    EXPECT_TRUE(animation_scheduler_is_empty());
+}
+
+TEST_F(AnimationScheduler, reschedules_a_due_animation) {
+    animation_scheduler_add(&animations[0], 0);
+    animation_scheduler_take_due(gfxSystemTicks());
+    EXPECT_EQ(animation_scheduler_get_due(), &animations[0]);
+    animation_scheduler_reschedule(&animations[0], 20);
+    EXPECT_EQ(animation_scheduler_get_due(), nullptr);
+    fake_ticks = 19;
+    animation_scheduler_take_due(gfxSystemTicks());
+    EXPECT_EQ(animation_scheduler_get_due(), nullptr);
+    fake_ticks = 20;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[0]);
+}
+
+TEST_F(AnimationScheduler, does_not_reschedule_a_removed_animation) {
+    animation_scheduler_add(&animations[0], 0);
+    animation_scheduler_take_due(gfxSystemTicks());
+    animation_scheduler_remove(&animations[0]);
+    animation_scheduler_reschedule(&animations[0], 20);
+    EXPECT_TRUE(animation_scheduler_is_empty());
+}
+
+TEST_F(AnimationScheduler, does_not_reschedule_an_animation_started_again) {
+    animation_scheduler_add(&animations[0], 0);
+    animation_scheduler_take_due(gfxSystemTicks());
+    animation_scheduler_add(&animations[0], 5);
+    animation_scheduler_reschedule(&animations[0], 20);
+    systemticks_t deadline;
+    EXPECT_TRUE(animation_scheduler_get_next_deadline(&deadline));
+    EXPECT_EQ(deadline, 5);
+}
+
+TEST_F(AnimationScheduler, moves_an_animation_that_is_added_twice) {
+    animation_scheduler_add(&animations[0], 10);
+    animation_scheduler_add(&animations[0], 30);
+    fake_ticks = 20;
+    animation_scheduler_take_due(gfxSystemTicks());
+    EXPECT_EQ(animation_scheduler_get_due(), nullptr);
+    fake_ticks = 30;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[0]);
+    expect_due(nullptr);
+}
+
+TEST_F(AnimationScheduler, handles_the_system_ticks_wrapping_around) {
+    fake_ticks = 0xFFFFFFF0;
+    animation_scheduler_add(&animations[0], 0x8);
+    animation_scheduler_add(&animations[1], 0xFFFFFFF8);
+    fake_ticks = 0xFFFFFFFA;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[1]);
+    expect_due(nullptr);
+    fake_ticks = 0x8;
+    animation_scheduler_take_due(gfxSystemTicks());
+    expect_due(&animations[0]);
+}
+
+TEST_F(AnimationScheduler, removes_both_waiting_and_due_animations) {
+    animation_scheduler_add(&animations[0], 0);
+    animation_scheduler_add(&animations[1], 10);
+    animation_scheduler_take_due(gfxSystemTicks());
+    EXPECT_EQ(animation_scheduler_remove_first(), &animations[0]);
+    EXPECT_EQ(animation_scheduler_remove_first(), &animations[1]);
+    EXPECT_EQ(animation_scheduler_remove_first(), nullptr);
+    EXPECT_TRUE(animation_scheduler_is_empty());
+}
@@ -0,0 +1,33 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// A minimal replacement for the uGFX header, so that the visualizer can be
+// tested on the host
+
+#ifndef QUANTUM_VISUALIZER_TESTS_GFX_H_
+#define QUANTUM_VISUALIZER_TESTS_GFX_H_
+
+#include <stdint.h>
+
+typedef uint32_t systemticks_t;
+typedef struct GDisplay GDisplay;
+
+#define TIME_INFINITE ((systemticks_t)-1)
+
+// Implemented by the tests
+systemticks_t gfxSystemTicks(void);
+
+#endif /* QUANTUM_VISUALIZER_TESTS_GFX_H_ */
@@ -0,0 +1,22 @@
+# Copyright 2017 Fred Sundvik
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+visualizer_animation_scheduler_SRC := \
+	$(QUANTUM_PATH)/visualizer/tests/animation_scheduler_tests.cpp \
+	$(QUANTUM_PATH)/visualizer/animation_scheduler.c
+
+visualizer_animation_scheduler_INC := \
+	$(QUANTUM_PATH)/visualizer/tests \
+	$(QUANTUM_PATH)/visualizer
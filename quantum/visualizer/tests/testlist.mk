@@ -0,0 +1,2 @@
+TEST_LIST +=\
+	visualizer_animation_scheduler
\ No newline at end of file
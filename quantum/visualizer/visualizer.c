@@ -24,6 +24,7 @@ SOFTWARE.
 
 #include "config.h"
 #include "visualizer.h"
+#include "animation_scheduler.h"
 #include <string.h>
 #ifdef PROTOCOL_CHIBIOS
 #include "ch.h"
@@ -48,6 +49,8 @@ SOFTWARE.
 #include "serial_link/system/serial_link.h"
 #endif
 
+#include "serial_link/protocol/triple_buffered_object.h"
+
 #include "action_util.h"
 
 // Define this in config.h
@@ -55,6 +58,8 @@ SOFTWARE.
 #define "Visualizer thread priority not defined"
 #endif
 
+// The status is owned by the keyboard thread, the visualizer thread only sees
+// the copies published through the status_channel
 static visualizer_keyboard_status_t current_status = {
     .layer = 0xFFFFFFFF,
     .default_layer = 0xFFFFFFFF,
@@ -69,19 +74,32 @@ static visualizer_keyboard_status_t current_status = {
 #endif
 };
 
-static bool same_status(visualizer_keyboard_status_t* status1, visualizer_keyboard_status_t* status2) {
-    return status1->layer == status2->layer &&
-        status1->default_layer == status2->default_layer &&
-        status1->mods == status2->mods &&
-        status1->leds == status2->leds &&
-        status1->suspended == status2->suspended
+static struct {
+    uint8_t state;
+    visualizer_keyboard_status_t buffer[3];
+} status_channel;
+
+static uint8_t get_status_changes(visualizer_keyboard_status_t* status1, visualizer_keyboard_status_t* status2) {
+    uint8_t changes = 0;
+    if (status1->layer != status2->layer)
+        changes |= VISUALIZER_CHANGED_LAYER;
+    if (status1->default_layer != status2->default_layer)
+        changes |= VISUALIZER_CHANGED_DEFAULT_LAYER;
+    if (status1->mods != status2->mods)
+        changes |= VISUALIZER_CHANGED_MODS;
+    if (status1->leds != status2->leds)
+        changes |= VISUALIZER_CHANGED_LEDS;
+    if (status1->suspended != status2->suspended)
+        changes |= VISUALIZER_CHANGED_SUSPENDED;
 #ifdef BACKLIGHT_ENABLE
-        && status1->backlight_level == status2->backlight_level
+    if (status1->backlight_level != status2->backlight_level)
+        changes |= VISUALIZER_CHANGED_BACKLIGHT;
 #endif
 #ifdef VISUALIZER_USER_DATA_SIZE
-        && memcmp(status1->user_data, status2->user_data, VISUALIZER_USER_DATA_SIZE) == 0
+    if (memcmp(status1->user_data, status2->user_data, VISUALIZER_USER_DATA_SIZE) != 0)
+        changes |= VISUALIZER_CHANGED_USER_DATA;
 #endif
-    ;
+    return changes;
 }
 
 static bool visualizer_enabled = false;
@@ -90,9 +108,6 @@ static bool visualizer_enabled = false;
 static uint8_t user_data[VISUALIZER_USER_DATA_SIZE];
 #endif
 
-#define MAX_SIMULTANEOUS_ANIMATIONS 4
-static keyframe_animation_t* animations[MAX_SIMULTANEOUS_ANIMATIONS] = {};
-
 #ifdef SERIAL_LINK_ENABLE
 MASTER_TO_ALL_SLAVES_OBJECT(current_status, visualizer_keyboard_status_t);
 
@@ -123,18 +138,9 @@ void start_keyframe_animation(keyframe_animation_t* animation) {
     animation->current_frame = -1;
     animation->time_left_in_frame = 0;
     animation->need_update = true;
-    int free_index = -1;
-    for (int i=0;i<MAX_SIMULTANEOUS_ANIMATIONS;i++) {
-        if (animations[i] == animation) {
-            return;
-        }
-        if (free_index == -1 && animations[i] == NULL) {
-           free_index=i;
-        }
-    }
-    if (free_index!=-1) {
-        animations[free_index] = animation;
-    }
+    // The first update starts the first frame, so it doesn't need a delta
+    animation->last_update = gfxSystemTicks();
+    animation_scheduler_add(animation, animation->last_update);
 }
 
 void stop_keyframe_animation(keyframe_animation_t* animation) {
@@ -143,34 +149,26 @@ void stop_keyframe_animation(keyframe_animation_t* animation) {
     animation->need_update = true;
     animation->first_update_of_frame = false;
     animation->last_update_of_frame = false;
-    for (int i=0;i<MAX_SIMULTANEOUS_ANIMATIONS;i++) {
-        if (animations[i] == animation) {
-            animations[i] = NULL;
-            return;
-        }
-    }
+    animation_scheduler_remove(animation);
 }
 
 void stop_all_keyframe_animations(void) {
-    for (int i=0;i<MAX_SIMULTANEOUS_ANIMATIONS;i++) {
-        if (animations[i]) {
-            animations[i]->current_frame = animations[i]->num_frames;
-            animations[i]->time_left_in_frame = 0;
-            animations[i]->need_update = true;
-            animations[i]->first_update_of_frame = false;
-            animations[i]->last_update_of_frame = false;
-            animations[i] = NULL;
-        }
+    keyframe_animation_t* animation;
+    while ((animation = animation_scheduler_remove_first())) {
+        animation->current_frame = animation->num_frames;
+        animation->time_left_in_frame = 0;
+        animation->need_update = true;
+        animation->first_update_of_frame = false;
+        animation->last_update_of_frame = false;
     }
 }
 
-static uint8_t get_num_running_animations(void) {
-    uint8_t count = 0;
-    for (int i=0;i<MAX_SIMULTANEOUS_ANIMATIONS;i++) {
-        count += animations[i] ? 1 : 0;
-    }
-    return count;
-}
+#ifdef VISUALIZER_HEADLESS
+// The headless build measures the time spent in each keyframe
+#define RUN_FRAME(func, animation, state) visualizer_headless_run_frame(func, animation, state)
+#else
+#define RUN_FRAME(func, animation, state) (*(func))(animation, state)
+#endif
 
 static bool update_keyframe_animation(keyframe_animation_t* animation, visualizer_state_t* state, systemticks_t delta, systemticks_t* sleep_time) {
     // TODO: Clean up this messy code
@@ -192,7 +190,7 @@ static bool update_keyframe_animation(keyframe_animation_t* animation, visualize
             if (animation->need_update) {
                 animation->time_left_in_frame = 0;
                 animation->last_update_of_frame = true;
-                (*animation->frame_functions[animation->current_frame])(animation, state);
+                RUN_FRAME(animation->frame_functions[animation->current_frame], animation, state);
                 animation->last_update_of_frame = false;
             }
             animation->current_frame++;
@@ -213,15 +211,11 @@ static bool update_keyframe_animation(keyframe_animation_t* animation, visualize
         }
     }
     if (animation->need_update) {
-        animation->need_update = (*animation->frame_functions[animation->current_frame])(animation, state);
+        animation->need_update = RUN_FRAME(animation->frame_functions[animation->current_frame], animation, state);
         animation->first_update_of_frame = false;
     }
 
-    systemticks_t wanted_sleep = animation->need_update ? gfxMillisecondsToTicks(10) : (unsigned)animation->time_left_in_frame;
-    if (wanted_sleep < *sleep_time) {
-        *sleep_time = wanted_sleep;
-    }
-
+    *sleep_time = animation->need_update ? gfxMillisecondsToTicks(10) : (unsigned)animation->time_left_in_frame;
     return true;
 }
 
@@ -237,37 +231,34 @@ void run_next_keyframe(keyframe_animation_t* animation, visualizer_state_t* stat
     temp_animation.last_update_of_frame = false;
     temp_animation.need_update  = false;
     visualizer_state_t temp_state = *state;
-    (*temp_animation.frame_functions[next_frame])(&temp_animation, &temp_state);
+    RUN_FRAME(temp_animation.frame_functions[next_frame], &temp_animation, &temp_state);
 }
 
-// TODO: Optimize the stack size, this is probably way too big
-static DECLARE_THREAD_STACK(visualizerThreadStack, 1024);
-static DECLARE_THREAD_FUNCTION(visualizerThread, arg) {
-    (void)arg;
+static const visualizer_keyboard_status_t initial_status = {
+    .default_layer = 0xFFFFFFFF,
+    .layer = 0xFFFFFFFF,
+    .mods = 0xFF,
+    .leds = 0xFFFFFFFF,
+    .suspended = false,
+#ifdef VISUALIZER_USER_DATA_SIZE
+    .user_data = {0},
+#endif
+};
 
-    GListener event_listener;
-    geventListenerInit(&event_listener);
-    geventAttachSource(&event_listener, (GSourceHandle)&current_status, 0);
-
-    visualizer_keyboard_status_t initial_status = {
-        .default_layer = 0xFFFFFFFF,
-        .layer = 0xFFFFFFFF,
-        .mods = 0xFF,
-        .leds = 0xFFFFFFFF,
-        .suspended = false,
-    #ifdef VISUALIZER_USER_DATA_SIZE
-        .user_data = {0},
-    #endif
-    };
-
-    visualizer_state_t state = {
-        .status = initial_status,
-        .current_lcd_color = 0,
+// The latest status received from the keyboard thread, state.status is
+// only updated from it when the visualizer is enabled
+static visualizer_keyboard_status_t received_status;
+static visualizer_state_t state;
+static bool force_update;
+
+static void visualizer_start(void) {
+    received_status = initial_status;
+    state.status = initial_status;
+    state.current_lcd_color = 0;
 #ifdef LCD_ENABLE
-        .font_fixed5x8 = gdispOpenFont("fixed_5x8"),
-        .font_dejavusansbold12 = gdispOpenFont("DejaVuSansBold12")
+    state.font_fixed5x8 = gdispOpenFont("fixed_5x8");
+    state.font_dejavusansbold12 = gdispOpenFont("DejaVuSansBold12");
 #endif
-    };
     initialize_user_visualizer(&state);
     state.prev_lcd_color = state.current_lcd_color;
 
@@ -277,89 +268,123 @@ static DECLARE_THREAD_FUNCTION(visualizerThread, arg) {
             LCD_SAT(state.current_lcd_color),
             LCD_INT(state.current_lcd_color));
 #endif
+    force_update = true;
+}
 
+// Runs one iteration of the visualizer, and returns the number of ticks
+// until the next one is needed, unless the status changes before that
+static systemticks_t visualizer_step(void) {
     systemticks_t sleep_time = TIME_INFINITE;
     systemticks_t current_time = gfxSystemTicks();
-    bool force_update = true;
-
-    while(true) {
-        systemticks_t new_time = gfxSystemTicks();
-        systemticks_t delta = new_time - current_time;
-        current_time = new_time;
-        bool enabled = visualizer_enabled;
-        if (force_update || !same_status(&state.status, &current_status)) {
-            force_update = false;
-    #if BACKLIGHT_ENABLE
-            if(current_status.backlight_level != state.status.backlight_level) {
-                if (current_status.backlight_level != 0) {
-                    gdispGSetPowerMode(LED_DISPLAY, powerOn);
-                    uint16_t percent = (uint16_t)current_status.backlight_level * 100 / BACKLIGHT_LEVELS;
-                    gdispGSetBacklight(LED_DISPLAY, percent);
-                }
-                else {
-                    gdispGSetPowerMode(LED_DISPLAY, powerOff);
-                }
+    bool enabled = visualizer_enabled;
+    uint8_t changes = 0;
+    visualizer_keyboard_status_t* new_status = triple_buffer_read(&status_channel);
+    if (new_status) {
+        received_status = *new_status;
+    }
+    if (new_status || force_update) {
+        changes = get_status_changes(&state.status, &received_status);
+    }
+    if (force_update || changes) {
+        force_update = false;
+#if BACKLIGHT_ENABLE
+        if(changes & VISUALIZER_CHANGED_BACKLIGHT) {
+            if (received_status.backlight_level != 0) {
+                gdispGSetPowerMode(LED_DISPLAY, powerOn);
+                uint16_t percent = (uint16_t)received_status.backlight_level * 100 / BACKLIGHT_LEVELS;
+                gdispGSetBacklight(LED_DISPLAY, percent);
             }
-    #endif
-            if (visualizer_enabled) {
-                if (current_status.suspended) {
-                    stop_all_keyframe_animations();
-                    visualizer_enabled = false;
-                    state.status = current_status;
-                    user_visualizer_suspend(&state);
-                }
-                else {
-                    visualizer_keyboard_status_t prev_status = state.status;
-                    state.status = current_status;
-                    update_user_visualizer_state(&state, &prev_status);
-                }
-                state.prev_lcd_color = state.current_lcd_color;
+            else {
+                gdispGSetPowerMode(LED_DISPLAY, powerOff);
             }
         }
-        if (!enabled && state.status.suspended && current_status.suspended == false) {
-            // Setting the status to the initial status will force an update
-            // when the visualizer is enabled again
-            state.status = initial_status;
-            state.status.suspended = false;
-            stop_all_keyframe_animations();
-            user_visualizer_resume(&state);
+#endif
+        if (visualizer_enabled) {
+            state.status_changes = changes;
+            if (received_status.suspended) {
+                stop_all_keyframe_animations();
+                visualizer_enabled = false;
+                state.status = received_status;
+                user_visualizer_suspend(&state);
+            }
+            else {
+                visualizer_keyboard_status_t prev_status = state.status;
+                state.status = received_status;
+                update_user_visualizer_state(&state, &prev_status);
+            }
             state.prev_lcd_color = state.current_lcd_color;
         }
-        sleep_time = TIME_INFINITE;
-        for (int i=0;i<MAX_SIMULTANEOUS_ANIMATIONS;i++) {
-            if (animations[i]) {
-                update_keyframe_animation(animations[i], &state, delta, &sleep_time);
-            }
+    }
+    if (!enabled && state.status.suspended && received_status.suspended == false) {
+        // Setting the status to the initial status will force an update
+        // when the visualizer is enabled again
+        state.status = initial_status;
+        state.status.suspended = false;
+        stop_all_keyframe_animations();
+        user_visualizer_resume(&state);
+        state.prev_lcd_color = state.current_lcd_color;
+    }
+    // Only the animations that have reached their deadline are updated,
+    // each with the time since its own last update
+    animation_scheduler_take_due(current_time);
+    keyframe_animation_t* animation;
+    while ((animation = animation_scheduler_get_due())) {
+        systemticks_t delta = current_time - animation->last_update;
+        animation->last_update = current_time;
+        if (update_keyframe_animation(animation, &state, delta, &sleep_time)) {
+            animation_scheduler_reschedule(animation, current_time + sleep_time);
+        }
+        else {
+            animation_scheduler_remove(animation);
         }
+    }
 #ifdef BACKLIGHT_ENABLE
-        gdispGFlush(LED_DISPLAY);
+    gdispGFlush(LED_DISPLAY);
 #endif
 
 #ifdef LCD_ENABLE
-        gdispGFlush(LCD_DISPLAY);
+    gdispGFlush(LCD_DISPLAY);
 #endif
 
 #ifdef EMULATOR
-        draw_emulator();
+    draw_emulator();
 #endif
-        // Enable the visualizer when the startup or the suspend animation has finished
-        if (!visualizer_enabled && state.status.suspended == false && get_num_running_animations() == 0) {
-            visualizer_enabled = true;
-            force_update = true;
+    // Sleep exactly until the next animation deadline
+    systemticks_t after_update = gfxSystemTicks();
+    systemticks_t deadline;
+    sleep_time = TIME_INFINITE;
+    if (animation_scheduler_get_next_deadline(&deadline)) {
+        sleep_time = deadline - after_update;
+        // The deadline has already passed
+        if (sleep_time > deadline - current_time) {
             sleep_time = 0;
         }
+    }
 
-        systemticks_t after_update = gfxSystemTicks();
-        unsigned update_delta = after_update - current_time;
-        if (sleep_time != TIME_INFINITE) {
-            if (sleep_time > update_delta) {
-                sleep_time -= update_delta;
-            }
-            else {
-                sleep_time = 0;
-            }
-        }
-        dprintf("Update took %d, last delta %d, sleep_time %d\n", update_delta, delta, sleep_time);
+    // Enable the visualizer when the startup or the suspend animation has finished
+    if (!visualizer_enabled && state.status.suspended == false && animation_scheduler_is_empty()) {
+        visualizer_enabled = true;
+        force_update = true;
+        sleep_time = 0;
+    }
+    dprintf("Update took %d, sleep_time %d\n", after_update - current_time, sleep_time);
+    return sleep_time;
+}
+
+#ifndef VISUALIZER_HEADLESS
+// TODO: Optimize the stack size, this is probably way too big
+static DECLARE_THREAD_STACK(visualizerThreadStack, 1024);
+static DECLARE_THREAD_FUNCTION(visualizerThread, arg) {
+    (void)arg;
+
+    GListener event_listener;
+    geventListenerInit(&event_listener);
+    geventAttachSource(&event_listener, (GSourceHandle)&status_channel, 0);
+
+    visualizer_start();
+
+    while(true) {
+        systemticks_t sleep_time = visualizer_step();
 #ifdef PROTOCOL_CHIBIOS
         // The gEventWait function really takes milliseconds, even if the documentation says ticks.
         // Unfortunately there's no generic ugfx conversion from system time to milliseconds,
@@ -379,8 +404,17 @@ static DECLARE_THREAD_FUNCTION(visualizerThread, arg) {
 
     return 0;
 }
+#else
+systemticks_t visualizer_headless_step(void) {
+    return visualizer_step();
+}
+#endif
 
 void visualizer_init(void) {
+    triple_buffer_init((triple_buffer_object_t*)&status_channel);
+    *triple_buffer_begin_write(&status_channel) = current_status;
+    triple_buffer_end_write(&status_channel);
+
     gfxInit();
 
   #ifdef LCD_BACKLIGHT_ENABLE
@@ -399,15 +433,22 @@ void visualizer_init(void) {
     LED_DISPLAY = get_led_display();
   #endif
 
+#ifndef VISUALIZER_HEADLESS
     // We are using a low priority thread, the idea is to have it run only
     // when the main thread is sleeping during the matrix scanning
   gfxThreadCreate(visualizerThreadStack, sizeof(visualizerThreadStack),
                   VISUALIZER_THREAD_PRIORITY, visualizerThread, NULL);
+#else
+    // The headless build has no thread, the caller steps the visualizer
+    visualizer_start();
+#endif
 }
 
 void update_status(bool changed) {
     if (changed) {
-        GSourceListener* listener = geventGetSourceListener((GSourceHandle)&current_status, NULL);
+        *triple_buffer_begin_write(&status_channel) = current_status;
+        triple_buffer_end_write(&status_channel);
+        GSourceListener* listener = geventGetSourceListener((GSourceHandle)&status_channel, NULL);
         if (listener) {
             geventSendEvent(listener);
         }
@@ -443,17 +484,15 @@ void visualizer_set_user_data(void* u) {
 #endif
 
 void visualizer_update(uint32_t default_state, uint32_t state, uint8_t mods, uint32_t leds) {
-    // Note that there's a small race condition here, the thread could read
-    // a state where one of these are set but not the other. But this should
-    // not really matter as it will be fixed during the next loop step.
-    // Alternatively a mutex could be used instead of the volatile variables
-
+    // The visualizer thread never reads current_status directly, it gets a
+    // consistent copy through the triple buffered status_channel, which is
+    // only written when something has really changed
     bool changed = false;
 #ifdef SERIAL_LINK_ENABLE
     if (is_serial_link_connected ()) {
         visualizer_keyboard_status_t* new_status = read_current_status();
         if (new_status) {
-            if (!same_status(&current_status, new_status)) {
+            if (get_status_changes(&current_status, new_status)) {
                 changed = true;
                 current_status = *new_status;
             }
@@ -476,7 +515,7 @@ void visualizer_update(uint32_t default_state, uint32_t state, uint8_t mods, uin
 #ifdef VISUALIZER_USER_DATA_SIZE
        memcpy(new_status.user_data, user_data, VISUALIZER_USER_DATA_SIZE);
 #endif
-        if (!same_status(&current_status, &new_status)) {
+        if (get_status_changes(&current_status, &new_status)) {
             changed = true;
             current_status = new_status;
         }
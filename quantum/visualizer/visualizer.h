@@ -35,6 +35,10 @@ SOFTWARE.
 #include "lcd_backlight.h"
 #endif
 
+#ifdef LCD_ENABLE
+#include "lcd_text.h"
+#endif
+
 #ifdef BACKLIGHT_ENABLE
 #include "backlight.h"
 #endif
@@ -81,6 +85,15 @@ typedef struct {
 #endif
 } visualizer_keyboard_status_t;
 
+// The fields of visualizer_keyboard_status_t that changed in an update
+#define VISUALIZER_CHANGED_LAYER (1 << 0)
+#define VISUALIZER_CHANGED_DEFAULT_LAYER (1 << 1)
+#define VISUALIZER_CHANGED_LEDS (1 << 2)
+#define VISUALIZER_CHANGED_MODS (1 << 3)
+#define VISUALIZER_CHANGED_SUSPENDED (1 << 4)
+#define VISUALIZER_CHANGED_BACKLIGHT (1 << 5)
+#define VISUALIZER_CHANGED_USER_DATA (1 << 6)
+
 // The state struct is used by the various keyframe functions
 // It's also used for setting the LCD color and layer text
 // from the user customized code
@@ -88,9 +101,17 @@ typedef struct visualizer_state_t {
     // The user code should primarily be modifying these
     uint32_t target_lcd_color;
     const char* layer_text;
+#ifdef LCD_ENABLE
+    // Optional, a layer text that has been rendered at build time, which is
+    // displayed instead of the layer_text
+    const lcd_text_bitmap_t* layer_bitmap;
+#endif
 
     // The user visualizer(and animation functions) can read these
     visualizer_keyboard_status_t status;
+    // The VISUALIZER_CHANGED_ flags of the fields that differ from prev_status
+    // in the last call to update_user_visualizer_state
+    uint8_t status_changes;
 
     // These are used by the animation functions
     uint32_t current_lcd_color;
@@ -114,6 +135,9 @@ typedef struct keyframe_animation_t {
     bool loop;
     int frame_lengths[MAX_VISUALIZER_KEY_FRAMES];
     frame_func frame_functions[MAX_VISUALIZER_KEY_FRAMES];
+    // Optional, when animations update at the same time, the ones with a
+    // higher layer are updated last, so that they are drawn on top
+    uint8_t layer;
 
     // Used internally by the system, and can also be read by
     // keyframe update functions
@@ -123,6 +147,11 @@ typedef struct keyframe_animation_t {
     bool last_update_of_frame;
     bool need_update;
 
+    // Used internally by the animation scheduler
+    struct keyframe_animation_t* next_scheduled;
+    systemticks_t deadline;
+    systemticks_t last_update;
+    uint8_t schedule_state;
 } keyframe_animation_t;
 
 extern GDisplay* LCD_DISPLAY;
@@ -152,4 +181,14 @@ void initialize_user_visualizer(visualizer_state_t* state);
 // Called when the computer resumes from a suspend
 void user_visualizer_resume(visualizer_state_t* state);
 
+// The headless build, see headless/ doesn't run the visualizer in a thread.
+// Instead the harness calls visualizer_headless_step, which returns the number
+// of ticks until the next step is needed. All keyframe functions are called
+// through visualizer_headless_run_frame, which has to be implemented by the
+// harness.
+#ifdef VISUALIZER_HEADLESS
+systemticks_t visualizer_headless_step(void);
+bool visualizer_headless_run_frame(frame_func func, keyframe_animation_t* animation, visualizer_state_t* state);
+#endif
+
 #endif /* VISUALIZER_H */
@@ -21,13 +21,21 @@
 # SOFTWARE.
 
 SRC += $(VISUALIZER_DIR)/visualizer.c \
-	$(VISUALIZER_DIR)/visualizer_keyframes.c
+	$(VISUALIZER_DIR)/visualizer_keyframes.c \
+	$(VISUALIZER_DIR)/animation_scheduler.c \
+	$(VISUALIZER_DIR)/visualizer_math.c
 EXTRAINCDIRS += $(GFXINC) $(VISUALIZER_DIR)
 GFXLIB = $(LIB_PATH)/ugfx
 VPATH += $(VISUALIZER_PATH)
 
 OPT_DEFS += -DVISUALIZER_ENABLE
 
+# The status is handed over to the visualizer thread through a triple buffer,
+# which is already included with the serial link
+ifneq ($(strip $(SERIAL_LINK_ENABLE)), yes)
+SRC += $(QUANTUM_DIR)/serial_link/protocol/triple_buffered_object.c
+endif
+
 ifdef LCD_ENABLE
 OPT_DEFS += -DLCD_ENABLE
 ULIBS += -lm
@@ -36,6 +44,7 @@ endif
 ifeq ($(strip $(LCD_ENABLE)), yes)
 SRC += $(VISUALIZER_DIR)/lcd_backlight.c
 SRC += $(VISUALIZER_DIR)/lcd_keyframes.c
+SRC += $(VISUALIZER_DIR)/lcd_text.c
 SRC += $(VISUALIZER_DIR)/lcd_backlight_keyframes.c
 # Note, that the linker will strip out any resources that are not actually in use
 SRC += $(VISUALIZER_DIR)/resources/lcd_logo.c
@@ -21,3 +21,12 @@ bool keyframe_no_operation(keyframe_animation_t* animation, visualizer_state_t*
     (void)state;
     return false;
 }
+
+q16_16_t keyframe_get_progress(keyframe_animation_t* animation) {
+    int frame_length = animation->frame_lengths[animation->current_frame];
+    int current_pos = frame_length - animation->time_left_in_frame;
+    if (frame_length <= 0) {
+        return Q16_16_ONE;
+    }
+    return q16_16_div(current_pos, frame_length);
+}
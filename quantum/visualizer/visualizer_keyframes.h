@@ -18,9 +18,13 @@
 #define QUANTUM_VISUALIZER_VISUALIZER_KEYFRAMES_H_
 
 #include "visualizer.h"
+#include "visualizer_math.h"
 
 // Some predefined keyframe functions that can be used by the user code
 // Does nothing, useful for adding delays
 bool keyframe_no_operation(keyframe_animation_t* animation, visualizer_state_t* state);
 
+// Returns how far the current frame has progressed, from zero to one
+q16_16_t keyframe_get_progress(keyframe_animation_t* animation);
+
 #endif /* QUANTUM_VISUALIZER_VISUALIZER_KEYFRAMES_H_ */
@@ -0,0 +1,96 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "visualizer_math.h"
+
+// A quarter of a cosine wave, in 64 steps with the end point included
+static const int16_t cos_table[65] = {
+    16384, 16379, 16364, 16340, 16305, 16261, 16207, 16143,
+    16069, 15986, 15893, 15791, 15679, 15557, 15426, 15286,
+    15137, 14978, 14811, 14635, 14449, 14256, 14053, 13842,
+    13623, 13395, 13160, 12916, 12665, 12406, 12140, 11866,
+    11585, 11297, 11003, 10702, 10394, 10080, 9760, 9434,
+    9102, 8765, 8423, 8076, 7723, 7366, 7005, 6639,
+    6270, 5897, 5520, 5139, 4756, 4370, 3981, 3590,
+    3196, 2801, 2404, 2006, 1606, 1205, 804, 402,
+    0,
+};
+
+q8_8_t q8_8_div(int16_t num, int16_t den) {
+    return ((int32_t)num << 8) / den;
+}
+
+q16_16_t q16_16_div(int32_t num, int32_t den) {
+    return ((int64_t)num << 16) / den;
+}
+
+int16_t fixed_cos(uint16_t angle) {
+    uint8_t quadrant = angle >> 14;
+    uint16_t pos = angle & 0x3FFF;
+    // The second and fourth quadrants run the table backwards
+    if (quadrant & 1) {
+        pos = 0x4000 - pos;
+    }
+    uint8_t index = pos >> 8;
+    int16_t value = cos_table[index];
+    if (index < 64) {
+        value -= ((int32_t)(value - cos_table[index + 1]) * (pos & 0xFF)) >> 8;
+    }
+    // And the middle two are negative
+    return (quadrant == 1 || quadrant == 2) ? -value : value;
+}
+
+uint8_t fixed_cos8(uint16_t angle) {
+    return ((int32_t)(fixed_cos(angle) + 16384) * 255 + 16384) >> 15;
+}
+
+void fixed_cos_gradient(uint8_t* values, uint8_t count, uint16_t phase) {
+    if (count == 1) {
+        values[0] = fixed_cos8(phase);
+        return;
+    }
+    // One full turn spread over the entries, in 16.16 so that the step
+    // doesn't accumulate rounding errors. A full turn doesn't quite fit, but
+    // being off by 1/65536 of a turn at the end doesn't matter.
+    uint32_t step = 0xFFFFFFFFUL / (count - 1);
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        values[i] = fixed_cos8(phase - (uint16_t)(offset >> 16));
+        offset += step;
+    }
+}
+
+void cos_gradient_table_init(cos_gradient_table_t* gradient, uint8_t count) {
+    gradient->count = count;
+    // The entries have to be a whole number of steps apart
+    gradient->spacing = count > 1 ? COS_GRADIENT_TABLE_SIZE / (count - 1) : 0;
+    gradient->period = count > 1 ? gradient->spacing * (count - 1) : COS_GRADIENT_TABLE_SIZE;
+    for (uint16_t i = 0; i < gradient->period; i++) {
+        gradient->table[i] = fixed_cos8(((uint32_t)i << 16) / gradient->period);
+    }
+}
+
+void cos_gradient_table_get(const cos_gradient_table_t* gradient, uint8_t* values, uint16_t phase) {
+    uint16_t index = ((uint32_t)phase * gradient->period + 0x8000) >> 16;
+    if (index == gradient->period) {
+        index = 0;
+    }
+    for (uint8_t i = 0; i < gradient->count; i++) {
+        values[i] = gradient->table[index];
+        // Each entry lags one spacing behind the previous one
+        index = index >= gradient->spacing ? index - gradient->spacing : index + gradient->period - gradient->spacing;
+    }
+}
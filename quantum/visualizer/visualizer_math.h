@@ -0,0 +1,76 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUANTUM_VISUALIZER_VISUALIZER_MATH_H_
+#define QUANTUM_VISUALIZER_VISUALIZER_MATH_H_
+
+#include <stdint.h>
+
+// Fixed point math for the animations, so that no floating point is needed
+// on processors without a FPU
+
+// 8.8 and 16.16 fixed point numbers
+typedef int16_t q8_8_t;
+typedef int32_t q16_16_t;
+
+#define Q8_8_ONE (1 << 8)
+#define Q16_16_ONE (1 << 16)
+
+// Returns num / den, den can't be zero
+q8_8_t q8_8_div(int16_t num, int16_t den);
+q16_16_t q16_16_div(int32_t num, int32_t den);
+
+// Interpolates between from and to, t is usually between zero and one
+static inline int16_t q8_8_lerp(int16_t from, int16_t to, q8_8_t t) {
+    return from + (((int32_t)(to - from) * t) >> 8);
+}
+
+static inline int32_t q16_16_lerp(int32_t from, int32_t to, q16_16_t t) {
+    return from + (int32_t)(((int64_t)(to - from) * t) >> 16);
+}
+
+// Angles are expressed in 1/65536 of a full turn, so they wrap around
+// naturally. A 16.16 fraction of a turn can be converted by casting it.
+#define ANGLE_DEGREES(degrees) ((uint16_t)((degrees) * 65536L / 360))
+
+// Cosine in 2.14 fixed point, from -16384 to 16384
+int16_t fixed_cos(uint16_t angle);
+
+// (cos(angle) + 1) / 2 scaled to 0-255
+uint8_t fixed_cos8(uint16_t angle);
+
+// Fills a gradient row with one full period of fixed_cos8, the first entry
+// is at the given phase, and each following entry lags a bit more behind,
+// until the last one is a full turn behind.
+void fixed_cos_gradient(uint8_t* values, uint8_t count, uint16_t phase);
+
+// The same gradient for every phase, computed once, so that an animation
+// only has to look up the values. The phase is rounded to the nearest step
+// of the table, which is at most 1/128 of a turn.
+#define COS_GRADIENT_TABLE_SIZE 256
+
+typedef struct {
+    uint8_t count;
+    // Table steps between two entries, and in a full turn
+    uint16_t spacing;
+    uint16_t period;
+    uint8_t table[COS_GRADIENT_TABLE_SIZE];
+} cos_gradient_table_t;
+
+void cos_gradient_table_init(cos_gradient_table_t* gradient, uint8_t count);
+void cos_gradient_table_get(const cos_gradient_table_t* gradient, uint8_t* values, uint16_t phase);
+
+#endif /* QUANTUM_VISUALIZER_VISUALIZER_MATH_H_ */
@@ -305,60 +305,70 @@ void do_flash_cmd(volatile uint8_t *fstat)
    e:	4770      	bx	lr
 */
 
-#elif defined(KL2x) /* chip selection */
-/* Teensy LC (emulated) */
+#else /* chip selection */
+/* Teensy LC, STM32F0/F1/F3 (emulated in flash), everything else (RAM only)
+ *
+ * The contents are kept in a RAM mirror, so the reads never touch the
+ * flash. The flash area is split into two banks. The active bank starts
+ * with a header holding a generation number and a magic number, followed by
+ * a log of 16-bit entries with the offset in the low byte and the value in
+ * the high byte. The mirror is built by replaying the log once at the start.
+ * A write appends an entry, and when the bank is full, the mirror is written
+ * to the other bank, which is then made active, and the old one is erased.
+ * If that is interrupted, the bank with the newer generation wins at the
+ * next start.
+ *
+ * Older firmware on the Teensy LC used the whole area as one log of the
+ * same entries, without banks or headers. Such a log is replayed once and
+ * written back in the new format. If the power is lost while that is
+ * written, the settings are lost, and eeconfig_init runs at the next start.
+ */
 
-#define SYMVAL(sym) (uint32_t)(((uint8_t *)&(sym)) - ((uint8_t *)0))
+#define EEPROM_SIZE 128
 
-extern uint32_t __eeprom_workarea_start__;
-extern uint32_t __eeprom_workarea_end__;
+#define ENTRY_ERASED 0xFFFF
+#define HEADER_SIZE 4
+/* The second half word of the header. Its low byte is an offset outside of
+ * the EEPROM, so no log entry of the old format looks like it. */
+#define HEADER_MAGIC 0x51EE
+/* The generation 0xFFFF would look erased */
+#define NUM_GENERATIONS 0xFFFF
 
-#define EEPROM_SIZE 128
+#if defined(KL2x)
+#define EEPROM_FLASH
 
-static uint32_t flashend = 0;
+#define SYMVAL(sym) (uint32_t)(((uint8_t *)&(sym)) - ((uint8_t *)0))
 
-void eeprom_initialize(void)
-{
-	const uint16_t *p = (uint16_t *)SYMVAL(__eeprom_workarea_start__);
+extern uint32_t __eeprom_workarea_start__;
+extern uint32_t __eeprom_workarea_end__;
 
-	do {
-		if (*p++ == 0xFFFF) {
-			flashend = (uint32_t)(p - 2);
-			return;
-		}
-	} while (p < (uint16_t *)SYMVAL(__eeprom_workarea_end__));
-	flashend = (uint32_t)((uint16_t *)SYMVAL(__eeprom_workarea_end__) - 1);
-}
+#define FLASH_START SYMVAL(__eeprom_workarea_start__)
+#define FLASH_END SYMVAL(__eeprom_workarea_end__)
+#define FLASH_PAGE_SIZE 1024
 
-uint8_t eeprom_read_byte(const uint8_t *addr)
+/*
+void do_flash_cmd(volatile uint8_t *fstat)
 {
-	uint32_t offset = (uint32_t)addr;
-	const uint16_t *p = (uint16_t *)SYMVAL(__eeprom_workarea_start__);
-	const uint16_t *end = (const uint16_t *)((uint32_t)flashend);
-	uint16_t val;
-	uint8_t data=0xFF;
-
-	if (!end) {
-		eeprom_initialize();
-		end = (const uint16_t *)((uint32_t)flashend);
-	}
-	if (offset < EEPROM_SIZE) {
-		while (p <= end) {
-			val = *p++;
-			if ((val & 255) == offset) data = val >> 8;
-		}
-	}
-	return data;
+        *fstat = 0x80;
+        while ((*fstat & 0x80) == 0) ; // wait
 }
-
-static void flash_write(const uint16_t *code, uint32_t addr, uint32_t data)
+00000000 <do_flash_cmd>:
+   0:	2380      	movs	r3, #128	; 0x80
+   2:	7003      	strb	r3, [r0, #0]
+   4:	7803      	ldrb	r3, [r0, #0]
+   6:	b25b      	sxtb	r3, r3
+   8:	2b00      	cmp	r3, #0
+   a:	dafb      	bge.n	4 <do_flash_cmd+0x4>
+   c:	4770      	bx	lr
+*/
+static void flash_cmd(void)
 {
-	// with great power comes great responsibility....
+	// The command has to run from RAM, since the flash is busy
+	uint16_t do_flash_cmd[] = {
+		0x2380, 0x7003, 0x7803, 0xb25b, 0x2b00, 0xdafb, 0x4770};
 	uint32_t stat;
-	*(uint32_t *)&(FTFA->FCCOB3) = 0x06000000 | (addr & 0x00FFFFFC);
-	*(uint32_t *)&(FTFA->FCCOB7) = data;
 	__disable_irq();
-	(*((void (*)(volatile uint8_t *))((uint32_t)code | 1)))(&(FTFA->FSTAT));
+	(*((void (*)(volatile uint8_t *))((uint32_t)do_flash_cmd | 1)))(&(FTFA->FSTAT));
 	__enable_irq();
 	stat = FTFA->FSTAT & (FTFA_FSTAT_RDCOLERR|FTFA_FSTAT_ACCERR|FTFA_FSTAT_FPVIOL);
 	if (stat) {
@@ -367,168 +377,261 @@ static void flash_write(const uint16_t *code, uint32_t addr, uint32_t data)
 	MCM->PLACR |= MCM_PLACR_CFCC;
 }
 
-void eeprom_write_byte(uint8_t *addr, uint8_t data)
+// The flash is programmed a longword at a time, the other half is left
+// erased, so that it can be programmed later
+static void flash_write_halfword(uint32_t addr, uint16_t data)
 {
-	uint32_t offset = (uint32_t)addr;
-	const uint16_t *p, *end = (const uint16_t *)((uint32_t)flashend);
-	uint32_t i, val, flashaddr;
-	uint16_t do_flash_cmd[] = {
-		0x2380, 0x7003, 0x7803, 0xb25b, 0x2b00, 0xdafb, 0x4770};
-	uint8_t buf[EEPROM_SIZE];
+	uint32_t val = (addr & 2) ? ((uint32_t)data << 16) | 0x0000FFFF : data | 0xFFFF0000;
+	*(uint32_t *)&(FTFA->FCCOB3) = 0x06000000 | (addr & 0x00FFFFFC);
+	*(uint32_t *)&(FTFA->FCCOB7) = val;
+	flash_cmd();
+}
 
-	if (offset >= EEPROM_SIZE) return;
-	if (!end) {
-		eeprom_initialize();
-		end = (const uint16_t *)((uint32_t)flashend);
-	}
-	if (++end < (uint16_t *)SYMVAL(__eeprom_workarea_end__)) {
-		val = (data << 8) | offset;
-		flashaddr = (uint32_t)end;
-		flashend = flashaddr;
-		if ((flashaddr & 2) == 0) {
-			val |= 0xFFFF0000;
-		} else {
-			val <<= 16;
-			val |= 0x0000FFFF;
-		}
-		flash_write(do_flash_cmd, flashaddr, val);
-	} else {
-		for (i=0; i < EEPROM_SIZE; i++) {
-			buf[i] = 0xFF;
-		}
-		val = 0;
-		for (p = (uint16_t *)SYMVAL(__eeprom_workarea_start__); p < (uint16_t *)SYMVAL(__eeprom_workarea_end__); p++) {
-			val = *p;
-			if ((val & 255) < EEPROM_SIZE) {
-				buf[val & 255] = val >> 8;
-			}
-		}
-		buf[offset] = data;
-		for (flashaddr=(uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_start__); flashaddr < (uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_end__); flashaddr += 1024) {
-			*(uint32_t *)&(FTFA->FCCOB3) = 0x09000000 | flashaddr;
-			__disable_irq();
-			(*((void (*)(volatile uint8_t *))((uint32_t)do_flash_cmd | 1)))(&(FTFA->FSTAT));
-			__enable_irq();
-			val = FTFA->FSTAT & (FTFA_FSTAT_RDCOLERR|FTFA_FSTAT_ACCERR|FTFA_FSTAT_FPVIOL);;
-			if (val) FTFA->FSTAT = val;
-			MCM->PLACR |= MCM_PLACR_CFCC;
-		}
-		flashaddr=(uint32_t)(uint16_t *)SYMVAL(__eeprom_workarea_start__);
-		for (i=0; i < EEPROM_SIZE; i++) {
-			if (buf[i] == 0xFF) continue;
-			if ((flashaddr & 2) == 0) {
-				val = (buf[i] << 8) | i;
-			} else {
-				val = val | (buf[i] << 24) | (i << 16);
-				flash_write(do_flash_cmd, flashaddr, val);
-			}
-			flashaddr += 2;
-		}
-		flashend = flashaddr;
-		if ((flashaddr & 2)) {
-			val |= 0xFFFF0000;
-			flash_write(do_flash_cmd, flashaddr, val);
-		}
+static void flash_erase_page(uint32_t addr)
+{
+	*(uint32_t *)&(FTFA->FCCOB3) = 0x09000000 | addr;
+	flash_cmd();
+}
+
+#elif defined(FLASH_CR_PER) && defined(EEPROM_FLASH_START)
+/* The STM32F0, F1 and F3 share the same flash controller, which programs a
+ * half word at a time, and erases a page at a time. The flash area has to
+ * be defined in the config.h of the keyboard, and kept out of the firmware,
+ * for example the last two pages:
+ *   #define EEPROM_FLASH_START 0x0801F000
+ *   #define EEPROM_FLASH_SIZE 0x1000
+ *   #define EEPROM_FLASH_PAGE_SIZE 0x800
+ */
+#define EEPROM_FLASH
+
+#define FLASH_START ((uint32_t)(EEPROM_FLASH_START))
+#define FLASH_END (FLASH_START + (EEPROM_FLASH_SIZE))
+#ifdef EEPROM_FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE (EEPROM_FLASH_PAGE_SIZE)
+#else
+#define FLASH_PAGE_SIZE 1024
+#endif
+
+#define FLASH_UNLOCK_KEY1 0x45670123
+#define FLASH_UNLOCK_KEY2 0xCDEF89AB
+
+static void flash_unlock(void)
+{
+	if (FLASH->CR & FLASH_CR_LOCK) {
+		FLASH->KEYR = FLASH_UNLOCK_KEY1;
+		FLASH->KEYR = FLASH_UNLOCK_KEY2;
 	}
 }
 
-/*
-void do_flash_cmd(volatile uint8_t *fstat)
+static void flash_wait(void)
 {
-        *fstat = 0x80;
-        while ((*fstat & 0x80) == 0) ; // wait
+	while (FLASH->SR & FLASH_SR_BSY);
+	// clear the end of operation and error flags
+	FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
 }
-00000000 <do_flash_cmd>:
-   0:	2380      	movs	r3, #128	; 0x80
-   2:	7003      	strb	r3, [r0, #0]
-   4:	7803      	ldrb	r3, [r0, #0]
-   6:	b25b      	sxtb	r3, r3
-   8:	2b00      	cmp	r3, #0
-   a:	dafb      	bge.n	4 <do_flash_cmd+0x4>
-   c:	4770      	bx	lr
-*/
 
+static void flash_write_halfword(uint32_t addr, uint16_t data)
+{
+	flash_unlock();
+	flash_wait();
+	FLASH->CR |= FLASH_CR_PG;
+	*(volatile uint16_t *)addr = data;
+	flash_wait();
+	FLASH->CR &= ~FLASH_CR_PG;
+	FLASH->CR |= FLASH_CR_LOCK;
+}
 
-uint16_t eeprom_read_word(const uint16_t *addr)
+static void flash_erase_page(uint32_t addr)
 {
-	const uint8_t *p = (const uint8_t *)addr;
-	return eeprom_read_byte(p) | (eeprom_read_byte(p+1) << 8);
+	flash_unlock();
+	flash_wait();
+	FLASH->CR |= FLASH_CR_PER;
+	FLASH->AR = addr;
+	FLASH->CR |= FLASH_CR_STRT;
+	flash_wait();
+	FLASH->CR &= ~FLASH_CR_PER;
+	FLASH->CR |= FLASH_CR_LOCK;
 }
+#endif
 
-uint32_t eeprom_read_dword(const uint32_t *addr)
+static uint8_t mirror[EEPROM_SIZE];
+static bool initialized = false;
+
+#ifdef EEPROM_FLASH
+#define BANK_SIZE ((FLASH_END - FLASH_START) / 2)
+
+static uint32_t bank;
+static uint32_t log_end;
+static uint16_t generation;
+
+static uint16_t read_halfword(uint32_t addr)
 {
-	const uint8_t *p = (const uint8_t *)addr;
-	return eeprom_read_byte(p) | (eeprom_read_byte(p+1) << 8)
-		| (eeprom_read_byte(p+2) << 16) | (eeprom_read_byte(p+3) << 24);
+	return *(const volatile uint16_t *)addr;
 }
 
-void eeprom_read_block(void *buf, const void *addr, uint32_t len)
+static void erase_bank(uint32_t start)
 {
-	const uint8_t *p = (const uint8_t *)addr;
-	uint8_t *dest = (uint8_t *)buf;
-	while (len--) {
-		*dest++ = eeprom_read_byte(p++);
+	for (uint32_t addr = start; addr < start + BANK_SIZE; addr += FLASH_PAGE_SIZE) {
+		flash_erase_page(addr);
 	}
 }
 
-int eeprom_is_ready(void)
+// The generation is written last, it makes the bank valid
+static void write_header(uint32_t start)
 {
-	return 1;
+	flash_write_halfword(start + 2, HEADER_MAGIC);
+	flash_write_halfword(start, generation);
 }
 
-void eeprom_write_word(uint16_t *addr, uint16_t value)
+static bool bank_is_valid(uint32_t start)
 {
-	uint8_t *p = (uint8_t *)addr;
-	eeprom_write_byte(p++, value);
-	eeprom_write_byte(p, value >> 8);
+	return read_halfword(start) != ENTRY_ERASED && read_halfword(start + 2) == HEADER_MAGIC;
 }
 
-void eeprom_write_dword(uint32_t *addr, uint32_t value)
+// Makes the other bank active, with only the current contents of the mirror
+static void compact(void)
 {
-	uint8_t *p = (uint8_t *)addr;
-	eeprom_write_byte(p++, value);
-	eeprom_write_byte(p++, value >> 8);
-	eeprom_write_byte(p++, value >> 16);
-	eeprom_write_byte(p, value >> 24);
+	uint32_t new_bank = bank == FLASH_START ? FLASH_START + BANK_SIZE : FLASH_START;
+	uint32_t addr = new_bank + HEADER_SIZE;
+
+	erase_bank(new_bank);
+	for (uint32_t i = 0; i < EEPROM_SIZE; i++) {
+		if (mirror[i] != 0xFF) {
+			flash_write_halfword(addr, (mirror[i] << 8) | i);
+			addr += 2;
+		}
+	}
+	generation = (generation + 1) % NUM_GENERATIONS;
+	write_header(new_bank);
+	erase_bank(bank);
+	bank = new_bank;
+	log_end = addr;
 }
 
-void eeprom_write_block(const void *buf, void *addr, uint32_t len)
+void eeprom_initialize(void)
 {
-	uint8_t *p = (uint8_t *)addr;
-	const uint8_t *src = (const uint8_t *)buf;
-	while (len--) {
-		eeprom_write_byte(p++, *src++);
+	uint32_t banks[2] = {FLASH_START, FLASH_START + BANK_SIZE};
+	uint16_t generations[2] = {read_halfword(banks[0]), read_halfword(banks[1])};
+	bool valid[2] = {bank_is_valid(banks[0]), bank_is_valid(banks[1])};
+	uint8_t active;
+
+	for (uint32_t i = 0; i < EEPROM_SIZE; i++) {
+		mirror[i] = 0xFF;
+	}
+	initialized = true;
+
+	if (!valid[0] && !valid[1]) {
+		if (generations[0] != ENTRY_ERASED) {
+			// A log of the old format, which starts right at the beginning
+			// and can fill both banks
+			for (uint32_t addr = FLASH_START; addr < FLASH_END; addr += 2) {
+				uint16_t entry = read_halfword(addr);
+				if (entry == ENTRY_ERASED) {
+					break;
+				}
+				if ((entry & 0xFF) < EEPROM_SIZE) {
+					mirror[entry & 0xFF] = entry >> 8;
+				}
+			}
+			// Written to the first bank as generation 1
+			bank = banks[1];
+			generation = 0;
+			compact();
+			return;
+		}
+		// Never used, so start from the first bank
+		erase_bank(banks[0]);
+		generation = 0;
+		write_header(banks[0]);
+		bank = banks[0];
+		log_end = bank + HEADER_SIZE;
+		return;
+	}
+	if (!valid[1]) {
+		active = 0;
+	} else if (!valid[0]) {
+		active = 1;
+	} else {
+		// The compaction was interrupted before the old bank was erased
+		active = generations[1] == (generations[0] + 1) % NUM_GENERATIONS ? 1 : 0;
+		erase_bank(banks[active ^ 1]);
+	}
+	bank = banks[active];
+	generation = generations[active];
+
+	uint32_t addr;
+	for (addr = bank + HEADER_SIZE; addr < bank + BANK_SIZE; addr += 2) {
+		uint16_t entry = read_halfword(addr);
+		if (entry == ENTRY_ERASED) {
+			break;
+		}
+		if ((entry & 0xFF) < EEPROM_SIZE) {
+			mirror[entry & 0xFF] = entry >> 8;
+		}
 	}
+	log_end = addr;
 }
 
-#else
-// No EEPROM supported, so emulate it
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+	uint32_t offset = (uint32_t)addr;
 
-#define EEPROM_SIZE 32
-static uint8_t buffer[EEPROM_SIZE];
+	if (offset >= EEPROM_SIZE) return;
+	if (!initialized) eeprom_initialize();
+	if (mirror[offset] == value) return;
 
-uint8_t eeprom_read_byte(const uint8_t *addr) {
+	mirror[offset] = value;
+	if (log_end < bank + BANK_SIZE) {
+		flash_write_halfword(log_end, (value << 8) | offset);
+		log_end += 2;
+	} else {
+		compact();
+	}
+}
+#else
+// No flash emulation for this chip, so the contents are lost at power off
+void eeprom_initialize(void)
+{
+	for (uint32_t i = 0; i < EEPROM_SIZE; i++) {
+		mirror[i] = 0xFF;
+	}
+	initialized = true;
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
 	uint32_t offset = (uint32_t)addr;
-	return buffer[offset];
+
+	if (offset >= EEPROM_SIZE) return;
+	if (!initialized) eeprom_initialize();
+	mirror[offset] = value;
 }
+#endif
 
-void eeprom_write_byte(uint8_t *addr, uint8_t value) {
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
 	uint32_t offset = (uint32_t)addr;
-	buffer[offset] = value;
+
+	if (offset >= EEPROM_SIZE) return 0xFF;
+	if (!initialized) eeprom_initialize();
+	return mirror[offset];
 }
 
-uint16_t eeprom_read_word(const uint16_t *addr) {
+uint16_t eeprom_read_word(const uint16_t *addr)
+{
 	const uint8_t *p = (const uint8_t *)addr;
 	return eeprom_read_byte(p) | (eeprom_read_byte(p+1) << 8);
 }
 
-uint32_t eeprom_read_dword(const uint32_t *addr) {
+uint32_t eeprom_read_dword(const uint32_t *addr)
+{
 	const uint8_t *p = (const uint8_t *)addr;
 	return eeprom_read_byte(p) | (eeprom_read_byte(p+1) << 8)
 		| (eeprom_read_byte(p+2) << 16) | (eeprom_read_byte(p+3) << 24);
 }
 
-void eeprom_read_block(void *buf, const void *addr, uint32_t len) {
+void eeprom_read_block(void *buf, const void *addr, uint32_t len)
+{
 	const uint8_t *p = (const uint8_t *)addr;
 	uint8_t *dest = (uint8_t *)buf;
 	while (len--) {
@@ -536,13 +639,20 @@ void eeprom_read_block(void *buf, const void *addr, uint32_t len) {
 	}
 }
 
-void eeprom_write_word(uint16_t *addr, uint16_t value) {
+int eeprom_is_ready(void)
+{
+	return 1;
+}
+
+void eeprom_write_word(uint16_t *addr, uint16_t value)
+{
 	uint8_t *p = (uint8_t *)addr;
 	eeprom_write_byte(p++, value);
 	eeprom_write_byte(p, value >> 8);
 }
 
-void eeprom_write_dword(uint32_t *addr, uint32_t value) {
+void eeprom_write_dword(uint32_t *addr, uint32_t value)
+{
 	uint8_t *p = (uint8_t *)addr;
 	eeprom_write_byte(p++, value);
 	eeprom_write_byte(p++, value >> 8);
@@ -550,7 +660,8 @@ void eeprom_write_dword(uint32_t *addr, uint32_t value) {
 	eeprom_write_byte(p, value >> 24);
 }
 
-void eeprom_write_block(const void *buf, void *addr, uint32_t len) {
+void eeprom_write_block(const void *buf, void *addr, uint32_t len)
+{
 	uint8_t *p = (uint8_t *)addr;
 	const uint8_t *src = (const uint8_t *)buf;
 	while (len--) {
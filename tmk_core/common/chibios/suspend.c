@@ -8,6 +8,7 @@
 #include "action_util.h"
 #include "mousekey.h"
 #include "host.h"
+#include "eeconfig.h"
 #include "backlight.h"
 #include "suspend.h"
 
@@ -17,6 +18,7 @@ void suspend_idle(uint8_t time) {
 }
 
 void suspend_power_down(void) {
+	eeconfig_flush();
 	// TODO: figure out what to power down and how
 	// shouldn't power down TPM/FTM if we want a breathing LED
 	// also shouldn't power down USB
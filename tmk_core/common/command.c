@@ -374,6 +374,7 @@ static bool command_common(uint8_t code)
             #else
 	            wait_ms(1000);
             #endif
+            eeconfig_flush();
             bootloader_jump(); // not return
             break;
 
@@ -1,56 +1,280 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "eeprom.h"
 #include "eeconfig.h"
+#include "timer.h"
+
+/* The settings are read from the EEPROM once, and then kept in RAM. The
+ * updates only change the cache, and eeconfig_task writes them back when
+ * nothing has changed for EECONFIG_WRITE_DELAY milliseconds.
+ */
+
+#if defined(EECONFIG_LOG_ADDR) && defined(EECONFIG_LOG_SIZE)
+#define EECONFIG_LOG
+/* A record is the block, followed by a checksum and a sequence number. The
+ * sequence number is written last, so a record that was only partly written
+ * doesn't pass the checksum, and the previous one is used instead.
+ */
+#define RECORD_SIZE                 (EECONFIG_SIZE + 2)
+#define RECORD_CHECKSUM             EECONFIG_SIZE
+#define RECORD_SEQUENCE             (EECONFIG_SIZE + 1)
+#define NUM_RECORDS                 (EECONFIG_LOG_SIZE / RECORD_SIZE)
+/* 0xFF is the value of an erased byte, so it's never used */
+#define NUM_SEQUENCES               0xFF
+#if NUM_RECORDS < 2 || NUM_RECORDS >= NUM_SEQUENCES
+#error "EECONFIG_LOG_SIZE has to fit between 2 and 254 records"
+#endif
+#else
+#define RECORD_SIZE                 EECONFIG_SIZE
+#endif
+
+#ifdef __AVR__
+#define EEPROM_READY()              eeprom_is_ready()
+#else
+#define EEPROM_READY()              true
+#endif
+
+#define OFFSET(addr)                ((uintptr_t)(addr))
+
+static uint8_t cache[EECONFIG_SIZE];
+static bool loaded = false;
+static bool dirty = false;
+static uint16_t last_change;
+
+/* The record that is being written, a copy of the cache is taken at the
+ * start, so that the changes made meanwhile don't end up half written */
+static uint8_t record[RECORD_SIZE];
+static uint8_t* record_addr;
+static uint8_t record_pos = RECORD_SIZE;
+
+#ifdef EECONFIG_LOG
+static uint8_t newest_record;
+static uint8_t newest_sequence;
+
+static uint8_t* record_address(uint8_t index)
+{
+    return (uint8_t*)(EECONFIG_LOG_ADDR + (uintptr_t)index * RECORD_SIZE);
+}
+
+/* CRC-8 with the polynomial 0x07 */
+static uint8_t record_checksum(const uint8_t* data, uint8_t sequence)
+{
+    uint8_t crc = sequence;
+    for (uint8_t i = 0; i < EECONFIG_SIZE; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static bool read_record(uint8_t index, uint8_t* data, uint8_t* sequence)
+{
+    uint8_t buffer[RECORD_SIZE];
+    eeprom_read_block(buffer, record_address(index), RECORD_SIZE);
+    if (buffer[RECORD_SEQUENCE] >= NUM_SEQUENCES ||
+        record_checksum(buffer, buffer[RECORD_SEQUENCE]) != buffer[RECORD_CHECKSUM]) {
+        return false;
+    }
+    if (data) {
+        memcpy(data, buffer, EECONFIG_SIZE);
+    }
+    *sequence = buffer[RECORD_SEQUENCE];
+    return true;
+}
+
+static void load(void)
+{
+    /* The records are written in order, so the newest one is the valid
+     * record that isn't followed by the next sequence number */
+    for (uint8_t i = 0; i < NUM_RECORDS; i++) {
+        uint8_t sequence;
+        uint8_t next_sequence;
+        if (!read_record(i, NULL, &sequence)) {
+            continue;
+        }
+        if (read_record((i + 1) % NUM_RECORDS, NULL, &next_sequence) &&
+            next_sequence == (sequence + 1) % NUM_SEQUENCES) {
+            continue;
+        }
+        read_record(i, cache, &sequence);
+        newest_record = i;
+        newest_sequence = sequence;
+        return;
+    }
+
+    /* Nothing has been logged yet, start from the fixed addresses */
+    eeprom_read_block(cache, (const void*)0, EECONFIG_SIZE);
+    newest_record = NUM_RECORDS - 1;
+    newest_sequence = NUM_SEQUENCES - 1;
+}
+
+static void start_write(void)
+{
+    memcpy(record, cache, EECONFIG_SIZE);
+    newest_record = (newest_record + 1) % NUM_RECORDS;
+    newest_sequence = (newest_sequence + 1) % NUM_SEQUENCES;
+    record[RECORD_CHECKSUM] = record_checksum(record, newest_sequence);
+    record[RECORD_SEQUENCE] = newest_sequence;
+    record_addr = record_address(newest_record);
+    record_pos = 0;
+    dirty = false;
+}
+#else
+static void load(void)
+{
+    eeprom_read_block(cache, (const void*)0, EECONFIG_SIZE);
+}
+
+static void start_write(void)
+{
+    memcpy(record, cache, EECONFIG_SIZE);
+    record_addr = (uint8_t*)0;
+    record_pos = 0;
+    dirty = false;
+}
+#endif
+
+static void cache_read(uintptr_t offset, void* data, uint8_t size)
+{
+    if (!loaded) {
+        load();
+        loaded = true;
+    }
+    memcpy(data, &cache[offset], size);
+}
+
+static void cache_update(uintptr_t offset, const void* data, uint8_t size)
+{
+    if (!loaded) {
+        load();
+        loaded = true;
+    }
+    if (memcmp(&cache[offset], data, size) != 0) {
+        memcpy(&cache[offset], data, size);
+        dirty = true;
+        last_change = timer_read();
+    }
+}
+
+/* Only the bytes that differ from the EEPROM take time to write */
+static void write_byte(void)
+{
+    eeprom_update_byte(record_addr + record_pos, record[record_pos]);
+    record_pos++;
+}
+
+void eeconfig_task(void)
+{
+    if (record_pos == RECORD_SIZE) {
+        if (!dirty || timer_elapsed(last_change) < EECONFIG_WRITE_DELAY) {
+            return;
+        }
+        start_write();
+    }
+    while (record_pos < RECORD_SIZE && EEPROM_READY()) {
+        write_byte();
+    }
+}
+
+void eeconfig_flush(void)
+{
+    while (dirty || record_pos < RECORD_SIZE) {
+        if (record_pos == RECORD_SIZE) {
+            start_write();
+        }
+        write_byte();
+    }
+}
+
+static uint8_t read_byte(const uint8_t* addr)
+{
+    uint8_t val;
+    cache_read(OFFSET(addr), &val, sizeof(val));
+    return val;
+}
+
+static void update_byte(uint8_t* addr, uint8_t val)
+{
+    cache_update(OFFSET(addr), &val, sizeof(val));
+}
+
+static void update_word(uint16_t* addr, uint16_t val)
+{
+    cache_update(OFFSET(addr), &val, sizeof(val));
+}
 
 void eeconfig_init(void)
 {
-    eeprom_update_word(EECONFIG_MAGIC,          EECONFIG_MAGIC_NUMBER);
-    eeprom_update_byte(EECONFIG_DEBUG,          0);
-    eeprom_update_byte(EECONFIG_DEFAULT_LAYER,  0);
-    eeprom_update_byte(EECONFIG_KEYMAP,         0);
-    eeprom_update_byte(EECONFIG_MOUSEKEY_ACCEL, 0);
+    update_word(EECONFIG_MAGIC,          EECONFIG_MAGIC_NUMBER);
+    update_byte(EECONFIG_DEBUG,          0);
+    update_byte(EECONFIG_DEFAULT_LAYER,  0);
+    update_byte(EECONFIG_KEYMAP,         0);
+    update_byte(EECONFIG_MOUSEKEY_ACCEL, 0);
 #ifdef BACKLIGHT_ENABLE
-    eeprom_update_byte(EECONFIG_BACKLIGHT,      0);
+    update_byte(EECONFIG_BACKLIGHT,      0);
 #endif
 #ifdef AUDIO_ENABLE
-    eeprom_update_byte(EECONFIG_AUDIO,             0xFF); // On by default
+    update_byte(EECONFIG_AUDIO,             0xFF); // On by default
 #endif
 #ifdef RGBLIGHT_ENABLE
-    eeprom_update_dword(EECONFIG_RGBLIGHT,      0);
+    eeconfig_update_rgblight(0);
 #endif
+    eeconfig_flush();
 }
 
 void eeconfig_enable(void)
 {
-    eeprom_update_word(EECONFIG_MAGIC, EECONFIG_MAGIC_NUMBER);
+    update_word(EECONFIG_MAGIC, EECONFIG_MAGIC_NUMBER);
+    eeconfig_flush();
 }
 
 void eeconfig_disable(void)
 {
-    eeprom_update_word(EECONFIG_MAGIC, 0xFFFF);
+    update_word(EECONFIG_MAGIC, 0xFFFF);
+    eeconfig_flush();
 }
 
 bool eeconfig_is_enabled(void)
 {
-    return (eeprom_read_word(EECONFIG_MAGIC) == EECONFIG_MAGIC_NUMBER);
+    uint16_t magic;
+    cache_read(OFFSET(EECONFIG_MAGIC), &magic, sizeof(magic));
+    return (magic == EECONFIG_MAGIC_NUMBER);
 }
 
-uint8_t eeconfig_read_debug(void)      { return eeprom_read_byte(EECONFIG_DEBUG); }
-void eeconfig_update_debug(uint8_t val) { eeprom_update_byte(EECONFIG_DEBUG, val); }
+uint8_t eeconfig_read_debug(void)      { return read_byte(EECONFIG_DEBUG); }
+void eeconfig_update_debug(uint8_t val) { update_byte(EECONFIG_DEBUG, val); }
 
-uint8_t eeconfig_read_default_layer(void)      { return eeprom_read_byte(EECONFIG_DEFAULT_LAYER); }
-void eeconfig_update_default_layer(uint8_t val) { eeprom_update_byte(EECONFIG_DEFAULT_LAYER, val); }
+uint8_t eeconfig_read_default_layer(void)      { return read_byte(EECONFIG_DEFAULT_LAYER); }
+void eeconfig_update_default_layer(uint8_t val) { update_byte(EECONFIG_DEFAULT_LAYER, val); }
 
-uint8_t eeconfig_read_keymap(void)      { return eeprom_read_byte(EECONFIG_KEYMAP); }
-void eeconfig_update_keymap(uint8_t val) { eeprom_update_byte(EECONFIG_KEYMAP, val); }
+uint8_t eeconfig_read_keymap(void)      { return read_byte(EECONFIG_KEYMAP); }
+void eeconfig_update_keymap(uint8_t val) { update_byte(EECONFIG_KEYMAP, val); }
 
 #ifdef BACKLIGHT_ENABLE
-uint8_t eeconfig_read_backlight(void)      { return eeprom_read_byte(EECONFIG_BACKLIGHT); }
-void eeconfig_update_backlight(uint8_t val) { eeprom_update_byte(EECONFIG_BACKLIGHT, val); }
+uint8_t eeconfig_read_backlight(void)      { return read_byte(EECONFIG_BACKLIGHT); }
+void eeconfig_update_backlight(uint8_t val) { update_byte(EECONFIG_BACKLIGHT, val); }
 #endif
 
 #ifdef AUDIO_ENABLE
-uint8_t eeconfig_read_audio(void)      { return eeprom_read_byte(EECONFIG_AUDIO); }
-void eeconfig_update_audio(uint8_t val) { eeprom_update_byte(EECONFIG_AUDIO, val); }
+uint8_t eeconfig_read_audio(void)      { return read_byte(EECONFIG_AUDIO); }
+void eeconfig_update_audio(uint8_t val) { update_byte(EECONFIG_AUDIO, val); }
 #endif
+
+#ifdef RGBLIGHT_ENABLE
+uint32_t eeconfig_read_rgblight(void)
+{
+    uint32_t val;
+    cache_read(OFFSET(EECONFIG_RGBLIGHT), &val, sizeof(val));
+    return val;
+}
+void eeconfig_update_rgblight(uint32_t val)
+{
+    cache_update(OFFSET(EECONFIG_RGBLIGHT), &val, sizeof(val));
+}
+#endif
+
+uint8_t eeconfig_read_unicode_mode(void)      { return read_byte(EECONFIG_UNICODEMODE); }
+void eeconfig_update_unicode_mode(uint8_t val) { update_byte(EECONFIG_UNICODEMODE, val); }
@@ -34,6 +34,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define EECONFIG_AUDIO                              (uint8_t *)7
 #define EECONFIG_RGBLIGHT                           (uint32_t *)8
 #define EECONFIG_UNICODEMODE                        (uint8_t *)12
+/* size of the block above, which is cached in RAM */
+#define EECONFIG_SIZE                               13
+
+/* The changes are written to the EEPROM this many milliseconds after the
+ * last one, so that stepping through a setting only writes the final value */
+#ifndef EECONFIG_WRITE_DELAY
+#define EECONFIG_WRITE_DELAY                        3000
+#endif
+
+/* Define both EECONFIG_LOG_ADDR and EECONFIG_LOG_SIZE to store the block as
+ * a log of records in that area of the EEPROM instead of at the addresses
+ * above. Each write goes to the next record, which spreads the wear over the
+ * whole area. The area must not overlap anything else in the EEPROM. The
+ * block at the addresses above is still read once, when the log is empty. */
 
 
 /* debug bit */
@@ -80,4 +94,18 @@ uint8_t eeconfig_read_audio(void);
 void eeconfig_update_audio(uint8_t val);
 #endif
 
+#ifdef RGBLIGHT_ENABLE
+uint32_t eeconfig_read_rgblight(void);
+void eeconfig_update_rgblight(uint32_t val);
+#endif
+
+uint8_t eeconfig_read_unicode_mode(void);
+void eeconfig_update_unicode_mode(uint8_t val);
+
+/* Writes the pending changes a byte at a time, without waiting for the
+ * EEPROM, this should be called regularly */
+void eeconfig_task(void);
+/* Writes all the pending changes, and waits for them to finish */
+void eeconfig_flush(void);
+
 #endif
@@ -226,6 +226,9 @@ MATRIX_LOOP_END:
     visualizer_update(default_layer_state, layer_state, visualizer_get_mods(), host_keyboard_leds());
 #endif
 
+    // write back the changed settings
+    eeconfig_task();
+
     // update LED
     if (led_status != host_keyboard_leds()) {
         led_status = host_keyboard_leds();
@@ -0,0 +1,155 @@
+/*
+Copyright 2017 Fred Sundvik
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "output_router.h"
+#include "timer.h"
+#include "debug.h"
+
+#define QUEUE_MASK (OUTPUT_QUEUE_LENGTH - 1)
+
+
+static bool output_full(output_transport_t *transport)
+{
+    return ((transport->head + 1) & QUEUE_MASK) == transport->tail;
+}
+
+/* Whether a keyboard report after the one at i is queued, the keyboard
+ * reports before the newest one can be dropped without losing a key */
+static bool output_newer_keyboard(output_transport_t *transport, uint8_t i)
+{
+    for (i = (i + 1) & QUEUE_MASK; i != transport->head; i = (i + 1) & QUEUE_MASK) {
+        if (transport->reports[i].type == OUTPUT_REPORT_KEYBOARD) return true;
+    }
+    return false;
+}
+
+/* Makes room in the full queue of a timed out transport, returns false when
+ * the report itself has to be dropped */
+static bool output_make_room(output_transport_t *transport, const output_report_t *report)
+{
+    uint8_t i;
+
+    transport->stats.dropped++;
+    if (report->type == OUTPUT_REPORT_KEYBOARD) {
+        /* The newest queued keyboard report takes the state of the keys */
+        for (i = transport->head; i != transport->tail; ) {
+            i = (i - 1) & QUEUE_MASK;
+            if (transport->reports[i].type == OUTPUT_REPORT_KEYBOARD) {
+                transport->reports[i].keyboard = report->keyboard;
+                return false;
+            }
+        }
+    }
+    for (i = transport->tail; i != transport->head; i = (i + 1) & QUEUE_MASK) {
+        if (transport->reports[i].type != OUTPUT_REPORT_KEYBOARD || output_newer_keyboard(transport, i)) {
+            /* Move the older reports down over the dropped one */
+            for (; i != transport->tail; i = (i - 1) & QUEUE_MASK) {
+                transport->reports[i] = transport->reports[(i - 1) & QUEUE_MASK];
+            }
+            transport->tail = (transport->tail + 1) & QUEUE_MASK;
+            return true;
+        }
+    }
+    /* Only the newest keyboard report is queued */
+    return false;
+}
+
+void output_queue(output_transport_t *transport, const output_report_t *report)
+{
+    /* Wait for room, as the reports were sent before, so that none of a burst
+     * of reports is lost. The timeout of the transport bounds the wait, and
+     * after it only the reports that can be sent right away make room. */
+    if (output_full(transport)) {
+        output_drain(transport);
+        while (output_full(transport) && !transport->timeouted) {
+            output_drain(transport);
+        }
+        if (output_full(transport) && !output_make_room(transport, report)) {
+            return;
+        }
+    }
+    transport->reports[transport->head] = *report;
+    transport->reports[transport->head].queued = timer_read();
+    transport->reports[transport->head].busy = false;
+    transport->head = (transport->head + 1) & QUEUE_MASK;
+}
+
+void output_drain(output_transport_t *transport)
+{
+    /* The channels that the transport is busy for, their later reports stay
+     * behind the first one */
+    uint16_t busy = 0;
+    uint8_t kept = transport->tail;
+
+    for (uint8_t i = transport->tail; i != transport->head; i = (i + 1) & QUEUE_MASK) {
+        output_report_t *report = &transport->reports[i];
+        uint16_t channel = 1 << (transport->channel ? transport->channel(report) : report->type);
+
+        if (!(busy & channel)) {
+            uint16_t latency = timer_elapsed(report->queued);
+
+            switch (transport->send(report)) {
+                case OUTPUT_SENT:
+                    transport->stats.sent++;
+                    transport->stats.total_latency += latency;
+                    if (latency > transport->stats.max_latency) {
+                        transport->stats.max_latency = latency;
+                    }
+                    transport->timeouted = false;
+                    continue;
+                case OUTPUT_BUSY:
+                    /* The timeout starts when the report is first tried, not
+                     * when it's queued behind the others of its channel */
+                    if (!report->busy) {
+                        report->busy = true;
+                        report->busy_since = timer_read();
+                    }
+                    else if (timer_elapsed(report->busy_since) > transport->timeout) {
+                        transport->timeouted = true;
+                        if (report->type != OUTPUT_REPORT_KEYBOARD || output_newer_keyboard(transport, i)) {
+                            dprintf("output busy for %ums, dropping a report\n", timer_elapsed(report->busy_since));
+                            transport->stats.dropped++;
+                            continue;
+                        }
+                    }
+                    busy |= channel;
+                    break;
+                default:
+                    transport->stats.discarded++;
+                    continue;
+            }
+        }
+
+        /* Move the waiting reports up over the ones that are done */
+        if (kept != i) {
+            transport->reports[kept] = *report;
+        }
+        kept = (kept + 1) & QUEUE_MASK;
+    }
+    transport->head = kept;
+}
+
+bool output_pending(output_transport_t *transport)
+{
+    return transport->tail != transport->head;
+}
+
+uint16_t output_average_latency(output_transport_t *transport)
+{
+    if (!transport->stats.sent) return 0;
+    return transport->stats.total_latency / transport->stats.sent;
+}
@@ -0,0 +1,125 @@
+/*
+Copyright 2017 Fred Sundvik
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_ROUTER_H
+#define OUTPUT_ROUTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "report.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Queues the reports separately for each of the transports that they go out
+ * on, for example USB and Bluetooth, so that a slow transport doesn't hold up
+ * the others. Each transport sends its reports without waiting, and when it
+ * is busy the reports stay queued until the next drain, which the protocol
+ * calls from its main loop. A busy report only holds up the later reports of
+ * its own channel, like an USB endpoint, which keep their order, the reports
+ * of the other channels are sent past it. Only the newest keyboard report is
+ * never dropped, since it's the state of all the keys.
+ */
+
+/* The number of reports, a power of two, one less can be queued */
+#ifndef OUTPUT_QUEUE_LENGTH
+#define OUTPUT_QUEUE_LENGTH 4
+#endif
+
+#if (OUTPUT_QUEUE_LENGTH & (OUTPUT_QUEUE_LENGTH - 1)) != 0 || OUTPUT_QUEUE_LENGTH > 128
+#error "OUTPUT_QUEUE_LENGTH has to be a power of two, no larger than 128"
+#endif
+
+enum output_report_type {
+    OUTPUT_REPORT_KEYBOARD,
+    OUTPUT_REPORT_MOUSE,
+    OUTPUT_REPORT_SYSTEM,
+    OUTPUT_REPORT_CONSUMER,
+};
+
+typedef struct {
+    uint8_t type;
+    /* timer_read() when the report was queued */
+    uint16_t queued;
+    /* timer_read() when the transport was first busy for it */
+    uint16_t busy_since;
+    bool busy;
+    union {
+        report_keyboard_t keyboard;
+        report_mouse_t mouse;
+        /* system and consumer */
+        uint16_t usage;
+    };
+} output_report_t;
+
+enum output_result {
+    OUTPUT_SENT,
+    /* retry later */
+    OUTPUT_BUSY,
+    /* the transport can't send it, e.g. while it's disconnected */
+    OUTPUT_DISCARDED,
+};
+
+typedef struct {
+    uint32_t sent;
+    /* busy for longer than the timeout, or pushed out of a full queue */
+    uint16_t dropped;
+    /* OUTPUT_DISCARDED by the transport */
+    uint16_t discarded;
+    /* milliseconds from queuing to sending */
+    uint16_t max_latency;
+    uint32_t total_latency;
+} output_stats_t;
+
+typedef struct {
+    /* Sends the report without waiting */
+    uint8_t (*send)(const output_report_t *report);
+    /* The channel of the report, below 16, the reports of a channel are
+     * busy together. Each type has its own channel when it's NULL. */
+    uint8_t (*channel)(const output_report_t *report);
+    /* Milliseconds a report can stay busy before it's dropped */
+    uint16_t timeout;
+    /* Set when a report was dropped after the timeout, a full queue isn't
+     * waited for again until the transport sends a report */
+    bool timeouted;
+    output_stats_t stats;
+    uint8_t head;
+    uint8_t tail;
+    output_report_t reports[OUTPUT_QUEUE_LENGTH];
+} output_transport_t;
+
+#define OUTPUT_TRANSPORT(send_func, channel_func, timeout_ms) \
+    { .send = send_func, .channel = channel_func, .timeout = timeout_ms }
+
+/* Queues the report, draining the queue first when it's full. When the
+ * transport has timed out, a keyboard report replaces the newest queued one,
+ * and other reports push out the oldest report. */
+void output_queue(output_transport_t *transport, const output_report_t *report);
+/* Sends the queued reports until the transport is busy */
+void output_drain(output_transport_t *transport);
+bool output_pending(output_transport_t *transport);
+/* Average latency in milliseconds */
+uint16_t output_average_latency(output_transport_t *transport);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,6 +23,7 @@
 #include "host.h"
 #include "debug.h"
 #include "suspend.h"
+#include "usb_descriptor_common.h"
 #ifdef SLEEP_LED_ENABLE
 #include "sleep_led.h"
 #include "led.h"
@@ -107,42 +108,12 @@ static const USBDescriptor usb_device_descriptor = {
  * See "Device Class Definition for Human Interface Devices (HID)"
  * (http://www.usb.org/developers/hidpage/HID1_11.pdf) for the
  * detailed descrition of all the fields
+ *
+ * The keyboard, mouse and extra key reports are shared with the other
+ * protocols, in usb_descriptor_common.h
  */
-
-/* Keyboard Protocol 1, HID 1.11 spec, Appendix B, page 59-60 */
 static const uint8_t keyboard_hid_report_desc_data[] = {
-  0x05, 0x01,                // Usage Page (Generic Desktop),
-  0x09, 0x06,                // Usage (Keyboard),
-  0xA1, 0x01,                // Collection (Application),
-  0x75, 0x01,                //   Report Size (1),
-  0x95, 0x08,                //   Report Count (8),
-  0x05, 0x07,                //   Usage Page (Key Codes),
-  0x19, 0xE0,                //   Usage Minimum (224),
-  0x29, 0xE7,                //   Usage Maximum (231),
-  0x15, 0x00,                //   Logical Minimum (0),
-  0x25, 0x01,                //   Logical Maximum (1),
-  0x81, 0x02,                //   Input (Data, Variable, Absolute), ;Modifier byte
-  0x95, 0x01,                //   Report Count (1),
-  0x75, 0x08,                //   Report Size (8),
-  0x81, 0x03,                //   Input (Constant),                 ;Reserved byte
-  0x95, 0x05,                //   Report Count (5),
-  0x75, 0x01,                //   Report Size (1),
-  0x05, 0x08,                //   Usage Page (LEDs),
-  0x19, 0x01,                //   Usage Minimum (1),
-  0x29, 0x05,                //   Usage Maximum (5),
-  0x91, 0x02,                //   Output (Data, Variable, Absolute), ;LED report
-  0x95, 0x01,                //   Report Count (1),
-  0x75, 0x03,                //   Report Size (3),
-  0x91, 0x03,                //   Output (Constant),                 ;LED report padding
-  0x95, KBD_REPORT_KEYS,          //   Report Count (),
-  0x75, 0x08,                //   Report Size (8),
-  0x15, 0x00,                //   Logical Minimum (0),
-  0x25, 0xFF,                //   Logical Maximum(255),
-  0x05, 0x07,                //   Usage Page (Key Codes),
-  0x19, 0x00,                //   Usage Minimum (0),
-  0x29, 0xFF,                //   Usage Maximum (255),
-  0x81, 0x00,                //   Input (Data, Array),
-  0xc0                       // End Collection
+  HID_KEYBOARD_REPORT_DESCRIPTOR(KBD_REPORT_KEYS)
 };
 /* wrapper */
 static const USBDescriptor keyboard_hid_report_descriptor = {
@@ -152,38 +123,7 @@ static const USBDescriptor keyboard_hid_report_descriptor = {
 
 #ifdef NKRO_ENABLE
 static const uint8_t nkro_hid_report_desc_data[] = {
-  0x05, 0x01,                           // Usage Page (Generic Desktop),
-  0x09, 0x06,                           // Usage (Keyboard),
-  0xA1, 0x01,                           // Collection (Application),
-  // bitmap of modifiers
-  0x75, 0x01,                           //   Report Size (1),
-  0x95, 0x08,                           //   Report Count (8),
-  0x05, 0x07,                           //   Usage Page (Key Codes),
-  0x19, 0xE0,                           //   Usage Minimum (224),
-  0x29, 0xE7,                           //   Usage Maximum (231),
-  0x15, 0x00,                           //   Logical Minimum (0),
-  0x25, 0x01,                           //   Logical Maximum (1),
-  0x81, 0x02,                           //   Input (Data, Variable, Absolute), ;Modifier byte
-  // LED output report
-  0x95, 0x05,                           //   Report Count (5),
-  0x75, 0x01,                           //   Report Size (1),
-  0x05, 0x08,                           //   Usage Page (LEDs),
-  0x19, 0x01,                           //   Usage Minimum (1),
-  0x29, 0x05,                           //   Usage Maximum (5),
-  0x91, 0x02,                           //   Output (Data, Variable, Absolute),
-  0x95, 0x01,                           //   Report Count (1),
-  0x75, 0x03,                           //   Report Size (3),
-  0x91, 0x03,                           //   Output (Constant),
-  // bitmap of keys
-  0x95, NKRO_REPORT_KEYS * 8,           //   Report Count (),
-  0x75, 0x01,                           //   Report Size (1),
-  0x15, 0x00,                           //   Logical Minimum (0),
-  0x25, 0x01,                           //   Logical Maximum(1),
-  0x05, 0x07,                           //   Usage Page (Key Codes),
-  0x19, 0x00,                           //   Usage Minimum (0),
-  0x29, NKRO_REPORT_KEYS * 8 - 1,       //   Usage Maximum (),
-  0x81, 0x02,                           //   Input (Data, Variable, Absolute),
-  0xc0                                  // End Collection
+  HID_NKRO_REPORT_DESCRIPTOR(NKRO_REPORT_KEYS * 8)
 };
 /* wrapper */
 static const USBDescriptor nkro_hid_report_descriptor = {
@@ -193,58 +133,8 @@ static const USBDescriptor nkro_hid_report_descriptor = {
 #endif /* NKRO_ENABLE */
 
 #ifdef MOUSE_ENABLE
-/* Mouse Protocol 1, HID 1.11 spec, Appendix B, page 59-60, with wheel extension
- * http://www.microchip.com/forums/tm.aspx?high=&m=391435&mpage=1#391521
- * http://www.keil.com/forum/15671/
- * http://www.microsoft.com/whdc/device/input/wheel.mspx */
 static const uint8_t mouse_hid_report_desc_data[] = {
-  /* mouse */
-  0x05, 0x01,                      // USAGE_PAGE (Generic Desktop)
-  0x09, 0x02,                      // USAGE (Mouse)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  //0x85, REPORT_ID_MOUSE,         //   REPORT_ID (1)
-  0x09, 0x01,                      //   USAGE (Pointer)
-  0xa1, 0x00,                      //   COLLECTION (Physical)
-                                   // ----------------------------  Buttons
-  0x05, 0x09,                      //     USAGE_PAGE (Button)
-  0x19, 0x01,                      //     USAGE_MINIMUM (Button 1)
-  0x29, 0x05,                      //     USAGE_MAXIMUM (Button 5)
-  0x15, 0x00,                      //     LOGICAL_MINIMUM (0)
-  0x25, 0x01,                      //     LOGICAL_MAXIMUM (1)
-  0x75, 0x01,                      //     REPORT_SIZE (1)
-  0x95, 0x05,                      //     REPORT_COUNT (5)
-  0x81, 0x02,                      //     INPUT (Data,Var,Abs)
-  0x75, 0x03,                      //     REPORT_SIZE (3)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x03,                      //     INPUT (Cnst,Var,Abs)
-                                   // ----------------------------  X,Y position
-  0x05, 0x01,                      //     USAGE_PAGE (Generic Desktop)
-  0x09, 0x30,                      //     USAGE (X)
-  0x09, 0x31,                      //     USAGE (Y)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x02,                      //     REPORT_COUNT (2)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Vertical wheel
-  0x09, 0x38,                      //     USAGE (Wheel)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x35, 0x00,                      //     PHYSICAL_MINIMUM (0)        - reset physical
-  0x45, 0x00,                      //     PHYSICAL_MAXIMUM (0)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-                                   // ----------------------------  Horizontal wheel
-  0x05, 0x0c,                      //     USAGE_PAGE (Consumer Devices)
-  0x0a, 0x38, 0x02,                //     USAGE (AC Pan)
-  0x15, 0x81,                      //     LOGICAL_MINIMUM (-127)
-  0x25, 0x7f,                      //     LOGICAL_MAXIMUM (127)
-  0x75, 0x08,                      //     REPORT_SIZE (8)
-  0x95, 0x01,                      //     REPORT_COUNT (1)
-  0x81, 0x06,                      //     INPUT (Data,Var,Rel)
-  0xc0,                            //   END_COLLECTION
-  0xc0,                            // END_COLLECTION
+  HID_MOUSE_REPORT_DESCRIPTOR(HID_NO_REPORT_ID)
 };
 /* wrapper */
 static const USBDescriptor mouse_hid_report_descriptor = {
@@ -274,35 +164,8 @@ static const USBDescriptor console_hid_report_descriptor = {
 #endif /* CONSOLE_ENABLE */
 
 #ifdef EXTRAKEY_ENABLE
-/* audio controls & system controls
- * http://www.microsoft.com/whdc/archive/w2kbd.mspx */
 static const uint8_t extra_hid_report_desc_data[] = {
-  /* system control */
-  0x05, 0x01,                      // USAGE_PAGE (Generic Desktop)
-  0x09, 0x80,                      // USAGE (System Control)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  0x85, REPORT_ID_SYSTEM,          //   REPORT_ID (2)
-  0x15, 0x01,                      //   LOGICAL_MINIMUM (0x1)
-  0x25, 0xb7,                      //   LOGICAL_MAXIMUM (0xb7)
-  0x19, 0x01,                      //   USAGE_MINIMUM (0x1)
-  0x29, 0xb7,                      //   USAGE_MAXIMUM (0xb7)
-  0x75, 0x10,                      //   REPORT_SIZE (16)
-  0x95, 0x01,                      //   REPORT_COUNT (1)
-  0x81, 0x00,                      //   INPUT (Data,Array,Abs)
-  0xc0,                            // END_COLLECTION
-  /* consumer */
-  0x05, 0x0c,                      // USAGE_PAGE (Consumer Devices)
-  0x09, 0x01,                      // USAGE (Consumer Control)
-  0xa1, 0x01,                      // COLLECTION (Application)
-  0x85, REPORT_ID_CONSUMER,        //   REPORT_ID (3)
-  0x15, 0x01,                      //   LOGICAL_MINIMUM (0x1)
-  0x26, 0x9c, 0x02,                //   LOGICAL_MAXIMUM (0x29c)
-  0x19, 0x01,                      //   USAGE_MINIMUM (0x1)
-  0x2a, 0x9c, 0x02,                //   USAGE_MAXIMUM (0x29c)
-  0x75, 0x10,                      //   REPORT_SIZE (16)
-  0x95, 0x01,                      //   REPORT_COUNT (1)
-  0x81, 0x00,                      //   INPUT (Data,Array,Abs)
-  0xc0,                            // END_COLLECTION
+  HID_EXTRAKEY_REPORT_DESCRIPTOR
 };
 /* wrapper */
 static const USBDescriptor extra_hid_report_descriptor = {
@@ -386,7 +249,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(KBD_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     KBD_EPSIZE,// wMaxPacketSize
-                    10),       // bInterval
+                    USB_POLLING_INTERVAL(KEYBOARD_POLLING_INTERVAL_US)), // bInterval
 
   #ifdef MOUSE_ENABLE
   /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
@@ -416,7 +279,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(MOUSE_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     MOUSE_EPSIZE,  // wMaxPacketSize
-                    1),        // bInterval
+                    USB_POLLING_INTERVAL(MOUSE_POLLING_INTERVAL_US)), // bInterval
   #endif /* MOUSE_ENABLE */
 
   #ifdef CONSOLE_ENABLE
@@ -468,7 +331,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(EXTRA_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     EXTRA_EPSIZE, // wMaxPacketSize
-                    10),       // bInterval
+                    USB_POLLING_INTERVAL(EXTRAKEY_POLLING_INTERVAL_US)), // bInterval
   #endif /* EXTRAKEY_ENABLE */
 
   #ifdef NKRO_ENABLE
@@ -494,7 +357,7 @@ static const uint8_t hid_configuration_descriptor_data[] = {
   USB_DESC_ENDPOINT(NKRO_ENDPOINT | 0x80,  // bEndpointAddress
                     0x03,      // bmAttributes (Interrupt)
                     NKRO_EPSIZE, // wMaxPacketSize
-                    1),       // bInterval
+                    USB_POLLING_INTERVAL(NKRO_POLLING_INTERVAL_US)), // bInterval
   #endif /* NKRO_ENABLE */
 };
 
@@ -4,11 +4,13 @@
 #include <alloca.h>
 #include <util/delay.h>
 #include <util/atomic.h>
+#include <avr/sleep.h>
 #include "debug.h"
 #include "pincontrol.h"
 #include "timer.h"
 #include "action_util.h"
 #include "ringbuffer.hpp"
+#include "suspend.h"
 #include <string.h>
 
 // These are the pin assignments for the 32u4 boards.
@@ -30,6 +32,23 @@
 #define SAMPLE_BATTERY
 #define ConnectionUpdateInterval 1000 /* milliseconds */
 
+// The status queries wait until there has been no input for this long, so
+// that they don't hold up the reports while typing
+#ifndef AdafruitBleQuietTime
+#define AdafruitBleQuietTime 1000 /* milliseconds */
+#endif
+
+// With USB unplugged, the MCU sleeps between the matrix scans once there has
+// been no input for this long, and powers down when the matrix can wake it
+// up after the longer delay.  Define AdafruitBleSleepDelay to 0 to never sleep
+#ifndef AdafruitBleSleepDelay
+#define AdafruitBleSleepDelay 100 /* milliseconds */
+#endif
+
+#ifndef AdafruitBlePowerDownDelay
+#define AdafruitBlePowerDownDelay 5000 /* milliseconds */
+#endif
+
 static struct {
   bool is_connected;
   bool initialized;
@@ -44,8 +63,13 @@ static struct {
   uint32_t vbat;
 #endif
   uint16_t last_connection_update;
+  uint16_t last_input;
+  uint16_t last_stats_update;
 } state;
 
+static struct adafruit_ble_stats stats;
+static uint32_t last_wakeups, last_commands;
+
 // Commands are encoded using SDEP and sent via SPI
 // https://github.com/adafruit/Adafruit_BluefruitLE_nRF51/blob/master/SDEP.md
 
@@ -75,14 +99,16 @@ enum queue_type {
 #endif
 };
 
+struct key_report {
+  uint8_t modifier;
+  uint8_t keys[6];
+};
+
 struct queue_item {
   enum queue_type queue_type;
   uint16_t added;
   union __attribute__((packed)) {
-    struct __attribute__((packed)) {
-      uint8_t modifier;
-      uint8_t keys[6];
-    } key;
+    struct key_report key;
 
     uint16_t consumer;
     struct __attribute__((packed)) {
@@ -481,6 +507,7 @@ static bool at_command(const char *cmd, char *resp, uint16_t resplen,
     resp_buf_wait(cmd);
     *resp = 0;
   }
+  stats.commands++;
 
   // Fragment the command into a series of SDEP packets
   while (end - cmd > SdepMaxPayload) {
@@ -521,6 +548,10 @@ bool adafruit_ble_is_connected(void) {
   return state.is_connected;
 }
 
+bool adafruit_ble_can_send(void) {
+  return !send_buf.full();
+}
+
 bool adafruit_ble_enable_keyboard(void) {
   char resbuf[128];
 
@@ -600,28 +631,21 @@ static void set_connected(bool connected) {
   }
 }
 
-void adafruit_ble_task(void) {
-  char resbuf[48];
-
-  if (!state.configured && !adafruit_ble_enable_keyboard()) {
+// The connection and battery queries are each a blocking AT round trip, that
+// would delay any report queued behind them, so they only run once the
+// queues have drained and the input has been quiet for a while.  When one of
+// them is due, the other runs in the same slot if it's due soon, so that the
+// module is only woken up once for both.
+static void ble_housekeeping(char *resbuf, uint16_t resplen) {
+  if (!resp_buf.empty() || !send_buf.empty() ||
+      timer_elapsed(state.last_input) < AdafruitBleQuietTime) {
     return;
   }
-  resp_buf_read_one(true);
-  send_buf_send_one(SdepShortTimeout);
-
-  if (resp_buf.empty() && (state.event_flags & UsingEvents) &&
-      digitalRead(AdafruitBleIRQPin)) {
-    // Must be an event update
-    if (at_command_P(PSTR("AT+EVENTSTATUS"), resbuf, sizeof(resbuf))) {
-      uint32_t mask = strtoul(resbuf, NULL, 16);
 
-      if (mask & BleSystemConnected) {
-        set_connected(true);
-      } else if (mask & BleSystemDisconnected) {
-        set_connected(false);
-      }
-    }
-  }
+#ifdef SAMPLE_BATTERY
+  bool sampleBattery =
+      timer_elapsed(state.last_battery_update) > BatteryUpdateInterval;
+#endif
 
   if (timer_elapsed(state.last_connection_update) > ConnectionUpdateInterval) {
     bool shouldPoll = true;
@@ -632,23 +656,30 @@ void adafruit_ble_task(void) {
       // Note that at the time of writing, HID reports only work correctly
       // with Apple products on firmware version 0.6.7!
       // https://forums.adafruit.com/viewtopic.php?f=8&t=104052
-      if (at_command_P(PSTR("AT+EVENTENABLE=0x1"), resbuf, sizeof(resbuf))) {
-        at_command_P(PSTR("AT+EVENTENABLE=0x2"), resbuf, sizeof(resbuf));
+      if (at_command_P(PSTR("AT+EVENTENABLE=0x1"), resbuf, resplen)) {
+        at_command_P(PSTR("AT+EVENTENABLE=0x2"), resbuf, resplen);
         state.event_flags |= UsingEvents;
       }
       state.event_flags |= ProbedEvents;
 
       // leave shouldPoll == true so that we check at least once
       // before relying solely on events
-    } else {
+    } else if (state.event_flags & UsingEvents) {
       shouldPoll = false;
     }
 
     static const char kGetConn[] PROGMEM = "AT+GAPGETCONN";
     state.last_connection_update = timer_read();
 
-    if (at_command_P(kGetConn, resbuf, sizeof(resbuf))) {
-      set_connected(atoi(resbuf));
+    if (shouldPoll) {
+      if (at_command_P(kGetConn, resbuf, resplen)) {
+        set_connected(atoi(resbuf));
+      }
+#ifdef SAMPLE_BATTERY
+      sampleBattery = sampleBattery ||
+                      timer_elapsed(state.last_battery_update) >
+                          BatteryUpdateInterval - ConnectionUpdateInterval;
+#endif
     }
   }
 
@@ -656,50 +687,126 @@ void adafruit_ble_task(void) {
   // I don't know if this really does anything useful yet; the reported
   // voltage level always seems to be around 3200mV.  We may want to just rip
   // this code out.
-  if (timer_elapsed(state.last_battery_update) > BatteryUpdateInterval &&
-      resp_buf.empty()) {
+  if (sampleBattery) {
     state.last_battery_update = timer_read();
 
-    if (at_command_P(PSTR("AT+HWVBAT"), resbuf, sizeof(resbuf))) {
+    if (at_command_P(PSTR("AT+HWVBAT"), resbuf, resplen)) {
       state.vbat = atoi(resbuf);
     }
   }
 #endif
 }
 
+static void ble_update_stats(void) {
+  uint16_t elapsed = timer_elapsed(state.last_stats_update);
+  if (elapsed < 1000) {
+    return;
+  }
+  state.last_stats_update = timer_read();
+
+  stats.wakeups_per_second =
+      (uint32_t)(stats.wakeups - last_wakeups) * 1000 / elapsed;
+  stats.commands_per_second =
+      (uint32_t)(stats.commands - last_commands) * 1000 / elapsed;
+  last_wakeups = stats.wakeups;
+  last_commands = stats.commands;
+
+  if (stats.wakeups_per_second || stats.commands_per_second) {
+    dprintf("ble: %u wakeups/s, %u commands/s, %lu power downs\n",
+            stats.wakeups_per_second, stats.commands_per_second,
+            stats.power_downs);
+  }
+}
+
+void adafruit_ble_task(void) {
+  char resbuf[48];
+
+  if (!state.configured && !adafruit_ble_enable_keyboard()) {
+    return;
+  }
+  resp_buf_read_one(true);
+  send_buf_send_one(SdepShortTimeout);
+
+  if (resp_buf.empty() && (state.event_flags & UsingEvents) &&
+      digitalRead(AdafruitBleIRQPin)) {
+    // Must be an event update
+    if (at_command_P(PSTR("AT+EVENTSTATUS"), resbuf, sizeof(resbuf))) {
+      uint32_t mask = strtoul(resbuf, NULL, 16);
+
+      if (mask & BleSystemConnected) {
+        set_connected(true);
+      } else if (mask & BleSystemDisconnected) {
+        set_connected(false);
+      }
+    }
+  }
+
+  ble_housekeeping(resbuf, sizeof(resbuf));
+  ble_update_stats();
+}
+
+// The reports are formatted by hand rather than with snprintf, which is
+// by far the most expensive part of sending them
+static char *append_P(char *dest, const char *src) {
+  strcpy_P(dest, src);
+  return dest + strlen(dest);
+}
+
+static char *append_hex(char *dest, uint8_t value) {
+  static const char kHexDigits[] PROGMEM = "0123456789abcdef";
+  *dest++ = pgm_read_byte(&kHexDigits[value >> 4]);
+  *dest++ = pgm_read_byte(&kHexDigits[value & 0xf]);
+  return dest;
+}
+
+#ifdef MOUSE_ENABLE
+static char *append_int(char *dest, int8_t value) {
+  itoa(value, dest, 10);
+  return dest + strlen(dest);
+}
+#endif
+
 static bool process_queue_item(struct queue_item *item, uint16_t timeout) {
   char cmdbuf[48];
-  char fmtbuf[64];
-
-  // Arrange to re-check connection after keys have settled
-  state.last_connection_update = timer_read();
+  char *cmd = cmdbuf;
 
 #if 1
-  if (TIMER_DIFF_16(state.last_connection_update, item->added) > 0) {
-    dprintf("send latency %dms\n",
-            TIMER_DIFF_16(state.last_connection_update, item->added));
+  uint16_t now = timer_read();
+  if (TIMER_DIFF_16(now, item->added) > 0) {
+    dprintf("send latency %dms\n", TIMER_DIFF_16(now, item->added));
   }
 #endif
 
   switch (item->queue_type) {
     case QTKeyReport:
-      strcpy_P(fmtbuf,
-          PSTR("AT+BLEKEYBOARDCODE=%02x-00-%02x-%02x-%02x-%02x-%02x-%02x"));
-      snprintf(cmdbuf, sizeof(cmdbuf), fmtbuf, item->key.modifier,
-               item->key.keys[0], item->key.keys[1], item->key.keys[2],
-               item->key.keys[3], item->key.keys[4], item->key.keys[5]);
+      // AT+BLEKEYBOARDCODE=mm-00-kk-kk-kk-kk-kk-kk
+      cmd = append_P(cmd, PSTR("AT+BLEKEYBOARDCODE="));
+      cmd = append_hex(cmd, item->key.modifier);
+      cmd = append_P(cmd, PSTR("-00"));
+      for (uint8_t i = 0; i < sizeof(item->key.keys); ++i) {
+        *cmd++ = '-';
+        cmd = append_hex(cmd, item->key.keys[i]);
+      }
+      *cmd = 0;
       return at_command(cmdbuf, NULL, 0, true, timeout);
 
     case QTConsumer:
-      strcpy_P(fmtbuf, PSTR("AT+BLEHIDCONTROLKEY=0x%04x"));
-      snprintf(cmdbuf, sizeof(cmdbuf), fmtbuf, item->consumer);
+      cmd = append_P(cmd, PSTR("AT+BLEHIDCONTROLKEY=0x"));
+      cmd = append_hex(cmd, item->consumer >> 8);
+      cmd = append_hex(cmd, item->consumer & 0xff);
+      *cmd = 0;
       return at_command(cmdbuf, NULL, 0, true, timeout);
 
 #ifdef MOUSE_ENABLE
     case QTMouseMove:
-      strcpy_P(fmtbuf, PSTR("AT+BLEHIDMOUSEMOVE=%d,%d,%d,%d"));
-      snprintf(cmdbuf, sizeof(cmdbuf), fmtbuf, item->mousemove.x,
-          item->mousemove.y, item->mousemove.scroll, item->mousemove.pan);
+      cmd = append_P(cmd, PSTR("AT+BLEHIDMOUSEMOVE="));
+      cmd = append_int(cmd, item->mousemove.x);
+      *cmd++ = ',';
+      cmd = append_int(cmd, item->mousemove.y);
+      *cmd++ = ',';
+      cmd = append_int(cmd, item->mousemove.scroll);
+      *cmd++ = ',';
+      cmd = append_int(cmd, item->mousemove.pan);
       if (!at_command(cmdbuf, NULL, 0, true, timeout)) {
         return false;
       }
@@ -723,10 +830,109 @@ static bool process_queue_item(struct queue_item *item, uint16_t timeout) {
   }
 }
 
+#ifdef MOUSE_ENABLE
+static bool add_movement(int8_t &total, int8_t delta) {
+  int16_t sum = total + delta;
+  if (sum < -127 || sum > 127) {
+    return false;
+  }
+  total = sum;
+  return true;
+}
+#endif
+
+// The newest enqueued key report, and the one before it, for coalescing
+static struct key_report last_key_report, previous_key_report;
+
+static bool has_key(const struct key_report &report, uint8_t key) {
+  return memchr(report.keys, key, sizeof(report.keys)) != NULL;
+}
+
+// Every queued item is still waiting to be sent, so the newest one can be
+// replaced when the new item supersedes it. A key report supersedes the
+// previous one when it has the same modifiers, keeps all of its keys and
+// doesn't press again a key that it released, since the host then sees
+// the same key presses, just closer together. Mouse movements with the
+// same buttons are added up.
+static bool send_buf_coalesce(const struct queue_item &item) {
+  if (send_buf.empty()) {
+    return false;
+  }
+  struct queue_item &last = send_buf.back();
+  if (last.queue_type != item.queue_type) {
+    return false;
+  }
+
+  switch (item.queue_type) {
+    case QTKeyReport: {
+      const struct key_report &next = item.key;
+      if (last_key_report.modifier != next.modifier) {
+        return false;
+      }
+      for (uint8_t i = 0; i < sizeof(next.keys); ++i) {
+        uint8_t key = last_key_report.keys[i];
+        if (key && !has_key(next, key)) {
+          return false;
+        }
+        key = previous_key_report.keys[i];
+        if (key && !has_key(last_key_report, key) && has_key(next, key)) {
+          return false;
+        }
+      }
+      // Keep the time of the older report, for the latency
+      last.key = next;
+      last_key_report = next;
+      return true;
+    }
+
+#ifdef MOUSE_ENABLE
+    case QTMouseMove: {
+      if (last.mousemove.buttons != item.mousemove.buttons) {
+        return false;
+      }
+      struct queue_item sum = last;
+      if (!add_movement(sum.mousemove.x, item.mousemove.x) ||
+          !add_movement(sum.mousemove.y, item.mousemove.y) ||
+          !add_movement(sum.mousemove.scroll, item.mousemove.scroll) ||
+          !add_movement(sum.mousemove.pan, item.mousemove.pan)) {
+        return false;
+      }
+      last = sum;
+      return true;
+    }
+#endif
+
+    default:
+      return false;
+  }
+}
+
+static void send_buf_enqueue(const struct queue_item &item) {
+  bool didWait = false;
+
+  // Arrange to re-check the connection after the input has settled
+  state.last_input = timer_read();
+
+  if (send_buf_coalesce(item)) {
+    dprintf("coalesced, have %d queued\n", (int)send_buf.size());
+    return;
+  }
+  if (item.queue_type == QTKeyReport) {
+    previous_key_report = last_key_report;
+    last_key_report = item.key;
+  }
+  while (!send_buf.enqueue(item)) {
+    if (!didWait) {
+      dprint("wait for buf space\n");
+      didWait = true;
+    }
+    send_buf_send_one();
+  }
+}
+
 bool adafruit_ble_send_keys(uint8_t hid_modifier_mask, uint8_t *keys,
                             uint8_t nkeys) {
   struct queue_item item;
-  bool didWait = false;
 
   item.queue_type = QTKeyReport;
   item.key.modifier = hid_modifier_mask;
@@ -740,14 +946,7 @@ bool adafruit_ble_send_keys(uint8_t hid_modifier_mask, uint8_t *keys,
     item.key.keys[4] = nkeys >= 4 ? keys[4] : 0;
     item.key.keys[5] = nkeys >= 5 ? keys[5] : 0;
 
-    if (!send_buf.enqueue(item)) {
-      if (!didWait) {
-        dprint("wait for buf space\n");
-        didWait = true;
-      }
-      send_buf_send_one();
-      continue;
-    }
+    send_buf_enqueue(item);
 
     if (nkeys <= 6) {
       return true;
@@ -765,10 +964,9 @@ bool adafruit_ble_send_consumer_key(uint16_t keycode, int hold_duration) {
 
   item.queue_type = QTConsumer;
   item.consumer = keycode;
+  item.added = timer_read();
 
-  while (!send_buf.enqueue(item)) {
-    send_buf_send_one();
-  }
+  send_buf_enqueue(item);
   return true;
 }
 
@@ -778,19 +976,73 @@ bool adafruit_ble_send_mouse_move(int8_t x, int8_t y, int8_t scroll,
   struct queue_item item;
 
   item.queue_type = QTMouseMove;
+  item.added = timer_read();
   item.mousemove.x = x;
   item.mousemove.y = y;
   item.mousemove.scroll = scroll;
   item.mousemove.pan = pan;
   item.mousemove.buttons = buttons;
 
-  while (!send_buf.enqueue(item)) {
-    send_buf_send_one();
-  }
+  send_buf_enqueue(item);
   return true;
 }
 #endif
 
+__attribute__ ((weak)) bool matrix_wake_enable(void) { return false; }
+__attribute__ ((weak)) void matrix_wake_disable(void) {}
+
+static bool keys_released(void) {
+  if (last_key_report.modifier) {
+    return false;
+  }
+  for (uint8_t i = 0; i < sizeof(last_key_report.keys); ++i) {
+    if (last_key_report.keys[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void adafruit_ble_sleep(void) {
+  if (!AdafruitBleSleepDelay || !state.configured || !send_buf.empty() ||
+      !resp_buf.empty() || digitalRead(AdafruitBleIRQPin)) {
+    return;
+  }
+  uint16_t idle = timer_elapsed(state.last_input);
+  if (idle < AdafruitBleSleepDelay) {
+    return;
+  }
+  if (idle >= AdafruitBlePowerDownDelay) {
+    // Keep the idle time from wrapping around
+    state.last_input = timer_read() - AdafruitBlePowerDownDelay;
+  }
+
+  // The module holds its IRQ pin high until it's read, so anything it sent
+  // while we were asleep is picked up by the next adafruit_ble_task
+  cli();
+  if (idle >= AdafruitBlePowerDownDelay && keys_released() &&
+      matrix_wake_enable()) {
+    // The timer stops in power down, so the time doesn't move on until the
+    // matrix wakes us up again, and none of the queries fall due meanwhile.
+    // A key pressed since the wake up was enabled wakes us up right away.
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    matrix_wake_disable();
+    stats.power_downs++;
+  } else {
+    // Wakes up with the next timer tick, in time for the next scan
+    suspend_idle(0);
+  }
+  stats.wakeups++;
+}
+
+void adafruit_ble_get_stats(struct adafruit_ble_stats *out) {
+  *out = stats;
+}
+
 uint32_t adafruit_ble_read_battery_voltage(void) {
   return state.vbat;
 }
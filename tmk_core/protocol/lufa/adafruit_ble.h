@@ -23,6 +23,10 @@ extern bool adafruit_ble_query_is_connected(void);
  * calling ble_task() periodically. */
 extern bool adafruit_ble_is_connected(void);
 
+/* Returns false while the send queue is full, when sending a report would
+ * wait for the module to take the queued ones. */
+extern bool adafruit_ble_can_send(void);
+
 /* Call this periodically to process BLE-originated things */
 extern void adafruit_ble_task(void);
 
@@ -46,6 +50,31 @@ extern bool adafruit_ble_send_mouse_move(int8_t x, int8_t y, int8_t scroll,
                                          int8_t pan, uint8_t buttons);
 #endif
 
+/* Puts the MCU to sleep until the next timer tick when there has been no
+ * input for a while and nothing is waiting for the module, and powers it
+ * down when the keyboard can wake it up from the matrix.
+ * Call this at the end of the main loop while running from the battery. */
+extern void adafruit_ble_sleep(void);
+
+/* Implement these in the keyboard to power down while idle.
+ * matrix_wake_enable is called with interrupts disabled, and returns true
+ * once any key press will raise an interrupt, for example by driving all the
+ * rows low and enabling the pin change interrupts of the columns.
+ * matrix_wake_disable restores the matrix for scanning. */
+extern bool matrix_wake_enable(void);
+extern void matrix_wake_disable(void);
+
+/* Counters of what costs current; the rates cover the last second */
+struct adafruit_ble_stats {
+  uint32_t wakeups;     /* from any sleep */
+  uint32_t power_downs; /* the wakeups from power down */
+  uint32_t commands;    /* AT commands sent to the module */
+  uint16_t wakeups_per_second;
+  uint16_t commands_per_second;
+};
+
+extern void adafruit_ble_get_stats(struct adafruit_ble_stats *stats);
+
 /* Compute battery voltage by reading an analog pin.
  * Returns the integer number of millivolts */
 extern uint32_t adafruit_ble_read_battery_voltage(void);
@@ -47,6 +47,21 @@
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/pgmspace.h>
 
+/* The report descriptors and the mouse polling stay as they always were on
+ * LUFA, the LED report is Non Volatile, the wheel has no physical range,
+ * and the mouse is polled every 10ms unless the board defines otherwise */
+#define HID_LED_OUTPUT_FLAGS 0x82
+#define HID_MOUSE_WHEEL_PHYSICAL_RANGE
+#ifndef MOUSE_POLLING_INTERVAL_US
+#define MOUSE_POLLING_INTERVAL_US 10000
+#endif
+
+#include "usb_descriptor_common.h"
+
+/* With SHARED_EP_ENABLE the mouse and the extra keys share one interface */
+#if defined(SHARED_EP_ENABLE) && (defined(MOUSE_ENABLE) || defined(EXTRAKEY_ENABLE))
+#   define SHARED_EP
+#endif
 
 typedef struct
 {
@@ -57,6 +72,12 @@ typedef struct
     USB_HID_Descriptor_HID_t              Keyboard_HID;
     USB_Descriptor_Endpoint_t             Keyboard_INEndpoint;
 
+#ifdef SHARED_EP
+    // Mouse and Extrakey HID Interface
+    USB_Descriptor_Interface_t            Shared_Interface;
+    USB_HID_Descriptor_HID_t              Shared_HID;
+    USB_Descriptor_Endpoint_t             Shared_INEndpoint;
+#else
 #ifdef MOUSE_ENABLE
     // Mouse HID Interface
     USB_Descriptor_Interface_t            Mouse_Interface;
@@ -70,6 +91,7 @@ typedef struct
     USB_HID_Descriptor_HID_t              Extrakey_HID;
     USB_Descriptor_Endpoint_t             Extrakey_INEndpoint;
 #endif
+#endif
 
 #ifdef RAW_ENABLE
     // Raw HID Interface
@@ -133,6 +155,11 @@ typedef struct
 /* index of interface */
 #define KEYBOARD_INTERFACE          0
 
+#ifdef SHARED_EP
+#   define SHARED_INTERFACE         (KEYBOARD_INTERFACE + 1)
+#   define MOUSE_INTERFACE          SHARED_INTERFACE
+#   define EXTRAKEY_INTERFACE       SHARED_INTERFACE
+#else
 #ifdef MOUSE_ENABLE
 #   define MOUSE_INTERFACE          (KEYBOARD_INTERFACE + 1)
 #else
@@ -144,6 +171,7 @@ typedef struct
 #else
 #   define EXTRAKEY_INTERFACE       MOUSE_INTERFACE
 #endif
+#endif
 
 #ifdef RAW_ENABLE
 #   define RAW_INTERFACE        	(EXTRAKEY_INTERFACE + 1)
@@ -184,6 +212,11 @@ typedef struct
 // Endopoint number and size
 #define KEYBOARD_IN_EPNUM           1
 
+#ifdef SHARED_EP
+#   define SHARED_IN_EPNUM          (KEYBOARD_IN_EPNUM + 1)
+#   define MOUSE_IN_EPNUM           SHARED_IN_EPNUM
+#   define EXTRAKEY_IN_EPNUM        SHARED_IN_EPNUM
+#else
 #ifdef MOUSE_ENABLE
 #   define MOUSE_IN_EPNUM           (KEYBOARD_IN_EPNUM + 1)
 #else
@@ -195,6 +228,7 @@ typedef struct
 #else
 #   define EXTRAKEY_IN_EPNUM        MOUSE_IN_EPNUM
 #endif
+#endif
 
 #ifdef RAW_ENABLE
 #   define RAW_IN_EPNUM         (EXTRAKEY_IN_EPNUM + 1)
@@ -239,12 +273,13 @@ typedef struct
 #endif
 
 #if defined(__AVR_ATmega32U2__) && CDC_OUT_EPNUM > 4
-# error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO, MIDI, SERIAL)"
+# error "Endpoints are not available enough to support all functions. Remove some in Makefile.(MOUSEKEY, EXTRAKEY, CONSOLE, NKRO, MIDI, SERIAL), or share the mouse endpoint with SHARED_EP_ENABLE"
 #endif
 
 #define KEYBOARD_EPSIZE             8
 #define MOUSE_EPSIZE                8
 #define EXTRAKEY_EPSIZE             8
+#define SHARED_EPSIZE               8
 #define RAW_EPSIZE              	32
 #define CONSOLE_EPSIZE              32
 #define NKRO_EPSIZE                 32
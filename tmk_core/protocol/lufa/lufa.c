@@ -84,6 +84,10 @@
 
 #ifdef MIDI_ENABLE
   #include "sysex_tools.h"
+  #include "usb_midi_queue.h"
+  #ifdef MIDI_ENGINE
+    #include "midi_engine.h"
+  #endif
 #endif
 
 #ifdef RAW_ENABLE
@@ -102,6 +106,9 @@ static void usb_send_func(MidiDevice * device, uint16_t cnt, uint8_t byte0, uint
 static void usb_get_midi(MidiDevice * device);
 static void midi_usb_init(MidiDevice * device);
 #endif
+#if defined(MIDI_ENABLE) && defined(MIDI_ENGINE)
+static void usb_midi_frame(void);
+#endif
 
 /* Host driver */
 static uint8_t keyboard_leds(void);
@@ -109,6 +116,11 @@ static void send_keyboard(report_keyboard_t *report);
 static void send_mouse(report_mouse_t *report);
 static void send_system(uint16_t data);
 static void send_consumer(uint16_t data);
+static uint8_t usb_send_report(const output_report_t *report);
+static uint8_t usb_report_endpoint(const output_report_t *report);
+#ifdef BLUETOOTH_ENABLE
+static uint8_t bluetooth_send_report(const output_report_t *report);
+#endif
 host_driver_t lufa_driver = {
     keyboard_leds,
     send_keyboard,
@@ -122,6 +134,15 @@ host_driver_t lufa_driver = {
 #endif
 };
 
+/* The reports wait on a busy endpoint for at most about 10ms, like before
+ * they were queued */
+output_transport_t usb_output = OUTPUT_TRANSPORT(usb_send_report, usb_report_endpoint, 10);
+#ifdef BLUETOOTH_ENABLE
+/* A keyboard report takes about 12ms on the UART at 9600 baud, so a few of
+ * them can be waiting for the ones before */
+output_transport_t bluetooth_output = OUTPUT_TRANSPORT(bluetooth_send_report, NULL, 100);
+#endif
+
 /*******************************************************************************
  * MIDI
  ******************************************************************************/
@@ -387,10 +408,17 @@ static bool console_flush = false;
     console_flush = b; \
   } \
 } while (0)
+#endif
 
+#if defined(CONSOLE_ENABLE) || (defined(MIDI_ENABLE) && defined(MIDI_ENGINE))
 // called every 1ms
 void EVENT_USB_Device_StartOfFrame(void)
 {
+#if defined(MIDI_ENABLE) && defined(MIDI_ENGINE)
+    usb_midi_frame();
+#endif
+
+#ifdef CONSOLE_ENABLE
     static uint8_t count;
     if (++count % 50) return;
     count = 0;
@@ -398,6 +426,7 @@ void EVENT_USB_Device_StartOfFrame(void)
     if (!console_flush) return;
     Console_Task();
     console_flush = false;
+#endif
 }
 
 #endif
@@ -416,6 +445,11 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(KEYBOARD_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      KEYBOARD_EPSIZE, ENDPOINT_BANK_SINGLE);
 
+#ifdef SHARED_EP
+    /* Setup Mouse and Extra HID Report Endpoint */
+    ConfigSuccess &= ENDPOINT_CONFIG(SHARED_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+                                     SHARED_EPSIZE, ENDPOINT_BANK_SINGLE);
+#else
 #ifdef MOUSE_ENABLE
     /* Setup Mouse HID Report Endpoint */
     ConfigSuccess &= ENDPOINT_CONFIG(MOUSE_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
@@ -427,6 +461,7 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     ConfigSuccess &= ENDPOINT_CONFIG(EXTRAKEY_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
                                      EXTRAKEY_EPSIZE, ENDPOINT_BANK_SINGLE);
 #endif
+#endif
 
 #ifdef RAW_ENABLE
     /* Setup Raw HID Report Endpoints */
@@ -597,147 +632,159 @@ static uint8_t keyboard_leds(void)
     return keyboard_led_stats;
 }
 
-static void send_keyboard(report_keyboard_t *report)
+/* The endpoint of the report, with SHARED_EP the mouse and extra keys share
+ * one, so they are busy together */
+static uint8_t usb_report_endpoint(const output_report_t *report)
 {
-    uint8_t timeout = 255;
-    uint8_t where = where_to_send();
-
-#ifdef BLUETOOTH_ENABLE
-  if (where == OUTPUT_BLUETOOTH || where == OUTPUT_USB_AND_BT) {
-    #ifdef MODULE_ADAFRUIT_BLE
-      adafruit_ble_send_keys(report->mods, report->keys, sizeof(report->keys));
-    #elif MODULE_RN42
-       bluefruit_serial_send(0xFD);
-       bluefruit_serial_send(0x09);
-       bluefruit_serial_send(0x01);
-       for (uint8_t i = 0; i < KEYBOARD_EPSIZE; i++) {
-         bluefruit_serial_send(report->raw[i]);
-       }
-    #else
-      bluefruit_serial_send(0xFD);
-      for (uint8_t i = 0; i < KEYBOARD_EPSIZE; i++) {
-        bluefruit_serial_send(report->raw[i]);
-      }
-    #endif
-  }
+    switch (report->type) {
+    case OUTPUT_REPORT_KEYBOARD:
+#ifdef NKRO_ENABLE
+        if (keyboard_protocol && keymap_config.nkro)
+            return NKRO_IN_EPNUM;
 #endif
-
-    if (where != OUTPUT_USB && where != OUTPUT_USB_AND_BT) {
-      return;
+        return KEYBOARD_IN_EPNUM;
+#ifdef MOUSE_ENABLE
+    case OUTPUT_REPORT_MOUSE:
+        return MOUSE_IN_EPNUM;
+#endif
+    default:
+        return EXTRAKEY_IN_EPNUM;
     }
+}
 
-    /* Select the Keyboard Report Endpoint */
-#ifdef NKRO_ENABLE
-    if (keyboard_protocol && keymap_config.nkro) {
-        /* Report protocol - NKRO */
-        Endpoint_SelectEndpoint(NKRO_IN_EPNUM);
+/* Sends the report to the endpoint without waiting for the host to poll it */
+static uint8_t usb_send_report(const output_report_t *report)
+{
+    uint8_t ep = usb_report_endpoint(report);
+    uint8_t size;
+    const void *data;
+    report_extra_t extra;
+#if defined(SHARED_EP) && defined(MOUSE_ENABLE)
+    shared_mouse_report_t mouse;
+#endif
 
-        /* Check if write ready for a polling interval around 1ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(4);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return OUTPUT_DISCARDED;
 
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, NKRO_EPSIZE, NULL);
-    }
-    else
+    switch (report->type) {
+    case OUTPUT_REPORT_KEYBOARD:
+        data = &report->keyboard;
+#ifdef NKRO_ENABLE
+        if (ep == NKRO_IN_EPNUM) {
+            /* Report protocol - NKRO */
+            size = NKRO_EPSIZE;
+        }
+        else
 #endif
-    {
-        /* Boot protocol */
-        Endpoint_SelectEndpoint(KEYBOARD_IN_EPNUM);
+        {
+            /* Boot protocol */
+            size = KEYBOARD_EPSIZE;
+        }
+        break;
+#ifdef MOUSE_ENABLE
+    case OUTPUT_REPORT_MOUSE:
+#ifdef SHARED_EP
+        /* The reports on the shared endpoint start with their ID */
+        mouse.report_id = REPORT_ID_MOUSE;
+        mouse.report = report->mouse;
+        data = &mouse;
+        size = sizeof(shared_mouse_report_t);
+#else
+        data = &report->mouse;
+        size = sizeof(report_mouse_t);
+#endif
+        break;
+#endif
+    case OUTPUT_REPORT_SYSTEM:
+        extra.report_id = REPORT_ID_SYSTEM;
+        extra.usage = report->usage;
+        data = &extra;
+        size = sizeof(report_extra_t);
+        break;
+    case OUTPUT_REPORT_CONSUMER:
+        extra.report_id = REPORT_ID_CONSUMER;
+        extra.usage = report->usage;
+        data = &extra;
+        size = sizeof(report_extra_t);
+        break;
+    default:
+        return OUTPUT_DISCARDED;
+    }
 
-        /* Check if write ready for a polling interval around 10ms */
-        while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-        if (!Endpoint_IsReadWriteAllowed()) return;
+    Endpoint_SelectEndpoint(ep);
+    if (!Endpoint_IsReadWriteAllowed()) return OUTPUT_BUSY;
 
-        /* Write Keyboard Report Data */
-        Endpoint_Write_Stream_LE(report, KEYBOARD_EPSIZE, NULL);
-    }
+    Endpoint_Write_Stream_LE(data, size, NULL);
 
     /* Finalize the stream transfer to send the last packet */
     Endpoint_ClearIN();
 
-    keyboard_report_sent = *report;
+    if (report->type == OUTPUT_REPORT_KEYBOARD) {
+        keyboard_report_sent = report->keyboard;
+    }
+    return OUTPUT_SENT;
 }
 
-static void send_mouse(report_mouse_t *report)
+#ifdef BLUETOOTH_ENABLE
+/* The longest report for the UART modules, the RN42 keyboard report */
+#define BLUETOOTH_REPORT_SIZE (3 + KEYBOARD_EPSIZE)
+
+/* Queues the report in the module driver, or in the UART buffer, without
+ * waiting for the module */
+static uint8_t bluetooth_send_report(const output_report_t *report)
 {
-#ifdef MOUSE_ENABLE
-    uint8_t timeout = 255;
-    uint8_t where = where_to_send();
+#ifdef MODULE_ADAFRUIT_BLE
+    if (!adafruit_ble_can_send()) return OUTPUT_BUSY;
+#else
+    if (serial_send_space() < BLUETOOTH_REPORT_SIZE) return OUTPUT_BUSY;
+#endif
 
-#ifdef BLUETOOTH_ENABLE
-  if (where == OUTPUT_BLUETOOTH || where == OUTPUT_USB_AND_BT) {
+    switch (report->type) {
+    case OUTPUT_REPORT_KEYBOARD:
+    #ifdef MODULE_ADAFRUIT_BLE
+      adafruit_ble_send_keys(report->keyboard.mods, (uint8_t *)report->keyboard.keys, sizeof(report->keyboard.keys));
+    #elif MODULE_RN42
+       bluefruit_serial_send(0xFD);
+       bluefruit_serial_send(0x09);
+       bluefruit_serial_send(0x01);
+       for (uint8_t i = 0; i < KEYBOARD_EPSIZE; i++) {
+         bluefruit_serial_send(report->keyboard.raw[i]);
+       }
+    #else
+      bluefruit_serial_send(0xFD);
+      for (uint8_t i = 0; i < KEYBOARD_EPSIZE; i++) {
+        bluefruit_serial_send(report->keyboard.raw[i]);
+      }
+    #endif
+      break;
+
+#ifdef MOUSE_ENABLE
+    case OUTPUT_REPORT_MOUSE:
     #ifdef MODULE_ADAFRUIT_BLE
       // FIXME: mouse buttons
-      adafruit_ble_send_mouse_move(report->x, report->y, report->v, report->h, report->buttons);
+      adafruit_ble_send_mouse_move(report->mouse.x, report->mouse.y, report->mouse.v, report->mouse.h, report->mouse.buttons);
     #else
       bluefruit_serial_send(0xFD);
       bluefruit_serial_send(0x00);
       bluefruit_serial_send(0x03);
-      bluefruit_serial_send(report->buttons);
-      bluefruit_serial_send(report->x);
-      bluefruit_serial_send(report->y);
-      bluefruit_serial_send(report->v); // should try sending the wheel v here
-      bluefruit_serial_send(report->h); // should try sending the wheel h here
+      bluefruit_serial_send(report->mouse.buttons);
+      bluefruit_serial_send(report->mouse.x);
+      bluefruit_serial_send(report->mouse.y);
+      bluefruit_serial_send(report->mouse.v); // should try sending the wheel v here
+      bluefruit_serial_send(report->mouse.h); // should try sending the wheel h here
       bluefruit_serial_send(0x00);
     #endif
-  }
+      break;
 #endif
 
-    if (where != OUTPUT_USB && where != OUTPUT_USB_AND_BT) {
-      return;
-    }
-
-    /* Select the Mouse Report Endpoint */
-    Endpoint_SelectEndpoint(MOUSE_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
-
-    /* Write Mouse Report Data */
-    Endpoint_Write_Stream_LE(report, sizeof(report_mouse_t), NULL);
-
-    /* Finalize the stream transfer to send the last packet */
-    Endpoint_ClearIN();
-#endif
-}
-
-static void send_system(uint16_t data)
-{
-    uint8_t timeout = 255;
-
-    if (USB_DeviceState != DEVICE_STATE_Configured)
-        return;
-
-    report_extra_t r = {
-        .report_id = REPORT_ID_SYSTEM,
-        .usage = data - SYSTEM_POWER_DOWN + 1
-    };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
-
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
-
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
-}
-
-static void send_consumer(uint16_t data)
-{
-    uint8_t timeout = 255;
-    uint8_t where = where_to_send();
-
-#ifdef BLUETOOTH_ENABLE
-    if (where == OUTPUT_BLUETOOTH || where == OUTPUT_USB_AND_BT) {
+    case OUTPUT_REPORT_CONSUMER: {
       #ifdef MODULE_ADAFRUIT_BLE
-        adafruit_ble_send_consumer_key(data, 0);
+        adafruit_ble_send_consumer_key(report->usage, 0);
       #elif MODULE_RN42
         static uint16_t last_data = 0;
-        if (data == last_data) return;
-        last_data = data;
-        uint16_t bitmap = CONSUMER2RN42(data);
+        if (report->usage == last_data) break;
+        last_data = report->usage;
+        uint16_t bitmap = CONSUMER2RN42(report->usage);
         bluefruit_serial_send(0xFD);
         bluefruit_serial_send(0x03);
         bluefruit_serial_send(0x03);
@@ -745,9 +792,9 @@ static void send_consumer(uint16_t data)
         bluefruit_serial_send((bitmap>>8)&0xFF);
       #else
         static uint16_t last_data = 0;
-        if (data == last_data) return;
-        last_data = data;
-        uint16_t bitmap = CONSUMER2BLUEFRUIT(data);
+        if (report->usage == last_data) break;
+        last_data = report->usage;
+        uint16_t bitmap = CONSUMER2BLUEFRUIT(report->usage);
         bluefruit_serial_send(0xFD);
         bluefruit_serial_send(0x00);
         bluefruit_serial_send(0x02);
@@ -758,25 +805,62 @@ static void send_consumer(uint16_t data)
         bluefruit_serial_send(0x00);
         bluefruit_serial_send(0x00);
       #endif
+      break;
+    }
+
+    default:
+      return OUTPUT_DISCARDED;
     }
+    return OUTPUT_SENT;
+}
 #endif
 
-    if (where != OUTPUT_USB && where != OUTPUT_USB_AND_BT) {
-      return;
+/* Queues the report for each of the outputs, and sends it on USB before
+ * Bluetooth, so that a slow Bluetooth module doesn't delay the USB report */
+static void route_report(output_report_t *report)
+{
+    uint8_t where = where_to_send();
+
+    /* The system reports only go to USB */
+    if (where == OUTPUT_USB || where == OUTPUT_USB_AND_BT ||
+            report->type == OUTPUT_REPORT_SYSTEM) {
+        output_queue(&usb_output, report);
+        output_drain(&usb_output);
     }
 
-    report_extra_t r = {
-        .report_id = REPORT_ID_CONSUMER,
-        .usage = data
-    };
-    Endpoint_SelectEndpoint(EXTRAKEY_IN_EPNUM);
+#ifdef BLUETOOTH_ENABLE
+    if ((where == OUTPUT_BLUETOOTH || where == OUTPUT_USB_AND_BT) &&
+            report->type != OUTPUT_REPORT_SYSTEM) {
+        output_queue(&bluetooth_output, report);
+        output_drain(&bluetooth_output);
+    }
+#endif
+}
 
-    /* Check if write ready for a polling interval around 10ms */
-    while (timeout-- && !Endpoint_IsReadWriteAllowed()) _delay_us(40);
-    if (!Endpoint_IsReadWriteAllowed()) return;
+static void send_keyboard(report_keyboard_t *report)
+{
+    output_report_t r = { .type = OUTPUT_REPORT_KEYBOARD, .keyboard = *report };
+    route_report(&r);
+}
 
-    Endpoint_Write_Stream_LE(&r, sizeof(report_extra_t), NULL);
-    Endpoint_ClearIN();
+static void send_mouse(report_mouse_t *report)
+{
+#ifdef MOUSE_ENABLE
+    output_report_t r = { .type = OUTPUT_REPORT_MOUSE, .mouse = *report };
+    route_report(&r);
+#endif
+}
+
+static void send_system(uint16_t data)
+{
+    output_report_t r = { .type = OUTPUT_REPORT_SYSTEM, .usage = data };
+    route_report(&r);
+}
+
+static void send_consumer(uint16_t data)
+{
+    output_report_t r = { .type = OUTPUT_REPORT_CONSUMER, .usage = data };
+    route_report(&r);
 }
 
 
@@ -853,65 +937,160 @@ int8_t sendchar(uint8_t c)
  ******************************************************************************/
 
 #ifdef MIDI_ENABLE
-static void usb_send_func(MidiDevice * device, uint16_t cnt, uint8_t byte0, uint8_t byte1, uint8_t byte2) {
-  MIDI_EventPacket_t event;
-  event.Data1 = byte0;
-  event.Data2 = byte1;
-  event.Data3 = byte2;
+// The events are queued, and written to the endpoint once per loop of the
+// main task, so that many events can share a bulk packet
+static usb_midi_queue_t midi_tx_queue;
+#ifdef MIDI_ENGINE
+// The events of the MIDI engine are queued from its timer interrupt, and are
+// also written at the start of every USB frame
+static usb_midi_queue_t midi_engine_queue;
+#endif
+// Set while the main loop writes to the endpoint, so that the start of frame
+// interrupt leaves it alone
+static volatile bool midi_flushing;
 
-  uint8_t cable = 0;
+static void usb_midi_discard(usb_midi_queue_t * queue) {
+  while (usb_midi_queue_peek(queue))
+    usb_midi_queue_release(queue);
+}
 
-// Endpoint_SelectEndpoint(MIDI_STREAM_IN_EPNUM);
+static bool usb_midi_pending(void) {
+#ifdef MIDI_ENGINE
+  if (usb_midi_queue_peek(&midi_engine_queue))
+    return true;
+#endif
+  return usb_midi_queue_peek(&midi_tx_queue);
+}
+
+// Writes the queued events to the bank, and returns false when it's full
+static bool usb_midi_write(usb_midi_queue_t * queue) {
+  usb_midi_packet_t * packet;
+  while ((packet = usb_midi_queue_peek(queue))) {
+    Endpoint_Write_Stream_LE(packet, sizeof(*packet), NULL);
+    usb_midi_queue_release(queue);
+    if (!Endpoint_IsReadWriteAllowed())
+      return false;
+  }
+  return true;
+}
+
+// Writes as many queued events as fit in one bulk packet, the events of the
+// engine first. Returns false when the host hasn't read the previous packet.
+static bool usb_midi_write_packet(void) {
+  Endpoint_SelectEndpoint(MIDI_STREAM_IN_EPADDR);
+  if (!Endpoint_IsINReady())
+    return false;
+  bool room = true;
+#ifdef MIDI_ENGINE
+  room = usb_midi_write(&midi_engine_queue);
+#endif
+  if (room)
+    usb_midi_write(&midi_tx_queue);
+  Endpoint_ClearIN();
+  return true;
+}
+
+// With wait set the previous packet is waited for, otherwise nothing is
+// written until the host has read it.
+static void usb_midi_flush(bool wait) {
+  midi_flushing = true;
+  if (USB_DeviceState != DEVICE_STATE_Configured) {
+    usb_midi_discard(&midi_tx_queue);
+#ifdef MIDI_ENGINE
+    usb_midi_discard(&midi_engine_queue);
+#endif
+  } else if (usb_midi_pending()) {
+    if (!usb_midi_write_packet() && wait) {
+      if (Endpoint_WaitUntilReady() == ENDPOINT_READYWAIT_NoError)
+        usb_midi_write_packet();
+    }
+  }
+  midi_flushing = false;
+}
+
+#ifdef MIDI_ENGINE
+// Called from the start of frame interrupt, so that the events of the engine
+// don't wait for the main loop
+static void usb_midi_frame(void) {
+  if (midi_flushing || USB_DeviceState != DEVICE_STATE_Configured || !usb_midi_pending())
+    return;
+  uint8_t ep = Endpoint_GetCurrentEndpoint();
+  usb_midi_write_packet();
+  Endpoint_SelectEndpoint(ep);
+}
+#endif
+
+// Fills in the USB-MIDI packet, returns false for an invalid count
+static bool usb_midi_packet_fill(usb_midi_packet_t * event, uint16_t cnt, uint8_t byte0, uint8_t byte1, uint8_t byte2) {
+  event->data[0] = byte0;
+  event->data[1] = byte1;
+  event->data[2] = byte2;
+
+  uint8_t cable = 0;
 
   //if the length is undefined we assume it is a SYSEX message
   if (midi_packet_length(byte0) == UNDEFINED) {
     switch(cnt) {
       case 3:
         if (byte2 == SYSEX_END)
-          event.Event = MIDI_EVENT(cable, SYSEX_ENDS_IN_3);
+          event->event = MIDI_EVENT(cable, SYSEX_ENDS_IN_3);
         else
-          event.Event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
+          event->event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
         break;
       case 2:
         if (byte1 == SYSEX_END)
-          event.Event = MIDI_EVENT(cable, SYSEX_ENDS_IN_2);
+          event->event = MIDI_EVENT(cable, SYSEX_ENDS_IN_2);
         else
-          event.Event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
+          event->event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
         break;
       case 1:
         if (byte0 == SYSEX_END)
-          event.Event = MIDI_EVENT(cable, SYSEX_ENDS_IN_1);
+          event->event = MIDI_EVENT(cable, SYSEX_ENDS_IN_1);
         else
-          event.Event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
+          event->event = MIDI_EVENT(cable, SYSEX_START_OR_CONT);
         break;
       default:
-        return; //invalid cnt
+        return false; //invalid cnt
     }
   } else {
     //deal with 'system common' messages
     //TODO are there any more?
     switch(byte0 & 0xF0){
       case MIDI_SONGPOSITION:
-        event.Event = MIDI_EVENT(cable, SYS_COMMON_3);
+        event->event = MIDI_EVENT(cable, SYS_COMMON_3);
         break;
       case MIDI_SONGSELECT:
       case MIDI_TC_QUARTERFRAME:
-        event.Event = MIDI_EVENT(cable, SYS_COMMON_2);
+        event->event = MIDI_EVENT(cable, SYS_COMMON_2);
         break;
       default:
-        event.Event = MIDI_EVENT(cable, byte0);
+        event->event = MIDI_EVENT(cable, byte0);
         break;
     }
   }
+  return true;
+}
 
-// Endpoint_Write_Stream_LE(&event, sizeof(event), NULL);
-// Endpoint_ClearIN();
+static void usb_send_func(MidiDevice * device, uint16_t cnt, uint8_t byte0, uint8_t byte1, uint8_t byte2) {
+  usb_midi_packet_t * event = usb_midi_queue_reserve(&midi_tx_queue);
+  if (!event) {
+    // Long sysex messages can fill the queue within one loop
+    usb_midi_flush(true);
+    event = usb_midi_queue_reserve(&midi_tx_queue);
+    if (!event)
+      return;
+  }
+  if (usb_midi_packet_fill(event, cnt, byte0, byte1, byte2))
+    usb_midi_queue_commit(&midi_tx_queue);
+}
 
-  MIDI_Device_SendEventPacket(&USB_MIDI_Interface, &event);
-  MIDI_Device_Flush(&USB_MIDI_Interface);
-  MIDI_Device_USBTask(&USB_MIDI_Interface);
-  USB_USBTask();
+#ifdef MIDI_ENGINE
+void midi_engine_send(uint8_t count, uint8_t byte0, uint8_t byte1, uint8_t byte2) {
+  usb_midi_packet_t * event = usb_midi_queue_reserve(&midi_engine_queue);
+  if (event && usb_midi_packet_fill(event, count, byte0, byte1, byte2))
+    usb_midi_queue_commit(&midi_engine_queue);
 }
+#endif
 
 static void usb_get_midi(MidiDevice * device) {
   MIDI_EventPacket_t event;
@@ -939,12 +1118,18 @@ static void usb_get_midi(MidiDevice * device) {
     if (length != UNDEFINED)
       midi_device_input(device, length, input);
   }
-  MIDI_Device_USBTask(&USB_MIDI_Interface);
+  // Called at the start of every midi_device_process, which sends the events
+  // queued since the previous one
+  usb_midi_flush(false);
   USB_USBTask();
 }
 
 static void midi_usb_init(MidiDevice * device){
   midi_device_init(device);
+  usb_midi_queue_init(&midi_tx_queue);
+#ifdef MIDI_ENGINE
+  usb_midi_queue_init(&midi_engine_queue);
+#endif
   midi_device_set_send_func(device, usb_send_func);
   midi_device_set_pre_input_process_func(device, usb_get_midi);
 
@@ -1120,6 +1305,10 @@ void setup_midi(void)
 	midi_init();
 #endif
 	midi_device_init(&midi_device);
+    usb_midi_queue_init(&midi_tx_queue);
+#ifdef MIDI_ENGINE
+    usb_midi_queue_init(&midi_engine_queue);
+#endif
     midi_device_set_send_func(&midi_device, usb_send_func);
     midi_device_set_pre_input_process_func(&midi_device, usb_get_midi);
 }
@@ -1141,6 +1330,9 @@ int main(void)
     midi_register_fallthrough_callback(&midi_device, fallthrough_callback);
     midi_register_cc_callback(&midi_device, cc_callback);
     midi_register_sysex_callback(&midi_device, sysex_callback);
+#ifdef MIDI_ENGINE
+    midi_register_realtime_callback(&midi_device, midi_engine_realtime_callback);
+#endif
 
     // init_notes();
     // midi_send_cc(&midi_device, 0, 1, 2);
@@ -1192,6 +1384,12 @@ int main(void)
 
         keyboard_task();
 
+        /* Retry the reports that a busy endpoint held back */
+        output_drain(&usb_output);
+#ifdef BLUETOOTH_ENABLE
+        output_drain(&bluetooth_output);
+#endif
+
 #ifdef MIDI_ENABLE
         midi_device_process(&midi_device);
 #ifdef MIDI_ADVANCED
@@ -1220,6 +1418,12 @@ int main(void)
         USB_USBTask();
 #endif
 
+#ifdef MODULE_ADAFRUIT_BLE
+        // Running from the battery
+        if (USB_DeviceState != DEVICE_STATE_Configured) {
+            adafruit_ble_sleep();
+        }
+#endif
     }
 }
 
@@ -48,6 +48,7 @@
 #include <LUFA/Version.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include "host.h"
+#include "output_router.h"
 #ifdef MIDI_ENABLE
   #include "process_midi.h"
 #endif
@@ -56,6 +57,10 @@ extern "C" {
 #endif
 
 extern host_driver_t lufa_driver;
+extern output_transport_t usb_output;
+#ifdef BLUETOOTH_ENABLE
+extern output_transport_t bluetooth_output;
+#endif
 
 #ifdef __cplusplus
 }
@@ -67,6 +72,12 @@ typedef struct {
     uint16_t usage;
 } __attribute__ ((packed)) report_extra_t;
 
+/* mouse report structure on the shared endpoint */
+typedef struct {
+    uint8_t  report_id;
+    report_mouse_t report;
+} __attribute__ ((packed)) shared_mouse_report_t;
+
 #ifdef MIDI_ENABLE
   void MIDI_Task(void);
   MidiDevice midi_device;
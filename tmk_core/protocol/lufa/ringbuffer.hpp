@@ -48,6 +48,8 @@ class RingBuffer {
 
   inline bool empty() const { return head_ == tail_; }
 
+  inline bool full() const { return (head_ + 1) % Size == tail_; }
+
   inline uint8_t size() const {
     int diff = head_ - tail_;
     if (diff >= 0) {
@@ -60,6 +62,11 @@ class RingBuffer {
     return buf_[tail_];
   }
 
+  // The most recently enqueued item; only valid when not empty
+  inline T& back() {
+    return buf_[prevPosition(head_)];
+  }
+
   inline bool peek(T &item) {
     return get(item, false);
   }
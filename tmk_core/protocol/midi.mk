@@ -5,6 +5,7 @@ SRC += midi.c \
 	   bytequeue/bytequeue.c \
 	   bytequeue/interrupt_setting.c \
 	   sysex_tools.c \
+	   usb_midi_queue.c \
 	   $(LUFA_SRC_USBCLASS)
 
 VPATH += $(TMK_PATH)/$(MIDI_DIR)
\ No newline at end of file
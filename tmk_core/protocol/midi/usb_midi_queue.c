@@ -0,0 +1,57 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "usb_midi_queue.h"
+#include <stddef.h>
+
+#define QUEUE_MASK (USB_MIDI_QUEUE_LENGTH - 1)
+// Keeps the compiler from moving the accesses of the packets past the
+// update of the index that hands them over
+#define BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+void usb_midi_queue_init(usb_midi_queue_t * queue) {
+   queue->head = 0;
+   queue->tail = 0;
+}
+
+usb_midi_packet_t * usb_midi_queue_reserve(usb_midi_queue_t * queue) {
+   uint8_t head = queue->head;
+   if (((head + 1) & QUEUE_MASK) == queue->tail)
+      return NULL;
+   return &queue->packets[head];
+}
+
+void usb_midi_queue_commit(usb_midi_queue_t * queue) {
+   BARRIER();
+   queue->head = (queue->head + 1) & QUEUE_MASK;
+}
+
+usb_midi_packet_t * usb_midi_queue_peek(usb_midi_queue_t * queue) {
+   uint8_t tail = queue->tail;
+   if (tail == queue->head)
+      return NULL;
+   BARRIER();
+   return &queue->packets[tail];
+}
+
+void usb_midi_queue_release(usb_midi_queue_t * queue) {
+   BARRIER();
+   queue->tail = (queue->tail + 1) & QUEUE_MASK;
+}
+
+uint8_t usb_midi_queue_length(usb_midi_queue_t * queue) {
+   return (queue->head - queue->tail) & QUEUE_MASK;
+}
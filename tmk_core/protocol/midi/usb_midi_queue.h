@@ -0,0 +1,87 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USB_MIDI_QUEUE_H
+#define USB_MIDI_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @file
+ * @brief A queue of the 4 byte USB-MIDI event packets that are waiting to be
+ * sent.
+ *
+ * The queue has a single producer, the send function of the midi device, and
+ * a single consumer, the function that writes the packets to the endpoint.
+ * Each of them only writes its own index, and the indexes are single bytes,
+ * so no interrupts need to be disabled, even if the two run in different
+ * contexts.
+ *
+ * The packets are written in place, the producer reserves the next free
+ * packet and commits it when it's filled in, and the consumer writes the
+ * oldest packet straight from the queue before releasing it.
+ */
+
+/** The number of packets, a power of two, one less can be queued */
+#ifndef USB_MIDI_QUEUE_LENGTH
+#define USB_MIDI_QUEUE_LENGTH 32
+#endif
+
+#if (USB_MIDI_QUEUE_LENGTH & (USB_MIDI_QUEUE_LENGTH - 1)) != 0 || USB_MIDI_QUEUE_LENGTH > 128
+#error "USB_MIDI_QUEUE_LENGTH has to be a power of two, no larger than 128"
+#endif
+
+/** A USB-MIDI event packet, with the same layout as MIDI_EventPacket_t */
+typedef struct {
+   uint8_t event;
+   uint8_t data[3];
+} usb_midi_packet_t;
+
+typedef struct {
+   volatile uint8_t head;
+   volatile uint8_t tail;
+   usb_midi_packet_t packets[USB_MIDI_QUEUE_LENGTH];
+} usb_midi_queue_t;
+
+void usb_midi_queue_init(usb_midi_queue_t * queue);
+
+/**
+ * @brief Returns the packet that will be queued next, or NULL if the queue is
+ * full. The packet is only queued after it's committed.
+ */
+usb_midi_packet_t * usb_midi_queue_reserve(usb_midi_queue_t * queue);
+
+/** @brief Queues the packet returned by usb_midi_queue_reserve */
+void usb_midi_queue_commit(usb_midi_queue_t * queue);
+
+/** @brief Returns the oldest queued packet, or NULL if the queue is empty */
+usb_midi_packet_t * usb_midi_queue_peek(usb_midi_queue_t * queue);
+
+/** @brief Removes the packet returned by usb_midi_queue_peek */
+void usb_midi_queue_release(usb_midi_queue_t * queue);
+
+uint8_t usb_midi_queue_length(usb_midi_queue_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -43,5 +43,9 @@ void serial_init(void);
 uint8_t serial_recv(void);
 int16_t serial_recv2(void);
 void serial_send(uint8_t data);
+/* The bytes that serial_send takes without waiting, only in serial_uart.c.
+ * They are buffered when SERIAL_UART_TXD_VECT is defined, otherwise it's at
+ * most 1. */
+uint8_t serial_send_space(void);
 
 #endif
@@ -0,0 +1,248 @@
+/* Copyright 2017 Fred Sundvik
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USB_DESCRIPTOR_COMMON_H
+#define USB_DESCRIPTOR_COMMON_H
+
+#include "report.h"
+
+/*
+ * The HID interfaces of the keyboard, described once for all the USB stacks.
+ *
+ * The report descriptors expand to plain bytes, so that LUFA, ChibiOS and
+ * V-USB all build their descriptor arrays from them, and the polling
+ * intervals are given in microseconds and turned into the bInterval of the
+ * speed the stack runs at.
+ *
+ * With SHARED_EP_ENABLE the mouse and the extra keys share one interface and
+ * one endpoint, told apart by their report IDs, for the chips that don't have
+ * enough endpoints for all of them. The keyboard keeps its own interface, as
+ * the boot protocol keyboard can't have a report ID.
+ *
+ * The comments have to be C comments, a line comment would swallow the line
+ * continuation.
+ */
+
+/* Polling intervals in microseconds */
+#ifndef KEYBOARD_POLLING_INTERVAL_US
+#define KEYBOARD_POLLING_INTERVAL_US 10000
+#endif
+
+#ifndef NKRO_POLLING_INTERVAL_US
+#define NKRO_POLLING_INTERVAL_US 1000
+#endif
+
+#ifndef MOUSE_POLLING_INTERVAL_US
+#define MOUSE_POLLING_INTERVAL_US 1000
+#endif
+
+#ifndef EXTRAKEY_POLLING_INTERVAL_US
+#define EXTRAKEY_POLLING_INTERVAL_US 10000
+#endif
+
+/* The shared endpoint is polled as often as the mouse */
+#ifndef SHARED_POLLING_INTERVAL_US
+#define SHARED_POLLING_INTERVAL_US MOUSE_POLLING_INTERVAL_US
+#endif
+
+#ifdef USB_HIGH_SPEED
+/* A high speed interrupt endpoint is polled every 2^(bInterval-1) microframes
+ * of 125us; rounds down to the next supported interval */
+#define USB_POLLING_INTERVAL(us) \
+    ((us) < 250 ? 1 : (us) < 500 ? 2 : (us) < 1000 ? 3 : (us) < 2000 ? 4 : \
+     (us) < 4000 ? 5 : (us) < 8000 ? 6 : (us) < 16000 ? 7 : 8)
+#else
+/* A full speed interrupt endpoint is polled every bInterval frames of 1ms, so
+ * the intervals below 1ms are rounded up to it */
+#define USB_POLLING_INTERVAL(us) \
+    ((us) <= 1000 ? 1 : (us) >= 255000 ? 255 : (us) / 1000)
+#endif
+
+#define HID_REPORT_ID(id) 0x85, (id),
+#define HID_NO_REPORT_ID
+
+/* The stacks can keep the differences of their old descriptors, by defining
+ * these before including this */
+#ifndef HID_LED_OUTPUT_FLAGS
+#define HID_LED_OUTPUT_FLAGS 0x02   /* Data, Variable, Absolute */
+#endif
+
+#ifndef HID_MOUSE_WHEEL_PHYSICAL_RANGE
+#define HID_MOUSE_WHEEL_PHYSICAL_RANGE \
+    0x35, 0x00,             /*     Physical Minimum (0), resets the physical range */ \
+    0x45, 0x00,             /*     Physical Maximum (0) */
+#endif
+
+/* Keyboard Protocol 1, HID 1.11 spec, Appendix B, page 59-60 */
+#define HID_KEYBOARD_REPORT_DESCRIPTOR(report_keys) \
+    0x05, 0x01,             /* Usage Page (Generic Desktop) */ \
+    0x09, 0x06,             /* Usage (Keyboard) */ \
+    0xA1, 0x01,             /* Collection (Application) */ \
+    0x75, 0x01,             /*   Report Size (1) */ \
+    0x95, 0x08,             /*   Report Count (8) */ \
+    0x05, 0x07,             /*   Usage Page (Key Codes) */ \
+    0x19, 0xE0,             /*   Usage Minimum (224) */ \
+    0x29, 0xE7,             /*   Usage Maximum (231) */ \
+    0x15, 0x00,             /*   Logical Minimum (0) */ \
+    0x25, 0x01,             /*   Logical Maximum (1) */ \
+    0x81, 0x02,             /*   Input (Data, Variable, Absolute), modifier byte */ \
+    0x95, 0x01,             /*   Report Count (1) */ \
+    0x75, 0x08,             /*   Report Size (8) */ \
+    0x81, 0x03,             /*   Input (Constant), reserved byte */ \
+    0x95, 0x05,             /*   Report Count (5) */ \
+    0x75, 0x01,             /*   Report Size (1) */ \
+    0x05, 0x08,             /*   Usage Page (LEDs) */ \
+    0x19, 0x01,             /*   Usage Minimum (1) */ \
+    0x29, 0x05,             /*   Usage Maximum (5) */ \
+    0x91, HID_LED_OUTPUT_FLAGS, /*   Output, LED report */ \
+    0x95, 0x01,             /*   Report Count (1) */ \
+    0x75, 0x03,             /*   Report Size (3) */ \
+    0x91, 0x03,             /*   Output (Constant), LED report padding */ \
+    0x95, (report_keys),    /*   Report Count () */ \
+    0x75, 0x08,             /*   Report Size (8) */ \
+    0x15, 0x00,             /*   Logical Minimum (0) */ \
+    0x26, 0xFF, 0x00,       /*   Logical Maximum (255) */ \
+    0x05, 0x07,             /*   Usage Page (Key Codes) */ \
+    0x19, 0x00,             /*   Usage Minimum (0) */ \
+    0x29, 0xFF,             /*   Usage Maximum (255) */ \
+    0x81, 0x00,             /*   Input (Data, Array) */ \
+    0xC0,                   /* End Collection */
+
+/* A bitmap of the keys, after the modifier byte */
+#define HID_NKRO_REPORT_DESCRIPTOR(report_bits) \
+    0x05, 0x01,             /* Usage Page (Generic Desktop) */ \
+    0x09, 0x06,             /* Usage (Keyboard) */ \
+    0xA1, 0x01,             /* Collection (Application) */ \
+    0x75, 0x01,             /*   Report Size (1) */ \
+    0x95, 0x08,             /*   Report Count (8) */ \
+    0x05, 0x07,             /*   Usage Page (Key Codes) */ \
+    0x19, 0xE0,             /*   Usage Minimum (224) */ \
+    0x29, 0xE7,             /*   Usage Maximum (231) */ \
+    0x15, 0x00,             /*   Logical Minimum (0) */ \
+    0x25, 0x01,             /*   Logical Maximum (1) */ \
+    0x81, 0x02,             /*   Input (Data, Variable, Absolute), modifier byte */ \
+    0x95, 0x05,             /*   Report Count (5) */ \
+    0x75, 0x01,             /*   Report Size (1) */ \
+    0x05, 0x08,             /*   Usage Page (LEDs) */ \
+    0x19, 0x01,             /*   Usage Minimum (1) */ \
+    0x29, 0x05,             /*   Usage Maximum (5) */ \
+    0x91, HID_LED_OUTPUT_FLAGS, /*   Output, LED report */ \
+    0x95, 0x01,             /*   Report Count (1) */ \
+    0x75, 0x03,             /*   Report Size (3) */ \
+    0x91, 0x03,             /*   Output (Constant), LED report padding */ \
+    0x95, (report_bits),    /*   Report Count () */ \
+    0x75, 0x01,             /*   Report Size (1) */ \
+    0x15, 0x00,             /*   Logical Minimum (0) */ \
+    0x25, 0x01,             /*   Logical Maximum (1) */ \
+    0x05, 0x07,             /*   Usage Page (Key Codes) */ \
+    0x19, 0x00,             /*   Usage Minimum (0) */ \
+    0x29, (report_bits) - 1, /*   Usage Maximum () */ \
+    0x81, 0x02,             /*   Input (Data, Variable, Absolute) */ \
+    0xC0,                   /* End Collection */
+
+/* Mouse Protocol 1, HID 1.11 spec, Appendix B, page 59-60, with wheel extension
+ * http://www.microsoft.com/whdc/device/input/wheel.mspx
+ * report_id is HID_REPORT_ID(REPORT_ID_MOUSE) on a shared endpoint, and
+ * HID_NO_REPORT_ID otherwise */
+#define HID_MOUSE_REPORT_DESCRIPTOR(report_id) \
+    0x05, 0x01,             /* Usage Page (Generic Desktop) */ \
+    0x09, 0x02,             /* Usage (Mouse) */ \
+    0xA1, 0x01,             /* Collection (Application) */ \
+    report_id \
+    0x09, 0x01,             /*   Usage (Pointer) */ \
+    0xA1, 0x00,             /*   Collection (Physical) */ \
+    0x05, 0x09,             /*     Usage Page (Button) */ \
+    0x19, 0x01,             /*     Usage Minimum (Button 1) */ \
+    0x29, 0x05,             /*     Usage Maximum (Button 5) */ \
+    0x15, 0x00,             /*     Logical Minimum (0) */ \
+    0x25, 0x01,             /*     Logical Maximum (1) */ \
+    0x75, 0x01,             /*     Report Size (1) */ \
+    0x95, 0x05,             /*     Report Count (5) */ \
+    0x81, 0x02,             /*     Input (Data, Variable, Absolute) */ \
+    0x75, 0x03,             /*     Report Size (3) */ \
+    0x95, 0x01,             /*     Report Count (1) */ \
+    0x81, 0x03,             /*     Input (Constant) */ \
+    0x05, 0x01,             /*     Usage Page (Generic Desktop) */ \
+    0x09, 0x30,             /*     Usage (X) */ \
+    0x09, 0x31,             /*     Usage (Y) */ \
+    0x15, 0x81,             /*     Logical Minimum (-127) */ \
+    0x25, 0x7F,             /*     Logical Maximum (127) */ \
+    0x75, 0x08,             /*     Report Size (8) */ \
+    0x95, 0x02,             /*     Report Count (2) */ \
+    0x81, 0x06,             /*     Input (Data, Variable, Relative) */ \
+    0x09, 0x38,             /*     Usage (Wheel) */ \
+    0x15, 0x81,             /*     Logical Minimum (-127) */ \
+    0x25, 0x7F,             /*     Logical Maximum (127) */ \
+    HID_MOUSE_WHEEL_PHYSICAL_RANGE \
+    0x75, 0x08,             /*     Report Size (8) */ \
+    0x95, 0x01,             /*     Report Count (1) */ \
+    0x81, 0x06,             /*     Input (Data, Variable, Relative) */ \
+    0x05, 0x0C,             /*     Usage Page (Consumer Devices) */ \
+    0x0A, 0x38, 0x02,       /*     Usage (AC Pan), the horizontal wheel */ \
+    0x15, 0x81,             /*     Logical Minimum (-127) */ \
+    0x25, 0x7F,             /*     Logical Maximum (127) */ \
+    0x75, 0x08,             /*     Report Size (8) */ \
+    0x95, 0x01,             /*     Report Count (1) */ \
+    0x81, 0x06,             /*     Input (Data, Variable, Relative) */ \
+    0xC0,                   /*   End Collection */ \
+    0xC0,                   /* End Collection */
+
+/* The system and consumer controls, the reports hold the usage itself
+ * http://www.microsoft.com/whdc/archive/w2kbd.mspx */
+#define HID_EXTRAKEY_REPORT_DESCRIPTOR \
+    0x05, 0x01,             /* Usage Page (Generic Desktop) */ \
+    0x09, 0x80,             /* Usage (System Control) */ \
+    0xA1, 0x01,             /* Collection (Application) */ \
+    0x85, REPORT_ID_SYSTEM, /*   Report ID */ \
+    0x15, 0x01,             /*   Logical Minimum (0x1) */ \
+    0x26, 0xB7, 0x00,       /*   Logical Maximum (0xB7) */ \
+    0x19, 0x01,             /*   Usage Minimum (0x1) */ \
+    0x29, 0xB7,             /*   Usage Maximum (0xB7) */ \
+    0x75, 0x10,             /*   Report Size (16) */ \
+    0x95, 0x01,             /*   Report Count (1) */ \
+    0x81, 0x00,             /*   Input (Data, Array, Absolute) */ \
+    0xC0,                   /* End Collection */ \
+    0x05, 0x0C,             /* Usage Page (Consumer Devices) */ \
+    0x09, 0x01,             /* Usage (Consumer Control) */ \
+    0xA1, 0x01,             /* Collection (Application) */ \
+    0x85, REPORT_ID_CONSUMER, /*   Report ID */ \
+    0x15, 0x01,             /*   Logical Minimum (0x1) */ \
+    0x26, 0x9C, 0x02,       /*   Logical Maximum (0x29C) */ \
+    0x19, 0x01,             /*   Usage Minimum (0x1) */ \
+    0x2A, 0x9C, 0x02,       /*   Usage Maximum (0x29C) */ \
+    0x75, 0x10,             /*   Report Size (16) */ \
+    0x95, 0x01,             /*   Report Count (1) */ \
+    0x81, 0x00,             /*   Input (Data, Array, Absolute) */ \
+    0xC0,                   /* End Collection */
+
+/* The interface that the mouse and the extra keys share */
+#ifdef MOUSE_ENABLE
+#define HID_SHARED_MOUSE_REPORT_DESCRIPTOR HID_MOUSE_REPORT_DESCRIPTOR(HID_REPORT_ID(REPORT_ID_MOUSE))
+#else
+#define HID_SHARED_MOUSE_REPORT_DESCRIPTOR
+#endif
+
+#ifdef EXTRAKEY_ENABLE
+#define HID_SHARED_EXTRAKEY_REPORT_DESCRIPTOR HID_EXTRAKEY_REPORT_DESCRIPTOR
+#else
+#define HID_SHARED_EXTRAKEY_REPORT_DESCRIPTOR
+#endif
+
+#define HID_SHARED_REPORT_DESCRIPTOR \
+    HID_SHARED_MOUSE_REPORT_DESCRIPTOR \
+    HID_SHARED_EXTRAKEY_REPORT_DESCRIPTOR
+
+#endif